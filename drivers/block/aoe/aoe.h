@@ -89,6 +89,7 @@ enum {
 	NAOEIFS = 8,
 	NSKBPOOLMAX = 256,
 	NFACTIVE = 61,
+	AOE_MAXHWQ = 8,		/* cap on blk-mq hardware queues, power of two */
 
 	TIMERTICK = HZ / 10,
 	RTTSCALE = 8,
@@ -115,13 +116,16 @@ enum frame_flags {
 	FFL_PROBE = 1,
 };
 
+struct aoe_hwq;
+
 struct frame {
 	struct list_head head;
 	u32 tag;
 	ktime_t sent;			/* high-res time packet was sent */
 	ulong waited;
 	ulong waited_total;
-	struct aoetgt *t;		/* parent target I belong to */
+	struct aoetgt *t;		/* target the frame is sent to */
+	struct aoe_hwq *q;		/* hardware queue whose pool I belong to */
 	struct sk_buff *skb;		/* command skb freed on module exit */
 	struct sk_buff *r_skb;		/* response skb for async processing */
 	struct buf *buf;
@@ -139,20 +143,41 @@ struct aoetgt {
 	unsigned char addr[6];
 	ushort nframes;		/* cap on frames to use */
 	struct aoedev *d;			/* parent device I belong to */
-	struct list_head ffree;			/* list of free frames */
 	struct aoeif ifs[NAOEIFS];
 	struct aoeif *ifp;	/* current aoeif in use */
 	ushort nout;		/* number of AoE commands outstanding */
 	ushort maxout;		/* current value for max outstanding */
 	ushort next_cwnd;	/* incr maxout after decrementing to zero */
 	ushort ssthresh;	/* slow start threshold */
-	ulong falloc;		/* number of allocated frames */
 	int taint;		/* how much we want to avoid this aoetgt */
 	int minbcnt;
 	int wpkts, rpkts;
 	char nout_probes;
 };
 
+/* Submission and retransmit state of one blk-mq hardware context.  Each
+ * queue owns its frames, so the I/O path only needs the device lock for
+ * target selection and congestion window accounting.  The device lock
+ * nests inside q->lock.
+ */
+struct aoe_hwq {
+	spinlock_t lock;
+	struct aoedev *d;
+	u16 idx;		/* index in d->hwq, carried in frame tags */
+	u16 lasttag;		/* last tag sent */
+	struct list_head rq_list;
+	struct {		/* pointers to work in progress */
+		struct buf *buf;
+		struct bio *nxbio;
+		struct request *rq;
+	} ip;
+	struct list_head ffree;	/* list of free frames */
+	ulong falloc;		/* number of allocated frames */
+	struct sk_buff_head skbpool;
+	struct list_head factive[NFACTIVE];	/* hash of active frames */
+	struct list_head rexmitq; /* deferred retransmissions */
+} ____cacheline_aligned_in_smp;
+
 struct aoedev {
 	struct aoedev *next;
 	ulong sysminor;
@@ -163,29 +188,22 @@ struct aoedev {
 	u16 flags;
 	u16 nopen;		/* (bd_openers isn't available without sleeping) */
 	u16 fw_ver;		/* version of blade's firmware */
-	u16 lasttag;		/* last tag sent */
 	u16 useme;
 	ulong ref;
 	struct work_struct work;/* disk create work struct */
 	struct gendisk *gd;
 	struct dentry *debugfs;
 	struct request_queue *blkq;
-	struct list_head rq_list;
 	struct blk_mq_tag_set tag_set;
 	struct hd_geometry geo;
 	sector_t ssize;
 	struct timer_list timer;
-	spinlock_t lock;
-	struct sk_buff_head skbpool;
+	spinlock_t lock;	/* flags, targets and congestion state */
 	mempool_t *bufpool;	/* for deadlock-free Buf allocation */
-	struct {		/* pointers to work in progress */
-		struct buf *buf;
-		struct bio *nxbio;
-		struct request *rq;
-	} ip;
+	struct aoe_hwq *hwq;	/* one per blk-mq hardware context */
+	ushort nhwq;
+	ulong hwq_starved;	/* queues that ran out of frames */
 	ulong maxbcnt;
-	struct list_head factive[NFACTIVE];	/* hash of active frames */
-	struct list_head rexmitq; /* deferred retransmissions */
 	struct aoetgt **targets;
 	ulong ntargets;		/* number of allocated aoetgt pointers */
 	struct aoetgt **tgt;	/* target in use when working */
@@ -214,7 +232,7 @@ int aoechr_init(void);
 void aoechr_exit(void);
 void aoechr_error(char *);
 
-void aoecmd_work(struct aoedev *d);
+void aoecmd_work(struct aoe_hwq *q);
 void aoecmd_cfg(ushort aoemajor, unsigned char aoeminor);
 struct sk_buff *aoecmd_ata_rsp(struct sk_buff *);
 void aoecmd_cfg_rsp(struct sk_buff *);
@@ -227,7 +245,7 @@ struct sk_buff *aoecmd_ata_id(struct aoedev *);
 void aoe_freetframe(struct frame *);
 void aoe_flush_iocq(void);
 void aoe_flush_iocq_by_index(int);
-void aoe_end_request(struct aoedev *, struct request *, int);
+void aoe_end_request(struct aoe_hwq *, struct request *, int);
 int aoe_ktstart(struct ktstate *k);
 void aoe_ktstop(struct ktstate *k);
 
@@ -236,7 +254,7 @@ void aoedev_exit(void);
 struct aoedev *aoedev_by_aoeaddr(ulong maj, int min, int do_alloc);
 void aoedev_downdev(struct aoedev *d);
 int aoedev_flush(const char __user *str, size_t size);
-void aoe_failbuf(struct aoedev *, struct buf *);
+void aoe_failbuf(struct aoe_hwq *, struct buf *);
 void aoedev_put(struct aoedev *);
 
 int aoenet_init(void);
@@ -113,28 +113,37 @@ static ssize_t aoedisk_show_payload(struct device *dev,
 static int aoedisk_debugfs_show(struct seq_file *s, void *ignored)
 {
 	struct aoedev *d;
+	struct aoe_hwq *q;
 	struct aoetgt **t, **te;
 	struct aoeif *ifp, *ife;
 	unsigned long flags;
 	char c;
+	int i;
 
 	d = s->private;
 	seq_printf(s, "rttavg: %d rttdev: %d\n",
 		d->rttavg >> RTTSCALE,
 		d->rttdev >> RTTDSCALE);
-	seq_printf(s, "nskbpool: %d\n", skb_queue_len(&d->skbpool));
 	seq_printf(s, "kicked: %ld\n", d->kicked);
 	seq_printf(s, "maxbcnt: %ld\n", d->maxbcnt);
 	seq_printf(s, "ref: %ld\n", d->ref);
 
+	for (i = 0; i < d->nhwq; i++) {
+		q = &d->hwq[i];
+		spin_lock_irqsave(&q->lock, flags);
+		seq_printf(s, "hwq%d:\n", i);
+		seq_printf(s, "\tnskbpool: %d\n", skb_queue_len(&q->skbpool));
+		seq_printf(s, "\tfalloc: %ld\n", q->falloc);
+		seq_printf(s, "\tffree: %p\n",
+			list_empty(&q->ffree) ? NULL : q->ffree.next);
+		spin_unlock_irqrestore(&q->lock, flags);
+	}
+
 	spin_lock_irqsave(&d->lock, flags);
 	t = d->targets;
 	te = t + d->ntargets;
 	for (; t < te && *t; t++) {
 		c = '\t';
-		seq_printf(s, "falloc: %ld\n", (*t)->falloc);
-		seq_printf(s, "ffree: %p\n",
-			list_empty(&(*t)->ffree) ? NULL : (*t)->ffree.next);
 		seq_printf(s, "%pm:%d:%d:%d\n", (*t)->addr, (*t)->nout,
 			(*t)->maxout, (*t)->nframes);
 		seq_printf(s, "\tssthresh:%d\n", (*t)->ssthresh);
@@ -263,24 +272,35 @@ aoeblk_release(struct gendisk *disk, fmode_t mode)
 static blk_status_t aoeblk_queue_rq(struct blk_mq_hw_ctx *hctx,
 				    const struct blk_mq_queue_data *bd)
 {
-	struct aoedev *d = hctx->queue->queuedata;
+	struct aoe_hwq *q = hctx->driver_data;
+	struct aoedev *d = q->d;
 
-	spin_lock_irq(&d->lock);
+	spin_lock_irq(&q->lock);
 
-	if ((d->flags & DEVFL_UP) == 0) {
+	/* aoedev_downdev clears UP before it takes each queue lock */
+	if ((READ_ONCE(d->flags) & DEVFL_UP) == 0) {
 		pr_info_ratelimited("aoe: device %ld.%d is not up\n",
 			d->aoemajor, d->aoeminor);
-		spin_unlock_irq(&d->lock);
+		spin_unlock_irq(&q->lock);
 		blk_mq_start_request(bd->rq);
 		return BLK_STS_IOERR;
 	}
 
-	list_add_tail(&bd->rq->queuelist, &d->rq_list);
-	aoecmd_work(d);
-	spin_unlock_irq(&d->lock);
+	list_add_tail(&bd->rq->queuelist, &q->rq_list);
+	aoecmd_work(q);
+	spin_unlock_irq(&q->lock);
 	return BLK_STS_OK;
 }
 
+static int aoeblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			    unsigned int hctx_idx)
+{
+	struct aoedev *d = data;
+
+	hctx->driver_data = &d->hwq[hctx_idx];
+	return 0;
+}
+
 static int
 aoeblk_getgeo(struct block_device *bdev, struct hd_geometry *geo)
 {
@@ -336,6 +356,7 @@ static const struct block_device_operations aoe_bdops = {
 
 static const struct blk_mq_ops aoeblk_mq_ops = {
 	.queue_rq	= aoeblk_queue_rq,
+	.init_hctx	= aoeblk_init_hctx,
 };
 
 /* alloc_disk and add_disk can sleep */
@@ -380,7 +401,8 @@ aoeblk_gdalloc(void *vp)
 	set = &d->tag_set;
 	set->ops = &aoeblk_mq_ops;
 	set->cmd_size = sizeof(struct aoe_req);
-	set->nr_hw_queues = 1;
+	set->nr_hw_queues = d->nhwq;
+	set->driver_data = d;
 	set->queue_depth = 128;
 	set->numa_node = NUMA_NO_NODE;
 	set->flags = BLK_MQ_F_SHOULD_MERGE;
@@ -99,17 +99,20 @@ revalidate(const char __user *str, size_t size)
 	d = aoedev_by_aoeaddr(major, minor, 0);
 	if (!d)
 		return -EINVAL;
-	spin_lock_irqsave(&d->lock, flags);
+	spin_lock_irqsave(&d->hwq[0].lock, flags);
+	spin_lock(&d->lock);
 	aoecmd_cleanslate(d);
 	aoecmd_cfg(major, minor);
 loop:
 	skb = aoecmd_ata_id(d);
-	spin_unlock_irqrestore(&d->lock, flags);
+	spin_unlock(&d->lock);
+	spin_unlock_irqrestore(&d->hwq[0].lock, flags);
 	/* try again if we are able to sleep a bit,
 	 * otherwise give up this revalidation
 	 */
 	if (!skb && !msleep_interruptible(250)) {
-		spin_lock_irqsave(&d->lock, flags);
+		spin_lock_irqsave(&d->hwq[0].lock, flags);
+		spin_lock(&d->lock);
 		goto loop;
 	}
 	aoedev_put(d);
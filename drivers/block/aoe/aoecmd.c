@@ -14,6 +14,7 @@
 #include <linux/moduleparam.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
+#include <linux/log2.h>
 #include <net/net_namespace.h>
 #include <asm/unaligned.h>
 #include <linux/uio.h>
@@ -24,7 +25,7 @@
 static void ktcomplete(struct frame *, struct sk_buff *);
 static int count_targets(struct aoedev *d, int *untainted);
 
-static struct buf *nextbuf(struct aoedev *);
+static struct buf *nextbuf(struct aoe_hwq *);
 
 static int aoe_deadsecs = 60 * 3;
 module_param(aoe_deadsecs, int, 0644);
@@ -76,12 +77,12 @@ new_skb(ulong len)
 }
 
 static struct frame *
-getframe_deferred(struct aoedev *d, u32 tag)
+getframe_deferred(struct aoe_hwq *q, u32 tag)
 {
 	struct list_head *head, *pos, *nx;
 	struct frame *f;
 
-	head = &d->rexmitq;
+	head = &q->rexmitq;
 	list_for_each_safe(pos, nx, head) {
 		f = list_entry(pos, struct frame, head);
 		if (f->tag == tag) {
@@ -93,14 +94,14 @@ getframe_deferred(struct aoedev *d, u32 tag)
 }
 
 static struct frame *
-getframe(struct aoedev *d, u32 tag)
+getframe(struct aoe_hwq *q, u32 tag)
 {
 	struct frame *f;
 	struct list_head *head, *pos, *nx;
 	u32 n;
 
 	n = tag % NFACTIVE;
-	head = &d->factive[n];
+	head = &q->factive[n];
 	list_for_each_safe(pos, nx, head) {
 		f = list_entry(pos, struct frame, head);
 		if (f->tag == tag) {
@@ -114,21 +115,31 @@ getframe(struct aoedev *d, u32 tag)
 /*
  * Leave the top bit clear so we have tagspace for userland.
  * The bottom 16 bits are the xmit tick for rexmit/rttavg processing.
+ * The low bits of the upper half hold the index of the hardware queue
+ * that sent the frame, so a response only has to look at that queue.
  * This driver reserves tag -1 to mean "unused frame."
  */
 static int
-newtag(struct aoedev *d)
+newtag(struct aoe_hwq *q)
 {
 	register ulong n;
 
-	n = jiffies & 0xffff;
-	return n |= (++d->lasttag & 0x7fff) << 16;
+	n = ++q->lasttag << ilog2(q->d->nhwq) | q->idx;
+	n = (n & 0x7fff) << 16;
+	return n |= jiffies & 0xffff;
+}
+
+static struct aoe_hwq *
+tag_hwq(struct aoedev *d, u32 tag)
+{
+	return &d->hwq[(tag >> 16) & (d->nhwq - 1)];
 }
 
 static u32
-aoehdr_atainit(struct aoedev *d, struct aoetgt *t, struct aoe_hdr *h)
+aoehdr_atainit(struct aoe_hwq *q, struct aoetgt *t, struct aoe_hdr *h)
 {
-	u32 host_tag = newtag(d);
+	struct aoedev *d = q->d;
+	u32 host_tag = newtag(q);
 
 	memcpy(h->src, t->ifp->nd->dev_addr, sizeof h->src);
 	memcpy(h->dst, t->addr, sizeof h->dst);
@@ -168,60 +179,59 @@ ifrotate(struct aoetgt *t)
 }
 
 static void
-skb_pool_put(struct aoedev *d, struct sk_buff *skb)
+skb_pool_put(struct aoe_hwq *q, struct sk_buff *skb)
 {
-	__skb_queue_tail(&d->skbpool, skb);
+	__skb_queue_tail(&q->skbpool, skb);
 }
 
 static struct sk_buff *
-skb_pool_get(struct aoedev *d)
+skb_pool_get(struct aoe_hwq *q)
 {
-	struct sk_buff *skb = skb_peek(&d->skbpool);
+	struct sk_buff *skb = skb_peek(&q->skbpool);
 
 	if (skb && atomic_read(&skb_shinfo(skb)->dataref) == 1) {
-		__skb_unlink(skb, &d->skbpool);
+		__skb_unlink(skb, &q->skbpool);
 		return skb;
 	}
-	if (skb_queue_len(&d->skbpool) < NSKBPOOLMAX &&
+	if (skb_queue_len(&q->skbpool) < NSKBPOOLMAX &&
 	    (skb = new_skb(ETH_ZLEN)))
 		return skb;
 
 	return NULL;
 }
 
+/* enters with f->q->lock held */
 void
 aoe_freetframe(struct frame *f)
 {
-	struct aoetgt *t;
-
-	t = f->t;
 	f->buf = NULL;
 	memset(&f->iter, 0, sizeof(f->iter));
 	f->r_skb = NULL;
 	f->flags = 0;
-	list_add(&f->head, &t->ffree);
+	list_add(&f->head, &f->q->ffree);
 }
 
 static struct frame *
-newtframe(struct aoedev *d, struct aoetgt *t)
+newtframe(struct aoe_hwq *q, struct aoetgt *t)
 {
 	struct frame *f;
 	struct sk_buff *skb;
 	struct list_head *pos;
 
-	if (list_empty(&t->ffree)) {
-		if (t->falloc >= NSKBPOOLMAX*2)
+	if (list_empty(&q->ffree)) {
+		if (q->falloc >= NSKBPOOLMAX*2)
 			return NULL;
 		f = kcalloc(1, sizeof(*f), GFP_ATOMIC);
 		if (f == NULL)
 			return NULL;
-		t->falloc++;
-		f->t = t;
+		q->falloc++;
+		f->q = q;
 	} else {
-		pos = t->ffree.next;
+		pos = q->ffree.next;
 		list_del(pos);
 		f = list_entry(pos, struct frame, head);
 	}
+	f->t = t;
 
 	skb = f->skb;
 	if (skb == NULL) {
@@ -233,10 +243,10 @@ bail:			aoe_freetframe(f);
 	}
 
 	if (atomic_read(&skb_shinfo(skb)->dataref) != 1) {
-		skb = skb_pool_get(d);
+		skb = skb_pool_get(q);
 		if (skb == NULL)
 			goto bail;
-		skb_pool_put(d, f->skb);
+		skb_pool_put(q, f->skb);
 		f->skb = skb;
 	}
 
@@ -246,9 +256,11 @@ bail:			aoe_freetframe(f);
 	return f;
 }
 
+/* enters with q->lock and d->lock held */
 static struct frame *
-newframe(struct aoedev *d)
+newframe(struct aoe_hwq *q)
 {
+	struct aoedev *d = q->d;
 	struct frame *f;
 	struct aoetgt *t, **tt;
 	int totout = 0;
@@ -272,7 +284,7 @@ newframe(struct aoedev *d)
 		if (t->nout < t->maxout
 		&& (use_tainted || !t->taint)
 		&& t->ifp->nd) {
-			f = newtframe(d, t);
+			f = newtframe(q, t);
 			if (f) {
 				ifrotate(t);
 				d->tgt = tt;
@@ -307,11 +319,10 @@ skb_fillup(struct sk_buff *skb, struct bio *bio, struct bvec_iter iter)
 static void
 fhash(struct frame *f)
 {
-	struct aoedev *d = f->t->d;
 	u32 n;
 
 	n = f->tag % NFACTIVE;
-	list_add_tail(&f->head, &d->factive[n]);
+	list_add_tail(&f->head, &f->q->factive[n]);
 }
 
 static void
@@ -333,7 +344,7 @@ ata_rw_frameinit(struct frame *f)
 	extbit = 0x4;
 
 	t = f->t;
-	f->tag = aoehdr_atainit(t->d, t, h);
+	f->tag = aoehdr_atainit(f->q, t, h);
 	fhash(f);
 	t->nout++;
 	f->waited = 0;
@@ -366,19 +377,24 @@ ata_rw_frameinit(struct frame *f)
 }
 
 static int
-aoecmd_ata_rw(struct aoedev *d)
+aoecmd_ata_rw(struct aoe_hwq *q)
 {
+	struct aoedev *d = q->d;
 	struct frame *f;
 	struct buf *buf;
 	struct sk_buff *skb;
 	struct sk_buff_head queue;
 
-	buf = nextbuf(d);
+	buf = nextbuf(q);
 	if (buf == NULL)
 		return 0;
-	f = newframe(d);
-	if (f == NULL)
+	spin_lock(&d->lock);
+	f = newframe(q);
+	if (f == NULL) {
+		spin_unlock(&d->lock);
+		set_bit(q->idx, &d->hwq_starved);
 		return 0;
+	}
 
 	/* initialize the headers & frame */
 	f->buf = buf;
@@ -389,12 +405,13 @@ aoecmd_ata_rw(struct aoedev *d)
 	bio_advance_iter(buf->bio, &buf->iter, f->iter.bi_size);
 
 	if (!buf->iter.bi_size)
-		d->ip.buf = NULL;
+		q->ip.buf = NULL;
 
 	/* mark all tracking fields and load out */
 	buf->nframesout += 1;
 
 	ata_rw_frameinit(f);
+	spin_unlock(&d->lock);
 
 	skb = skb_clone(f->skb, GFP_ATOMIC);
 	if (skb) {
@@ -449,8 +466,9 @@ cont:
 }
 
 static void
-resend(struct aoedev *d, struct frame *f)
+resend(struct aoe_hwq *q, struct frame *f)
 {
+	struct aoedev *d = q->d;
 	struct sk_buff *skb;
 	struct sk_buff_head queue;
 	struct aoe_hdr *h;
@@ -459,7 +477,7 @@ resend(struct aoedev *d, struct frame *f)
 	u32 n;
 
 	t = f->t;
-	n = newtag(d);
+	n = newtag(q);
 	skb = f->skb;
 	if (ifrotate(t) == NULL) {
 		/* probably can't happen, but set it up to fail anyway */
@@ -551,12 +569,12 @@ ejectif(struct aoetgt *t, struct aoeif *ifp)
 }
 
 static struct frame *
-reassign_frame(struct frame *f)
+reassign_frame(struct aoe_hwq *q, struct frame *f)
 {
 	struct frame *nf;
 	struct sk_buff *skb;
 
-	nf = newframe(f->t->d);
+	nf = newframe(q);
 	if (!nf)
 		return NULL;
 	if (nf->t == f->t) {
@@ -576,8 +594,9 @@ reassign_frame(struct frame *f)
 	return nf;
 }
 
+/* enters with q->lock and d->lock held */
 static void
-probe(struct aoetgt *t)
+probe(struct aoe_hwq *q, struct aoetgt *t)
 {
 	struct aoedev *d;
 	struct frame *f;
@@ -587,7 +606,7 @@ probe(struct aoetgt *t)
 	int frag;
 
 	d = t->d;
-	f = newtframe(d, t);
+	f = newtframe(q, t);
 	if (!f) {
 		pr_err("%s %pm for e%ld.%d: %s\n",
 			"aoe: cannot probe remote address",
@@ -634,9 +653,11 @@ rto(struct aoedev *d)
 	return t;
 }
 
+/* enters with q->lock and d->lock held */
 static void
-rexmit_deferred(struct aoedev *d)
+rexmit_deferred(struct aoe_hwq *q)
 {
+	struct aoedev *d = q->d;
 	struct aoetgt *t;
 	struct frame *f;
 	struct frame *nf;
@@ -646,17 +667,17 @@ rexmit_deferred(struct aoedev *d)
 
 	count_targets(d, &untainted);
 
-	head = &d->rexmitq;
+	head = &q->rexmitq;
 	list_for_each_safe(pos, nx, head) {
 		f = list_entry(pos, struct frame, head);
 		t = f->t;
 		if (t->taint) {
 			if (!(f->flags & FFL_PROBE)) {
-				nf = reassign_frame(f);
+				nf = reassign_frame(q, f);
 				if (nf) {
 					if (t->nout_probes == 0
 					&& untainted > 0) {
-						probe(t);
+						probe(q, t);
 						t->nout_probes++;
 					}
 					list_replace(&f->head, &nf->head);
@@ -689,7 +710,7 @@ stop_probe:		/* don't probe untainted aoetgts */
 		since = tsince_hr(f);
 		f->waited += since;
 		f->waited_total += since;
-		resend(d, f);
+		resend(q, f);
 	}
 }
 
@@ -723,10 +744,14 @@ count_targets(struct aoedev *d, int *untainted)
 	return i;
 }
 
-static void
-rexmit_timer(struct timer_list *timer)
+/* Expire the overdue frames of one hardware queue and retransmit what
+ * the target windows allow.  Returns nonzero when a frame has waited
+ * past aoe_deadsecs and the device must be taken down.
+ */
+static int
+rexmit_hwq(struct aoe_hwq *q)
 {
-	struct aoedev *d;
+	struct aoedev *d = q->d;
 	struct aoetgt *t;
 	struct aoeif *ifp;
 	struct frame *f;
@@ -737,24 +762,19 @@ rexmit_timer(struct timer_list *timer)
 	int i;
 	int utgts;	/* number of aoetgt descriptors (not slots) */
 	int since;
+	int dead = 0;
 
-	d = from_timer(d, timer, timer);
-
-	spin_lock_irqsave(&d->lock, flags);
+	spin_lock_irqsave(&q->lock, flags);
+	spin_lock(&d->lock);
 
 	/* timeout based on observed timings and variations */
 	timeout = rto(d);
 
 	utgts = count_targets(d, NULL);
 
-	if (d->flags & DEVFL_TKILL) {
-		spin_unlock_irqrestore(&d->lock, flags);
-		return;
-	}
-
 	/* collect all frames to rexmit into flist */
 	for (i = 0; i < NFACTIVE; i++) {
-		head = &d->factive[i];
+		head = &q->factive[i];
 		list_for_each_safe(pos, nx, head) {
 			f = list_entry(pos, struct frame, head);
 			if (tsince_hr(f) < timeout)
@@ -778,8 +798,8 @@ rexmit_timer(struct timer_list *timer)
 			 * Hang all frames on first hash bucket for downdev
 			 * to clean up.
 			 */
-			list_splice(&flist, &d->factive[0]);
-			aoedev_downdev(d);
+			list_splice(&flist, &q->factive[0]);
+			dead = 1;
 			goto out;
 		}
 
@@ -805,19 +825,74 @@ rexmit_timer(struct timer_list *timer)
 				ifp = NULL;
 			}
 		}
-		list_move_tail(pos, &d->rexmitq);
+		list_move_tail(pos, &q->rexmitq);
 		t->nout--;
 	}
-	rexmit_deferred(d);
+	rexmit_deferred(q);
 
 out:
+	spin_unlock(&d->lock);
+	spin_unlock_irqrestore(&q->lock, flags);
+	return dead;
+}
+
+/* Give the hardware queues that ran out of frames another go, now that
+ * a response or a timeout may have opened a target window.
+ */
+static void
+aoecmd_kick(struct aoedev *d)
+{
+	struct aoe_hwq *q;
+	ulong flags;
+	int i;
+
+	if (!READ_ONCE(d->hwq_starved))
+		return;
+	for (i = 0; i < d->nhwq; i++) {
+		if (!test_and_clear_bit(i, &d->hwq_starved))
+			continue;
+		q = &d->hwq[i];
+		spin_lock_irqsave(&q->lock, flags);
+		aoecmd_work(q);
+		spin_unlock_irqrestore(&q->lock, flags);
+	}
+}
+
+static void
+rexmit_timer(struct timer_list *timer)
+{
+	struct aoedev *d;
+	ulong flags;
+	int i;
+
+	d = from_timer(d, timer, timer);
+
+	spin_lock_irqsave(&d->lock, flags);
+	if (d->flags & DEVFL_TKILL) {
+		spin_unlock_irqrestore(&d->lock, flags);
+		return;
+	}
+	spin_unlock_irqrestore(&d->lock, flags);
+
+	for (i = 0; i < d->nhwq; i++)
+		if (rexmit_hwq(&d->hwq[i]))
+			break;
+	if (i < d->nhwq)
+		aoedev_downdev(d);
+	else
+		aoecmd_kick(d);
+
+	spin_lock_irqsave(&d->lock, flags);
 	if ((d->flags & DEVFL_KICKME) && d->blkq) {
 		d->flags &= ~DEVFL_KICKME;
 		blk_mq_run_hw_queues(d->blkq, true);
 	}
 
-	d->timer.expires = jiffies + TIMERTICK;
-	add_timer(&d->timer);
+	/* the device lock was dropped above, so recheck before rearming */
+	if (!(d->flags & DEVFL_TKILL)) {
+		d->timer.expires = jiffies + TIMERTICK;
+		add_timer(&d->timer);
+	}
 
 	spin_unlock_irqrestore(&d->lock, flags);
 }
@@ -832,29 +907,28 @@ bufinit(struct buf *buf, struct request *rq, struct bio *bio)
 }
 
 static struct buf *
-nextbuf(struct aoedev *d)
+nextbuf(struct aoe_hwq *q)
 {
+	struct aoedev *d = q->d;
 	struct request *rq;
-	struct request_queue *q;
 	struct aoe_req *req;
 	struct buf *buf;
 	struct bio *bio;
 
-	q = d->blkq;
-	if (q == NULL)
+	if (d->blkq == NULL)
 		return NULL;	/* initializing */
-	if (d->ip.buf)
-		return d->ip.buf;
-	rq = d->ip.rq;
+	if (q->ip.buf)
+		return q->ip.buf;
+	rq = q->ip.rq;
 	if (rq == NULL) {
-		rq = list_first_entry_or_null(&d->rq_list, struct request,
+		rq = list_first_entry_or_null(&q->rq_list, struct request,
 						queuelist);
 		if (rq == NULL)
 			return NULL;
 		list_del_init(&rq->queuelist);
 		blk_mq_start_request(rq);
-		d->ip.rq = rq;
-		d->ip.nxbio = rq->bio;
+		q->ip.rq = rq;
+		q->ip.nxbio = rq->bio;
 
 		req = blk_mq_rq_to_pdu(rq);
 		req->nr_bios = 0;
@@ -866,21 +940,25 @@ nextbuf(struct aoedev *d)
 		pr_err("aoe: nextbuf: unable to mempool_alloc!\n");
 		return NULL;
 	}
-	bio = d->ip.nxbio;
+	bio = q->ip.nxbio;
 	bufinit(buf, rq, bio);
 	bio = bio->bi_next;
-	d->ip.nxbio = bio;
+	q->ip.nxbio = bio;
 	if (bio == NULL)
-		d->ip.rq = NULL;
-	return d->ip.buf = buf;
+		q->ip.rq = NULL;
+	return q->ip.buf = buf;
 }
 
-/* enters with d->lock held */
+/* enters with q->lock held */
 void
-aoecmd_work(struct aoedev *d)
+aoecmd_work(struct aoe_hwq *q)
 {
-	rexmit_deferred(d);
-	while (aoecmd_ata_rw(d))
+	if (!list_empty(&q->rexmitq)) {
+		spin_lock(&q->d->lock);
+		rexmit_deferred(q);
+		spin_unlock(&q->d->lock);
+	}
+	while (aoecmd_ata_rw(q))
 		;
 }
 
@@ -1034,16 +1112,16 @@ bvcpy(struct sk_buff *skb, struct bio *bio, struct bvec_iter iter, long cnt)
 }
 
 void
-aoe_end_request(struct aoedev *d, struct request *rq, int fastfail)
+aoe_end_request(struct aoe_hwq *hwq, struct request *rq, int fastfail)
 {
 	struct bio *bio;
 	int bok;
 	struct request_queue *q;
 	blk_status_t err = BLK_STS_OK;
 
-	q = d->blkq;
-	if (rq == d->ip.rq)
-		d->ip.rq = NULL;
+	q = hwq->d->blkq;
+	if (rq == hwq->ip.rq)
+		hwq->ip.rq = NULL;
 	do {
 		bio = rq->bio;
 		bok = !fastfail && !bio->bi_status;
@@ -1059,16 +1137,16 @@ aoe_end_request(struct aoedev *d, struct request *rq, int fastfail)
 }
 
 static void
-aoe_end_buf(struct aoedev *d, struct buf *buf)
+aoe_end_buf(struct aoe_hwq *q, struct buf *buf)
 {
 	struct request *rq = buf->rq;
 	struct aoe_req *req = blk_mq_rq_to_pdu(rq);
 
-	if (buf == d->ip.buf)
-		d->ip.buf = NULL;
-	mempool_free(buf, d->bufpool);
+	if (buf == q->ip.buf)
+		q->ip.buf = NULL;
+	mempool_free(buf, q->d->bufpool);
 	if (--req->nr_bios == 0)
-		aoe_end_request(d, rq, 0);
+		aoe_end_request(q, rq, 0);
 }
 
 static void
@@ -1078,6 +1156,7 @@ ktiocomplete(struct frame *f)
 	struct aoe_atahdr *ahin, *ahout;
 	struct buf *buf;
 	struct sk_buff *skb;
+	struct aoe_hwq *q;
 	struct aoetgt *t;
 	struct aoeif *ifp;
 	struct aoedev *d;
@@ -1087,6 +1166,7 @@ ktiocomplete(struct frame *f)
 	if (f == NULL)
 		return;
 
+	q = f->q;
 	t = f->t;
 	d = t->d;
 	skb = f->r_skb;
@@ -1163,23 +1243,25 @@ noskb:		if (buf)
 			hin->minor);
 	}
 out:
-	spin_lock_irq(&d->lock);
+	spin_lock_irq(&q->lock);
+	spin_lock(&d->lock);
 	if (t->taint > 0
 	&& --t->taint > 0
 	&& t->nout_probes == 0) {
 		count_targets(d, &untainted);
 		if (untainted > 0) {
-			probe(t);
+			probe(q, t);
 			t->nout_probes++;
 		}
 	}
+	spin_unlock(&d->lock);
 
 	aoe_freetframe(f);
 
 	if (buf && --buf->nframesout == 0 && buf->iter.bi_size == 0)
-		aoe_end_buf(d, buf);
+		aoe_end_buf(q, buf);
 
-	spin_unlock_irq(&d->lock);
+	spin_unlock_irq(&q->lock);
 	aoedev_put(d);
 	dev_kfree_skb(skb);
 }
@@ -1300,6 +1382,7 @@ struct sk_buff *
 aoecmd_ata_rsp(struct sk_buff *skb)
 {
 	struct aoedev *d;
+	struct aoe_hwq *q;
 	struct aoe_hdr *h;
 	struct frame *f;
 	u32 n;
@@ -1318,22 +1401,26 @@ aoecmd_ata_rsp(struct sk_buff *skb)
 		return skb;
 	}
 
-	spin_lock_irqsave(&d->lock, flags);
-
 	n = be32_to_cpu(get_unaligned(&h->tag));
-	f = getframe(d, n);
+	q = tag_hwq(d, n);
+
+	spin_lock_irqsave(&q->lock, flags);
+	spin_lock(&d->lock);
+
+	f = getframe(q, n);
 	if (f) {
 		calc_rttavg(d, f->t, tsince_hr(f));
 		f->t->nout--;
 		if (f->flags & FFL_PROBE)
 			f->t->nout_probes--;
 	} else {
-		f = getframe_deferred(d, n);
+		f = getframe_deferred(q, n);
 		if (f) {
 			calc_rttavg(d, NULL, tsince_hr(f));
 		} else {
 			calc_rttavg(d, NULL, tsince(n));
-			spin_unlock_irqrestore(&d->lock, flags);
+			spin_unlock(&d->lock);
+			spin_unlock_irqrestore(&q->lock, flags);
 			aoedev_put(d);
 			snprintf(ebuf, sizeof(ebuf),
 				 "%15s e%d.%d    tag=%08x@%08lx s=%pm d=%pm\n",
@@ -1348,10 +1435,12 @@ aoecmd_ata_rsp(struct sk_buff *skb)
 			return skb;
 		}
 	}
-	aoecmd_work(d);
+	spin_unlock(&d->lock);
+	aoecmd_work(q);
 
-	spin_unlock_irqrestore(&d->lock, flags);
+	spin_unlock_irqrestore(&q->lock, flags);
 
+	aoecmd_kick(d);
 	ktcomplete(f, skb);
 
 	/*
@@ -1371,16 +1460,18 @@ aoecmd_cfg(ushort aoemajor, unsigned char aoeminor)
 	aoenet_xmit(&queue);
 }
 
+/* enters with d->hwq[0].lock and d->lock held */
 struct sk_buff *
 aoecmd_ata_id(struct aoedev *d)
 {
+	struct aoe_hwq *q = &d->hwq[0];
 	struct aoe_hdr *h;
 	struct aoe_atahdr *ah;
 	struct frame *f;
 	struct sk_buff *skb;
 	struct aoetgt *t;
 
-	f = newframe(d);
+	f = newframe(q);
 	if (f == NULL)
 		return NULL;
 
@@ -1392,7 +1483,7 @@ aoecmd_ata_id(struct aoedev *d)
 	ah = (struct aoe_atahdr *) (h+1);
 	skb_put(skb, sizeof *h + sizeof *ah);
 	memset(h, 0, skb->len);
-	f->tag = aoehdr_atainit(d, t, h);
+	f->tag = aoehdr_atainit(q, t, h);
 	fhash(f);
 	t->nout++;
 	f->waited = 0;
@@ -1460,7 +1551,6 @@ addtgt(struct aoedev *d, char *addr, ulong nframes)
 	t->ifp = t->ifs;
 	aoecmd_wreset(t);
 	t->maxout = t->nframes / 2;
-	INIT_LIST_HEAD(&t->ffree);
 	return *tt = t;
 
  nomem:
@@ -1566,7 +1656,8 @@ aoecmd_cfg_rsp(struct sk_buff *skb)
 		return;
 	}
 
-	spin_lock_irqsave(&d->lock, flags);
+	spin_lock_irqsave(&d->hwq[0].lock, flags);
+	spin_lock(&d->lock);
 
 	t = gettgt(d, h->src);
 	if (t) {
@@ -1592,7 +1683,8 @@ aoecmd_cfg_rsp(struct sk_buff *skb)
 		sl = aoecmd_ata_id(d);
 	}
 bail:
-	spin_unlock_irqrestore(&d->lock, flags);
+	spin_unlock(&d->lock);
+	spin_unlock_irqrestore(&d->hwq[0].lock, flags);
 	aoedev_put(d);
 	if (sl) {
 		__skb_queue_head_init(&queue);
@@ -1625,14 +1717,14 @@ aoecmd_cleanslate(struct aoedev *d)
 }
 
 void
-aoe_failbuf(struct aoedev *d, struct buf *buf)
+aoe_failbuf(struct aoe_hwq *q, struct buf *buf)
 {
 	if (buf == NULL)
 		return;
 	buf->iter.bi_size = 0;
 	buf->bio->bi_status = BLK_STS_IOERR;
 	if (buf->nframesout == 0)
-		aoe_end_buf(d, buf);
+		aoe_end_buf(q, buf);
 }
 
 void
@@ -1651,6 +1743,7 @@ aoe_flush_iocq_by_index(int id)
 {
 	struct frame *f;
 	struct aoedev *d;
+	struct aoe_hwq *q;
 	LIST_HEAD(flist);
 	struct list_head *pos;
 	struct sk_buff *skb;
@@ -1664,14 +1757,15 @@ aoe_flush_iocq_by_index(int id)
 		list_del(pos);
 		f = list_entry(pos, struct frame, head);
 		d = f->t->d;
+		q = f->q;
 		skb = f->r_skb;
-		spin_lock_irqsave(&d->lock, flags);
+		spin_lock_irqsave(&q->lock, flags);
 		if (f->buf) {
 			f->buf->nframesout--;
-			aoe_failbuf(d, f->buf);
+			aoe_failbuf(q, f->buf);
 		}
 		aoe_freetframe(f);
-		spin_unlock_irqrestore(&d->lock, flags);
+		spin_unlock_irqrestore(&q->lock, flags);
 		dev_kfree_skb(skb);
 		aoedev_put(d);
 	}
@@ -11,12 +11,13 @@
 #include <linux/slab.h>
 #include <linux/bitmap.h>
 #include <linux/kdev_t.h>
+#include <linux/log2.h>
 #include <linux/moduleparam.h>
 #include <linux/string.h>
 #include "aoe.h"
 
 static void freetgt(struct aoedev *d, struct aoetgt *t);
-static void skbpoolfree(struct aoedev *d);
+static void freehwq(struct aoe_hwq *q);
 
 static int aoe_dyndevs = 1;
 module_param(aoe_dyndevs, int, 0644);
@@ -157,26 +158,26 @@ dummy_timer(struct timer_list *t)
 }
 
 static void
-aoe_failip(struct aoedev *d)
+aoe_failip(struct aoe_hwq *q)
 {
 	struct request *rq;
 	struct aoe_req *req;
 	struct bio *bio;
 
-	aoe_failbuf(d, d->ip.buf);
-	rq = d->ip.rq;
+	aoe_failbuf(q, q->ip.buf);
+	rq = q->ip.rq;
 	if (rq == NULL)
 		return;
 
 	req = blk_mq_rq_to_pdu(rq);
-	while ((bio = d->ip.nxbio)) {
+	while ((bio = q->ip.nxbio)) {
 		bio->bi_status = BLK_STS_IOERR;
-		d->ip.nxbio = bio->bi_next;
+		q->ip.nxbio = bio->bi_next;
 		req->nr_bios--;
 	}
 
 	if (!req->nr_bios)
-		aoe_end_request(d, rq, 0);
+		aoe_end_request(q, rq, 0);
 }
 
 static void
@@ -188,40 +189,59 @@ downdev_frame(struct list_head *pos)
 	list_del(pos);
 	if (f->buf) {
 		f->buf->nframesout--;
-		aoe_failbuf(f->t->d, f->buf);
+		aoe_failbuf(f->q, f->buf);
 	}
 	aoe_freetframe(f);
 }
 
-void
-aoedev_downdev(struct aoedev *d)
+static void
+downdev_hwq(struct aoe_hwq *q)
 {
-	struct aoetgt *t, **tt, **te;
 	struct list_head *head, *pos, *nx;
+	ulong flags;
 	int i;
 
-	d->flags &= ~DEVFL_UP;
+	spin_lock_irqsave(&q->lock, flags);
 
 	/* clean out active and to-be-retransmitted buffers */
 	for (i = 0; i < NFACTIVE; i++) {
-		head = &d->factive[i];
+		head = &q->factive[i];
 		list_for_each_safe(pos, nx, head)
 			downdev_frame(pos);
 	}
-	head = &d->rexmitq;
+	head = &q->rexmitq;
 	list_for_each_safe(pos, nx, head)
 		downdev_frame(pos);
 
+	/* clean out the in-process request (if any) */
+	aoe_failip(q);
+
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+void
+aoedev_downdev(struct aoedev *d)
+{
+	struct aoetgt *t, **tt, **te;
+	ulong flags;
+	int i;
+
+	spin_lock_irqsave(&d->lock, flags);
+	d->flags &= ~DEVFL_UP;
+	spin_unlock_irqrestore(&d->lock, flags);
+
+	for (i = 0; i < d->nhwq; i++)
+		downdev_hwq(&d->hwq[i]);
+
 	/* reset window dressings */
+	spin_lock_irqsave(&d->lock, flags);
 	tt = d->targets;
 	te = tt + d->ntargets;
 	for (; tt < te && (t = *tt); tt++) {
 		aoecmd_wreset(t);
 		t->nout = 0;
 	}
-
-	/* clean out the in-process request (if any) */
-	aoe_failip(d);
+	spin_unlock_irqrestore(&d->lock, flags);
 
 	/* fast fail all pending I/O */
 	if (d->blkq) {
@@ -262,6 +282,7 @@ freedev(struct aoedev *d)
 	struct aoetgt **t, **e;
 	int freeing = 0;
 	unsigned long flags;
+	int i;
 
 	spin_lock_irqsave(&d->lock, flags);
 	if (d->flags & DEVFL_TKILL
@@ -285,9 +306,10 @@ freedev(struct aoedev *d)
 	e = t + d->ntargets;
 	for (; t < e && *t; t++)
 		freetgt(d, *t);
+	for (i = 0; i < d->nhwq; i++)
+		freehwq(&d->hwq[i]);
 
 	mempool_destroy(d->bufpool);
-	skbpoolfree(d);
 	minor_free(d->sysminor);
 
 	spin_lock_irqsave(&d->lock, flags);
@@ -381,8 +403,10 @@ restart2:
 			dd = &d->next;
 		}
 		spin_unlock(&d->lock);
-		if (doomed)
+		if (doomed) {
+			kfree(doomed->hwq);
 			kfree(doomed->targets);
+		}
 		kfree(doomed);
 	}
 	spin_unlock_irqrestore(&devlist_lock, flags);
@@ -425,14 +449,30 @@ skbfree(struct sk_buff *skb)
 }
 
 static void
-skbpoolfree(struct aoedev *d)
+skbpoolfree(struct aoe_hwq *q)
 {
 	struct sk_buff *skb, *tmp;
 
-	skb_queue_walk_safe(&d->skbpool, skb, tmp)
+	skb_queue_walk_safe(&q->skbpool, skb, tmp)
 		skbfree(skb);
 
-	__skb_queue_head_init(&d->skbpool);
+	__skb_queue_head_init(&q->skbpool);
+}
+
+static void
+hwqinit(struct aoedev *d, struct aoe_hwq *q, int idx)
+{
+	int i;
+
+	spin_lock_init(&q->lock);
+	q->d = d;
+	q->idx = idx;
+	INIT_LIST_HEAD(&q->rq_list);
+	INIT_LIST_HEAD(&q->ffree);
+	skb_queue_head_init(&q->skbpool);
+	for (i = 0; i < NFACTIVE; i++)
+		INIT_LIST_HEAD(&q->factive[i]);
+	INIT_LIST_HEAD(&q->rexmitq);
 }
 
 /* find it or allocate it */
@@ -470,19 +510,25 @@ aoedev_by_aoeaddr(ulong maj, int min, int do_alloc)
 		goto out;
 	}
 	d->ntargets = NTARGETS;
+	d->nhwq = rounddown_pow_of_two(min_t(uint, num_online_cpus(),
+					     AOE_MAXHWQ));
+	d->hwq = kcalloc(d->nhwq, sizeof(*d->hwq), GFP_ATOMIC);
+	if (!d->hwq) {
+		kfree(d->targets);
+		kfree(d);
+		d = NULL;
+		goto out;
+	}
+	for (i = 0; i < d->nhwq; i++)
+		hwqinit(d, &d->hwq[i], i);
 	INIT_WORK(&d->work, aoecmd_sleepwork);
 	spin_lock_init(&d->lock);
-	INIT_LIST_HEAD(&d->rq_list);
-	skb_queue_head_init(&d->skbpool);
 	timer_setup(&d->timer, dummy_timer, 0);
 	d->timer.expires = jiffies + HZ;
 	add_timer(&d->timer);
 	d->bufpool = NULL;	/* defer to aoeblk_gdalloc */
 	d->tgt = d->targets;
 	d->ref = 1;
-	for (i = 0; i < NFACTIVE; i++)
-		INIT_LIST_HEAD(&d->factive[i]);
-	INIT_LIST_HEAD(&d->rexmitq);
 	d->sysminor = sysminor;
 	d->aoemajor = maj;
 	d->aoeminor = min;
@@ -498,8 +544,6 @@ aoedev_by_aoeaddr(ulong maj, int min, int do_alloc)
 static void
 freetgt(struct aoedev *d, struct aoetgt *t)
 {
-	struct frame *f;
-	struct list_head *pos, *nx, *head;
 	struct aoeif *ifp;
 
 	for (ifp = t->ifs; ifp < &t->ifs[NAOEIFS]; ++ifp) {
@@ -507,15 +551,23 @@ freetgt(struct aoedev *d, struct aoetgt *t)
 			break;
 		dev_put(ifp->nd);
 	}
+	kfree(t);
+}
 
-	head = &t->ffree;
+static void
+freehwq(struct aoe_hwq *q)
+{
+	struct frame *f;
+	struct list_head *pos, *nx, *head;
+
+	head = &q->ffree;
 	list_for_each_safe(pos, nx, head) {
 		list_del(pos);
 		f = list_entry(pos, struct frame, head);
 		skbfree(f->skb);
 		kfree(f);
 	}
-	kfree(t);
+	skbpoolfree(q);
 }
 
 void
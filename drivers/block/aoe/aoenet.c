@@ -5,6 +5,7 @@
  */
 
 #include <linux/gfp.h>
+#include <linux/slab.h>
 #include <linux/hdreg.h>
 #include <linux/blkdev.h>
 #include <linux/netdevice.h>
@@ -33,8 +34,16 @@ static char aoe_iflist[IFLISTSZ];
 module_param_string(aoe_iflist, aoe_iflist, IFLISTSZ, 0600);
 MODULE_PARM_DESC(aoe_iflist, "aoe_iflist=dev1[,dev2...]");
 
-static wait_queue_head_t txwq;
-static struct ktstate kts;
+/* per-CPU transmit queues, each drained by its own kthread */
+struct aoe_txq {
+	spinlock_t lock;
+	struct sk_buff_head skbs;
+	wait_queue_head_t waitq;
+	struct ktstate kts;
+};
+
+static struct aoe_txq *txq;
+static int ntxq;
 
 #ifndef MODULE
 static int __init aoe_iflist_setup(char *str)
@@ -47,24 +56,27 @@ static int __init aoe_iflist_setup(char *str)
 __setup("aoe_iflist=", aoe_iflist_setup);
 #endif
 
-static spinlock_t txlock;
-static struct sk_buff_head skbtxq;
+static void
+aoenet_xmit_skb(struct sk_buff *skb)
+{
+	struct net_device *ifp = skb->dev;
+
+	if (dev_queue_xmit(skb) == NET_XMIT_DROP && net_ratelimit())
+		pr_warn("aoe: packet could not be sent on %s.  %s\n",
+			ifp ? ifp->name : "netif",
+			"consider increasing tx_queue_len");
+}
 
-/* enters with txlock held */
+/* enters with txq[id].lock held */
 static int
-tx(int id) __must_hold(&txlock)
+tx(int id) __must_hold(&txq[id].lock)
 {
 	struct sk_buff *skb;
-	struct net_device *ifp;
-
-	while ((skb = skb_dequeue(&skbtxq))) {
-		spin_unlock_irq(&txlock);
-		ifp = skb->dev;
-		if (dev_queue_xmit(skb) == NET_XMIT_DROP && net_ratelimit())
-			pr_warn("aoe: packet could not be sent on %s.  %s\n",
-				ifp ? ifp->name : "netif",
-				"consider increasing tx_queue_len");
-		spin_lock_irq(&txlock);
+
+	while ((skb = __skb_dequeue(&txq[id].skbs))) {
+		spin_unlock_irq(&txq[id].lock);
+		aoenet_xmit_skb(skb);
+		spin_lock_irq(&txq[id].lock);
 	}
 	return 0;
 }
@@ -109,19 +121,31 @@ set_aoe_iflist(const char __user *user_str, size_t size)
 	return 0;
 }
 
+/* Transmit right away when the caller allows it.  Callers holding
+ * a device lock with interrupts off hand the packets to the transmit
+ * thread of their CPU instead.
+ */
 void
 aoenet_xmit(struct sk_buff_head *queue)
 {
-	struct sk_buff *skb, *tmp;
+	struct sk_buff *skb;
+	struct aoe_txq *q;
 	ulong flags;
 
-	skb_queue_walk_safe(queue, skb, tmp) {
-		__skb_unlink(skb, queue);
-		spin_lock_irqsave(&txlock, flags);
-		skb_queue_tail(&skbtxq, skb);
-		spin_unlock_irqrestore(&txlock, flags);
-		wake_up(&txwq);
+	if (skb_queue_empty(queue))
+		return;
+
+	if (!in_irq() && !irqs_disabled()) {
+		while ((skb = __skb_dequeue(queue)))
+			aoenet_xmit_skb(skb);
+		return;
 	}
+
+	q = &txq[raw_smp_processor_id() % ntxq];
+	spin_lock_irqsave(&q->lock, flags);
+	skb_queue_splice_tail_init(queue, &q->skbs);
+	spin_unlock_irqrestore(&q->lock, flags);
+	wake_up(&q->waitq);
 }
 
 /*
@@ -196,19 +220,45 @@ static struct packet_type aoe_pt __read_mostly = {
 	.func = aoenet_rcv,
 };
 
+static void
+aoenet_txq_stop(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		aoe_ktstop(&txq[i].kts);
+		__skb_queue_purge(&txq[i].skbs);
+	}
+	kfree(txq);
+	txq = NULL;
+}
+
 int __init
 aoenet_init(void)
 {
-	skb_queue_head_init(&skbtxq);
-	init_waitqueue_head(&txwq);
-	spin_lock_init(&txlock);
-	kts.lock = &txlock;
-	kts.fn = tx;
-	kts.waitq = &txwq;
-	kts.id = 0;
-	snprintf(kts.name, sizeof(kts.name), "aoe_tx%d", kts.id);
-	if (aoe_ktstart(&kts))
-		return -EAGAIN;
+	struct aoe_txq *q;
+	int i;
+
+	ntxq = num_online_cpus();
+	txq = kcalloc(ntxq, sizeof(*txq), GFP_KERNEL);
+	if (!txq)
+		return -ENOMEM;
+
+	for (i = 0; i < ntxq; i++) {
+		q = &txq[i];
+		spin_lock_init(&q->lock);
+		__skb_queue_head_init(&q->skbs);
+		init_waitqueue_head(&q->waitq);
+		q->kts.lock = &q->lock;
+		q->kts.fn = tx;
+		q->kts.waitq = &q->waitq;
+		q->kts.id = i;
+		snprintf(q->kts.name, sizeof(q->kts.name), "aoe_tx%d", i);
+		if (aoe_ktstart(&q->kts)) {
+			aoenet_txq_stop(i);
+			return -EAGAIN;
+		}
+	}
 	dev_add_pack(&aoe_pt);
 	return 0;
 }
@@ -216,8 +266,7 @@ aoenet_init(void)
 void
 aoenet_exit(void)
 {
-	aoe_ktstop(&kts);
-	skb_queue_purge(&skbtxq);
+	aoenet_txq_stop(ntxq);
 	dev_remove_pack(&aoe_pt);
 }
 
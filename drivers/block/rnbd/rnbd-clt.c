@@ -22,6 +22,10 @@ MODULE_DESCRIPTION("RDMA Network Block Device Client");
 MODULE_LICENSE("GPL");
 
 static int rnbd_client_major;
+static unsigned int nr_poll_queues;
+module_param(nr_poll_queues, uint, 0444);
+MODULE_PARM_DESC(nr_poll_queues,
+		 "Number of polled hardware queues per session, capped to the number of online CPUs (default: 0)");
 static DEFINE_IDA(index_ida);
 static DEFINE_MUTEX(ida_lock);
 static DEFINE_MUTEX(sess_lock);
@@ -1114,6 +1118,12 @@ static void rnbd_clt_dev_kick_mq_queue(struct rnbd_clt_dev *dev,
 		blk_mq_delay_run_hw_queue(hctx, 10/*ms*/);
 }
 
+static inline unsigned int rnbd_poll_queue_idx(struct rnbd_clt_session *sess,
+					       struct blk_mq_hw_ctx *hctx)
+{
+	return hctx->queue_num - sess->tag_set.map[HCTX_TYPE_POLL].queue_offset;
+}
+
 static blk_status_t rnbd_queue_rq(struct blk_mq_hw_ctx *hctx,
 				   const struct blk_mq_queue_data *bd)
 {
@@ -1131,6 +1141,9 @@ static blk_status_t rnbd_queue_rq(struct blk_mq_hw_ctx *hctx,
 		rnbd_clt_dev_kick_mq_queue(dev, hctx, RNBD_DELAY_IFBUSY);
 		return BLK_STS_RESOURCE;
 	}
+	if (hctx->type == HCTX_TYPE_POLL)
+		rtrs_clt_permit_set_poll(iu->permit,
+					 rnbd_poll_queue_idx(dev->sess, hctx));
 
 	blk_mq_start_request(rq);
 	err = rnbd_client_xfer_request(dev, rq, iu);
@@ -1155,12 +1168,50 @@ static int rnbd_init_request(struct blk_mq_tag_set *set, struct request *rq,
 	return 0;
 }
 
+static int rnbd_rdma_poll(struct blk_mq_hw_ctx *hctx)
+{
+	struct rnbd_queue *q = hctx->driver_data;
+	struct rnbd_clt_session *sess = q->dev->sess;
+
+	return rtrs_clt_rdma_cq_direct(sess->rtrs,
+				       rnbd_poll_queue_idx(sess, hctx));
+}
+
+static int rnbd_rdma_map_queues(struct blk_mq_tag_set *set)
+{
+	struct rnbd_clt_session *sess = set->driver_data;
+
+	/* Reads and writes share the interrupt driven queues */
+	set->map[HCTX_TYPE_DEFAULT].nr_queues = num_online_cpus();
+	set->map[HCTX_TYPE_DEFAULT].queue_offset = 0;
+	set->map[HCTX_TYPE_READ].nr_queues = 0;
+	set->map[HCTX_TYPE_READ].queue_offset = 0;
+	blk_mq_map_queues(&set->map[HCTX_TYPE_DEFAULT]);
+
+	if (sess->nr_poll_queues) {
+		set->map[HCTX_TYPE_POLL].nr_queues = sess->nr_poll_queues;
+		set->map[HCTX_TYPE_POLL].queue_offset =
+			set->map[HCTX_TYPE_DEFAULT].nr_queues;
+		blk_mq_map_queues(&set->map[HCTX_TYPE_POLL]);
+	}
+
+	return 0;
+}
+
 static struct blk_mq_ops rnbd_mq_ops = {
 	.queue_rq	= rnbd_queue_rq,
 	.init_request	= rnbd_init_request,
 	.complete	= rnbd_softirq_done_fn,
 };
 
+static struct blk_mq_ops rnbd_mq_poll_ops = {
+	.queue_rq	= rnbd_queue_rq,
+	.init_request	= rnbd_init_request,
+	.complete	= rnbd_softirq_done_fn,
+	.map_queues	= rnbd_rdma_map_queues,
+	.poll		= rnbd_rdma_poll,
+};
+
 static int setup_mq_tags(struct rnbd_clt_session *sess)
 {
 	struct blk_mq_tag_set *tag_set = &sess->tag_set;
@@ -1173,6 +1224,16 @@ static int setup_mq_tags(struct rnbd_clt_session *sess)
 				  BLK_MQ_F_TAG_QUEUE_SHARED;
 	tag_set->cmd_size		= sizeof(struct rnbd_iu);
 	tag_set->nr_hw_queues	= num_online_cpus();
+	tag_set->driver_data	= sess;
+	if (sess->nr_poll_queues) {
+		/*
+		 * Polled queues are served by their own RTRS connections,
+		 * whose completions are reaped by rnbd_rdma_poll() only.
+		 */
+		tag_set->ops		= &rnbd_mq_poll_ops;
+		tag_set->nr_maps	= HCTX_MAX_TYPES;
+		tag_set->nr_hw_queues  += sess->nr_poll_queues;
+	}
 
 	return blk_mq_alloc_tag_set(tag_set);
 }
@@ -1198,6 +1259,7 @@ find_and_get_or_create_sess(const char *sessname,
 		.priv = sess,
 		.link_ev = rnbd_clt_link_ev,
 	};
+	sess->nr_poll_queues = min(nr_poll_queues, num_online_cpus());
 	/*
 	 * Nothing was found, establish rtrs connection and proceed further.
 	 */
@@ -1206,7 +1268,7 @@ find_and_get_or_create_sess(const char *sessname,
 				   sizeof(struct rnbd_iu),
 				   RECONNECT_DELAY, BMAX_SEGMENTS,
 				   BLK_MAX_SEGMENT_SIZE,
-				   MAX_RECONNECTS);
+				   MAX_RECONNECTS, sess->nr_poll_queues);
 	if (IS_ERR(sess->rtrs)) {
 		err = PTR_ERR(sess->rtrs);
 		goto wake_up_and_put;
@@ -1366,8 +1428,8 @@ static struct rnbd_clt_dev *init_dev(struct rnbd_clt_session *sess,
 	if (!dev)
 		return ERR_PTR(-ENOMEM);
 
-	dev->hw_queues = kcalloc(nr_cpu_ids, sizeof(*dev->hw_queues),
-				 GFP_KERNEL);
+	dev->hw_queues = kcalloc(sess->tag_set.nr_hw_queues,
+				 sizeof(*dev->hw_queues), GFP_KERNEL);
 	if (!dev->hw_queues) {
 		ret = -ENOMEM;
 		goto out_alloc;
@@ -81,6 +81,7 @@ struct rnbd_clt_session {
 	atomic_t		busy;
 	int			queue_depth;
 	u32			max_io_size;
+	u32			nr_poll_queues;
 	struct blk_mq_tag_set	tag_set;
 	struct mutex		lock; /* protects state and devs_list */
 	struct list_head        devs_list; /* list of struct rnbd_clt_dev */
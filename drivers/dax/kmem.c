@@ -3,6 +3,7 @@
 #include <linux/memremap.h>
 #include <linux/pagemap.h>
 #include <linux/memory.h>
+#include <linux/memory-tiers.h>
 #include <linux/module.h>
 #include <linux/device.h>
 #include <linux/pfn_t.h>
@@ -40,6 +41,58 @@ struct dax_kmem_data {
 	struct resource *res[];
 };
 
+static ssize_t promotions_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct dev_dax *dev_dax = to_dev_dax(dev);
+
+	return sprintf(buf, "%lu\n", node_tier_promotions(dev_dax->target_node));
+}
+static DEVICE_ATTR_RO(promotions);
+
+static ssize_t demotions_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct dev_dax *dev_dax = to_dev_dax(dev);
+
+	return sprintf(buf, "%lu\n", node_tier_demotions(dev_dax->target_node));
+}
+static DEVICE_ATTR_RO(demotions);
+
+/* Pages moved between DRAM and the node of the device, see memory-tiers.c */
+static struct attribute *dax_kmem_tier_attributes[] = {
+	&dev_attr_promotions.attr,
+	&dev_attr_demotions.attr,
+	NULL,
+};
+
+static const struct attribute_group dax_kmem_tier_attribute_group = {
+	.attrs = dax_kmem_tier_attributes,
+};
+
+static void dax_kmem_tier_add(struct dev_dax *dev_dax)
+{
+	if (!IS_ENABLED(CONFIG_DEV_DAX_KMEM_TIERING))
+		return;
+
+	node_set_lower_tier(dev_dax->target_node);
+	if (sysfs_create_group(&dev_dax->dev.kobj,
+			       &dax_kmem_tier_attribute_group))
+		dev_warn(&dev_dax->dev, "failed to create tiering attributes\n");
+}
+
+static void dax_kmem_tier_remove(struct dev_dax *dev_dax, bool removed)
+{
+	if (!IS_ENABLED(CONFIG_DEV_DAX_KMEM_TIERING))
+		return;
+
+	sysfs_remove_group(&dev_dax->dev.kobj, &dax_kmem_tier_attribute_group);
+
+	/* Memory that could not be removed is still slow, keep the tier */
+	if (removed)
+		node_clear_lower_tier(dev_dax->target_node);
+}
+
 static int dev_dax_kmem_probe(struct dev_dax *dev_dax)
 {
 	struct device *dev = &dev_dax->dev;
@@ -125,6 +178,7 @@ static int dev_dax_kmem_probe(struct dev_dax *dev_dax)
 	}
 
 	dev_set_drvdata(dev, data);
+	dax_kmem_tier_add(dev_dax);
 
 	return 0;
 
@@ -171,6 +225,8 @@ static int dev_dax_kmem_remove(struct dev_dax *dev_dax)
 				i, range.start, range.end);
 	}
 
+	dax_kmem_tier_remove(dev_dax, success >= dev_dax->nr_range);
+
 	if (success >= dev_dax->nr_range) {
 		kfree(data->res_name);
 		kfree(data);
@@ -189,6 +245,7 @@ static int dev_dax_kmem_remove(struct dev_dax *dev_dax)
 	 * permanently pinned as reserved by the unreleased
 	 * request_mem_region().
 	 */
+	dax_kmem_tier_remove(dev_dax, false);
 	any_hotremove_failed = true;
 	return 0;
 }
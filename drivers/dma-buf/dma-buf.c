@@ -1172,6 +1172,82 @@ int dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 }
 EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access);
 
+/**
+ * dma_buf_begin_cpu_access_partial - Must be called before accessing a range
+ * of a dma_buf from the cpu in the kernel context. Calls
+ * begin_cpu_access_partial, or begin_cpu_access for the whole buffer if the
+ * exporter doesn't implement it.
+ * @dmabuf:	[in]	buffer to prepare cpu access for.
+ * @direction:	[in]	direction of cpu access.
+ * @offset:	[in]	offset of the range for cpu access.
+ * @len:	[in]	length of the range for cpu access.
+ *
+ * Like dma_buf_begin_cpu_access(), but coherency is only guaranteed for the
+ * given range, until dma_buf_end_cpu_access_partial() is called for it.
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+				     enum dma_data_direction direction,
+				     unsigned int offset, unsigned int len)
+{
+	int ret = 0;
+
+	if (WARN_ON(!dmabuf))
+		return -EINVAL;
+
+	if (!len || offset > dmabuf->size || len > dmabuf->size - offset)
+		return -EINVAL;
+
+	if (dmabuf->ops->begin_cpu_access_partial)
+		ret = dmabuf->ops->begin_cpu_access_partial(dmabuf, direction,
+							    offset, len);
+	else if (dmabuf->ops->begin_cpu_access)
+		ret = dmabuf->ops->begin_cpu_access(dmabuf, direction);
+
+	/* Ensure that all fences are waited upon, as for the whole buffer */
+	if (ret == 0)
+		ret = __dma_buf_begin_cpu_access(dmabuf, direction);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_begin_cpu_access_partial);
+
+/**
+ * dma_buf_end_cpu_access_partial - Must be called after accessing a range of
+ * a dma_buf from the cpu in the kernel context. Calls end_cpu_access_partial,
+ * or end_cpu_access for the whole buffer if the exporter doesn't implement
+ * it.
+ * @dmabuf:	[in]	buffer to complete cpu access for.
+ * @direction:	[in]	direction of cpu access.
+ * @offset:	[in]	offset of the range for cpu access.
+ * @len:	[in]	length of the range for cpu access.
+ *
+ * This terminates CPU access started with dma_buf_begin_cpu_access_partial().
+ *
+ * Can return negative error values, returns 0 on success.
+ */
+int dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+				   enum dma_data_direction direction,
+				   unsigned int offset, unsigned int len)
+{
+	int ret = 0;
+
+	WARN_ON(!dmabuf);
+
+	if (!len || offset > dmabuf->size || len > dmabuf->size - offset)
+		return -EINVAL;
+
+	if (dmabuf->ops->end_cpu_access_partial)
+		ret = dmabuf->ops->end_cpu_access_partial(dmabuf, direction,
+							  offset, len);
+	else if (dmabuf->ops->end_cpu_access)
+		ret = dmabuf->ops->end_cpu_access(dmabuf, direction);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(dma_buf_end_cpu_access_partial);
+
 
 /**
  * dma_buf_mmap - Setup up a userspace mmap with the given vma
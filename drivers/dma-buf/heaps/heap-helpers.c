@@ -83,10 +83,18 @@ static void dma_heap_buffer_vmap_put(struct heap_helper_buffer *buffer)
 	}
 }
 
+/*
+ * The DMA mapping of an attachment is made on its first map and kept until
+ * it is detached: mapping and unmapping it again for every use, as
+ * importers like video pipelines do per frame, only costs IOMMU page table
+ * updates and TLB invalidations. Later map/unmap calls only do the cache
+ * maintenance for their direction.
+ */
 struct dma_heaps_attachment {
 	struct device *dev;
 	struct sg_table table;
 	struct list_head list;
+	bool mapped;
 };
 
 static int dma_heap_attach(struct dma_buf *dmabuf,
@@ -111,6 +119,7 @@ static int dma_heap_attach(struct dma_buf *dmabuf,
 
 	a->dev = attachment->dev;
 	INIT_LIST_HEAD(&a->list);
+	a->mapped = false;
 
 	attachment->priv = a;
 
@@ -131,6 +140,10 @@ static void dma_heap_detach(struct dma_buf *dmabuf,
 	list_del(&a->list);
 	mutex_unlock(&buffer->lock);
 
+	/* The CPU sync was done by the last unmap */
+	if (a->mapped)
+		dma_unmap_sgtable(a->dev, &a->table, DMA_BIDIRECTIONAL,
+				  DMA_ATTR_SKIP_CPU_SYNC);
 	sg_free_table(&a->table);
 	kfree(a);
 }
@@ -140,12 +153,23 @@ struct sg_table *dma_heap_map_dma_buf(struct dma_buf_attachment *attachment,
 				      enum dma_data_direction direction)
 {
 	struct dma_heaps_attachment *a = attachment->priv;
+	struct heap_helper_buffer *buffer = attachment->dmabuf->priv;
 	struct sg_table *table = &a->table;
-	int ret;
+	int ret = 0;
+
+	mutex_lock(&buffer->lock);
+	if (!a->mapped) {
+		/* Map it for any direction, so that the mapping can be reused */
+		ret = dma_map_sgtable(attachment->dev, table, DMA_BIDIRECTIONAL,
+				      DMA_ATTR_SKIP_CPU_SYNC);
+		a->mapped = !ret;
+	}
+	mutex_unlock(&buffer->lock);
 
-	ret = dma_map_sgtable(attachment->dev, table, direction, 0);
 	if (ret)
-		table = ERR_PTR(ret);
+		return ERR_PTR(ret);
+
+	dma_sync_sgtable_for_device(attachment->dev, table, direction);
 	return table;
 }
 
@@ -153,7 +177,8 @@ static void dma_heap_unmap_dma_buf(struct dma_buf_attachment *attachment,
 				   struct sg_table *table,
 				   enum dma_data_direction direction)
 {
-	dma_unmap_sgtable(attachment->dev, table, direction, 0);
+	/* Keep the mapping for the next map, just hand the pages back */
+	dma_sync_sgtable_for_cpu(attachment->dev, table, direction);
 }
 
 static vm_fault_t dma_heap_vm_fault(struct vm_fault *vmf)
@@ -207,8 +232,9 @@ static int dma_heap_dma_buf_begin_cpu_access(struct dma_buf *dmabuf,
 		invalidate_kernel_vmap_range(buffer->vaddr, buffer->size);
 
 	list_for_each_entry(a, &buffer->attachments, list) {
-		dma_sync_sg_for_cpu(a->dev, a->table.sgl, a->table.nents,
-				    direction);
+		if (!a->mapped)
+			continue;
+		dma_sync_sgtable_for_cpu(a->dev, &a->table, direction);
 	}
 	mutex_unlock(&buffer->lock);
 
@@ -227,8 +253,91 @@ static int dma_heap_dma_buf_end_cpu_access(struct dma_buf *dmabuf,
 		flush_kernel_vmap_range(buffer->vaddr, buffer->size);
 
 	list_for_each_entry(a, &buffer->attachments, list) {
-		dma_sync_sg_for_device(a->dev, a->table.sgl, a->table.nents,
-				       direction);
+		if (!a->mapped)
+			continue;
+		dma_sync_sgtable_for_device(a->dev, &a->table, direction);
+	}
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
+/*
+ * Sync only the scatterlist entries of an attachment which overlap
+ * [offset, offset + len). The entries are physically contiguous, so
+ * this limits the cache maintenance to the range rounded out to them.
+ */
+static void dma_heap_sync_range(struct dma_heaps_attachment *a,
+				unsigned int offset, unsigned int len,
+				enum dma_data_direction direction,
+				bool for_cpu)
+{
+	struct scatterlist *sg, *first = NULL;
+	size_t pos = 0, end = (size_t)offset + len;
+	unsigned int i, nents = 0;
+
+	for_each_sgtable_sg(&a->table, sg, i) {
+		if (pos >= end)
+			break;
+		if (pos + sg->length > offset) {
+			if (!first)
+				first = sg;
+			nents++;
+		}
+		pos += sg->length;
+	}
+
+	if (!first)
+		return;
+
+	if (for_cpu)
+		dma_sync_sg_for_cpu(a->dev, first, nents, direction);
+	else
+		dma_sync_sg_for_device(a->dev, first, nents, direction);
+}
+
+static int
+dma_heap_dma_buf_begin_cpu_access_partial(struct dma_buf *dmabuf,
+					  enum dma_data_direction direction,
+					  unsigned int offset,
+					  unsigned int len)
+{
+	struct heap_helper_buffer *buffer = dmabuf->priv;
+	struct dma_heaps_attachment *a;
+
+	mutex_lock(&buffer->lock);
+
+	if (buffer->vmap_cnt)
+		invalidate_kernel_vmap_range(buffer->vaddr + offset, len);
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		dma_heap_sync_range(a, offset, len, direction, true);
+	}
+	mutex_unlock(&buffer->lock);
+
+	return 0;
+}
+
+static int
+dma_heap_dma_buf_end_cpu_access_partial(struct dma_buf *dmabuf,
+					enum dma_data_direction direction,
+					unsigned int offset,
+					unsigned int len)
+{
+	struct heap_helper_buffer *buffer = dmabuf->priv;
+	struct dma_heaps_attachment *a;
+
+	mutex_lock(&buffer->lock);
+
+	if (buffer->vmap_cnt)
+		flush_kernel_vmap_range(buffer->vaddr + offset, len);
+
+	list_for_each_entry(a, &buffer->attachments, list) {
+		if (!a->mapped)
+			continue;
+		dma_heap_sync_range(a, offset, len, direction, false);
 	}
 	mutex_unlock(&buffer->lock);
 
@@ -265,6 +374,8 @@ const struct dma_buf_ops heap_helper_ops = {
 	.detach = dma_heap_detach,
 	.begin_cpu_access = dma_heap_dma_buf_begin_cpu_access,
 	.end_cpu_access = dma_heap_dma_buf_end_cpu_access,
+	.begin_cpu_access_partial = dma_heap_dma_buf_begin_cpu_access_partial,
+	.end_cpu_access_partial = dma_heap_dma_buf_end_cpu_access_partial,
 	.vmap = dma_heap_dma_buf_vmap,
 	.vunmap = dma_heap_dma_buf_vunmap,
 };
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * DMA BUF page pool system
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * Based on the ION page pool code
+ */
+
+#include <linux/highmem.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sched/signal.h>
+#include <linux/shrinker.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "page_pool.h"
+
+static LIST_HEAD(pool_list);
+static DEFINE_MUTEX(pool_list_lock);
+
+static void dmabuf_page_pool_refill_fn(struct work_struct *work);
+static DECLARE_WORK(pool_refill_work, dmabuf_page_pool_refill_fn);
+
+static inline
+struct page *dmabuf_page_pool_alloc_pages(struct dmabuf_page_pool *pool)
+{
+	if (fatal_signal_pending(current))
+		return NULL;
+	return alloc_pages(pool->gfp_mask, pool->order);
+}
+
+static inline void dmabuf_page_pool_free_pages(struct dmabuf_page_pool *pool,
+					       struct page *page)
+{
+	__free_pages(page, pool->order);
+}
+
+static void dmabuf_page_pool_zero(struct dmabuf_page_pool *pool,
+				  struct page *page)
+{
+	int i;
+
+	for (i = 0; i < (1 << pool->order); i++) {
+		clear_highpage(page + i);
+		cond_resched();
+	}
+}
+
+static void dmabuf_page_pool_add(struct dmabuf_page_pool *pool,
+				 struct page *page, bool clean)
+{
+	spin_lock(&pool->lock);
+	if (clean) {
+		list_add_tail(&page->lru, &pool->clean_items);
+		pool->clean_count++;
+	} else {
+		list_add_tail(&page->lru, &pool->dirty_items);
+		pool->dirty_count++;
+	}
+	spin_unlock(&pool->lock);
+
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    1 << pool->order);
+}
+
+static struct page *dmabuf_page_pool_remove(struct dmabuf_page_pool *pool,
+					    bool clean)
+{
+	struct page *page;
+
+	spin_lock(&pool->lock);
+	if (clean && pool->clean_count) {
+		page = list_first_entry(&pool->clean_items, struct page, lru);
+		pool->clean_count--;
+	} else if (!clean && pool->dirty_count) {
+		page = list_first_entry(&pool->dirty_items, struct page, lru);
+		pool->dirty_count--;
+	} else {
+		spin_unlock(&pool->lock);
+		return NULL;
+	}
+	list_del(&page->lru);
+	spin_unlock(&pool->lock);
+
+	mod_node_page_state(page_pgdat(page), NR_KERNEL_MISC_RECLAIMABLE,
+			    -(1 << pool->order));
+	return page;
+}
+
+static bool dmabuf_page_pool_needs_work(struct dmabuf_page_pool *pool)
+{
+	return READ_ONCE(pool->dirty_count) ||
+	       READ_ONCE(pool->clean_count) < pool->fill_count;
+}
+
+/*
+ * Zero the pages given back to the pools, then top the pools up to their
+ * fill count, but only from memory which is free already: it is not worth
+ * reclaiming anything for pages nobody has asked for yet.
+ */
+static void dmabuf_page_pool_refill_fn(struct work_struct *work)
+{
+	struct dmabuf_page_pool *pool;
+	struct page *page;
+
+	mutex_lock(&pool_list_lock);
+	list_for_each_entry(pool, &pool_list, list) {
+		while ((page = dmabuf_page_pool_remove(pool, false))) {
+			dmabuf_page_pool_zero(pool, page);
+			dmabuf_page_pool_add(pool, page, true);
+		}
+
+		while (READ_ONCE(pool->clean_count) < pool->fill_count) {
+			page = alloc_pages((pool->gfp_mask | __GFP_NOWARN |
+					    __GFP_NORETRY) & ~__GFP_RECLAIM,
+					   pool->order);
+			if (!page)
+				break;
+			dmabuf_page_pool_add(pool, page, true);
+		}
+	}
+	mutex_unlock(&pool_list_lock);
+}
+
+static void dmabuf_page_pool_kick(struct dmabuf_page_pool *pool)
+{
+	if (dmabuf_page_pool_needs_work(pool))
+		queue_work(system_unbound_wq, &pool_refill_work);
+}
+
+struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool)
+{
+	struct page *page;
+
+	if (WARN_ON(!pool))
+		return NULL;
+
+	page = dmabuf_page_pool_remove(pool, true);
+	if (!page) {
+		/*
+		 * Zeroing a page given back is as cheap as zeroing a new
+		 * one, and more likely to work for the high orders.
+		 */
+		page = dmabuf_page_pool_remove(pool, false);
+		if (page)
+			dmabuf_page_pool_zero(pool, page);
+		else
+			page = dmabuf_page_pool_alloc_pages(pool);
+	}
+
+	dmabuf_page_pool_kick(pool);
+	return page;
+}
+
+void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page)
+{
+	if (WARN_ON(pool->order != compound_order(page)))
+		return;
+
+	if (READ_ONCE(pool->clean_count) + READ_ONCE(pool->dirty_count) >=
+	    pool->max_count) {
+		dmabuf_page_pool_free_pages(pool, page);
+		return;
+	}
+
+	dmabuf_page_pool_add(pool, page, false);
+	dmabuf_page_pool_kick(pool);
+}
+
+static int dmabuf_page_pool_total(struct dmabuf_page_pool *pool)
+{
+	return (READ_ONCE(pool->clean_count) + READ_ONCE(pool->dirty_count))
+		<< pool->order;
+}
+
+static int dmabuf_page_pool_do_shrink(struct dmabuf_page_pool *pool,
+				      int nr_to_scan)
+{
+	int freed = 0;
+
+	while (freed < nr_to_scan) {
+		struct page *page;
+
+		/* Give back what is still dirty first, it is the least ready */
+		page = dmabuf_page_pool_remove(pool, false);
+		if (!page)
+			page = dmabuf_page_pool_remove(pool, true);
+		if (!page)
+			break;
+
+		dmabuf_page_pool_free_pages(pool, page);
+		freed += (1 << pool->order);
+	}
+
+	return freed;
+}
+
+struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
+						 unsigned int order,
+						 unsigned int fill_count,
+						 unsigned int max_count)
+{
+	struct dmabuf_page_pool *pool = kmalloc(sizeof(*pool), GFP_KERNEL);
+
+	if (!pool)
+		return NULL;
+	pool->clean_count = 0;
+	pool->dirty_count = 0;
+	INIT_LIST_HEAD(&pool->clean_items);
+	INIT_LIST_HEAD(&pool->dirty_items);
+	pool->fill_count = fill_count;
+	pool->max_count = max(max_count, fill_count);
+	pool->gfp_mask = gfp_mask | __GFP_COMP;
+	pool->order = order;
+	spin_lock_init(&pool->lock);
+
+	mutex_lock(&pool_list_lock);
+	list_add(&pool->list, &pool_list);
+	mutex_unlock(&pool_list_lock);
+
+	dmabuf_page_pool_kick(pool);
+
+	return pool;
+}
+
+void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool)
+{
+	struct page *page;
+
+	/* Remove us from the pool list */
+	mutex_lock(&pool_list_lock);
+	list_del(&pool->list);
+	mutex_unlock(&pool_list_lock);
+
+	/* Free any remaining pages in the pool */
+	while ((page = dmabuf_page_pool_remove(pool, false)))
+		dmabuf_page_pool_free_pages(pool, page);
+	while ((page = dmabuf_page_pool_remove(pool, true)))
+		dmabuf_page_pool_free_pages(pool, page);
+
+	kfree(pool);
+}
+
+static unsigned long dmabuf_page_pool_shrink_count(struct shrinker *shrinker,
+						   struct shrink_control *sc)
+{
+	struct dmabuf_page_pool *pool;
+	unsigned long count = 0;
+
+	/* The refill worker may hold the lock for a while, don't wait */
+	if (!mutex_trylock(&pool_list_lock))
+		return 0;
+	list_for_each_entry(pool, &pool_list, list)
+		count += dmabuf_page_pool_total(pool);
+	mutex_unlock(&pool_list_lock);
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long dmabuf_page_pool_shrink_scan(struct shrinker *shrinker,
+						  struct shrink_control *sc)
+{
+	struct dmabuf_page_pool *pool;
+	int nr_to_scan = sc->nr_to_scan;
+	unsigned long freed = 0;
+
+	if (!mutex_trylock(&pool_list_lock))
+		return SHRINK_STOP;
+	list_for_each_entry(pool, &pool_list, list) {
+		freed += dmabuf_page_pool_do_shrink(pool, nr_to_scan - freed);
+		if (freed >= nr_to_scan)
+			break;
+	}
+	mutex_unlock(&pool_list_lock);
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker pool_shrinker = {
+	.count_objects = dmabuf_page_pool_shrink_count,
+	.scan_objects = dmabuf_page_pool_shrink_scan,
+	.seeks = DEFAULT_SEEKS,
+	.batch = 0,
+};
+
+static int dmabuf_page_pool_init_shrinker(void)
+{
+	return register_shrinker(&pool_shrinker);
+}
+module_init(dmabuf_page_pool_init_shrinker);
+MODULE_LICENSE("GPL v2");
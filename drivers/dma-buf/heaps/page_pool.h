@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * DMA BUF page pool system
+ *
+ * Copyright (C) 2011 Google, Inc.
+ *
+ * Based on the ION page pool code
+ */
+
+#ifndef _DMABUF_PAGE_POOL_H
+#define _DMABUF_PAGE_POOL_H
+
+#include <linux/list.h>
+#include <linux/mm_types.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/**
+ * struct dmabuf_page_pool - pagepool struct
+ * @clean_count:	number of zeroed items in the pool
+ * @dirty_count:	number of items returned to the pool, not zeroed yet
+ * @clean_items:	list of zeroed pages
+ * @dirty_items:	list of pages which still hold buffer contents
+ * @fill_count:		number of zeroed items kept ready by the refill worker
+ * @max_count:		number of items beyond which freed pages are returned
+ *			to the system
+ * @lock:		lock protecting this struct and especially the counts
+ *			and item lists
+ * @gfp_mask:		gfp_mask to use from alloc
+ * @order:		order of pages in the pool
+ * @list:		list node for list of pools
+ *
+ * Allows you to keep a pool of pre allocated and zeroed pages to use from
+ * your heap. Keeping a pool of pages that is ready for dma, ie any cached
+ * mapping have been invalidated from the cache, provides a significant
+ * performance benefit on many systems. Pages given back are zeroed by a
+ * background worker before they can be handed out again, and the pools
+ * are shrunk under memory pressure.
+ */
+struct dmabuf_page_pool {
+	unsigned int clean_count;
+	unsigned int dirty_count;
+	struct list_head clean_items;
+	struct list_head dirty_items;
+	unsigned int fill_count;
+	unsigned int max_count;
+	spinlock_t lock;
+	gfp_t gfp_mask;
+	unsigned int order;
+	struct list_head list;
+};
+
+struct dmabuf_page_pool *dmabuf_page_pool_create(gfp_t gfp_mask,
+						 unsigned int order,
+						 unsigned int fill_count,
+						 unsigned int max_count);
+void dmabuf_page_pool_destroy(struct dmabuf_page_pool *pool);
+struct page *dmabuf_page_pool_alloc(struct dmabuf_page_pool *pool);
+void dmabuf_page_pool_free(struct dmabuf_page_pool *pool, struct page *page);
+
+#endif /* _DMABUF_PAGE_POOL_H */
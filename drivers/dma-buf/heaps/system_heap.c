@@ -19,19 +19,95 @@
 #include <asm/page.h>
 
 #include "heap-helpers.h"
+#include "page_pool.h"
 
 struct dma_heap *sys_heap;
 
-static void system_heap_free(struct heap_helper_buffer *buffer)
+#define HIGH_ORDER_GFP  (((GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN \
+				| __GFP_NORETRY) & ~__GFP_RECLAIM) \
+				| __GFP_COMP)
+#define MID_ORDER_GFP (GFP_KERNEL | __GFP_ZERO | __GFP_NOWARN | \
+		       __GFP_NORETRY | __GFP_COMP)
+#define LOW_ORDER_GFP (GFP_KERNEL | __GFP_ZERO | __GFP_COMP)
+
+/*
+ * The largest chunks come first: an order-8 page is a single 1MB
+ * scatterlist entry, which IOMMUs can often map with a few block entries.
+ * Keep a few of each zeroed and ready, and recycle freed buffers up to a
+ * limit, leaving the rest to the shrinker.
+ */
+static const struct {
+	unsigned int order;
+	gfp_t gfp;
+	unsigned int fill_count;
+	unsigned int max_count;
+} pool_info[] = {
+	{ 8, HIGH_ORDER_GFP,   4,   32 },	/* 4MB ready, up to 32MB */
+	{ 4, MID_ORDER_GFP,   16,  128 },	/* 1MB ready, up to 8MB */
+	{ 0, LOW_ORDER_GFP,  256, 2048 },	/* 1MB ready, up to 8MB */
+};
+
+#define NUM_ORDERS ARRAY_SIZE(pool_info)
+
+static struct dmabuf_page_pool *pools[NUM_ORDERS];
+
+static void system_heap_free_page(struct page *page)
 {
-	pgoff_t pg;
+	unsigned int order = compound_order(page);
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (order == pool_info[i].order) {
+			dmabuf_page_pool_free(pools[i], page);
+			return;
+		}
+	}
+	__free_pages(page, order);
+}
+
+/*
+ * buffer->pages has an entry for every PAGE_SIZE page, the first of which
+ * is the head of the compound page it was allocated as.
+ */
+static void system_heap_free_pages(struct page **pages, pgoff_t pagecount)
+{
+	pgoff_t pg = 0;
+
+	while (pg < pagecount) {
+		struct page *page = pages[pg];
 
-	for (pg = 0; pg < buffer->pagecount; pg++)
-		__free_page(buffer->pages[pg]);
+		pg += 1 << compound_order(page);
+		system_heap_free_page(page);
+	}
+}
+
+static void system_heap_free(struct heap_helper_buffer *buffer)
+{
+	system_heap_free_pages(buffer->pages, buffer->pagecount);
 	kfree(buffer->pages);
 	kfree(buffer);
 }
 
+static struct page *alloc_largest_available(unsigned long size,
+					    unsigned int max_order)
+{
+	struct page *page;
+	int i;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		if (size < (PAGE_SIZE << pool_info[i].order))
+			continue;
+		if (max_order < pool_info[i].order)
+			continue;
+
+		page = dmabuf_page_pool_alloc(pools[i]);
+		if (!page)
+			continue;
+		return page;
+	}
+	return NULL;
+}
+
 static int system_heap_allocate(struct dma_heap *heap,
 				unsigned long len,
 				unsigned long fd_flags,
@@ -39,8 +115,9 @@ static int system_heap_allocate(struct dma_heap *heap,
 {
 	struct heap_helper_buffer *helper_buffer;
 	struct dma_buf *dmabuf;
+	unsigned int max_order = pool_info[0].order;
 	int ret = -ENOMEM;
-	pgoff_t pg;
+	pgoff_t pg, i;
 
 	helper_buffer = kzalloc(sizeof(*helper_buffer), GFP_KERNEL);
 	if (!helper_buffer)
@@ -59,7 +136,10 @@ static int system_heap_allocate(struct dma_heap *heap,
 		goto err0;
 	}
 
-	for (pg = 0; pg < helper_buffer->pagecount; pg++) {
+	pg = 0;
+	while (pg < helper_buffer->pagecount) {
+		struct page *page;
+
 		/*
 		 * Avoid trying to allocate memory if the process
 		 * has been killed by by SIGKILL
@@ -67,9 +147,15 @@ static int system_heap_allocate(struct dma_heap *heap,
 		if (fatal_signal_pending(current))
 			goto err1;
 
-		helper_buffer->pages[pg] = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (!helper_buffer->pages[pg])
+		page = alloc_largest_available((helper_buffer->pagecount - pg)
+					       << PAGE_SHIFT, max_order);
+		if (!page)
 			goto err1;
+
+		/* Later chunks won't be found any bigger than this one */
+		max_order = compound_order(page);
+		for (i = 0; i < (1 << max_order); i++)
+			helper_buffer->pages[pg++] = page + i;
 	}
 
 	/* create the dmabuf */
@@ -91,8 +177,7 @@ static int system_heap_allocate(struct dma_heap *heap,
 	return ret;
 
 err1:
-	while (pg > 0)
-		__free_page(helper_buffer->pages[--pg]);
+	system_heap_free_pages(helper_buffer->pages, pg);
 	kfree(helper_buffer->pages);
 err0:
 	kfree(helper_buffer);
@@ -107,16 +192,35 @@ static const struct dma_heap_ops system_heap_ops = {
 static int system_heap_create(void)
 {
 	struct dma_heap_export_info exp_info;
-	int ret = 0;
+	int i, ret = 0;
+
+	for (i = 0; i < NUM_ORDERS; i++) {
+		pools[i] = dmabuf_page_pool_create(pool_info[i].gfp,
+						   pool_info[i].order,
+						   pool_info[i].fill_count,
+						   pool_info[i].max_count);
+		if (!pools[i]) {
+			pr_err("%s: page pool creation failed!\n", __func__);
+			ret = -ENOMEM;
+			goto err_pools;
+		}
+	}
 
 	exp_info.name = "system";
 	exp_info.ops = &system_heap_ops;
 	exp_info.priv = NULL;
 
 	sys_heap = dma_heap_add(&exp_info);
-	if (IS_ERR(sys_heap))
+	if (IS_ERR(sys_heap)) {
 		ret = PTR_ERR(sys_heap);
+		goto err_pools;
+	}
+
+	return 0;
 
+err_pools:
+	while (i-- > 0)
+		dmabuf_page_pool_destroy(pools[i]);
 	return ret;
 }
 module_init(system_heap_create);
@@ -3,11 +3,14 @@
 #include <linux/device.h>
 #include <linux/dma-buf.h>
 #include <linux/highmem.h>
+#include <linux/hugetlb.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/memfd.h>
 #include <linux/miscdevice.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/pagemap.h>
 #include <linux/shmem_fs.h>
 #include <linux/slab.h>
 #include <linux/udmabuf.h>
@@ -20,6 +23,19 @@ struct udmabuf {
 	struct page **pages;
 	struct sg_table *sg;
 	struct miscdevice *device;
+	struct mutex sg_lock;
+	struct list_head sg_cache;
+};
+
+/*
+ * The mapping of the buffer for a device, kept from its first map until
+ * the buffer is released, so that importers attaching and mapping the
+ * buffer again for every frame don't rebuild and remap the sg table.
+ */
+struct udmabuf_sg_cache {
+	struct list_head list;
+	struct device *dev;
+	struct sg_table *sg;
 };
 
 static vm_fault_t udmabuf_vm_fault(struct vm_fault *vmf)
@@ -85,22 +101,62 @@ static void put_sg_table(struct device *dev, struct sg_table *sg,
 static struct sg_table *map_udmabuf(struct dma_buf_attachment *at,
 				    enum dma_data_direction direction)
 {
-	return get_sg_table(at->dev, at->dmabuf, direction);
+	struct udmabuf *ubuf = at->dmabuf->priv;
+	struct udmabuf_sg_cache *cache;
+	struct sg_table *sg;
+
+	mutex_lock(&ubuf->sg_lock);
+	list_for_each_entry(cache, &ubuf->sg_cache, list) {
+		if (cache->dev == at->dev) {
+			sg = cache->sg;
+			mutex_unlock(&ubuf->sg_lock);
+			dma_sync_sgtable_for_device(at->dev, sg, direction);
+			return sg;
+		}
+	}
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache) {
+		sg = ERR_PTR(-ENOMEM);
+		goto out;
+	}
+
+	/* Mapped for any direction, to be reused by any later map */
+	sg = get_sg_table(at->dev, at->dmabuf, DMA_BIDIRECTIONAL);
+	if (IS_ERR(sg)) {
+		kfree(cache);
+		goto out;
+	}
+
+	cache->dev = get_device(at->dev);
+	cache->sg = sg;
+	list_add(&cache->list, &ubuf->sg_cache);
+out:
+	mutex_unlock(&ubuf->sg_lock);
+	return sg;
 }
 
 static void unmap_udmabuf(struct dma_buf_attachment *at,
 			  struct sg_table *sg,
 			  enum dma_data_direction direction)
 {
-	return put_sg_table(at->dev, sg, direction);
+	/* The mapping stays cached until release, just hand it back */
+	dma_sync_sgtable_for_cpu(at->dev, sg, direction);
 }
 
 static void release_udmabuf(struct dma_buf *buf)
 {
 	struct udmabuf *ubuf = buf->priv;
 	struct device *dev = ubuf->device->this_device;
+	struct udmabuf_sg_cache *cache, *tmp;
 	pgoff_t pg;
 
+	list_for_each_entry_safe(cache, tmp, &ubuf->sg_cache, list) {
+		put_sg_table(cache->dev, cache->sg, DMA_BIDIRECTIONAL);
+		put_device(cache->dev);
+		kfree(cache);
+	}
+
 	if (ubuf->sg)
 		put_sg_table(dev, ubuf->sg, DMA_BIDIRECTIONAL);
 
@@ -154,6 +210,70 @@ static const struct dma_buf_ops udmabuf_ops = {
 #define SEALS_WANTED (F_SEAL_SHRINK)
 #define SEALS_DENIED (F_SEAL_WRITE)
 
+/*
+ * Hugetlbfs page cache is indexed in huge pages: look each one up once and
+ * take a reference on its subpages covering the range.
+ */
+static int udmabuf_pin_hugetlb(struct udmabuf *ubuf, struct file *memfd,
+			       pgoff_t pgoff, pgoff_t pgcnt, pgoff_t *pgbuf)
+{
+	struct hstate *hpstate = hstate_file(memfd);
+	pgoff_t subpgs = huge_page_size(hpstate) >> PAGE_SHIFT;
+	pgoff_t mapidx = pgoff / subpgs;
+	pgoff_t subpgoff = pgoff % subpgs;
+	struct page *hpage;
+
+	while (pgcnt) {
+		hpage = find_get_page_flags(memfd->f_mapping, mapidx,
+					    FGP_ACCESSED);
+		if (!hpage)
+			return -EINVAL;
+
+		for (; subpgoff < subpgs && pgcnt; subpgoff++, pgcnt--) {
+			get_page(hpage + subpgoff);
+			ubuf->pages[(*pgbuf)++] = hpage + subpgoff;
+		}
+		put_page(hpage);
+
+		subpgoff = 0;
+		mapidx++;
+	}
+
+	return 0;
+}
+
+/*
+ * Shmem may back the memfd with transparent huge pages: when it does, all
+ * the subpages of the huge page come from a single lookup.
+ */
+static int udmabuf_pin_shmem(struct udmabuf *ubuf, struct file *memfd,
+			     pgoff_t pgoff, pgoff_t pgcnt, pgoff_t *pgbuf)
+{
+	pgoff_t pgidx = 0;
+	struct page *page, *head;
+
+	while (pgidx < pgcnt) {
+		page = shmem_read_mapping_page(file_inode(memfd)->i_mapping,
+					       pgoff + pgidx);
+		if (IS_ERR(page))
+			return PTR_ERR(page);
+		ubuf->pages[(*pgbuf)++] = page;
+		pgidx++;
+
+		if (!PageTransCompound(page))
+			continue;
+
+		head = compound_head(page);
+		for (page++; page < head + compound_nr(head) && pgidx < pgcnt;
+		     page++, pgidx++) {
+			get_page(page);
+			ubuf->pages[(*pgbuf)++] = page;
+		}
+	}
+
+	return 0;
+}
+
 static long udmabuf_create(struct miscdevice *device,
 			   struct udmabuf_create_list *head,
 			   struct udmabuf_create_item *list)
@@ -162,14 +282,15 @@ static long udmabuf_create(struct miscdevice *device,
 	struct file *memfd = NULL;
 	struct udmabuf *ubuf;
 	struct dma_buf *buf;
-	pgoff_t pgoff, pgcnt, pgidx, pgbuf = 0, pglimit;
-	struct page *page;
+	pgoff_t pgoff, pgcnt, pgbuf = 0, pglimit;
 	int seals, ret = -EINVAL;
 	u32 i, flags;
 
 	ubuf = kzalloc(sizeof(*ubuf), GFP_KERNEL);
 	if (!ubuf)
 		return -ENOMEM;
+	mutex_init(&ubuf->sg_lock);
+	INIT_LIST_HEAD(&ubuf->sg_cache);
 
 	pglimit = (size_limit_mb * 1024 * 1024) >> PAGE_SHIFT;
 	for (i = 0; i < head->count; i++) {
@@ -194,7 +315,8 @@ static long udmabuf_create(struct miscdevice *device,
 		memfd = fget(list[i].memfd);
 		if (!memfd)
 			goto err;
-		if (!shmem_mapping(file_inode(memfd)->i_mapping))
+		if (!shmem_mapping(file_inode(memfd)->i_mapping) &&
+		    !is_file_hugepages(memfd))
 			goto err;
 		seals = memfd_fcntl(memfd, F_GET_SEALS, 0);
 		if (seals == -EINVAL)
@@ -205,15 +327,14 @@ static long udmabuf_create(struct miscdevice *device,
 			goto err;
 		pgoff = list[i].offset >> PAGE_SHIFT;
 		pgcnt = list[i].size   >> PAGE_SHIFT;
-		for (pgidx = 0; pgidx < pgcnt; pgidx++) {
-			page = shmem_read_mapping_page(
-				file_inode(memfd)->i_mapping, pgoff + pgidx);
-			if (IS_ERR(page)) {
-				ret = PTR_ERR(page);
-				goto err;
-			}
-			ubuf->pages[pgbuf++] = page;
-		}
+		if (is_file_hugepages(memfd))
+			ret = udmabuf_pin_hugetlb(ubuf, memfd, pgoff, pgcnt,
+						  &pgbuf);
+		else
+			ret = udmabuf_pin_shmem(ubuf, memfd, pgoff, pgcnt,
+						&pgbuf);
+		if (ret)
+			goto err;
 		fput(memfd);
 		memfd = NULL;
 	}
@@ -48,7 +48,7 @@ MODULE_PARM_DESC(iterations,
 static unsigned int dmatest;
 module_param(dmatest, uint, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(dmatest,
-		"dmatest 0-memcpy 1-memset (default: 0)");
+		"dmatest 0-memcpy 1-memset 2-sg (default: 0)");
 
 static unsigned int xor_sources = 3;
 module_param(xor_sources, uint, S_IRUGO | S_IWUSR);
@@ -89,6 +89,14 @@ static bool polled;
 module_param(polled, bool, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(polled, "Use polling for completion instead of interrupts");
 
+static unsigned int sg_nents = 4;
+module_param(sg_nents, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(sg_nents, "Number of chunks each sg transfer is split into (default: 4)");
+
+static bool benchmark;
+module_param(benchmark, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(benchmark, "Report per-channel and aggregate throughput and latency when the test is stopped (default: off)");
+
 /**
  * struct dmatest_params - test parameters.
  * @buf_size:		size of the memcpy test buffer
@@ -105,6 +113,8 @@ MODULE_PARM_DESC(polled, "Use polling for completion instead of interrupts");
  * @alignment:		custom data address alignment taken as 2^alignment
  * @transfer_size:	custom transfer size in bytes
  * @polled:		use polling for completion instead of interrupts
+ * @sg_nents:		number of chunks each sg transfer is split into
+ * @benchmark:		collect throughput and latency statistics
  */
 struct dmatest_params {
 	unsigned int	buf_size;
@@ -121,6 +131,8 @@ struct dmatest_params {
 	int		alignment;
 	unsigned int	transfer_size;
 	bool		polled;
+	unsigned int	sg_nents;
+	bool		benchmark;
 };
 
 /**
@@ -210,9 +222,36 @@ MODULE_PARM_DESC(test_list, "Print current test list");
 /* poor man's completion - we want to use wait_event_freezable() on it */
 struct dmatest_done {
 	bool			done;
+	ktime_t			stamp;
 	wait_queue_head_t	*wait;
 };
 
+/* Latency histogram buckets, bucket n counts [2^(n-1), 2^n) usecs */
+#define DMATEST_LAT_BUCKETS	16
+
+/**
+ * struct dmatest_stats - benchmark statistics.
+ * @tests:		number of transfers issued
+ * @len:		number of bytes transferred
+ * @runtime:		time spent transferring in usecs, without buffer
+ *			fill and verification
+ * @lat_count:		number of completed transfers in the histogram
+ * @lat_min:		shortest submit to completion latency in nsecs
+ * @lat_max:		longest submit to completion latency in nsecs
+ * @lat_total:		sum of submit to completion latencies in nsecs
+ * @lat_hist:		submit to completion latency histogram
+ */
+struct dmatest_stats {
+	unsigned int		tests;
+	unsigned long long	len;
+	s64			runtime;
+	unsigned int		lat_count;
+	u64			lat_min;
+	u64			lat_max;
+	u64			lat_total;
+	unsigned int		lat_hist[DMATEST_LAT_BUCKETS];
+};
+
 struct dmatest_data {
 	u8		**raw;
 	u8		**aligned;
@@ -230,6 +269,7 @@ struct dmatest_thread {
 	enum dma_transaction_type type;
 	wait_queue_head_t done_wait;
 	struct dmatest_done test_done;
+	struct dmatest_stats	stats;
 	bool			done;
 	bool			pending;
 };
@@ -431,6 +471,7 @@ static void dmatest_callback(void *arg)
 	struct dmatest_thread *thread =
 		container_of(done, struct dmatest_thread, test_done);
 	if (!thread->done) {
+		done->stamp = ktime_get();
 		done->done = true;
 		wake_up_all(done->wait);
 	} else {
@@ -504,6 +545,106 @@ static unsigned long long dmatest_KBs(s64 runtime, unsigned long long len)
 	return FIXPT_TO_INT(dmatest_persec(runtime, len >> 10));
 }
 
+static unsigned long long dmatest_MBs(s64 runtime, unsigned long long len)
+{
+	return dmatest_persec(runtime, len >> 10) >> 10;
+}
+
+static void dmatest_record_latency(struct dmatest_stats *stats, ktime_t lat)
+{
+	u64 ns = ktime_to_ns(lat);
+	unsigned int bucket = min_t(unsigned int,
+				    fls64(div_u64(ns, NSEC_PER_USEC)),
+				    DMATEST_LAT_BUCKETS - 1);
+
+	if (!stats->lat_count || ns < stats->lat_min)
+		stats->lat_min = ns;
+	stats->lat_max = max(stats->lat_max, ns);
+	stats->lat_total += ns;
+	stats->lat_count++;
+	stats->lat_hist[bucket]++;
+}
+
+static void dmatest_stats_add(struct dmatest_stats *sum,
+			      const struct dmatest_stats *stats)
+{
+	unsigned int i;
+
+	if (stats->lat_count &&
+	    (!sum->lat_count || stats->lat_min < sum->lat_min))
+		sum->lat_min = stats->lat_min;
+	sum->lat_max = max(sum->lat_max, stats->lat_max);
+	sum->lat_total += stats->lat_total;
+	sum->lat_count += stats->lat_count;
+	for (i = 0; i < DMATEST_LAT_BUCKETS; i++)
+		sum->lat_hist[i] += stats->lat_hist[i];
+
+	sum->tests += stats->tests;
+	sum->len += stats->len;
+	/* concurrent transfers: the slowest one bounds the throughput */
+	sum->runtime = max(sum->runtime, stats->runtime);
+}
+
+static void dmatest_bench_report(const char *name,
+				 const struct dmatest_stats *stats)
+{
+	unsigned long long mbs = dmatest_MBs(stats->runtime, stats->len);
+	unsigned int i;
+
+	pr_info("%s: %u tests, %llu bytes in %lld us, %llu.%02llu MB/s\n",
+		name, stats->tests, stats->len, stats->runtime,
+		FIXPT_TO_INT(mbs), FIXPT_GET_FRAC(mbs));
+
+	if (!stats->lat_count)
+		return;
+
+	pr_info("%s: latency min %llu avg %llu max %llu ns\n", name,
+		stats->lat_min, div_u64(stats->lat_total, stats->lat_count),
+		stats->lat_max);
+
+	for (i = 0; i < DMATEST_LAT_BUCKETS; i++) {
+		if (!stats->lat_hist[i])
+			continue;
+		if (i == DMATEST_LAT_BUCKETS - 1)
+			pr_info("%s:   >= %u us: %u\n", name, 1U << (i - 1),
+				stats->lat_hist[i]);
+		else
+			pr_info("%s:   %u - %u us: %u\n", name,
+				i ? 1U << (i - 1) : 0, 1U << i,
+				stats->lat_hist[i]);
+	}
+}
+
+/*
+ * Describe a single contiguous transfer as an interleaved one made of
+ * @nents chunks, so that drivers build a multi-entry descriptor for it.
+ */
+static void dmatest_init_xt(struct dma_interleaved_template *xt,
+			    dma_addr_t dst, dma_addr_t src, unsigned int len,
+			    u8 align, unsigned int nents)
+{
+	unsigned int chunk, i;
+
+	nents = clamp(len >> align, 1U, nents);
+	chunk = ((len / nents) >> align) << align;
+
+	xt->src_start = src;
+	xt->dst_start = dst;
+	xt->dir = DMA_MEM_TO_MEM;
+	xt->src_inc = true;
+	xt->dst_inc = true;
+	xt->src_sgl = true;
+	xt->dst_sgl = true;
+	xt->numf = 1;
+	xt->frame_size = nents;
+	for (i = 0; i < nents; i++) {
+		xt->sgl[i].size = i == nents - 1 ? len - chunk * i : chunk;
+		xt->sgl[i].icg = 0;
+		xt->sgl[i].src_icg = 0;
+		xt->sgl[i].dst_icg = 0;
+	}
+}
+
 static void __dmatest_free_test_data(struct dmatest_data *d, unsigned int cnt)
 {
 	unsigned int i;
@@ -595,6 +736,8 @@ static int dmatest_func(void *data)
 	bool			is_memset = false;
 	dma_addr_t		*srcs;
 	dma_addr_t		*dma_pq;
+	struct dma_interleaved_template *xt = NULL;
+	ktime_t			submit;
 
 	set_freezable();
 
@@ -608,7 +751,7 @@ static int dmatest_func(void *data)
 	dev = chan->device;
 	src = &thread->src;
 	dst = &thread->dst;
-	if (thread->type == DMA_MEMCPY) {
+	if (thread->type == DMA_MEMCPY || thread->type == DMA_INTERLEAVE) {
 		align = params->alignment < 0 ? dev->copy_align :
 						params->alignment;
 		src->cnt = dst->cnt = 1;
@@ -669,6 +812,13 @@ static int dmatest_func(void *data)
 	if (!dma_pq)
 		goto err_srcs_array;
 
+	if (thread->type == DMA_INTERLEAVE) {
+		xt = kzalloc(struct_size(xt, sgl, params->sg_nents),
+			     GFP_KERNEL);
+		if (!xt)
+			goto err_dma_pq;
+	}
+
 	/*
 	 * src and dst buffers are freed by ourselves below
 	 */
@@ -794,6 +944,10 @@ static int dmatest_func(void *data)
 			tx = dev->device_prep_dma_pq(chan, dma_pq, srcs,
 						     src->cnt, pq_coefs,
 						     len, flags);
+		} else if (thread->type == DMA_INTERLEAVE) {
+			dmatest_init_xt(xt, dsts[0] + dst->off, srcs[0], len,
+					align, params->sg_nents);
+			tx = dev->device_prep_interleaved_dma(chan, xt, flags);
 		}
 
 		if (!tx) {
@@ -808,6 +962,7 @@ static int dmatest_func(void *data)
 			tx->callback = dmatest_callback;
 			tx->callback_param = done;
 		}
+		submit = ktime_get();
 		cookie = tx->tx_submit(tx);
 
 		if (dma_submit_error(cookie)) {
@@ -819,6 +974,7 @@ static int dmatest_func(void *data)
 
 		if (params->polled) {
 			status = dma_sync_wait(chan, cookie);
+			done->stamp = ktime_get();
 			dmaengine_terminate_sync(chan);
 			if (status == DMA_COMPLETE)
 				done->done = true;
@@ -848,6 +1004,10 @@ static int dmatest_func(void *data)
 			goto error_unmap_continue;
 		}
 
+		if (params->benchmark)
+			dmatest_record_latency(&thread->stats,
+					       ktime_sub(done->stamp, submit));
+
 		dmaengine_unmap_put(um);
 
 		if (params->noverify) {
@@ -903,6 +1063,8 @@ error_unmap_continue:
 	runtime = ktime_to_us(ktime);
 
 	ret = 0;
+	kfree(xt);
+err_dma_pq:
 	kfree(dma_pq);
 err_srcs_array:
 	kfree(srcs);
@@ -919,6 +1081,10 @@ err_thread_type:
 		FIXPT_TO_INT(iops), FIXPT_GET_FRAC(iops),
 		dmatest_KBs(runtime, total_len), ret);
 
+	thread->stats.tests = total_tests;
+	thread->stats.len = total_len;
+	thread->stats.runtime = runtime;
+
 	/* terminate all transfers on specified channels */
 	if (ret || failed_tests)
 		dmaengine_terminate_sync(chan);
@@ -929,16 +1095,19 @@ err_thread_type:
 	return ret;
 }
 
-static void dmatest_cleanup_channel(struct dmatest_chan *dtc)
+static void dmatest_cleanup_channel(struct dmatest_chan *dtc,
+				    struct dmatest_stats *total)
 {
 	struct dmatest_thread	*thread;
 	struct dmatest_thread	*_thread;
+	struct dmatest_stats	stats = {};
 	int			ret;
 
 	list_for_each_entry_safe(thread, _thread, &dtc->threads, node) {
 		ret = kthread_stop(thread->task);
 		pr_debug("thread %s exited with status %d\n",
 			 thread->task->comm, ret);
+		dmatest_stats_add(&stats, &thread->stats);
 		list_del(&thread->node);
 		put_task_struct(thread->task);
 		kfree(thread);
@@ -947,6 +1116,11 @@ static void dmatest_cleanup_channel(struct dmatest_chan *dtc)
 	/* terminate all transfers on specified channels */
 	dmaengine_terminate_sync(dtc->chan);
 
+	if (total && stats.tests) {
+		dmatest_bench_report(dma_chan_name(dtc->chan), &stats);
+		dmatest_stats_add(total, &stats);
+	}
+
 	kfree(dtc);
 }
 
@@ -967,6 +1141,8 @@ static int dmatest_add_threads(struct dmatest_info *info,
 		op = "xor";
 	else if (type == DMA_PQ)
 		op = "pq";
+	else if (type == DMA_INTERLEAVE)
+		op = "sg";
 	else
 		return -EINVAL;
 
@@ -1031,6 +1207,14 @@ static int dmatest_add_channel(struct dmatest_info *info,
 		}
 	}
 
+	/* only mem-to-mem capable channels are requested for sg tests */
+	if (dma_has_cap(DMA_INTERLEAVE, dma_dev->cap_mask)) {
+		if (dmatest == 2) {
+			cnt = dmatest_add_threads(info, dtc, DMA_INTERLEAVE);
+			thread_count += cnt > 0 ? cnt : 0;
+		}
+	}
+
 	if (dma_has_cap(DMA_MEMSET, dma_dev->cap_mask)) {
 		if (dmatest == 1) {
 			cnt = dmatest_add_threads(info, dtc, DMA_MEMSET);
@@ -1105,6 +1289,8 @@ static void add_threaded_test(struct dmatest_info *info)
 	params->alignment = alignment;
 	params->transfer_size = transfer_size;
 	params->polled = polled;
+	params->sg_nents = max(sg_nents, 1U);
+	params->benchmark = benchmark;
 
 	request_channels(info, DMA_MEMCPY);
 	request_channels(info, DMA_MEMSET);
@@ -1132,17 +1318,27 @@ static void run_pending_tests(struct dmatest_info *info)
 
 static void stop_threaded_test(struct dmatest_info *info)
 {
+	struct dmatest_params *params = &info->params;
 	struct dmatest_chan *dtc, *_dtc;
+	struct dmatest_stats total = {};
 	struct dma_chan *chan;
 
 	list_for_each_entry_safe(dtc, _dtc, &info->channels, node) {
 		list_del(&dtc->node);
 		chan = dtc->chan;
-		dmatest_cleanup_channel(dtc);
+		dmatest_cleanup_channel(dtc,
+					params->benchmark ? &total : NULL);
 		pr_debug("dropped channel %s\n", dma_chan_name(chan));
 		dma_release_channel(chan);
 	}
 
+	if (total.tests) {
+		pr_info("benchmark: %u channels, %u threads per channel, %u-byte buffers\n",
+			info->nr_channels, params->threads_per_chan,
+			params->buf_size);
+		dmatest_bench_report("aggregate", &total);
+	}
+
 	info->nr_channels = 0;
 }
 
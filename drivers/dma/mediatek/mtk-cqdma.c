@@ -559,8 +559,10 @@ static void mtk_cqdma_free_inactive_desc(struct dma_chan *c)
 	 * and desc_issued as the candicates to be freed
 	 */
 	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock(&vc->submit_lock);
 	list_splice_tail_init(&vc->desc_allocated, &head);
 	list_splice_tail_init(&vc->desc_submitted, &head);
+	spin_unlock(&vc->submit_lock);
 	list_splice_tail_init(&vc->desc_issued, &head);
 	spin_unlock_irqrestore(&vc->lock, flags);
 
@@ -742,8 +742,10 @@ static int mtk_hsdma_free_inactive_desc(struct dma_chan *c)
 	LIST_HEAD(head);
 
 	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock(&vc->submit_lock);
 	list_splice_tail_init(&vc->desc_allocated, &head);
 	list_splice_tail_init(&vc->desc_submitted, &head);
+	spin_unlock(&vc->submit_lock);
 	list_splice_tail_init(&vc->desc_issued, &head);
 	spin_unlock_irqrestore(&vc->lock, flags);
 
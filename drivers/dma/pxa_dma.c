@@ -785,6 +785,7 @@ static dma_cookie_t pxad_tx_submit(struct dma_async_tx_descriptor *tx)
 	set_updater_desc(to_pxad_sw_desc(vd), tx->flags);
 
 	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock(&vc->submit_lock);
 	cookie = dma_cookie_assign(tx);
 
 	if (list_empty(&vc->desc_submitted) && pxad_try_hotchain(vc, vd)) {
@@ -819,6 +820,7 @@ static dma_cookie_t pxad_tx_submit(struct dma_async_tx_descriptor *tx)
 	chan->misaligned |= to_pxad_sw_desc(vd)->misaligned;
 
 out:
+	spin_unlock(&vc->submit_lock);
 	spin_unlock_irqrestore(&vc->lock, flags);
 	return cookie;
 }
@@ -23,11 +23,11 @@ dma_cookie_t vchan_tx_submit(struct dma_async_tx_descriptor *tx)
 	unsigned long flags;
 	dma_cookie_t cookie;
 
-	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock_irqsave(&vc->submit_lock, flags);
 	cookie = dma_cookie_assign(tx);
 
 	list_move_tail(&vd->node, &vc->desc_submitted);
-	spin_unlock_irqrestore(&vc->lock, flags);
+	spin_unlock_irqrestore(&vc->submit_lock, flags);
 
 	dev_dbg(vc->chan.device->dev, "vchan %p: txd %p[%x]: submitted\n",
 		vc, vd, cookie);
@@ -52,9 +52,9 @@ int vchan_tx_desc_free(struct dma_async_tx_descriptor *tx)
 	struct virt_dma_desc *vd = to_virt_desc(tx);
 	unsigned long flags;
 
-	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock_irqsave(&vc->submit_lock, flags);
 	list_del(&vd->node);
-	spin_unlock_irqrestore(&vc->lock, flags);
+	spin_unlock_irqrestore(&vc->submit_lock, flags);
 
 	dev_dbg(vc->chan.device->dev, "vchan %p: txd %p[%x]: freeing\n",
 		vc, vd, vd->tx.cookie);
@@ -77,8 +77,10 @@ struct virt_dma_desc *vchan_find_desc(struct virt_dma_chan *vc,
 EXPORT_SYMBOL_GPL(vchan_find_desc);
 
 /*
- * This tasklet handles the completion of a DMA descriptor by
- * calling its callback and freeing it.
+ * This tasklet handles the completion of DMA descriptors by calling
+ * their callbacks and freeing them. All descriptors completed since the
+ * last run are handled in one pass, and the reusable ones are given back
+ * to the channel in one go.
  */
 static void vchan_complete(struct tasklet_struct *t)
 {
@@ -86,6 +88,7 @@ static void vchan_complete(struct tasklet_struct *t)
 	struct virt_dma_desc *vd, *_vd;
 	struct dmaengine_desc_callback cb;
 	LIST_HEAD(head);
+	LIST_HEAD(reuse);
 
 	spin_lock_irq(&vc->lock);
 	list_splice_tail_init(&vc->desc_completed, &head);
@@ -105,7 +108,16 @@ static void vchan_complete(struct tasklet_struct *t)
 
 		list_del(&vd->node);
 		dmaengine_desc_callback_invoke(&cb, &vd->tx_result);
-		vchan_vdesc_fini(vd);
+		if (dmaengine_desc_test_reuse(&vd->tx))
+			list_add(&vd->node, &reuse);
+		else
+			vc->desc_free(vd);
+	}
+
+	if (!list_empty(&reuse)) {
+		spin_lock_irq(&vc->submit_lock);
+		list_splice(&reuse, &vc->desc_allocated);
+		spin_unlock_irq(&vc->submit_lock);
 	}
 }
 
@@ -125,6 +137,7 @@ void vchan_init(struct virt_dma_chan *vc, struct dma_device *dmadev)
 	dma_cookie_init(&vc->chan);
 
 	spin_lock_init(&vc->lock);
+	spin_lock_init(&vc->submit_lock);
 	INIT_LIST_HEAD(&vc->desc_allocated);
 	INIT_LIST_HEAD(&vc->desc_submitted);
 	INIT_LIST_HEAD(&vc->desc_issued);
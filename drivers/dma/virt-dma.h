@@ -15,7 +15,7 @@
 struct virt_dma_desc {
 	struct dma_async_tx_descriptor tx;
 	struct dmaengine_result tx_result;
-	/* protected by vc.lock */
+	/* protected by vc.lock, or vc.submit_lock until issued */
 	struct list_head node;
 };
 
@@ -25,10 +25,17 @@ struct virt_dma_chan {
 	void (*desc_free)(struct virt_dma_desc *);
 
 	spinlock_t lock;
+	/*
+	 * Nests inside vc.lock, so that submitting a descriptor does not
+	 * have to wait for the interrupt handler or the completion tasklet.
+	 */
+	spinlock_t submit_lock;
 
-	/* protected by vc.lock */
+	/* protected by vc.submit_lock */
 	struct list_head desc_allocated;
 	struct list_head desc_submitted;
+
+	/* protected by vc.lock */
 	struct list_head desc_issued;
 	struct list_head desc_completed;
 	struct list_head desc_terminated;
@@ -66,9 +73,9 @@ static inline struct dma_async_tx_descriptor *vchan_tx_prep(struct virt_dma_chan
 	vd->tx_result.result = DMA_TRANS_NOERROR;
 	vd->tx_result.residue = 0;
 
-	spin_lock_irqsave(&vc->lock, flags);
+	spin_lock_irqsave(&vc->submit_lock, flags);
 	list_add_tail(&vd->node, &vc->desc_allocated);
-	spin_unlock_irqrestore(&vc->lock, flags);
+	spin_unlock_irqrestore(&vc->submit_lock, flags);
 
 	return &vd->tx;
 }
@@ -81,7 +88,17 @@ static inline struct dma_async_tx_descriptor *vchan_tx_prep(struct virt_dma_chan
  */
 static inline bool vchan_issue_pending(struct virt_dma_chan *vc)
 {
-	list_splice_tail_init(&vc->desc_submitted, &vc->desc_issued);
+	unsigned long flags;
+
+	/*
+	 * A descriptor racing in here is issued by its submitter's own
+	 * call, don't bother with the lock when there is nothing to move.
+	 */
+	if (!list_empty(&vc->desc_submitted)) {
+		spin_lock_irqsave(&vc->submit_lock, flags);
+		list_splice_tail_init(&vc->desc_submitted, &vc->desc_issued);
+		spin_unlock_irqrestore(&vc->submit_lock, flags);
+	}
 	return !list_empty(&vc->desc_issued);
 }
 
@@ -116,9 +133,9 @@ static inline void vchan_vdesc_fini(struct virt_dma_desc *vd)
 	if (dmaengine_desc_test_reuse(&vd->tx)) {
 		unsigned long flags;
 
-		spin_lock_irqsave(&vc->lock, flags);
+		spin_lock_irqsave(&vc->submit_lock, flags);
 		list_add(&vd->node, &vc->desc_allocated);
-		spin_unlock_irqrestore(&vc->lock, flags);
+		spin_unlock_irqrestore(&vc->submit_lock, flags);
 	} else {
 		vc->desc_free(vd);
 	}
@@ -177,8 +194,12 @@ static inline struct virt_dma_desc *vchan_next_desc(struct virt_dma_chan *vc)
 static inline void vchan_get_all_descriptors(struct virt_dma_chan *vc,
 	struct list_head *head)
 {
+	unsigned long flags;
+
+	spin_lock_irqsave(&vc->submit_lock, flags);
 	list_splice_tail_init(&vc->desc_allocated, head);
 	list_splice_tail_init(&vc->desc_submitted, head);
+	spin_unlock_irqrestore(&vc->submit_lock, flags);
 	list_splice_tail_init(&vc->desc_issued, head);
 	list_splice_tail_init(&vc->desc_completed, head);
 	list_splice_tail_init(&vc->desc_terminated, head);
@@ -155,6 +155,7 @@ int rtrs_clt_reset_all_stats(struct rtrs_clt_stats *s, bool enable)
 		rtrs_clt_reset_cpu_migr_stats(s, enable);
 		rtrs_clt_reset_reconnects_stat(s, enable);
 		atomic_set(&s->inflight, 0);
+		WRITE_ONCE(s->latency_ns, 0);
 		return 0;
 	}
 
@@ -180,10 +181,24 @@ void rtrs_clt_update_all_stats(struct rtrs_clt_io_req *req, int dir)
 
 	len = req->usr_len + req->data_len;
 	rtrs_clt_update_rdma_stats(stats, len, dir);
-	if (sess->clt->mp_policy == MP_POLICY_MIN_INFLIGHT)
+	if (sess->clt->mp_policy != MP_POLICY_RR)
 		atomic_inc(&stats->inflight);
 }
 
+/*
+ * Exponentially weighted moving average of the IO completion latency,
+ * each new sample has a weight of 1/8.  Concurrent updates from several
+ * CPUs may lose a sample, which is fine for a path selection hint.
+ */
+void rtrs_clt_update_latency(struct rtrs_clt_stats *stats, u64 lat_ns)
+{
+	u64 avg = READ_ONCE(stats->latency_ns);
+
+	if (avg)
+		lat_ns = avg - (avg >> 3) + (lat_ns >> 3);
+	WRITE_ONCE(stats->latency_ns, lat_ns);
+}
+
 int rtrs_clt_init_stats(struct rtrs_clt_stats *stats)
 {
 	stats->pcpu_stats = alloc_percpu(typeof(*stats->pcpu_stats));
@@ -98,6 +98,8 @@ static ssize_t mpath_policy_show(struct device *dev,
 		return sprintf(page, "round-robin (RR: %d)\n", clt->mp_policy);
 	case MP_POLICY_MIN_INFLIGHT:
 		return sprintf(page, "min-inflight (MI: %d)\n", clt->mp_policy);
+	case MP_POLICY_MIN_LATENCY:
+		return sprintf(page, "min-latency (ML: %d)\n", clt->mp_policy);
 	default:
 		return sprintf(page, "Unknown (%d)\n", clt->mp_policy);
 	}
@@ -116,7 +118,8 @@ static ssize_t mpath_policy_store(struct device *dev,
 
 	ret = kstrtoint(buf, 10, &value);
 	if (!ret && (value == MP_POLICY_RR ||
-		     value == MP_POLICY_MIN_INFLIGHT)) {
+		     value == MP_POLICY_MIN_INFLIGHT ||
+		     value == MP_POLICY_MIN_LATENCY)) {
 		clt->mp_policy = value;
 		return count;
 	}
@@ -127,6 +130,9 @@ static ssize_t mpath_policy_store(struct device *dev,
 	else if (!strncasecmp(buf, "min-inflight", 12) ||
 		 !strncasecmp(buf, "mi", 2))
 		clt->mp_policy = MP_POLICY_MIN_INFLIGHT;
+	else if (!strncasecmp(buf, "min-latency", 11) ||
+		 !strncasecmp(buf, "ml", 2))
+		clt->mp_policy = MP_POLICY_MIN_LATENCY;
 	else
 		return -EINVAL;
 
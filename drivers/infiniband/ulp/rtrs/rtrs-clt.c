@@ -165,6 +165,24 @@ void *rtrs_permit_to_pdu(struct rtrs_permit *permit)
 }
 EXPORT_SYMBOL(rtrs_permit_to_pdu);
 
+/**
+ * rtrs_clt_permit_set_poll() - route IO of the permit to a polled connection
+ * @permit:	IO permit
+ * @index:	index of the polled connection, below the @nr_poll_queues
+ *		passed to rtrs_clt_open()
+ *
+ * Description:
+ *    Completions of the IO sent with this permit are not signalled by an
+ *    interrupt, they are reaped only by rtrs_clt_rdma_cq_direct() called
+ *    with the same @index.
+ */
+void rtrs_clt_permit_set_poll(struct rtrs_permit *permit, unsigned int index)
+{
+	permit->con_type = RTRS_POLL_CON;
+	permit->poll_idx = index;
+}
+EXPORT_SYMBOL(rtrs_clt_permit_set_poll);
+
 /**
  * rtrs_permit_to_clt_con() - returns RDMA connection pointer by the permit
  * @sess: client session pointer
@@ -172,15 +190,19 @@ EXPORT_SYMBOL(rtrs_permit_to_pdu);
  * Note:
  *     IO connection starts from 1.
  *     0 connection is for user messages.
+ *     Polled connections follow the interrupt driven ones.
  */
 static
 struct rtrs_clt_con *rtrs_permit_to_clt_con(struct rtrs_clt_sess *sess,
 					    struct rtrs_permit *permit)
 {
+	unsigned int nr_poll = sess->s.con_num - sess->s.irq_con_num;
 	int id = 0;
 
 	if (likely(permit->con_type == RTRS_IO_CON))
-		id = (permit->cpu_id % (sess->s.con_num - 1)) + 1;
+		id = (permit->cpu_id % (sess->s.irq_con_num - 1)) + 1;
+	else if (permit->con_type == RTRS_POLL_CON && nr_poll)
+		id = sess->s.irq_con_num + permit->poll_idx % nr_poll;
 
 	return to_clt_con(sess->s.con[id]);
 }
@@ -437,8 +459,11 @@ static void complete_rdma_req(struct rtrs_clt_io_req *req, int errno,
 		ib_dma_unmap_sg(sess->s.dev->ib_dev, req->sglist,
 				req->sg_cnt, req->dir);
 	}
-	if (sess->clt->mp_policy == MP_POLICY_MIN_INFLIGHT)
+	if (sess->clt->mp_policy != MP_POLICY_RR)
 		atomic_dec(&sess->stats->inflight);
+	if (req->start_ns && !errno)
+		rtrs_clt_update_latency(sess->stats,
+					ktime_get_ns() - req->start_ns);
 
 	req->in_use = false;
 	req->con = NULL;
@@ -832,6 +857,52 @@ static struct rtrs_clt_sess *get_next_path_min_inflight(struct path_it *it)
 	return min_path;
 }
 
+/**
+ * get_next_path_min_latency() - Returns path with minimal expected latency.
+ * @it:	the path pointer
+ *
+ * Related to @MP_POLICY_MIN_LATENCY
+ *
+ * The expected latency of a path is the moving average of its IO
+ * completion latency multiplied by the number of IOs which would be
+ * queued on it, so a fast but loaded path loses against an idle slower
+ * one.  Paths without latency samples yet are preferred, so that every
+ * path gets measured.
+ *
+ * Locks:
+ *    rcu_read_lock() must be hold.
+ */
+static struct rtrs_clt_sess *get_next_path_min_latency(struct path_it *it)
+{
+	struct rtrs_clt_sess *min_path = NULL;
+	struct rtrs_clt *clt = it->clt;
+	struct rtrs_clt_sess *sess;
+	u64 min_score = U64_MAX;
+	u64 score;
+
+	list_for_each_entry_rcu(sess, &clt->paths_list, s.entry) {
+		if (unlikely(!list_empty(raw_cpu_ptr(sess->mp_skip_entry))))
+			continue;
+
+		score = READ_ONCE(sess->stats->latency_ns) *
+			(atomic_read(&sess->stats->inflight) + 1);
+
+		if (score < min_score) {
+			min_score = score;
+			min_path = sess;
+		}
+	}
+
+	/*
+	 * add the path to the skip list, so that next time we can get
+	 * a different one
+	 */
+	if (min_path)
+		list_add(raw_cpu_ptr(min_path->mp_skip_entry), &it->skip_list);
+
+	return min_path;
+}
+
 static inline void path_it_init(struct path_it *it, struct rtrs_clt *clt)
 {
 	INIT_LIST_HEAD(&it->skip_list);
@@ -840,6 +911,8 @@ static inline void path_it_init(struct path_it *it, struct rtrs_clt *clt)
 
 	if (clt->mp_policy == MP_POLICY_RR)
 		it->next_path = get_next_path_rr;
+	else if (clt->mp_policy == MP_POLICY_MIN_LATENCY)
+		it->next_path = get_next_path_min_latency;
 	else
 		it->next_path = get_next_path_min_inflight;
 }
@@ -848,7 +921,8 @@ static inline void path_it_deinit(struct path_it *it)
 {
 	struct list_head *skip, *tmp;
 	/*
-	 * The skip_list is used only for the MIN_INFLIGHT policy.
+	 * The skip_list is used only for the MIN_INFLIGHT and MIN_LATENCY
+	 * policies.
 	 * We need to remove paths from it, so that next IO can insert
 	 * paths (->mp_skip_entry) into a skip_list again.
 	 */
@@ -895,6 +969,9 @@ static void rtrs_clt_init_req(struct rtrs_clt_io_req *req,
 	req->dir = dir;
 	req->con = rtrs_permit_to_clt_con(sess, permit);
 	req->conf = conf;
+	req->start_ns = 0;
+	if (sess->clt->mp_policy == MP_POLICY_MIN_LATENCY)
+		req->start_ns = ktime_get_ns();
 	req->need_inv = false;
 	req->need_inv_comp = false;
 	req->inv_errno = 0;
@@ -1027,7 +1104,7 @@ static int rtrs_clt_write_req(struct rtrs_clt_io_req *req)
 				       imm);
 	if (unlikely(ret)) {
 		rtrs_err(s, "Write request failed: %d\n", ret);
-		if (sess->clt->mp_policy == MP_POLICY_MIN_INFLIGHT)
+		if (sess->clt->mp_policy != MP_POLICY_RR)
 			atomic_dec(&sess->stats->inflight);
 		if (req->sg_cnt)
 			ib_dma_unmap_sg(sess->s.dev->ib_dev, req->sglist,
@@ -1148,7 +1225,7 @@ static int rtrs_clt_read_req(struct rtrs_clt_io_req *req)
 				   req->data_len, imm, wr);
 	if (unlikely(ret)) {
 		rtrs_err(s, "Read request failed: %d\n", ret);
-		if (sess->clt->mp_policy == MP_POLICY_MIN_INFLIGHT)
+		if (sess->clt->mp_policy != MP_POLICY_RR)
 			atomic_dec(&sess->stats->inflight);
 		req->need_inv = false;
 		if (req->sg_cnt)
@@ -1419,6 +1496,9 @@ static struct rtrs_clt_sess *alloc_sess(struct rtrs_clt *clt,
 
 	/* Extra connection for user messages */
 	con_num += 1;
+	sess->s.irq_con_num = con_num;
+	/* Polled connections go after the interrupt driven ones */
+	con_num += clt->nr_poll_queues;
 
 	sess->s.con = kcalloc(con_num, sizeof(*sess->s.con), GFP_KERNEL);
 	if (!sess->s.con)
@@ -1499,6 +1579,7 @@ static int create_con(struct rtrs_clt_sess *sess, unsigned int cid)
 	con->c.cid = cid;
 	con->c.sess = &sess->s;
 	atomic_set(&con->io_cnt, 0);
+	spin_lock_init(&con->poll_lock);
 
 	sess->s.con[cid] = &con->c;
 
@@ -1589,9 +1670,14 @@ static int create_con_cq_qp(struct rtrs_clt_con *con)
 	}
 	cq_size = max_send_wr + max_recv_wr;
 	cq_vector = con->cpu % sess->s.dev->ib_dev->num_comp_vectors;
-	err = rtrs_cq_qp_create(&sess->s, &con->c, sess->max_send_sge,
-				 cq_vector, cq_size, max_send_wr,
-				 max_recv_wr, IB_POLL_SOFTIRQ);
+	if (con->c.cid >= sess->s.irq_con_num)
+		err = rtrs_cq_qp_create(&sess->s, &con->c, sess->max_send_sge,
+					cq_vector, cq_size, max_send_wr,
+					max_recv_wr, IB_POLL_DIRECT);
+	else
+		err = rtrs_cq_qp_create(&sess->s, &con->c, sess->max_send_sge,
+					cq_vector, cq_size, max_send_wr,
+					max_recv_wr, IB_POLL_SOFTIRQ);
 	/*
 	 * In case of error we do not bother to clean previous allocations,
 	 * since destroy_con_cq_qp() must be called.
@@ -2536,7 +2622,8 @@ static struct rtrs_clt *alloc_clt(const char *sessname, size_t paths_num,
 				  unsigned int max_segments,
 				  size_t max_segment_size,
 				  unsigned int reconnect_delay_sec,
-				  unsigned int max_reconnect_attempts)
+				  unsigned int max_reconnect_attempts,
+				  u32 nr_poll_queues)
 {
 	struct rtrs_clt *clt;
 	int err;
@@ -2567,6 +2654,7 @@ static struct rtrs_clt *alloc_clt(const char *sessname, size_t paths_num,
 	clt->max_segment_size = max_segment_size;
 	clt->reconnect_delay_sec = reconnect_delay_sec;
 	clt->max_reconnect_attempts = max_reconnect_attempts;
+	clt->nr_poll_queues = nr_poll_queues;
 	clt->priv = priv;
 	clt->link_ev = link_ev;
 	clt->mp_policy = MP_POLICY_MIN_INFLIGHT;
@@ -2648,6 +2736,9 @@ static void free_clt(struct rtrs_clt *clt)
  * @max_segment_size: Max. size of one segment
  * @max_reconnect_attempts: Number of times to reconnect on error before giving
  *			    up, 0 for * disabled, -1 for forever
+ * @nr_poll_queues: Number of extra IO connections per path whose completions
+ *		    are polled by rtrs_clt_rdma_cq_direct() instead of being
+ *		    signalled by an interrupt, 0 for none
  *
  * Starts session establishment with the rtrs_server. The function can block
  * up to ~2000ms before it returns.
@@ -2661,7 +2752,8 @@ struct rtrs_clt *rtrs_clt_open(struct rtrs_clt_ops *ops,
 				 size_t pdu_sz, u8 reconnect_delay_sec,
 				 u16 max_segments,
 				 size_t max_segment_size,
-				 s16 max_reconnect_attempts)
+				 s16 max_reconnect_attempts,
+				 u32 nr_poll_queues)
 {
 	struct rtrs_clt_sess *sess, *tmp;
 	struct rtrs_clt *clt;
@@ -2670,7 +2762,7 @@ struct rtrs_clt *rtrs_clt_open(struct rtrs_clt_ops *ops,
 	clt = alloc_clt(sessname, paths_num, port, pdu_sz, ops->priv,
 			ops->link_ev,
 			max_segments, max_segment_size, reconnect_delay_sec,
-			max_reconnect_attempts);
+			max_reconnect_attempts, nr_poll_queues);
 	if (IS_ERR(clt)) {
 		err = PTR_ERR(clt);
 		goto out;
@@ -2906,6 +2998,48 @@ int rtrs_clt_request(int dir, struct rtrs_clt_req_ops *ops,
 }
 EXPORT_SYMBOL(rtrs_clt_request);
 
+/**
+ * rtrs_clt_rdma_cq_direct() - reap completions of a polled connection
+ * @clt:	Session pointer
+ * @index:	Index of the polled connection, see rtrs_clt_permit_set_poll()
+ *
+ * Description:
+ *    Processes completions of the polled connection @index on every
+ *    connected path.  If another context is already polling a connection,
+ *    it is skipped, the completions are reaped there.
+ *
+ * Returns:
+ *    Number of processed completions, or -1 if no path is connected.
+ */
+int rtrs_clt_rdma_cq_direct(struct rtrs_clt *clt, unsigned int index)
+{
+	struct rtrs_clt_sess *sess;
+	struct rtrs_clt_con *con;
+	unsigned int nr_poll;
+	int cnt = -1;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sess, &clt->paths_list, s.entry) {
+		if (READ_ONCE(sess->state) != RTRS_CLT_CONNECTED)
+			continue;
+		nr_poll = sess->s.con_num - sess->s.irq_con_num;
+		if (unlikely(!nr_poll))
+			continue;
+		if (cnt < 0)
+			cnt = 0;
+		con = to_clt_con(sess->s.con[sess->s.irq_con_num +
+					     index % nr_poll]);
+		if (!spin_trylock(&con->poll_lock))
+			continue;
+		cnt += ib_process_cq_direct(con->c.cq, -1);
+		spin_unlock(&con->poll_lock);
+	}
+	rcu_read_unlock();
+
+	return cnt;
+}
+EXPORT_SYMBOL(rtrs_clt_rdma_cq_direct);
+
 /**
  * rtrs_clt_query() - queries RTRS session attributes
  *@clt: session pointer
@@ -29,6 +29,7 @@ enum rtrs_clt_state {
 enum rtrs_mp_policy {
 	MP_POLICY_RR,
 	MP_POLICY_MIN_INFLIGHT,
+	MP_POLICY_MIN_LATENCY,
 };
 
 /* see Documentation/ABI/testing/sysfs-class-rtrs-client for details */
@@ -65,6 +66,7 @@ struct rtrs_clt_stats {
 	struct rtrs_clt_stats_pcpu    __percpu	*pcpu_stats;
 	struct rtrs_clt_stats_reconnects	reconnects;
 	atomic_t				inflight;
+	u64					latency_ns;
 };
 
 struct rtrs_clt_con {
@@ -74,6 +76,7 @@ struct rtrs_clt_con {
 	unsigned int		cpu;
 	atomic_t		io_cnt;
 	int			cm_err;
+	spinlock_t		poll_lock; /* serializes direct CQ polling */
 };
 
 /**
@@ -83,6 +86,7 @@ struct rtrs_clt_con {
 struct rtrs_permit {
 	enum rtrs_clt_con_type con_type;
 	unsigned int cpu_id;
+	unsigned int poll_idx;
 	unsigned int mem_id;
 	unsigned int mem_off;
 };
@@ -107,6 +111,7 @@ struct rtrs_clt_io_req {
 	enum dma_data_direction dir;
 	void			(*conf)(void *priv, int errno);
 	unsigned long		start_jiffies;
+	u64			start_ns;
 
 	struct ib_mr		*mr;
 	struct ib_cqe		inv_cqe;
@@ -178,6 +183,7 @@ struct rtrs_clt {
 	struct device		dev;
 	struct kobject		*kobj_paths;
 	enum rtrs_mp_policy	mp_policy;
+	u32			nr_poll_queues;
 };
 
 static inline struct rtrs_clt_con *to_clt_con(struct rtrs_con *c)
@@ -219,6 +225,7 @@ void rtrs_clt_inc_failover_cnt(struct rtrs_clt_stats *s);
 
 void rtrs_clt_update_wc_stats(struct rtrs_clt_con *con);
 void rtrs_clt_update_all_stats(struct rtrs_clt_io_req *req, int dir);
+void rtrs_clt_update_latency(struct rtrs_clt_stats *stats, u64 lat_ns);
 
 int rtrs_clt_reset_rdma_lat_distr_stats(struct rtrs_clt_stats *stats,
 					 bool enable);
@@ -59,7 +59,8 @@ struct rtrs_clt *rtrs_clt_open(struct rtrs_clt_ops *ops,
 				 size_t pdu_sz, u8 reconnect_delay_sec,
 				 u16 max_segments,
 				 size_t max_segment_size,
-				 s16 max_reconnect_attempts);
+				 s16 max_reconnect_attempts,
+				 u32 nr_poll_queues);
 
 void rtrs_clt_close(struct rtrs_clt *sess);
 
@@ -80,10 +81,12 @@ enum {
  * rtrs_permit
  * @ADMIN_CON - use connection reserved for "service" messages
  * @IO_CON - use a connection reserved for IO
+ * @POLL_CON - use a polled IO connection, set by rtrs_clt_permit_set_poll()
  */
 enum rtrs_clt_con_type {
 	RTRS_ADMIN_CON,
-	RTRS_IO_CON
+	RTRS_IO_CON,
+	RTRS_POLL_CON
 };
 
 struct rtrs_permit *rtrs_clt_get_permit(struct rtrs_clt *sess,
@@ -92,6 +95,8 @@ struct rtrs_permit *rtrs_clt_get_permit(struct rtrs_clt *sess,
 
 void rtrs_clt_put_permit(struct rtrs_clt *sess, struct rtrs_permit *permit);
 
+void rtrs_clt_permit_set_poll(struct rtrs_permit *permit, unsigned int index);
+
 /**
  * rtrs_clt_req_ops - it holds the request confirmation callback
  * and a private pointer.
@@ -111,6 +116,8 @@ int rtrs_clt_request(int dir, struct rtrs_clt_req_ops *ops,
 		     const struct kvec *vec, size_t nr, size_t len,
 		     struct scatterlist *sg, unsigned int sg_cnt);
 
+int rtrs_clt_rdma_cq_direct(struct rtrs_clt *clt, unsigned int index);
+
 /**
  * rtrs_attrs - RTRS session attributes
  */
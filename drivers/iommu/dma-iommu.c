@@ -286,6 +286,18 @@ static void iommu_dma_flush_iotlb_all(struct iova_domain *iovad)
 	domain->ops->flush_iotlb_all(domain);
 }
 
+static void iommu_dma_flush_iotlb_range(struct iova_domain *iovad,
+					unsigned long pfn, unsigned long pages)
+{
+	struct iommu_dma_cookie *cookie;
+	struct iommu_domain *domain;
+
+	cookie = container_of(iovad, struct iommu_dma_cookie, iovad);
+	domain = cookie->fq_domain;
+	domain->ops->flush_iotlb_range(domain, pfn << iova_shift(iovad),
+				       pages << iova_shift(iovad));
+}
+
 /**
  * iommu_dma_init_domain - Initialise a DMA mapping domain
  * @domain: IOMMU domain previously prepared by iommu_get_dma_cookie()
@@ -342,8 +354,13 @@ static int iommu_dma_init_domain(struct iommu_domain *domain, dma_addr_t base,
 
 	if (!cookie->fq_domain && !iommu_domain_get_attr(domain,
 			DOMAIN_ATTR_DMA_USE_FLUSH_QUEUE, &attr) && attr) {
+		iova_flush_range_cb flush_range_cb = NULL;
+
+		if (domain->ops->flush_iotlb_range)
+			flush_range_cb = iommu_dma_flush_iotlb_range;
+
 		if (init_iova_flush_queue(iovad, iommu_dma_flush_iotlb_all,
-					NULL))
+					flush_range_cb, NULL))
 			pr_warn("iova flush queue initialization failed\n");
 		else
 			cookie->fq_domain = domain;
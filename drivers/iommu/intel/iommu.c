@@ -1683,6 +1683,28 @@ static void iommu_flush_iova(struct iova_domain *iovad)
 	}
 }
 
+static void iommu_flush_iova_range(struct iova_domain *iovad,
+				   unsigned long pfn, unsigned long pages)
+{
+	unsigned long start_pfn = pfn, last_pfn = pfn + pages - 1;
+	/* PSI flushes a naturally aligned power-of-two block */
+	unsigned int mask = fls_long(start_pfn ^ last_pfn);
+	struct dmar_domain *domain;
+	int idx;
+
+	if (mask >= 32) {
+		iommu_flush_iova(iovad);
+		return;
+	}
+
+	domain = container_of(iovad, struct dmar_domain, iovad);
+	start_pfn &= ~((1UL << mask) - 1);
+
+	for_each_domain_iommu(idx, domain)
+		iommu_flush_iotlb_psi(g_iommus[idx], domain, start_pfn,
+				      1U << mask, 0, 0);
+}
+
 static void iommu_disable_protect_mem_regions(struct intel_iommu *iommu)
 {
 	u32 pmen;
@@ -5128,7 +5150,8 @@ static void intel_init_iova_domain(struct dmar_domain *dmar_domain)
 
 	if (!intel_iommu_strict &&
 	    init_iova_flush_queue(&dmar_domain->iovad,
-				  iommu_flush_iova, iova_entry_free))
+				  iommu_flush_iova, iommu_flush_iova_range,
+				  iova_entry_free))
 		pr_info("iova flush queue initialization failed\n");
 }
 
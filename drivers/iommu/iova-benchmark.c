@@ -0,0 +1,180 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Benchmark for the IOVA allocator.
+ *
+ * Several threads allocate and free ranges of mixed sizes from a single
+ * IOVA domain, each keeping a window of ranges allocated to fragment the
+ * address space, similar to what DMA API users behind an IOMMU do.
+ */
+
+#define pr_fmt(fmt)	"iova-benchmark: " fmt
+
+#include <linux/completion.h>
+#include <linux/iova.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static unsigned int threads;
+module_param(threads, uint, 0444);
+MODULE_PARM_DESC(threads, "Number of threads (default: number of online CPUs)");
+
+static unsigned int iterations = 100000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Allocations per thread");
+
+static unsigned int depth = 64;
+module_param(depth, uint, 0444);
+MODULE_PARM_DESC(depth, "Ranges each thread keeps allocated");
+
+static unsigned int max_order = IOVA_RANGE_CACHE_MAX_SIZE;
+module_param(max_order, uint, 0444);
+MODULE_PARM_DESC(max_order, "Log of the largest range size (in pages)");
+
+static unsigned int limit_bits = 32;
+module_param(limit_bits, uint, 0444);
+MODULE_PARM_DESC(limit_bits, "Size of the IOVA space in bits");
+
+struct iova_bench_thread {
+	struct iova_domain *iovad;
+	struct completion *done;
+	unsigned long limit_pfn;
+	u64 alloc_ns, free_ns;
+	unsigned long failed;
+};
+
+struct iova_bench_range {
+	unsigned long pfn;
+	unsigned long size;
+};
+
+static void iova_bench_free(struct iova_bench_thread *t,
+			    struct iova_bench_range *r)
+{
+	ktime_t start;
+
+	if (!r->pfn)
+		return;
+
+	start = ktime_get();
+	free_iova_fast(t->iovad, r->pfn, r->size);
+	t->free_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+	r->pfn = 0;
+}
+
+static int iova_bench_thread_fn(void *data)
+{
+	struct iova_bench_thread *t = data;
+	struct iova_bench_range *ranges;
+	unsigned int i;
+	ktime_t start;
+
+	ranges = kcalloc(depth, sizeof(*ranges), GFP_KERNEL);
+	if (!ranges) {
+		t->failed = iterations;
+		goto out;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		struct iova_bench_range *r = &ranges[i % depth];
+
+		iova_bench_free(t, r);
+
+		/* Mix all sizes, most of them small like real DMA traffic */
+		r->size = 1UL << (i % 4 ? i % 3 : i % (max_order + 1));
+
+		start = ktime_get();
+		r->pfn = alloc_iova_fast(t->iovad, r->size, t->limit_pfn,
+					 true);
+		t->alloc_ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+		if (!r->pfn)
+			t->failed++;
+
+		cond_resched();
+	}
+
+	for (i = 0; i < depth; i++)
+		iova_bench_free(t, &ranges[i]);
+	kfree(ranges);
+out:
+	complete(t->done);
+	return 0;
+}
+
+static int __init iova_bench_init(void)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct iova_bench_thread *bench;
+	struct task_struct *task;
+	struct iova_domain *iovad;
+	u64 alloc_ns = 0, free_ns = 0;
+	unsigned long failed = 0;
+	unsigned int i, started;
+	int ret;
+
+	if (!threads)
+		threads = num_online_cpus();
+	if (!iterations || !depth || max_order >= BITS_PER_LONG ||
+	    limit_bits <= PAGE_SHIFT || limit_bits > 64)
+		return -EINVAL;
+
+	bench = kcalloc(threads, sizeof(*bench), GFP_KERNEL);
+	iovad = kzalloc(sizeof(*iovad), GFP_KERNEL);
+	if (!bench || !iovad) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ret = iova_cache_get();
+	if (ret)
+		goto out_free;
+
+	init_iova_domain(iovad, PAGE_SIZE, 1);
+
+	for (i = 0, started = 0; i < threads; i++) {
+		bench[i].iovad = iovad;
+		bench[i].done = &done;
+		bench[i].limit_pfn = DMA_BIT_MASK(limit_bits) >> PAGE_SHIFT;
+
+		task = kthread_run(iova_bench_thread_fn, &bench[i],
+				   "iova_bench/%u", i);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+		started++;
+	}
+
+	for (i = 0; i < started; i++)
+		wait_for_completion(&done);
+
+	for (i = 0; i < started; i++) {
+		alloc_ns += bench[i].alloc_ns;
+		free_ns += bench[i].free_ns;
+		failed += bench[i].failed;
+	}
+
+	if (started)
+		pr_info("%u threads, %u iterations, depth %u, max order %u: alloc %llu ns, free %llu ns, %lu failed\n",
+			started, iterations, depth, max_order,
+			div64_u64(alloc_ns, (u64)started * iterations),
+			div64_u64(free_ns, (u64)started * iterations), failed);
+
+	put_iova_domain(iovad);
+	iova_cache_put();
+out_free:
+	kfree(iovad);
+	kfree(bench);
+	return ret;
+}
+
+static void __exit iova_bench_exit(void)
+{
+}
+
+module_init(iova_bench_init);
+module_exit(iova_bench_exit);
+
+MODULE_DESCRIPTION("IOVA allocator benchmark");
+MODULE_LICENSE("GPL v2");
@@ -6,15 +6,28 @@
  */
 
 #include <linux/iova.h>
+#include <linux/iommu.h>
+#include <linux/debugfs.h>
 #include <linux/module.h>
 #include <linux/slab.h>
 #include <linux/smp.h>
 #include <linux/bitops.h>
 #include <linux/cpu.h>
+#include <linux/rbtree_augmented.h>
 
 /* The anchor node sits above the top of the usable address space */
 #define IOVA_ANCHOR	~0UL
 
+/*
+ * Each iova remembers the number of free pfns between itself and the
+ * next lower iova, and each subtree the largest such gap. That allows
+ * finding a free range in O(log n), no matter how fragmented the space is.
+ */
+#define IOVA_GAP(iova)	((iova)->gap)
+
+RB_DECLARE_CALLBACKS_MAX(static, iova_gap_callbacks, struct iova, node,
+			 unsigned long, __subtree_max_gap, IOVA_GAP)
+
 static bool iova_rcache_insert(struct iova_domain *iovad,
 			       unsigned long pfn,
 			       unsigned long size);
@@ -26,6 +39,14 @@ static void free_iova_rcaches(struct iova_domain *iovad);
 static void fq_destroy_all_entries(struct iova_domain *iovad);
 static void fq_flush_timeout(struct timer_list *t);
 
+/*
+ * Flush-Queue statistics of all domains, in <debugfs>/iommu/iova/: the
+ * ranges invalidated instead of a full flush, and the full flushes done
+ * although the domain can invalidate ranges.
+ */
+static atomic64_t fq_flush_range_cnt = ATOMIC64_INIT(0);
+static atomic64_t fq_flush_fallback_cnt = ATOMIC64_INIT(0);
+
 void
 init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn)
@@ -39,8 +60,6 @@ init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 
 	spin_lock_init(&iovad->iova_rbtree_lock);
 	iovad->rbroot = RB_ROOT;
-	iovad->cached_node = &iovad->anchor.node;
-	iovad->cached32_node = &iovad->anchor.node;
 	iovad->granule = granule;
 	iovad->start_pfn = start_pfn;
 	iovad->dma_32bit_pfn = 1UL << (32 - iova_shift(iovad));
@@ -48,6 +67,7 @@ init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	iovad->flush_cb = NULL;
 	iovad->fq = NULL;
 	iovad->anchor.pfn_lo = iovad->anchor.pfn_hi = IOVA_ANCHOR;
+	iovad->anchor.gap = iovad->anchor.__subtree_max_gap = IOVA_ANCHOR;
 	rb_link_node(&iovad->anchor.node, NULL, &iovad->rbroot.rb_node);
 	rb_insert_color(&iovad->anchor.node, &iovad->rbroot);
 	init_iova_rcaches(iovad);
@@ -73,11 +93,14 @@ static void free_iova_flush_queue(struct iova_domain *iovad)
 
 	iovad->fq         = NULL;
 	iovad->flush_cb   = NULL;
+	iovad->flush_range_cb = NULL;
 	iovad->entry_dtor = NULL;
 }
 
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor)
+			  iova_flush_cb flush_cb,
+			  iova_flush_range_cb flush_range_cb,
+			  iova_entry_dtor entry_dtor)
 {
 	struct iova_fq __percpu *queue;
 	int cpu;
@@ -90,6 +113,7 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 		return -ENOMEM;
 
 	iovad->flush_cb   = flush_cb;
+	iovad->flush_range_cb = flush_range_cb;
 	iovad->entry_dtor = entry_dtor;
 
 	for_each_possible_cpu(cpu) {
@@ -113,40 +137,44 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 }
 EXPORT_SYMBOL_GPL(init_iova_flush_queue);
 
-static struct rb_node *
-__get_cached_rbnode(struct iova_domain *iovad, unsigned long limit_pfn)
+static void
+__iova_delete_update(struct iova_domain *iovad, struct iova *free)
 {
-	if (limit_pfn <= iovad->dma_32bit_pfn)
-		return iovad->cached32_node;
-
-	return iovad->cached_node;
+	/* Freed space below 4G might satisfy a failed 32-bit allocation */
+	if (free->pfn_hi < iovad->dma_32bit_pfn)
+		iovad->max32_alloc_size = iovad->dma_32bit_pfn;
 }
 
-static void
-__cached_rbnode_insert_update(struct iova_domain *iovad, struct iova *new)
+/* Number of free pfns between the iova and the next lower one. */
+static unsigned long iova_gap_below(struct iova *iova)
 {
-	if (new->pfn_hi < iovad->dma_32bit_pfn)
-		iovad->cached32_node = &new->node;
-	else
-		iovad->cached_node = &new->node;
+	struct rb_node *prev = rb_prev(&iova->node);
+
+	if (!prev)
+		return iova->pfn_lo;
+
+	return iova->pfn_lo - rb_entry(prev, struct iova, node)->pfn_hi - 1;
 }
 
-static void
-__cached_rbnode_delete_update(struct iova_domain *iovad, struct iova *free)
+/* Recalculate the gap below an iova after its neighbourhood changed. */
+static void iova_gap_update(struct rb_node *node)
 {
-	struct iova *cached_iova;
+	struct iova *iova;
 
-	cached_iova = rb_entry(iovad->cached32_node, struct iova, node);
-	if (free == cached_iova ||
-	    (free->pfn_hi < iovad->dma_32bit_pfn &&
-	     free->pfn_lo >= cached_iova->pfn_lo)) {
-		iovad->cached32_node = rb_next(&free->node);
-		iovad->max32_alloc_size = iovad->dma_32bit_pfn;
-	}
+	if (!node)
+		return;
+
+	iova = rb_entry(node, struct iova, node);
+	iova->gap = iova_gap_below(iova);
+	iova_gap_callbacks_propagate(node, NULL);
+}
+
+static void iova_erase_rbtree(struct rb_root *root, struct iova *iova)
+{
+	struct rb_node *next = rb_next(&iova->node);
 
-	cached_iova = rb_entry(iovad->cached_node, struct iova, node);
-	if (free->pfn_lo >= cached_iova->pfn_lo)
-		iovad->cached_node = rb_next(&free->node);
+	rb_erase_augmented(&iova->node, root, &iova_gap_callbacks);
+	iova_gap_update(next);
 }
 
 /* Insert the iova into domain rbtree by holding writer lock */
@@ -172,17 +200,92 @@ iova_insert_rbtree(struct rb_root *root, struct iova *iova,
 			return;
 		}
 	}
-	/* Add new node and rebalance tree. */
+	/* Add new node, account its gap and rebalance tree. */
 	rb_link_node(&iova->node, parent, new);
-	rb_insert_color(&iova->node, root);
+	iova->gap = iova->__subtree_max_gap = iova_gap_below(iova);
+	if (parent)
+		iova_gap_callbacks_propagate(parent, NULL);
+	rb_insert_augmented(&iova->node, root, &iova_gap_callbacks);
+
+	/* The new node shrinks the gap below the next higher one. */
+	iova_gap_update(rb_next(&iova->node));
+}
+
+/*
+ * Find the highest free range of size pfns which ends below limit_pfn and
+ * starts at or above start_pfn, walking the tree top-down and skipping all
+ * subtrees without a large enough gap. Returns the iova right above the
+ * free range, or NULL if there is none.
+ */
+static struct iova *
+iova_find_gap(struct iova_domain *iovad, unsigned long size,
+	      unsigned long limit_pfn, unsigned long align_mask,
+	      unsigned long *new_pfn)
+{
+	struct iova *iova, *child;
+	struct rb_node *prev;
+	unsigned long gap_start, high, pfn;
+
+	if (limit_pfn < size || limit_pfn - size < iovad->start_pfn)
+		return NULL;
+	/* Gaps starting above this cannot fit the range below limit_pfn */
+	high = limit_pfn - size;
+
+	iova = rb_entry(iovad->rbroot.rb_node, struct iova, node);
+	if (iova->__subtree_max_gap < size)
+		return NULL;
+
+	while (true) {
+		/* Visit the right subtree if it looks promising */
+		gap_start = iova->pfn_lo - iova->gap;
+		if (gap_start <= high && iova->node.rb_right) {
+			child = rb_entry(iova->node.rb_right, struct iova, node);
+			if (child->__subtree_max_gap >= size) {
+				iova = child;
+				continue;
+			}
+		}
+check_current:
+		/* All remaining gaps end below this one */
+		if (iova->pfn_lo < iovad->start_pfn + size)
+			return NULL;
+
+		if (gap_start <= high && iova->gap >= size) {
+			pfn = (min(iova->pfn_lo, limit_pfn) - size) & align_mask;
+			if (pfn >= gap_start && pfn >= iovad->start_pfn) {
+				*new_pfn = pfn;
+				return iova;
+			}
+		}
+
+		/* Visit the left subtree if it looks promising */
+		if (iova->node.rb_left) {
+			child = rb_entry(iova->node.rb_left, struct iova, node);
+			if (child->__subtree_max_gap >= size) {
+				iova = child;
+				continue;
+			}
+		}
+
+		/* Go back up to the next lower node */
+		while (true) {
+			prev = &iova->node;
+			if (!rb_parent(prev))
+				return NULL;
+			iova = rb_entry(rb_parent(prev), struct iova, node);
+			if (prev == iova->node.rb_right) {
+				gap_start = iova->pfn_lo - iova->gap;
+				goto check_current;
+			}
+		}
+	}
 }
 
 static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 		unsigned long size, unsigned long limit_pfn,
 			struct iova *new, bool size_aligned)
 {
-	struct rb_node *curr, *prev;
-	struct iova *curr_iova;
+	struct iova *next;
 	unsigned long flags;
 	unsigned long new_pfn;
 	unsigned long align_mask = ~0UL;
@@ -190,23 +293,13 @@ static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 	if (size_aligned)
 		align_mask <<= fls_long(size - 1);
 
-	/* Walk the tree backwards */
 	spin_lock_irqsave(&iovad->iova_rbtree_lock, flags);
 	if (limit_pfn <= iovad->dma_32bit_pfn &&
 			size >= iovad->max32_alloc_size)
 		goto iova32_full;
 
-	curr = __get_cached_rbnode(iovad, limit_pfn);
-	curr_iova = rb_entry(curr, struct iova, node);
-	do {
-		limit_pfn = min(limit_pfn, curr_iova->pfn_lo);
-		new_pfn = (limit_pfn - size) & align_mask;
-		prev = curr;
-		curr = rb_prev(curr);
-		curr_iova = rb_entry(curr, struct iova, node);
-	} while (curr && new_pfn <= curr_iova->pfn_hi);
-
-	if (limit_pfn < size || new_pfn < iovad->start_pfn) {
+	next = iova_find_gap(iovad, size, limit_pfn, align_mask, &new_pfn);
+	if (!next) {
 		iovad->max32_alloc_size = size;
 		goto iova32_full;
 	}
@@ -215,9 +308,8 @@ static int __alloc_and_insert_iova_range(struct iova_domain *iovad,
 	new->pfn_lo = new_pfn;
 	new->pfn_hi = new->pfn_lo + size - 1;
 
-	/* If we have 'prev', it's a valid place to start the insertion. */
-	iova_insert_rbtree(&iovad->rbroot, new, prev);
-	__cached_rbnode_insert_update(iovad, new);
+	/* The new iova goes right below 'next', start the insertion there. */
+	iova_insert_rbtree(&iovad->rbroot, new, &next->node);
 
 	spin_unlock_irqrestore(&iovad->iova_rbtree_lock, flags);
 	return 0;
@@ -338,8 +430,8 @@ private_find_iova(struct iova_domain *iovad, unsigned long pfn)
 static void private_free_iova(struct iova_domain *iovad, struct iova *iova)
 {
 	assert_spin_locked(&iovad->iova_rbtree_lock);
-	__cached_rbnode_delete_update(iovad, iova);
-	rb_erase(&iova->node, &iovad->rbroot);
+	__iova_delete_update(iovad, iova);
+	iova_erase_rbtree(&iovad->rbroot, iova);
 	free_iova_mem(iova);
 }
 
@@ -476,6 +568,15 @@ static inline unsigned fq_ring_add(struct iova_fq *fq)
 	return idx;
 }
 
+static void fq_entry_free(struct iova_domain *iovad,
+			  struct iova_fq_entry *entry)
+{
+	if (iovad->entry_dtor)
+		iovad->entry_dtor(entry->data);
+
+	free_iova_fast(iovad, entry->iova_pfn, entry->pages);
+}
+
 static void fq_ring_free(struct iova_domain *iovad, struct iova_fq *fq)
 {
 	u64 counter = atomic64_read(&iovad->fq_flush_finish_cnt);
@@ -488,12 +589,7 @@ static void fq_ring_free(struct iova_domain *iovad, struct iova_fq *fq)
 		if (fq->entries[idx].counter >= counter)
 			break;
 
-		if (iovad->entry_dtor)
-			iovad->entry_dtor(fq->entries[idx].data);
-
-		free_iova_fast(iovad,
-			       fq->entries[idx].iova_pfn,
-			       fq->entries[idx].pages);
+		fq_entry_free(iovad, &fq->entries[idx]);
 
 		fq->head = (fq->head + 1) % IOVA_FQ_SIZE;
 	}
@@ -506,6 +602,102 @@ static void iova_domain_flush(struct iova_domain *iovad)
 	atomic64_inc(&iovad->fq_flush_finish_cnt);
 }
 
+struct iova_fq_range {
+	unsigned long pfn_lo;
+	unsigned long pfn_hi;
+};
+
+/*
+ * Add a range of pfns to an array of ranges sorted by pfn, merging it with
+ * all ranges it overlaps or touches. Fails if that would take more than
+ * IOVA_FQ_MAX_RANGES ranges.
+ */
+static bool fq_range_add(struct iova_fq_range *ranges, unsigned int *nr,
+			 unsigned long pfn, unsigned long pages)
+{
+	unsigned long pfn_hi = pfn + pages - 1;
+	unsigned int i, j;
+
+	/* Skip all ranges ending before the new one and not touching it */
+	for (i = 0; i < *nr && ranges[i].pfn_hi + 1 < pfn; i++)
+		;
+
+	if (i < *nr && ranges[i].pfn_lo <= pfn_hi + 1) {
+		ranges[i].pfn_lo = min(ranges[i].pfn_lo, pfn);
+		ranges[i].pfn_hi = max(ranges[i].pfn_hi, pfn_hi);
+
+		/* The grown range may now reach the following ones, too */
+		for (j = i + 1; j < *nr &&
+		     ranges[j].pfn_lo <= ranges[i].pfn_hi + 1; j++)
+			ranges[i].pfn_hi = max(ranges[i].pfn_hi,
+					       ranges[j].pfn_hi);
+
+		memmove(&ranges[i + 1], &ranges[j],
+			(*nr - j) * sizeof(*ranges));
+		*nr -= j - i - 1;
+		return true;
+	}
+
+	if (*nr == IOVA_FQ_MAX_RANGES)
+		return false;
+
+	memmove(&ranges[i + 1], &ranges[i], (*nr - i) * sizeof(*ranges));
+	ranges[i].pfn_lo = pfn;
+	ranges[i].pfn_hi = pfn_hi;
+	(*nr)++;
+	return true;
+}
+
+/*
+ * Flush the IOTLB only for what is queued in this Flush-Queue, with the
+ * entries sorted and coalesced into a few range invalidations, and free
+ * them. Returns false if the IOMMU driver can't do range invalidations or
+ * the entries are too scattered, so the caller has to flush the domain.
+ */
+static bool fq_flush_ranges(struct iova_domain *iovad, struct iova_fq *fq)
+{
+	struct iova_fq_range ranges[IOVA_FQ_MAX_RANGES];
+	unsigned int i, nr = 0;
+	unsigned idx;
+
+	assert_spin_locked(&fq->lock);
+
+	if (!iovad->flush_range_cb)
+		return false;
+
+	/* Entries covered by a full flush meanwhile are done already */
+	fq_ring_free(iovad, fq);
+
+	fq_ring_for_each(idx, fq) {
+		if (!fq_range_add(ranges, &nr, fq->entries[idx].iova_pfn,
+				  fq->entries[idx].pages))
+			return false;
+	}
+
+	for (i = 0; i < nr; i++)
+		iovad->flush_range_cb(iovad, ranges[i].pfn_lo,
+				      ranges[i].pfn_hi - ranges[i].pfn_lo + 1);
+	atomic64_add(nr, &fq_flush_range_cnt);
+
+	fq_ring_for_each(idx, fq)
+		fq_entry_free(iovad, &fq->entries[idx]);
+	fq->head = fq->tail;
+
+	return true;
+}
+
+/*
+ * Flush the whole domain for a Flush-Queue that fq_flush_ranges() could not
+ * deal with.
+ */
+static void fq_flush_all(struct iova_domain *iovad)
+{
+	if (iovad->flush_range_cb)
+		atomic64_inc(&fq_flush_fallback_cnt);
+
+	iova_domain_flush(iovad);
+}
+
 static void fq_destroy_all_entries(struct iova_domain *iovad)
 {
 	int cpu;
@@ -530,10 +722,30 @@ static void fq_destroy_all_entries(struct iova_domain *iovad)
 static void fq_flush_timeout(struct timer_list *t)
 {
 	struct iova_domain *iovad = from_timer(iovad, t, fq_timer);
+	bool flush_all = !iovad->flush_range_cb;
 	int cpu;
 
 	atomic_set(&iovad->fq_timer_on, 0);
-	iova_domain_flush(iovad);
+
+	/* Try to invalidate just what each CPU has queued first */
+	for_each_possible_cpu(cpu) {
+		unsigned long flags;
+		struct iova_fq *fq;
+
+		if (flush_all)
+			break;
+
+		fq = per_cpu_ptr(iovad->fq, cpu);
+		spin_lock_irqsave(&fq->lock, flags);
+		if (!fq_flush_ranges(iovad, fq))
+			flush_all = true;
+		spin_unlock_irqrestore(&fq->lock, flags);
+	}
+
+	if (!flush_all)
+		return;
+
+	fq_flush_all(iovad);
 
 	for_each_possible_cpu(cpu) {
 		unsigned long flags;
@@ -563,8 +775,8 @@ void queue_iova(struct iova_domain *iovad,
 	 */
 	fq_ring_free(iovad, fq);
 
-	if (fq_full(fq)) {
-		iova_domain_flush(iovad);
+	if (fq_full(fq) && !fq_flush_ranges(iovad, fq)) {
+		fq_flush_all(iovad);
 		fq_ring_free(iovad, fq);
 	}
 
@@ -675,6 +887,7 @@ reserve_iova(struct iova_domain *iovad,
 		if (__is_range_overlap(node, pfn_lo, pfn_hi)) {
 			iova = rb_entry(node, struct iova, node);
 			__adjust_overlap_range(iova, &pfn_lo, &pfn_hi);
+			iova_gap_update(node);
 			if ((pfn_lo >= iova->pfn_lo) &&
 				(pfn_hi <= iova->pfn_hi))
 				goto finish;
@@ -744,8 +957,8 @@ split_and_remove_iova(struct iova_domain *iovad, struct iova *iova,
 			goto error;
 	}
 
-	__cached_rbnode_delete_update(iovad, iova);
-	rb_erase(&iova->node, &iovad->rbroot);
+	__iova_delete_update(iovad, iova);
+	iova_erase_rbtree(&iovad->rbroot, iova);
 
 	if (prev) {
 		iova_insert_rbtree(&iovad->rbroot, prev, NULL);
@@ -1046,5 +1259,35 @@ void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
 	}
 }
 
+#ifdef CONFIG_IOMMU_DEBUGFS
+static struct dentry *iova_debugfs_dir;
+
+static int fq_stat_get(void *data, u64 *val)
+{
+	*val = atomic64_read(data);
+	return 0;
+}
+DEFINE_DEBUGFS_ATTRIBUTE(fq_stat_fops, fq_stat_get, NULL, "%llu\n");
+
+static int __init iova_debugfs_init(void)
+{
+	iova_debugfs_dir = debugfs_create_dir("iova", iommu_debugfs_dir);
+	debugfs_create_file_unsafe("fq_flush_ranges", 0444, iova_debugfs_dir,
+				   &fq_flush_range_cnt, &fq_stat_fops);
+	debugfs_create_file_unsafe("fq_flush_fallbacks", 0444,
+				   iova_debugfs_dir, &fq_flush_fallback_cnt,
+				   &fq_stat_fops);
+	return 0;
+}
+
+static void __exit iova_debugfs_exit(void)
+{
+	debugfs_remove_recursive(iova_debugfs_dir);
+}
+
+module_init(iova_debugfs_init);
+module_exit(iova_debugfs_exit);
+#endif
+
 MODULE_AUTHOR("Anil S Keshavamurthy <anil.s.keshavamurthy@intel.com>");
 MODULE_LICENSE("GPL");
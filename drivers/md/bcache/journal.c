@@ -10,6 +10,7 @@
 #include "debug.h"
 #include "extents.h"
 
+#include <linux/hash.h>
 #include <trace/events/bcache.h>
 
 /*
@@ -19,7 +20,8 @@
  * entries, do some other stuff, then we mark all the keys in the journal
  * entries (same as garbage collection would), then we replay them - reinserting
  * them into the cache in precisely the same order as they appear in the
- * journal.
+ * journal. Keys that cannot overlap are replayed in parallel, see
+ * journal_replay_parallel().
  *
  * We only journal keys that go in leaf nodes, which simplifies things quite a
  * bit.
@@ -347,6 +349,175 @@ static bool is_discard_enabled(struct cache_set *s)
 	return false;
 }
 
+/*
+ * Keys only need to be replayed in journal order relative to the keys they
+ * overlap. The key space is split into fixed size chunks, each chunk is owned
+ * by one replay thread, and keys straddling a chunk boundary are cut so each
+ * piece is inserted by the owner of its chunk. Every chunk thus still sees its
+ * keys in journal order, and the resulting btree is the same as after a
+ * serial replay.
+ */
+static int journal_replay_chunk_owner(struct bkey *k, uint64_t chunk, int nr)
+{
+	return hash_64(chunk ^ (KEY_INODE(k) << 44), 32) % nr;
+}
+
+static int journal_replay_key(struct cache_set *c, struct journal_replay *i,
+			      struct bkey *k, int idx, int nr)
+{
+	uint64_t chunk = KEY_START(k) >> BCH_JOURNAL_REPLAY_CHUNK_BITS;
+	uint64_t last = chunk;
+	struct keylist keylist;
+	BKEY_PADDED(key) temp;
+	int ret;
+
+	if (KEY_SIZE(k))
+		last = (KEY_OFFSET(k) - 1) >> BCH_JOURNAL_REPLAY_CHUNK_BITS;
+
+	for (; chunk <= last; chunk++) {
+		uint64_t start = chunk << BCH_JOURNAL_REPLAY_CHUNK_BITS;
+		uint64_t end = (chunk + 1) << BCH_JOURNAL_REPLAY_CHUNK_BITS;
+
+		if (nr > 1 && journal_replay_chunk_owner(k, chunk, nr) != idx)
+			continue;
+
+		/*
+		 * Btree insertion cuts the keys it is given in place, and the
+		 * journal entry is shared by all replay threads, so always
+		 * insert a private copy.
+		 */
+		bkey_copy(&temp.key, k);
+		if (start > KEY_START(k))
+			bch_cut_front(&KEY(KEY_INODE(k), start, 0), &temp.key);
+		if (end < KEY_OFFSET(k))
+			bch_cut_back(&KEY(KEY_INODE(k), end, 0), &temp.key);
+
+		trace_bcache_journal_replay_key(&temp.key);
+
+		bch_keylist_init_single(&keylist, &temp.key);
+
+		ret = bch_btree_insert(c, &keylist, i->pin, NULL);
+		if (ret)
+			return ret;
+
+		BUG_ON(!bch_keylist_empty(&keylist));
+	}
+
+	return 0;
+}
+
+static int journal_replay_keys(struct cache_set *c, struct list_head *list,
+			       int idx, int nr)
+{
+	struct journal_replay *i;
+	struct bkey *k;
+	int ret;
+
+	list_for_each_entry(i, list, list) {
+		for (k = i->j.start;
+		     k < bset_bkey_last(&i->j);
+		     k = bkey_next(k)) {
+			ret = journal_replay_key(c, i, k, idx, nr);
+			if (ret)
+				return ret;
+
+			cond_resched();
+		}
+	}
+
+	return 0;
+}
+
+static int bch_journal_replay_thread(void *arg)
+{
+	struct journal_replay_thrd_info *info = arg;
+	struct bch_journal_replay_state *state = info->state;
+
+	info->result = journal_replay_keys(state->c, state->list,
+					   info->idx, state->total_threads);
+
+	/* In order to wake up state->wait in time */
+	smp_mb__before_atomic();
+	if (atomic_dec_and_test(&state->started))
+		wake_up(&state->wait);
+
+	return 0;
+}
+
+static int bch_journal_replay_thread_nr(void)
+{
+	int n = num_online_cpus()/2;
+
+	if (n == 0)
+		n = 1;
+	else if (n > BCH_JOURNAL_REPLAY_THRD_MAX)
+		n = BCH_JOURNAL_REPLAY_THRD_MAX;
+
+	return n;
+}
+
+static int journal_replay_parallel(struct cache_set *c, struct list_head *list)
+{
+	struct bch_journal_replay_state *state;
+	int i, nr, ret = 0;
+	char name[32];
+
+	nr = bch_journal_replay_thread_nr();
+	if (nr == 1)
+		return journal_replay_keys(c, list, 0, 1);
+
+	state = kzalloc(sizeof(struct bch_journal_replay_state), GFP_KERNEL);
+	if (!state)
+		return journal_replay_keys(c, list, 0, 1);
+
+	state->c = c;
+	state->list = list;
+	state->total_threads = nr;
+	atomic_set(&state->started, 0);
+	init_waitqueue_head(&state->wait);
+
+	for (i = 0; i < nr; i++) {
+		state->infos[i].state = state;
+		state->infos[i].idx = i;
+		state->infos[i].result = 0;
+		atomic_inc(&state->started);
+		snprintf(name, sizeof(name), "bch_jreplay[%d]", i);
+
+		state->infos[i].thread =
+			kthread_run(bch_journal_replay_thread,
+				    &state->infos[i],
+				    name);
+		if (IS_ERR(state->infos[i].thread)) {
+			pr_err("fails to run thread bch_jreplay[%d]\n", i);
+			atomic_dec(&state->started);
+			break;
+		}
+	}
+
+	/*
+	 * Chunks of threads which could not be created are replayed from
+	 * here, alongside the threads which are running.
+	 */
+	for (; i < nr; i++)
+		state->infos[i].result = journal_replay_keys(c, list, i, nr);
+
+	/*
+	 * The replay threads reference the journal list and the state, so
+	 * they must all have finished before either is freed.
+	 */
+	wait_event(state->wait, atomic_read(&state->started) == 0);
+
+	for (i = 0; i < nr; i++) {
+		if (state->infos[i].result) {
+			ret = state->infos[i].result;
+			break;
+		}
+	}
+
+	kfree(state);
+	return ret;
+}
+
 int bch_journal_replay(struct cache_set *s, struct list_head *list)
 {
 	int ret = 0, keys = 0, entries = 0;
@@ -355,7 +526,6 @@ int bch_journal_replay(struct cache_set *s, struct list_head *list)
 		list_entry(list->prev, struct journal_replay, list);
 
 	uint64_t start = i->j.last_seq, end = i->j.seq, n = start;
-	struct keylist keylist;
 
 	list_for_each_entry(i, list, list) {
 		BUG_ON(i->pin && atomic_read(i->pin) != 1);
@@ -374,27 +544,21 @@ int bch_journal_replay(struct cache_set *s, struct list_head *list)
 
 		for (k = i->j.start;
 		     k < bset_bkey_last(&i->j);
-		     k = bkey_next(k)) {
-			trace_bcache_journal_replay_key(k);
-
-			bch_keylist_init_single(&keylist, k);
-
-			ret = bch_btree_insert(s, &keylist, i->pin, NULL);
-			if (ret)
-				goto err;
-
-			BUG_ON(!bch_keylist_empty(&keylist));
+		     k = bkey_next(k))
 			keys++;
 
-			cond_resched();
-		}
-
-		if (i->pin)
-			atomic_dec(i->pin);
 		n = i->j.seq + 1;
 		entries++;
 	}
 
+	ret = journal_replay_parallel(s, list);
+	if (ret)
+		goto err;
+
+	list_for_each_entry(i, list, list)
+		if (i->pin)
+			atomic_dec(i->pin);
+
 	pr_info("journal replay done, %i keys in %i entries, seq %llu\n",
 		keys, entries, end);
 err:
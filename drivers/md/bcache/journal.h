@@ -166,6 +166,31 @@ struct journal_device {
 #define journal_full(j)						\
 	(!(j)->blocks_free || fifo_free(&(j)->pin) <= 1)
 
+/*
+ * Journal replay splits the key space into chunks of
+ * 2^BCH_JOURNAL_REPLAY_CHUNK_BITS sectors, and each chunk is owned by exactly
+ * one replay thread.
+ */
+#define BCH_JOURNAL_REPLAY_THRD_MAX	64
+#define BCH_JOURNAL_REPLAY_CHUNK_BITS	15
+
+struct bch_journal_replay_state;
+struct journal_replay_thrd_info {
+	struct bch_journal_replay_state	*state;
+	struct task_struct		*thread;
+	int				idx;
+	int				result;
+};
+
+struct bch_journal_replay_state {
+	struct cache_set		*c;
+	struct list_head		*list;
+	int				total_threads;
+	atomic_t			started;
+	wait_queue_head_t		wait;
+	struct journal_replay_thrd_info	infos[BCH_JOURNAL_REPLAY_THRD_MAX];
+};
+
 struct closure;
 struct cache_set;
 struct btree_op;
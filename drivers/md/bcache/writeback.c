@@ -242,28 +242,50 @@ static unsigned int writeback_delay(struct cached_dev *dc,
 	return bch_next_delay(&dc->writeback_rate, sectors);
 }
 
+/*
+ * A dirty_io writes back one pass: a run of contiguous dirty keys. Each key is
+ * read from the cache into its slice of io->bio, and once all reads are done
+ * the whole run goes to the backing device as a single write.
+ */
 struct dirty_io {
 	struct closure		cl;
 	struct cached_dev	*dc;
 	uint16_t		sequence;
+	unsigned int		nr_keys;
+	struct keybuf_key	*keys[MAX_WRITEBACKS_IN_BIG_PASS];
 	struct bio		bio;
 };
 
-static void dirty_init(struct keybuf_key *w)
+static void dirty_init(struct dirty_io *io, size_t sectors)
 {
-	struct dirty_io *io = w->private;
 	struct bio *bio = &io->bio;
 
 	bio_init(bio, bio->bi_inline_vecs,
-		 DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS));
+		 DIV_ROUND_UP(sectors, PAGE_SECTORS));
 	if (!io->dc->writeback_percent)
 		bio_set_prio(bio, IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0));
 
-	bio->bi_iter.bi_size	= KEY_SIZE(&w->key) << 9;
-	bio->bi_private		= w;
+	bio->bi_iter.bi_size	= sectors << 9;
+	bio->bi_private		= io;
 	bch_bio_map(bio, NULL);
 }
 
+/*
+ * Returns a bio covering only key @i of the pass, sharing io->bio's pages.
+ */
+static struct bio *dirty_key_bio(struct dirty_io *io, unsigned int i)
+{
+	struct keybuf_key *w = io->keys[i];
+	struct bio *bio;
+
+	bio = bio_clone_fast(&io->bio, GFP_NOIO, &io->dc->disk.bio_split);
+	bio_trim(bio, KEY_START(&w->key) - KEY_START(&io->keys[0]->key),
+		 KEY_SIZE(&w->key));
+	bio->bi_private = w;
+
+	return bio;
+}
+
 static void dirty_io_destructor(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
@@ -274,43 +296,62 @@ static void dirty_io_destructor(struct closure *cl)
 static void write_dirty_finish(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
-	struct keybuf_key *w = io->bio.bi_private;
 	struct cached_dev *dc = io->dc;
+	unsigned int n;
 
 	bio_free_pages(&io->bio);
 
-	/* This is kind of a dumb way of signalling errors. */
-	if (KEY_DIRTY(&w->key)) {
-		int ret;
-		unsigned int i;
-		struct keylist keys;
+	for (n = 0; n < io->nr_keys; n++) {
+		struct keybuf_key *w = io->keys[n];
+
+		/* This is kind of a dumb way of signalling errors. */
+		if (KEY_DIRTY(&w->key)) {
+			int ret;
+			unsigned int i;
+			struct keylist keys;
 
-		bch_keylist_init(&keys);
+			bch_keylist_init(&keys);
 
-		bkey_copy(keys.top, &w->key);
-		SET_KEY_DIRTY(keys.top, false);
-		bch_keylist_push(&keys);
+			bkey_copy(keys.top, &w->key);
+			SET_KEY_DIRTY(keys.top, false);
+			bch_keylist_push(&keys);
 
-		for (i = 0; i < KEY_PTRS(&w->key); i++)
-			atomic_inc(&PTR_BUCKET(dc->disk.c, &w->key, i)->pin);
+			for (i = 0; i < KEY_PTRS(&w->key); i++)
+				atomic_inc(&PTR_BUCKET(dc->disk.c, &w->key, i)->pin);
 
-		ret = bch_btree_insert(dc->disk.c, &keys, NULL, &w->key);
+			ret = bch_btree_insert(dc->disk.c, &keys, NULL, &w->key);
 
-		if (ret)
-			trace_bcache_writeback_collision(&w->key);
+			if (ret)
+				trace_bcache_writeback_collision(&w->key);
 
-		atomic_long_inc(ret
-				? &dc->disk.c->writeback_keys_failed
-				: &dc->disk.c->writeback_keys_done);
+			atomic_long_inc(ret
+					? &dc->disk.c->writeback_keys_failed
+					: &dc->disk.c->writeback_keys_done);
+		}
+
+		bch_keybuf_del(&dc->writeback_keys, w);
 	}
 
-	bch_keybuf_del(&dc->writeback_keys, w);
 	up(&dc->in_flight);
 
 	closure_return_with_destructor(cl, dirty_io_destructor);
 }
 
 static void dirty_endio(struct bio *bio)
+{
+	struct dirty_io *io = bio->bi_private;
+	unsigned int i;
+
+	if (bio->bi_status) {
+		for (i = 0; i < io->nr_keys; i++)
+			SET_KEY_DIRTY(&io->keys[i]->key, false);
+		bch_count_backing_io_errors(io->dc, bio);
+	}
+
+	closure_put(&io->cl);
+}
+
+static void dirty_key_endio(struct bio *bio)
 {
 	struct keybuf_key *w = bio->bi_private;
 	struct dirty_io *io = w->private;
@@ -320,14 +361,15 @@ static void dirty_endio(struct bio *bio)
 		bch_count_backing_io_errors(io->dc, bio);
 	}
 
+	bio_put(bio);
 	closure_put(&io->cl);
 }
 
 static void write_dirty(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
-	struct keybuf_key *w = io->bio.bi_private;
 	struct cached_dev *dc = io->dc;
+	unsigned int i, nr_dirty = 0;
 
 	uint16_t next_sequence;
 
@@ -349,21 +391,43 @@ static void write_dirty(struct closure *cl)
 
 	next_sequence = io->sequence + 1;
 
+	for (i = 0; i < io->nr_keys; i++)
+		if (KEY_DIRTY(&io->keys[i]->key))
+			nr_dirty++;
+
 	/*
 	 * IO errors are signalled using the dirty bit on the key.
 	 * If we failed to read, we should not attempt to write to the
 	 * backing device.  Instead, immediately go to write_dirty_finish
 	 * to clean up.
+	 *
+	 * Normally the whole pass is written with one bio; keys whose
+	 * read failed leave holes, and the rest are then written one by one.
 	 */
-	if (KEY_DIRTY(&w->key)) {
-		dirty_init(w);
+	if (nr_dirty == io->nr_keys) {
 		bio_set_op_attrs(&io->bio, REQ_OP_WRITE, 0);
-		io->bio.bi_iter.bi_sector = KEY_START(&w->key);
+		io->bio.bi_iter.bi_sector = KEY_START(&io->keys[0]->key);
 		bio_set_dev(&io->bio, io->dc->bdev);
 		io->bio.bi_end_io	= dirty_endio;
 
 		/* I/O request sent to backing device */
 		closure_bio_submit(io->dc->disk.c, &io->bio, cl);
+	} else if (nr_dirty) {
+		for (i = 0; i < io->nr_keys; i++) {
+			struct keybuf_key *w = io->keys[i];
+			struct bio *bio;
+
+			if (!KEY_DIRTY(&w->key))
+				continue;
+
+			bio = dirty_key_bio(io, i);
+			bio_set_op_attrs(bio, REQ_OP_WRITE, 0);
+			bio->bi_iter.bi_sector = KEY_START(&w->key);
+			bio_set_dev(bio, io->dc->bdev);
+			bio->bi_end_io	= dirty_key_endio;
+
+			closure_bio_submit(io->dc->disk.c, bio, cl);
+		}
 	}
 
 	atomic_set(&dc->writeback_sequence_next, next_sequence);
@@ -382,24 +446,72 @@ static void read_dirty_endio(struct bio *bio)
 			    bio->bi_status, 1,
 			    "reading dirty data from cache");
 
-	dirty_endio(bio);
+	dirty_key_endio(bio);
 }
 
 static void read_dirty_submit(struct closure *cl)
 {
 	struct dirty_io *io = container_of(cl, struct dirty_io, cl);
+	unsigned int i;
 
-	closure_bio_submit(io->dc->disk.c, &io->bio, cl);
+	for (i = 0; i < io->nr_keys; i++) {
+		struct keybuf_key *w = io->keys[i];
+		struct bio *bio = dirty_key_bio(io, i);
+
+		bio_set_op_attrs(bio, REQ_OP_READ, 0);
+		bio->bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
+		bio_set_dev(bio, PTR_CACHE(io->dc->disk.c, &w->key, 0)->bdev);
+		bio->bi_end_io	= read_dirty_endio;
+
+		closure_bio_submit(io->dc->disk.c, bio, cl);
+	}
 
 	continue_at(cl, write_dirty, io->dc->writeback_write_wq);
 }
 
+/*
+ * How many keys and sectors one writeback pass may gather. When the cache set
+ * is idle, passes are allowed to grow so the backing device sees large
+ * sequential writes. When partial stripe writes are expensive, passes end on
+ * stripe boundaries so that contiguous dirty data becomes full-stripe writes.
+ */
+static void writeback_pass_limits(struct cached_dev *dc, struct bkey *k,
+				  unsigned int *max_keys, size_t *max_size)
+{
+	*max_keys = MAX_WRITEBACKS_IN_PASS;
+	*max_size = MAX_WRITESIZE_IN_PASS;
+
+	if (atomic_read(&dc->disk.c->at_max_writeback_rate)) {
+		*max_keys = MAX_WRITEBACKS_IN_BIG_PASS;
+		*max_size = MAX_WRITESIZE_IN_BIG_PASS;
+	}
+
+	if (dc->partial_stripes_expensive) {
+		unsigned int stripe_size = dc->disk.stripe_size;
+		uint64_t start = KEY_START(k);
+		uint64_t end = start;
+		/* never cut a pass short of the stripe it starts in */
+		uint64_t cap = max_t(uint64_t, MAX_WRITESIZE_IN_BIG_PASS,
+				     stripe_size);
+
+		do_div(end, stripe_size);
+		end = (end + 1) * stripe_size;
+
+		while (end - start < *max_size &&
+		       end - start + stripe_size <= cap)
+			end += stripe_size;
+
+		*max_keys = MAX_WRITEBACKS_IN_BIG_PASS;
+		*max_size = end - start;
+	}
+}
+
 static void read_dirty(struct cached_dev *dc)
 {
 	unsigned int delay = 0;
-	struct keybuf_key *next, *keys[MAX_WRITEBACKS_IN_PASS], *w;
-	size_t size;
-	int nk, i;
+	struct keybuf_key *next, *keys[MAX_WRITEBACKS_IN_BIG_PASS];
+	size_t size, max_size;
+	unsigned int nk, max_keys, i;
 	struct dirty_io *io;
 	struct closure cl;
 	uint16_t sequence = 0;
@@ -421,6 +533,8 @@ static void read_dirty(struct cached_dev *dc)
 		size = 0;
 		nk = 0;
 
+		writeback_pass_limits(dc, &next->key, &max_keys, &max_size);
+
 		do {
 			BUG_ON(ptr_stale(dc->disk.c, &next->key, 0));
 
@@ -428,14 +542,14 @@ static void read_dirty(struct cached_dev *dc)
 			 * Don't combine too many operations, even if they
 			 * are all small.
 			 */
-			if (nk >= MAX_WRITEBACKS_IN_PASS)
+			if (nk >= max_keys)
 				break;
 
 			/*
 			 * If the current operation is very large, don't
 			 * further combine operations.
 			 */
-			if (size >= MAX_WRITESIZE_IN_PASS)
+			if (nk != 0 && size + KEY_SIZE(&next->key) > max_size)
 				break;
 
 			/*
@@ -455,41 +569,40 @@ static void read_dirty(struct cached_dev *dc)
 			keys[nk++] = next;
 		} while ((next = bch_keybuf_next(&dc->writeback_keys)));
 
-		/* Now we have gathered a set of 1..5 keys to write back. */
+		/*
+		 * Now we have gathered a run of contiguous keys; read them
+		 * from the cache and write them back as one bio.
+		 */
+		io = kzalloc(struct_size(io, bio.bi_inline_vecs,
+					 DIV_ROUND_UP(size, PAGE_SECTORS)),
+			     GFP_KERNEL);
+		if (!io)
+			goto err;
+
+		io->dc		= dc;
+		io->sequence	= sequence++;
+		io->nr_keys	= nk;
 		for (i = 0; i < nk; i++) {
-			w = keys[i];
-
-			io = kzalloc(struct_size(io, bio.bi_inline_vecs,
-						DIV_ROUND_UP(KEY_SIZE(&w->key), PAGE_SECTORS)),
-				     GFP_KERNEL);
-			if (!io)
-				goto err;
-
-			w->private	= io;
-			io->dc		= dc;
-			io->sequence    = sequence++;
+			io->keys[i] = keys[i];
+			keys[i]->private = io;
+		}
 
-			dirty_init(w);
-			bio_set_op_attrs(&io->bio, REQ_OP_READ, 0);
-			io->bio.bi_iter.bi_sector = PTR_OFFSET(&w->key, 0);
-			bio_set_dev(&io->bio,
-				    PTR_CACHE(dc->disk.c, &w->key, 0)->bdev);
-			io->bio.bi_end_io	= read_dirty_endio;
+		dirty_init(io, size);
 
-			if (bch_bio_alloc_pages(&io->bio, GFP_KERNEL))
-				goto err_free;
+		if (bch_bio_alloc_pages(&io->bio, GFP_KERNEL))
+			goto err_free;
 
-			trace_bcache_writeback(&w->key);
+		for (i = 0; i < nk; i++)
+			trace_bcache_writeback(&keys[i]->key);
 
-			down(&dc->in_flight);
+		down(&dc->in_flight);
 
-			/*
-			 * We've acquired a semaphore for the maximum
-			 * simultaneous number of writebacks; from here
-			 * everything happens asynchronously.
-			 */
-			closure_call(&io->cl, read_dirty_submit, NULL, &cl);
-		}
+		/*
+		 * We've acquired a semaphore for the maximum
+		 * simultaneous number of writebacks; from here
+		 * everything happens asynchronously.
+		 */
+		closure_call(&io->cl, read_dirty_submit, NULL, &cl);
 
 		delay = writeback_delay(dc, size);
 
@@ -503,9 +616,10 @@ static void read_dirty(struct cached_dev *dc)
 
 	if (0) {
 err_free:
-		kfree(w->private);
+		kfree(io);
 err:
-		bch_keybuf_del(&dc->writeback_keys, w);
+		for (i = 0; i < nk; i++)
+			bch_keybuf_del(&dc->writeback_keys, keys[i]);
 	}
 
 	/*
@@ -11,6 +11,10 @@
 #define MAX_WRITEBACKS_IN_PASS  5
 #define MAX_WRITESIZE_IN_PASS   5000	/* *512b */
 
+/* Pass limits when the cache set is idle or when writing whole stripes */
+#define MAX_WRITEBACKS_IN_BIG_PASS	64
+#define MAX_WRITESIZE_IN_BIG_PASS	8192	/* *512b */
+
 #define WRITEBACK_RATE_UPDATE_SECS_MAX		60
 #define WRITEBACK_RATE_UPDATE_SECS_DEFAULT	5
 
@@ -368,15 +368,43 @@ static int insert_new_ablock(struct dm_array_info *info, size_t size_of_block,
 	return r;
 }
 
+/*
+ * Full array blocks are inserted into the btree this many at a time, so
+ * consecutive blocks share the shadowing of the btree leaf they go in.
+ */
+#define INSERT_BATCH_SIZE 32u
+
 static int insert_full_ablocks(struct dm_array_info *info, size_t size_of_block,
 			       unsigned begin_block, unsigned end_block,
 			       unsigned max_entries, const void *value,
 			       dm_block_t *root)
 {
 	int r = 0;
+	unsigned i, nr;
+	uint64_t key, keys[INSERT_BATCH_SIZE];
+	__le64 blocks_le[INSERT_BATCH_SIZE];
+	struct dm_block *block;
+	struct array_block *ab;
+
+	while (!r && begin_block != end_block) {
+		nr = min(end_block - begin_block, INSERT_BATCH_SIZE);
 
-	for (; !r && begin_block != end_block; begin_block++)
-		r = insert_new_ablock(info, size_of_block, max_entries, begin_block, max_entries, value, root);
+		for (i = 0; i < nr; i++) {
+			r = alloc_ablock(info, size_of_block, max_entries, &block, &ab);
+			if (r)
+				return r;
+
+			fill_ablock(info, ab, value, max_entries);
+			keys[i] = begin_block + i;
+			blocks_le[i] = cpu_to_le64(dm_block_location(block));
+			unlock_ablock(info, block);
+		}
+
+		__dm_bless_for_disk(blocks_le);
+		r = dm_btree_insert_batch(&info->btree_info, *root, &key, keys,
+					  blocks_le, nr, root, NULL);
+		begin_block += nr;
+	}
 
 	return r;
 }
@@ -71,12 +71,22 @@ static int upper_bound(struct btree_node *n, uint64_t key)
 void inc_children(struct dm_transaction_manager *tm, struct btree_node *n,
 		  struct dm_btree_value_type *vt)
 {
-	unsigned i;
+	unsigned i, j;
+	dm_block_t b;
 	uint32_t nr_entries = le32_to_cpu(n->header.nr_entries);
 
+	/*
+	 * Children are often allocated one after another, so increment
+	 * each run of adjacent blocks as a range.
+	 */
 	if (le32_to_cpu(n->header.flags) & INTERNAL_NODE)
-		for (i = 0; i < nr_entries; i++)
-			dm_tm_inc(tm, value64(n, i));
+		for (i = 0; i < nr_entries; i = j) {
+			b = value64(n, i);
+			for (j = i + 1; j < nr_entries; j++)
+				if (value64(n, j) != b + (j - i))
+					break;
+			dm_tm_inc_range(tm, b, b + (j - i));
+		}
 	else if (vt->inc)
 		for (i = 0; i < nr_entries; i++)
 			vt->inc(vt->context, value_ptr(n, i));
@@ -690,11 +700,17 @@ static int btree_split_beneath(struct shadow_spine *s, uint64_t key)
 	return 0;
 }
 
+/*
+ * On return *bound holds the lowest key that belongs to a node to the right
+ * of the leaf we stopped at, or U64_MAX if no such key is known.  Keys below
+ * *bound that are greater than @key may be inserted into the same leaf.
+ */
 static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 			    struct dm_btree_value_type *vt,
-			    uint64_t key, unsigned *index)
+			    uint64_t key, unsigned *index, uint64_t *bound)
 {
 	int r, i = *index, top = 1;
+	uint64_t node_bound = U64_MAX;
 	struct btree_node *node;
 
 	for (;;) {
@@ -727,6 +743,17 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 
 			if (r < 0)
 				return r;
+
+			if (!top) {
+				/*
+				 * If we kept the left half, the right half now
+				 * bounds it.
+				 */
+				struct btree_node *pn = dm_block_data(shadow_parent(s));
+
+				if (key < le64_to_cpu(pn->keys[i + 1]))
+					node_bound = le64_to_cpu(pn->keys[i + 1]);
+			}
 		}
 
 		node = dm_block_data(shadow_current(s));
@@ -742,6 +769,9 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 			i = 0;
 		}
 
+		if (i + 1 < le32_to_cpu(node->header.nr_entries))
+			node_bound = le64_to_cpu(node->keys[i + 1]);
+
 		root = value64(node, i);
 		top = 0;
 	}
@@ -750,6 +780,7 @@ static int btree_insert_raw(struct shadow_spine *s, dm_block_t root,
 		i++;
 
 	*index = i;
+	*bound = node_bound;
 	return 0;
 }
 
@@ -760,80 +791,106 @@ static bool need_insert(struct btree_node *node, uint64_t *keys,
 		(le64_to_cpu(node->keys[index]) != keys[level]));
 }
 
-static int insert(struct dm_btree_info *info, dm_block_t root,
-		  uint64_t *keys, void *value, dm_block_t *new_root,
-		  int *inserted)
-		  __dm_written_to_disk(value)
+/*
+ * Walks down to the leaf that the bottom level key belongs in, shadowing and
+ * splitting nodes on the way.  The leaf is left as shadow_current(spine).
+ */
+static int insert_walk(struct shadow_spine *spine, struct dm_btree_info *info,
+		       dm_block_t root, uint64_t *keys, unsigned *index,
+		       uint64_t *bound)
 {
 	int r;
-	unsigned level, index = -1, last_level = info->levels - 1;
+	unsigned level, last_level = info->levels - 1;
 	dm_block_t block = root;
-	struct shadow_spine spine;
 	struct btree_node *n;
 	struct dm_btree_value_type le64_type;
 
 	init_le64_type(info->tm, &le64_type);
-	init_shadow_spine(&spine, info);
+	*index = -1;
 
 	for (level = 0; level < (info->levels - 1); level++) {
-		r = btree_insert_raw(&spine, block, &le64_type, keys[level], &index);
+		r = btree_insert_raw(spine, block, &le64_type, keys[level],
+				     index, bound);
 		if (r < 0)
-			goto bad;
+			return r;
 
-		n = dm_block_data(shadow_current(&spine));
+		n = dm_block_data(shadow_current(spine));
 
-		if (need_insert(n, keys, level, index)) {
+		if (need_insert(n, keys, level, *index)) {
 			dm_block_t new_tree;
 			__le64 new_le;
 
 			r = dm_btree_empty(info, &new_tree);
 			if (r < 0)
-				goto bad;
+				return r;
 
 			new_le = cpu_to_le64(new_tree);
 			__dm_bless_for_disk(&new_le);
 
-			r = insert_at(sizeof(uint64_t), n, index,
+			r = insert_at(sizeof(uint64_t), n, *index,
 				      keys[level], &new_le);
 			if (r)
-				goto bad;
+				return r;
 		}
 
 		if (level < last_level)
-			block = value64(n, index);
+			block = value64(n, *index);
 	}
 
-	r = btree_insert_raw(&spine, block, &info->value_type,
-			     keys[level], &index);
-	if (r < 0)
-		goto bad;
-
-	n = dm_block_data(shadow_current(&spine));
+	return btree_insert_raw(spine, block, &info->value_type,
+				keys[level], index, bound);
+}
 
-	if (need_insert(n, keys, level, index)) {
+static int insert_value(struct dm_btree_info *info, struct btree_node *n,
+			unsigned index, uint64_t key, void *value,
+			int *inserted)
+			__dm_written_to_disk(value)
+{
+	if (need_insert(n, &key, 0, index)) {
 		if (inserted)
 			*inserted = 1;
 
-		r = insert_at(info->value_type.size, n, index,
-			      keys[level], value);
-		if (r)
-			goto bad_unblessed;
-	} else {
-		if (inserted)
-			*inserted = 0;
-
-		if (info->value_type.dec &&
-		    (!info->value_type.equal ||
-		     !info->value_type.equal(
-			     info->value_type.context,
-			     value_ptr(n, index),
-			     value))) {
-			info->value_type.dec(info->value_type.context,
-					     value_ptr(n, index));
-		}
-		memcpy_disk(value_ptr(n, index),
-			    value, info->value_type.size);
+		return insert_at(info->value_type.size, n, index, key, value);
+	}
+
+	if (inserted)
+		*inserted = 0;
+
+	if (info->value_type.dec &&
+	    (!info->value_type.equal ||
+	     !info->value_type.equal(
+		     info->value_type.context,
+		     value_ptr(n, index),
+		     value))) {
+		info->value_type.dec(info->value_type.context,
+				     value_ptr(n, index));
 	}
+	memcpy_disk(value_ptr(n, index),
+		    value, info->value_type.size);
+
+	return 0;
+}
+
+static int insert(struct dm_btree_info *info, dm_block_t root,
+		  uint64_t *keys, void *value, dm_block_t *new_root,
+		  int *inserted)
+		  __dm_written_to_disk(value)
+{
+	int r;
+	unsigned index;
+	uint64_t bound;
+	struct shadow_spine spine;
+
+	init_shadow_spine(&spine, info);
+
+	r = insert_walk(&spine, info, root, keys, &index, &bound);
+	if (r < 0)
+		goto bad;
+
+	r = insert_value(info, dm_block_data(shadow_current(&spine)), index,
+			 keys[info->levels - 1], value, inserted);
+	if (r)
+		goto bad_unblessed;
 
 	*new_root = shadow_root(&spine);
 	exit_shadow_spine(&spine);
@@ -864,6 +921,73 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 }
 EXPORT_SYMBOL_GPL(dm_btree_insert_notify);
 
+int dm_btree_insert_batch(struct dm_btree_info *info, dm_block_t root,
+			  uint64_t *keys, uint64_t *leaf_keys, void *values,
+			  unsigned count, dm_block_t *new_root,
+			  unsigned *nr_inserted)
+			  __dm_written_to_disk(values)
+{
+	int r = 0, inserted;
+	unsigned i, index, last_level = info->levels - 1;
+	uint64_t bound = 0;
+	struct shadow_spine spine;
+	struct btree_node *n = NULL;
+
+	if (nr_inserted)
+		*nr_inserted = 0;
+
+	init_shadow_spine(&spine, info);
+
+	for (i = 0; i < count; i++) {
+		void *value = values + i * info->value_type.size;
+
+		if (i && leaf_keys[i] <= leaf_keys[i - 1]) {
+			DMERR("batch insert keys are not in ascending order");
+			r = -EINVAL;
+			break;
+		}
+
+		keys[last_level] = leaf_keys[i];
+
+		/*
+		 * Only walk from the root when the key doesn't belong in the
+		 * leaf we already hold, or that leaf needs splitting.
+		 */
+		if (!n || leaf_keys[i] >= bound ||
+		    n->header.nr_entries == n->header.max_entries) {
+			exit_shadow_spine(&spine);
+			init_shadow_spine(&spine, info);
+
+			r = insert_walk(&spine, info, root, keys, &index, &bound);
+			if (r < 0)
+				break;
+
+			root = shadow_root(&spine);
+			n = dm_block_data(shadow_current(&spine));
+		} else {
+			int j = lower_bound(n, leaf_keys[i]);
+
+			if (j < 0 || le64_to_cpu(n->keys[j]) != leaf_keys[i])
+				j++;
+			index = j;
+		}
+
+		r = insert_value(info, n, index, leaf_keys[i], value, &inserted);
+		if (r)
+			break;
+
+		if (inserted && nr_inserted)
+			(*nr_inserted)++;
+	}
+
+	if (!r)
+		*new_root = root;
+	exit_shadow_spine(&spine);
+
+	return r;
+}
+EXPORT_SYMBOL_GPL(dm_btree_insert_batch);
+
 /*----------------------------------------------------------------*/
 
 static int find_key(struct ro_spine *s, dm_block_t block, bool find_highest,
@@ -964,6 +1088,18 @@ static int walk_node(struct dm_btree_info *info, dm_block_t block,
 	n = dm_block_data(node);
 
 	nr = le32_to_cpu(n->header.nr_entries);
+
+	/*
+	 * We're going to visit every child, so get them all reading now
+	 * rather than one at a time as the recursion reaches them.
+	 */
+	if (le32_to_cpu(n->header.flags) & INTERNAL_NODE) {
+		struct dm_block_manager *bm = dm_tm_get_bm(info->tm);
+
+		for (i = 0; i < nr; i++)
+			dm_bm_prefetch(bm, value64(n, i));
+	}
+
 	for (i = 0; i < nr; i++) {
 		if (le32_to_cpu(n->header.flags) & INTERNAL_NODE) {
 			r = walk_node(info, value64(n, i), fn, context);
@@ -133,6 +133,24 @@ int dm_btree_insert_notify(struct dm_btree_info *info, dm_block_t root,
 			   int *inserted)
 			   __dm_written_to_disk(value);
 
+/*
+ * Insert (or overwrite) a batch of values whose keys only differ in the
+ * bottom level.  'leaf_keys' holds the bottom level keys, which must be
+ * strictly ascending, and 'values' holds 'count' values back to back.  The
+ * final entry of 'keys' is overwritten with each of 'leaf_keys' in turn.
+ *
+ * Equivalent to calling dm_btree_insert() for each value, but a leaf that
+ * has been shadowed is reused by every following key that belongs in it,
+ * rather than walking and shadowing the spine again for each key.  If
+ * 'nr_inserted' is given it is set to the number of new (rather than
+ * overwritten) entries.
+ */
+int dm_btree_insert_batch(struct dm_btree_info *info, dm_block_t root,
+			  uint64_t *keys, uint64_t *leaf_keys, void *values,
+			  unsigned count, dm_block_t *new_root,
+			  unsigned *nr_inserted)
+			  __dm_written_to_disk(values);
+
 /*
  * Remove a key if present.  This doesn't remove empty sub trees.  Normally
  * subtrees represent a separate entity, like a snapshot map, so this is
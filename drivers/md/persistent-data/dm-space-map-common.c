@@ -9,6 +9,8 @@
 
 #include <linux/bitops.h>
 #include <linux/device-mapper.h>
+#include <linux/mm.h>
+#include <linux/sched/mm.h>
 
 #define DM_MSG_PREFIX "space map common"
 
@@ -188,6 +190,99 @@ static int sm_find_free(void *addr, unsigned begin, unsigned end,
 
 /*----------------------------------------------------------------*/
 
+/*
+ * Free summary.
+ */
+static unsigned long *summary_alloc(dm_block_t nr_indexes)
+{
+	unsigned long *summary;
+	unsigned noio_flag;
+
+	/*
+	 * Space maps are extended and opened with metadata locks held that
+	 * the io path may be waiting on.
+	 */
+	noio_flag = memalloc_noio_save();
+	summary = kvcalloc(BITS_TO_LONGS(max_t(dm_block_t, nr_indexes, 1)),
+			   sizeof(unsigned long), GFP_KERNEL);
+	memalloc_noio_restore(noio_flag);
+
+	return summary;
+}
+
+static void summary_free(struct ll_disk *ll)
+{
+	kvfree(ll->free_summary);
+	ll->free_summary = NULL;
+	ll->free_summary_bits = 0;
+}
+
+static void summary_update(struct ll_disk *ll, dm_block_t index,
+			   struct disk_index_entry *ie)
+{
+	if (!ll->free_summary)
+		return;
+
+	if (le32_to_cpu(ie->nr_free))
+		__set_bit(index, ll->free_summary);
+	else
+		__clear_bit(index, ll->free_summary);
+}
+
+/*
+ * If the summary can't be grown we stop using it, searches then fall back
+ * to checking every index entry.
+ */
+static void summary_resize(struct ll_disk *ll, dm_block_t nr_indexes)
+{
+	unsigned long *summary;
+
+	if (!ll->free_summary || nr_indexes <= ll->free_summary_bits)
+		return;
+
+	summary = summary_alloc(nr_indexes);
+	if (!summary) {
+		DMWARN("unable to grow free space summary");
+		summary_free(ll);
+		return;
+	}
+
+	bitmap_copy(summary, ll->free_summary, ll->free_summary_bits);
+	kvfree(ll->free_summary);
+	ll->free_summary = summary;
+	ll->free_summary_bits = nr_indexes;
+}
+
+static int summary_build(struct ll_disk *ll)
+{
+	int r;
+	dm_block_t i, nr_indexes;
+	struct disk_index_entry ie_disk;
+
+	nr_indexes = dm_sector_div_up(ll->nr_blocks, ll->entries_per_block);
+
+	ll->free_summary = summary_alloc(nr_indexes);
+	if (!ll->free_summary) {
+		DMWARN("unable to allocate free space summary");
+		return 0;
+	}
+	ll->free_summary_bits = nr_indexes;
+
+	for (i = 0; i < nr_indexes; i++) {
+		r = ll->load_ie(ll, i, &ie_disk);
+		if (r < 0) {
+			summary_free(ll);
+			return r;
+		}
+
+		summary_update(ll, i, &ie_disk);
+	}
+
+	return 0;
+}
+
+/*----------------------------------------------------------------*/
+
 static int sm_ll_init(struct ll_disk *ll, struct dm_transaction_manager *tm)
 {
 	memset(ll, 0, sizeof(struct ll_disk));
@@ -247,6 +342,8 @@ int sm_ll_extend(struct ll_disk *ll, dm_block_t extra_blocks)
 		return -EINVAL;
 	}
 
+	summary_resize(ll, blocks);
+
 	/*
 	 * We need to set this before the dm_tm_new_block() call below.
 	 */
@@ -269,6 +366,8 @@ int sm_ll_extend(struct ll_disk *ll, dm_block_t extra_blocks)
 		r = ll->save_ie(ll, i, &idx);
 		if (r < 0)
 			return r;
+
+		summary_update(ll, i, &idx);
 	}
 
 	return 0;
@@ -345,6 +444,19 @@ int sm_ll_find_free_block(struct ll_disk *ll, dm_block_t begin,
 		unsigned position;
 		uint32_t bit_end;
 
+		if (ll->free_summary) {
+			dm_block_t next = find_next_bit(ll->free_summary,
+							index_end, i);
+
+			if (next >= index_end)
+				break;
+
+			if (next != i) {
+				i = next;
+				begin = 0;
+			}
+		}
+
 		r = ll->load_ie(ll, i, &ie_disk);
 		if (r < 0)
 			return r;
@@ -492,7 +604,13 @@ static int sm_ll_mutate(struct ll_disk *ll, dm_block_t b,
 	} else
 		*ev = SM_NONE;
 
-	return ll->save_ie(ll, index, &ie_disk);
+	r = ll->save_ie(ll, index, &ie_disk);
+	if (r)
+		return r;
+
+	summary_update(ll, index, &ie_disk);
+
+	return 0;
 }
 
 static int set_ref_count(void *context, uint32_t old, uint32_t *new)
@@ -518,6 +636,95 @@ int sm_ll_inc(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev)
 	return sm_ll_mutate(ll, b, inc_ref_count, NULL, ev);
 }
 
+/*
+ * Increments the blocks from *b up to e that share a bitmap, shadowing the
+ * bitmap and saving its index entry once for all of them.  Returns 1, with
+ * *b pointing at it, if a block's count needs the ref count tree.
+ */
+static int sm_ll_inc_bitmap(struct ll_disk *ll, dm_block_t *b, dm_block_t e,
+			    dm_block_t *nr_allocations)
+{
+	int r, inc, overflow = 0;
+	uint32_t bit, bit_end, old;
+	struct dm_block *nb;
+	dm_block_t index = *b;
+	struct disk_index_entry ie_disk;
+	void *bm_le;
+
+	bit = do_div(index, ll->entries_per_block);
+	bit_end = min_t(dm_block_t, ll->entries_per_block, bit + (e - *b));
+
+	r = ll->load_ie(ll, index, &ie_disk);
+	if (r < 0)
+		return r;
+
+	r = dm_tm_shadow_block(ll->tm, le64_to_cpu(ie_disk.blocknr),
+			       &dm_sm_bitmap_validator, &nb, &inc);
+	if (r < 0) {
+		DMERR("dm_tm_shadow_block() failed");
+		return r;
+	}
+	ie_disk.blocknr = cpu_to_le64(dm_block_location(nb));
+
+	bm_le = dm_bitmap_data(nb);
+
+	for (; bit < bit_end; bit++, (*b)++) {
+		old = sm_lookup_bitmap(bm_le, bit);
+		if (old >= 2) {
+			overflow = 1;
+			break;
+		}
+
+		sm_set_bitmap(bm_le, bit, old + 1);
+
+		if (!old) {
+			(*nr_allocations)++;
+			ll->nr_allocated++;
+			le32_add_cpu(&ie_disk.nr_free, -1);
+			if (le32_to_cpu(ie_disk.none_free_before) == bit)
+				ie_disk.none_free_before = cpu_to_le32(bit + 1);
+		}
+	}
+
+	dm_tm_unlock(ll->tm, nb);
+
+	r = ll->save_ie(ll, index, &ie_disk);
+	if (r)
+		return r;
+
+	summary_update(ll, index, &ie_disk);
+
+	return overflow;
+}
+
+int sm_ll_inc_blocks(struct ll_disk *ll, dm_block_t b, dm_block_t e,
+		     dm_block_t *nr_allocations)
+{
+	int r;
+	enum allocation_event ev;
+
+	*nr_allocations = 0;
+
+	while (b < e) {
+		r = sm_ll_inc_bitmap(ll, &b, e, nr_allocations);
+		if (r < 0)
+			return r;
+
+		if (r) {
+			/*
+			 * The count is already at least 2 so this can't be
+			 * an allocation.
+			 */
+			r = sm_ll_inc(ll, b, &ev);
+			if (r)
+				return r;
+			b++;
+		}
+	}
+
+	return 0;
+}
+
 static int dec_ref_count(void *context, uint32_t old, uint32_t *new)
 {
 	if (!old) {
@@ -738,6 +945,10 @@ int sm_ll_new_disk(struct ll_disk *ll, struct dm_transaction_manager *tm)
 	ll->nr_blocks = 0;
 	ll->nr_allocated = 0;
 
+	r = summary_build(ll);
+	if (r < 0)
+		return r;
+
 	r = ll->init_index(ll);
 	if (r < 0)
 		return r;
@@ -776,7 +987,16 @@ int sm_ll_open_disk(struct ll_disk *ll, struct dm_transaction_manager *tm,
 	ll->bitmap_root = le64_to_cpu(smr->bitmap_root);
 	ll->ref_count_root = le64_to_cpu(smr->ref_count_root);
 
-	return ll->open_index(ll);
+	r = ll->open_index(ll);
+	if (r)
+		return r;
+
+	return summary_build(ll);
+}
+
+void sm_ll_destroy(struct ll_disk *ll)
+{
+	summary_free(ll);
 }
 
 /*----------------------------------------------------------------*/
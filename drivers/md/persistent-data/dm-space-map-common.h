@@ -79,6 +79,15 @@ struct ll_disk {
 	max_index_entries_fn max_entries;
 	commit_fn commit;
 	bool bitmap_index_changed:1;
+
+	/*
+	 * In core summary holding one bit per bitmap, set if its index
+	 * entry has any free blocks.  Searches use it to skip full bitmaps
+	 * without loading their index entries.  Only disk space maps,
+	 * whose index lives in a btree, keep one; NULL otherwise.
+	 */
+	unsigned long *free_summary;
+	dm_block_t free_summary_bits;
 };
 
 struct disk_sm_root {
@@ -113,6 +122,8 @@ int sm_ll_find_common_free_block(struct ll_disk *old_ll, struct ll_disk *new_ll,
 	                         dm_block_t begin, dm_block_t end, dm_block_t *result);
 int sm_ll_insert(struct ll_disk *ll, dm_block_t b, uint32_t ref_count, enum allocation_event *ev);
 int sm_ll_inc(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev);
+int sm_ll_inc_blocks(struct ll_disk *ll, dm_block_t b, dm_block_t e,
+		     dm_block_t *nr_allocations);
 int sm_ll_dec(struct ll_disk *ll, dm_block_t b, enum allocation_event *ev);
 int sm_ll_commit(struct ll_disk *ll);
 
@@ -124,6 +135,8 @@ int sm_ll_new_disk(struct ll_disk *ll, struct dm_transaction_manager *tm);
 int sm_ll_open_disk(struct ll_disk *ll, struct dm_transaction_manager *tm,
 		    void *root_le, size_t len);
 
+void sm_ll_destroy(struct ll_disk *ll);
+
 /*----------------------------------------------------------------*/
 
 #endif	/* DM_SPACE_MAP_COMMON_H */
@@ -35,6 +35,7 @@ static void sm_disk_destroy(struct dm_space_map *sm)
 {
 	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
 
+	sm_ll_destroy(&smd->ll);
 	kfree(smd);
 }
 
@@ -140,6 +141,24 @@ static int sm_disk_inc_block(struct dm_space_map *sm, dm_block_t b)
 	return r;
 }
 
+static int sm_disk_inc_blocks(struct dm_space_map *sm, dm_block_t b,
+			      dm_block_t e)
+{
+	int r;
+	dm_block_t nr_allocations;
+	struct sm_disk *smd = container_of(sm, struct sm_disk, sm);
+
+	r = sm_ll_inc_blocks(&smd->ll, b, e, &nr_allocations);
+
+	/*
+	 * These _must_ be free in the prior transaction otherwise we've
+	 * lost atomicity.
+	 */
+	smd->nr_allocated_this_transaction += nr_allocations;
+
+	return r;
+}
+
 static int sm_disk_dec_block(struct dm_space_map *sm, dm_block_t b)
 {
 	int r;
@@ -199,6 +218,9 @@ static int sm_disk_commit(struct dm_space_map *sm)
 		return r;
 
 	memcpy(&smd->old_ll, &smd->ll, sizeof(smd->old_ll));
+	/* old_ll is only used for lookups and mustn't share the summary */
+	smd->old_ll.free_summary = NULL;
+	smd->old_ll.free_summary_bits = 0;
 	smd->begin = 0;
 	smd->nr_allocated_this_transaction = 0;
 
@@ -245,6 +267,7 @@ static struct dm_space_map ops = {
 	.count_is_more_than_one = sm_disk_count_is_more_than_one,
 	.set_count = sm_disk_set_count,
 	.inc_block = sm_disk_inc_block,
+	.inc_blocks = sm_disk_inc_blocks,
 	.dec_block = sm_disk_dec_block,
 	.new_block = sm_disk_new_block,
 	.commit = sm_disk_commit,
@@ -259,7 +282,7 @@ struct dm_space_map *dm_sm_disk_create(struct dm_transaction_manager *tm,
 	int r;
 	struct sm_disk *smd;
 
-	smd = kmalloc(sizeof(*smd), GFP_KERNEL);
+	smd = kzalloc(sizeof(*smd), GFP_KERNEL);
 	if (!smd)
 		return ERR_PTR(-ENOMEM);
 
@@ -282,6 +305,7 @@ struct dm_space_map *dm_sm_disk_create(struct dm_transaction_manager *tm,
 	return &smd->sm;
 
 bad:
+	sm_ll_destroy(&smd->ll);
 	kfree(smd);
 	return ERR_PTR(r);
 }
@@ -293,7 +317,7 @@ struct dm_space_map *dm_sm_disk_open(struct dm_transaction_manager *tm,
 	int r;
 	struct sm_disk *smd;
 
-	smd = kmalloc(sizeof(*smd), GFP_KERNEL);
+	smd = kzalloc(sizeof(*smd), GFP_KERNEL);
 	if (!smd)
 		return ERR_PTR(-ENOMEM);
 
@@ -312,6 +336,7 @@ struct dm_space_map *dm_sm_disk_open(struct dm_transaction_manager *tm,
 	return &smd->sm;
 
 bad:
+	sm_ll_destroy(&smd->ll);
 	kfree(smd);
 	return ERR_PTR(r);
 }
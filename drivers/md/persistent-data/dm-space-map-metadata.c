@@ -425,6 +425,25 @@ static int sm_metadata_inc_block(struct dm_space_map *sm, dm_block_t b)
 	return combine_errors(r, r2);
 }
 
+static int sm_metadata_inc_blocks(struct dm_space_map *sm, dm_block_t b,
+				  dm_block_t e)
+{
+	int r, r2 = 0;
+	dm_block_t nr_allocations;
+	struct sm_metadata *smm = container_of(sm, struct sm_metadata, sm);
+
+	if (recursing(smm)) {
+		for (r = 0; !r && b < e; b++)
+			r = add_bop(smm, BOP_INC, b);
+	} else {
+		in(smm);
+		r = sm_ll_inc_blocks(&smm->ll, b, e, &nr_allocations);
+		r2 = out(smm);
+	}
+
+	return combine_errors(r, r2);
+}
+
 static int sm_metadata_dec_block(struct dm_space_map *sm, dm_block_t b)
 {
 	int r, r2 = 0;
@@ -557,6 +576,7 @@ static const struct dm_space_map ops = {
 	.count_is_more_than_one = sm_metadata_count_is_more_than_one,
 	.set_count = sm_metadata_set_count,
 	.inc_block = sm_metadata_inc_block,
+	.inc_blocks = sm_metadata_inc_blocks,
 	.dec_block = sm_metadata_dec_block,
 	.new_block = sm_metadata_new_block,
 	.commit = sm_metadata_commit,
@@ -49,6 +49,12 @@ struct dm_space_map {
 	int (*inc_block)(struct dm_space_map *sm, dm_block_t b);
 	int (*dec_block)(struct dm_space_map *sm, dm_block_t b);
 
+	/*
+	 * Optional.  Increments every block in [b, e), which is much
+	 * cheaper than calling inc_block() on each of them.
+	 */
+	int (*inc_blocks)(struct dm_space_map *sm, dm_block_t b, dm_block_t e);
+
 	/*
 	 * new_block will increment the returned block.
 	 */
@@ -122,6 +128,23 @@ static inline int dm_sm_inc_block(struct dm_space_map *sm, dm_block_t b)
 	return sm->inc_block(sm, b);
 }
 
+static inline int dm_sm_inc_blocks(struct dm_space_map *sm, dm_block_t b,
+				   dm_block_t e)
+{
+	int r;
+
+	if (sm->inc_blocks)
+		return sm->inc_blocks(sm, b, e);
+
+	for (; b < e; b++) {
+		r = sm->inc_block(sm, b);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
 static inline int dm_sm_dec_block(struct dm_space_map *sm, dm_block_t b)
 {
 	return sm->dec_block(sm, b);
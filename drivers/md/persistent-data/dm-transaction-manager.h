@@ -101,6 +101,12 @@ void dm_tm_unlock(struct dm_transaction_manager *tm, struct dm_block *b);
  */
 void dm_tm_inc(struct dm_transaction_manager *tm, dm_block_t b);
 
+/*
+ * Increments every block in [b, e).
+ */
+void dm_tm_inc_range(struct dm_transaction_manager *tm, dm_block_t b,
+		     dm_block_t e);
+
 void dm_tm_dec(struct dm_transaction_manager *tm, dm_block_t b);
 
 int dm_tm_ref(struct dm_transaction_manager *tm, dm_block_t b,
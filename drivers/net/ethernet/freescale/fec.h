@@ -19,6 +19,7 @@
 #include <linux/pm_qos.h>
 #include <linux/ptp_clock_kernel.h>
 #include <linux/timecounter.h>
+#include <net/xdp.h>
 #include <dt-bindings/firmware/imx/rsrc.h>
 #include <linux/firmware/imx/sci.h>
 
@@ -342,12 +343,19 @@ struct bufdesc_ex {
  * to keep them that size.
  * We don't need to allocate pages for the transmitter.  We just use
  * the skbuffer directly.
+ *
+ * Each Rx buffer is a page of its own, with XDP headroom in front of the
+ * frame and room for the skb_shared_info behind it, so that the page can
+ * be run through XDP and turned into an skb without a copy.
  */
 
-#define FEC_ENET_RX_PAGES	256
-#define FEC_ENET_RX_FRSIZE	2048
+#define FEC_ENET_XDP_HEADROOM	(XDP_PACKET_HEADROOM)
+#define FEC_ENET_RX_PAGES	512	/* Keeps the Rx ring at 512 entries */
+#define FEC_ENET_RX_FRSIZE	(PAGE_SIZE - FEC_ENET_XDP_HEADROOM \
+		- SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
 #define FEC_ENET_RX_FRPPG	(PAGE_SIZE / FEC_ENET_RX_FRSIZE)
 #define RX_RING_SIZE		(FEC_ENET_RX_FRPPG * FEC_ENET_RX_PAGES)
+#define FEC_ENET_RX_REUSE	128	/* Must be power of two */
 #define FEC_ENET_TX_FRSIZE	2048
 #define FEC_ENET_TX_FRPPG	(PAGE_SIZE / FEC_ENET_TX_FRSIZE)
 #define TX_RING_SIZE		512	/* Must be power of two */
@@ -498,10 +506,18 @@ struct bufdesc_prop {
 	unsigned char dsize_log2;
 };
 
+enum fec_txbuf_type {
+	FEC_TXBUF_T_SKB,
+	FEC_TXBUF_T_XDP_NDO,	/* frame from ndo_xdp_xmit, mapped by us */
+	FEC_TXBUF_T_XDP_TX,	/* frame from our own page pool */
+};
+
 struct fec_enet_priv_tx_q {
 	struct bufdesc_prop bd;
 	unsigned char *tx_bounce[TX_RING_SIZE];
 	struct  sk_buff *tx_skbuff[TX_RING_SIZE];
+	struct xdp_frame *tx_xdpf[TX_RING_SIZE];
+	enum fec_txbuf_type tx_buf_type[TX_RING_SIZE];
 
 	unsigned short tx_stop_threshold;
 	unsigned short tx_wake_threshold;
@@ -513,7 +529,15 @@ struct fec_enet_priv_tx_q {
 
 struct fec_enet_priv_rx_q {
 	struct bufdesc_prop bd;
-	struct  sk_buff *rx_skbuff[RX_RING_SIZE];
+	struct page *rx_page[RX_RING_SIZE];
+
+	struct page_pool *page_pool;
+	struct xdp_rxq_info xdp_rxq;
+
+	/* Pool pages passed up the stack, reused once the stack is done */
+	struct page *reuse_page[FEC_ENET_RX_REUSE];
+	unsigned int reuse_head;
+	unsigned int reuse_count;
 };
 
 struct fec_stop_mode_gpr {
@@ -615,6 +639,8 @@ struct fec_enet_private {
 
 	u32 rx_copybreak;
 
+	struct bpf_prog *xdp_prog;
+
 	/* ptp clock period in ns*/
 	unsigned int ptp_inc;
 
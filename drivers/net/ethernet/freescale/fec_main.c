@@ -66,6 +66,9 @@
 #include <linux/prefetch.h>
 #include <linux/mfd/syscon.h>
 #include <linux/regmap.h>
+#include <linux/filter.h>
+#include <linux/bpf_trace.h>
+#include <net/page_pool.h>
 #include <soc/imx/cpuidle.h>
 
 #include <asm/cacheflush.h>
@@ -310,15 +313,21 @@ MODULE_PARM_DESC(macaddr, "FEC Ethernet MAC address");
 #define FEC_WOL_FLAG_ENABLE		(0x1 << 1)
 #define FEC_WOL_FLAG_SLEEP_ON		(0x1 << 2)
 
-/* By default, set the copybreak to 1518,
- * then the RX path always keep DMA memory unchanged, and
- * allocate one new skb and copy DMA memory data to the new skb
- * buffer, which can improve the performance when SMMU is enabled.
+/* Frames up to the copybreak are copied into a new skb and their page
+ * stays in the ring. Larger frames are passed up in their page pool page,
+ * which the driver keeps a reference to and reuses once the stack is done
+ * with it.
  *
  * The driver support .set_tunable() interface for ethtool, user
  * can dynamicly change the copybreak value.
  */
-#define COPYBREAK_DEFAULT	1518
+#define COPYBREAK_DEFAULT	256
+
+/* Verdicts of the XDP program, as seen by the Rx path */
+#define FEC_ENET_XDP_PASS	0
+#define FEC_ENET_XDP_CONSUMED	BIT(0)
+#define FEC_ENET_XDP_TX		BIT(1)
+#define FEC_ENET_XDP_REDIR	BIT(2)
 
 /* Max number of allowed TCP segments for software TSO */
 #define FEC_MAX_TSO_SEGS	100
@@ -369,16 +378,6 @@ static void swap_buffer(void *bufaddr, int len)
 		swab32s(buf);
 }
 
-static void swap_buffer2(void *dst_buf, void *src_buf, int len)
-{
-	int i;
-	unsigned int *src = src_buf;
-	unsigned int *dst = dst_buf;
-
-	for (i = 0; i < len; i += 4, src++, dst++)
-		*dst = swab32p(src);
-}
-
 static void fec_dump(struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
@@ -912,6 +911,7 @@ static void fec_enet_bd_init(struct net_device *dev)
 			/* Initialize the BD for every fragment in the page. */
 			bdp->cbd_sc = cpu_to_fec16(0);
 			if (bdp->cbd_bufaddr &&
+			    txq->tx_buf_type[i] != FEC_TXBUF_T_XDP_TX &&
 			    !IS_TSO_HEADER(txq, fec32_to_cpu(bdp->cbd_bufaddr)))
 				dma_unmap_single(&fep->pdev->dev,
 						 fec32_to_cpu(bdp->cbd_bufaddr),
@@ -921,6 +921,11 @@ static void fec_enet_bd_init(struct net_device *dev)
 				dev_kfree_skb_any(txq->tx_skbuff[i]);
 				txq->tx_skbuff[i] = NULL;
 			}
+			if (txq->tx_xdpf[i]) {
+				xdp_return_frame(txq->tx_xdpf[i]);
+				txq->tx_xdpf[i] = NULL;
+			}
+			txq->tx_buf_type[i] = FEC_TXBUF_T_SKB;
 			bdp->cbd_bufaddr = cpu_to_fec32(0);
 			bdp = fec_enet_get_nextdesc(bdp, &txq->bd);
 		}
@@ -1328,6 +1333,35 @@ fec_enet_hwtstamp(struct fec_enet_private *fep, unsigned ts,
 	hwtstamps->hwtstamp = ns_to_ktime(ns);
 }
 
+static void
+fec_enet_tx_xdp_done(struct fec_enet_private *fep,
+		     struct fec_enet_priv_tx_q *txq, struct bufdesc *bdp,
+		     int index, unsigned short status)
+{
+	struct net_device *ndev = fep->netdev;
+	struct xdp_frame *xdpf = txq->tx_xdpf[index];
+
+	/* Frames sent back from our own page pool are mapped by the pool */
+	if (txq->tx_buf_type[index] == FEC_TXBUF_T_XDP_NDO)
+		dma_unmap_single(&fep->pdev->dev,
+				 fec32_to_cpu(bdp->cbd_bufaddr),
+				 fec16_to_cpu(bdp->cbd_datlen),
+				 DMA_TO_DEVICE);
+	bdp->cbd_bufaddr = cpu_to_fec32(0);
+
+	if (status & (BD_ENET_TX_HB | BD_ENET_TX_LC | BD_ENET_TX_RL |
+		      BD_ENET_TX_UN | BD_ENET_TX_CSL)) {
+		ndev->stats.tx_errors++;
+	} else {
+		ndev->stats.tx_packets++;
+		ndev->stats.tx_bytes += xdpf->len;
+	}
+
+	txq->tx_xdpf[index] = NULL;
+	txq->tx_buf_type[index] = FEC_TXBUF_T_SKB;
+	xdp_return_frame(xdpf);
+}
+
 static void
 fec_enet_tx_queue(struct net_device *ndev, u16 queue_id)
 {
@@ -1359,6 +1393,11 @@ fec_enet_tx_queue(struct net_device *ndev, u16 queue_id)
 
 		index = fec_enet_get_bd_index(bdp, &txq->bd);
 
+		if (txq->tx_buf_type[index] != FEC_TXBUF_T_SKB) {
+			fec_enet_tx_xdp_done(fep, txq, bdp, index, status);
+			goto skb_done;
+		}
+
 		skb = txq->tx_skbuff[index];
 		txq->tx_skbuff[index] = NULL;
 		if (!IS_TSO_HEADER(txq, fec32_to_cpu(bdp->cbd_bufaddr)))
@@ -1447,50 +1486,249 @@ static void fec_enet_tx(struct net_device *ndev)
 		fec_enet_tx_queue(ndev, i);
 }
 
-static int
-fec_enet_new_rxbdp(struct net_device *ndev, struct bufdesc *bdp, struct sk_buff *skb)
+static void fec_enet_update_cbd(struct fec_enet_priv_rx_q *rxq,
+				struct bufdesc *bdp, int index,
+				struct page *page)
 {
-	struct  fec_enet_private *fep = netdev_priv(ndev);
-	int off;
+	rxq->rx_page[index] = page;
+	bdp->cbd_bufaddr = cpu_to_fec32(page_pool_get_dma_addr(page) +
+					FEC_ENET_XDP_HEADROOM);
+}
 
-	off = ((unsigned long)skb->data) & fep->rx_align;
-	if (off)
-		skb_reserve(skb, fep->rx_align + 1 - off);
+/* Hand a page the CPU has read, and maybe written to, back to the device */
+static void fec_enet_rx_sync_for_device(struct fec_enet_private *fep,
+					struct fec_enet_priv_rx_q *rxq,
+					struct page *page, unsigned int len)
+{
+	dma_sync_single_for_device(&fep->pdev->dev,
+				   page_pool_get_dma_addr(page),
+				   FEC_ENET_XDP_HEADROOM + len,
+				   page_pool_get_dma_dir(rxq->page_pool));
+}
 
-	bdp->cbd_bufaddr = cpu_to_fec32(dma_map_single(&fep->pdev->dev, skb->data, FEC_ENET_RX_FRSIZE - fep->rx_align, DMA_FROM_DEVICE));
-	if (dma_mapping_error(&fep->pdev->dev, fec32_to_cpu(bdp->cbd_bufaddr))) {
-		if (net_ratelimit())
-			netdev_err(ndev, "Rx DMA memory map failed\n");
-		return -ENOMEM;
+/* Keep a page passed up the stack in the pool: our reference outlives the
+ * skb's, so the page is neither unmapped nor freed when the skb goes away.
+ */
+static void fec_enet_rx_hold_page(struct fec_enet_priv_rx_q *rxq,
+				  struct page *page)
+{
+	unsigned int tail;
+
+	if (rxq->reuse_count == FEC_ENET_RX_REUSE) {
+		/* Give up on the oldest one, the pool releases it if the
+		 * stack still holds it.
+		 */
+		page_pool_put_full_page(rxq->page_pool,
+					rxq->reuse_page[rxq->reuse_head], true);
+		rxq->reuse_head = (rxq->reuse_head + 1) &
+				  (FEC_ENET_RX_REUSE - 1);
+		rxq->reuse_count--;
+	}
+
+	page_ref_inc(page);
+	tail = (rxq->reuse_head + rxq->reuse_count) & (FEC_ENET_RX_REUSE - 1);
+	rxq->reuse_page[tail] = page;
+	rxq->reuse_count++;
+}
+
+/* Get a new Rx page, preferably the oldest one the stack gave back */
+static struct page *fec_enet_rx_alloc_page(struct fec_enet_private *fep,
+					   struct fec_enet_priv_rx_q *rxq)
+{
+	struct page *page;
+
+	if (rxq->reuse_count) {
+		page = rxq->reuse_page[rxq->reuse_head];
+		if (page_ref_count(page) == 1) {
+			rxq->reuse_head = (rxq->reuse_head + 1) &
+					  (FEC_ENET_RX_REUSE - 1);
+			rxq->reuse_count--;
+
+			/* The stack may have written anywhere in the page */
+			fec_enet_rx_sync_for_device(fep, rxq, page,
+						    FEC_ENET_RX_FRSIZE);
+			return page;
+		}
+	}
+
+	return page_pool_dev_alloc_pages(rxq->page_pool);
+}
+
+static void fec_enet_rx_reuse_drain(struct fec_enet_priv_rx_q *rxq)
+{
+	while (rxq->reuse_count) {
+		page_pool_put_full_page(rxq->page_pool,
+					rxq->reuse_page[rxq->reuse_head], false);
+		rxq->reuse_head = (rxq->reuse_head + 1) &
+				  (FEC_ENET_RX_REUSE - 1);
+		rxq->reuse_count--;
+	}
+	rxq->reuse_head = 0;
+}
+
+static int fec_enet_xdp_get_tx_queue(struct fec_enet_private *fep, int cpu)
+{
+	int index = cpu;
+
+	if (unlikely(index < 0))
+		index = 0;
+
+	while (index >= fep->num_tx_queues)
+		index -= fep->num_tx_queues;
+
+	return index;
+}
+
+/* Queue one XDP frame on a Tx ring, the caller holds the queue's tx lock. */
+static int fec_enet_txq_xmit_frame(struct fec_enet_private *fep,
+				   struct fec_enet_priv_tx_q *txq,
+				   struct xdp_frame *xdpf, bool ndo_xmit)
+{
+	struct bufdesc *bdp = txq->bd.cur;
+	enum fec_txbuf_type type;
+	unsigned int estatus = 0;
+	unsigned short status;
+	unsigned int index;
+	void *data = xdpf->data;
+	dma_addr_t addr;
+
+	if (fec_enet_get_free_txdesc_num(txq) <= txq->tx_stop_threshold)
+		return -EBUSY;
+
+	index = fec_enet_get_bd_index(bdp, &txq->bd);
+	if (((unsigned long)data) & fep->tx_align) {
+		if (xdpf->len > FEC_ENET_TX_FRSIZE)
+			return -EINVAL;
+		memcpy(txq->tx_bounce[index], data, xdpf->len);
+		data = txq->tx_bounce[index];
+		ndo_xmit = true;
+	}
+
+	if (ndo_xmit) {
+		addr = dma_map_single(&fep->pdev->dev, data, xdpf->len,
+				      DMA_TO_DEVICE);
+		if (dma_mapping_error(&fep->pdev->dev, addr))
+			return -ENOMEM;
+		type = FEC_TXBUF_T_XDP_NDO;
+	} else {
+		struct page *page = virt_to_page(data);
+
+		/* The page still belongs to our Rx page pool and its mapping */
+		addr = page_pool_get_dma_addr(page) +
+		       (data - page_address(page));
+		dma_sync_single_for_device(&fep->pdev->dev, addr, xdpf->len,
+					   DMA_BIDIRECTIONAL);
+		type = FEC_TXBUF_T_XDP_TX;
+	}
+
+	status = fec16_to_cpu(bdp->cbd_sc);
+	status &= ~BD_ENET_TX_STATS;
+	status |= BD_ENET_TX_INTR | BD_ENET_TX_LAST;
+
+	bdp->cbd_bufaddr = cpu_to_fec32(addr);
+	bdp->cbd_datlen = cpu_to_fec16(xdpf->len);
+
+	if (fep->bufdesc_ex) {
+		struct bufdesc_ex *ebdp = (struct bufdesc_ex *)bdp;
+
+		estatus = BD_ENET_TX_INT;
+		if (fep->quirks & FEC_QUIRK_HAS_AVB)
+			estatus |= FEC_TX_BD_FTYPE(txq->bd.qid);
+
+		ebdp->cbd_bdu = 0;
+		ebdp->cbd_esc = cpu_to_fec32(estatus);
 	}
 
+	txq->tx_xdpf[index] = xdpf;
+	txq->tx_buf_type[index] = type;
+
+	/* Make sure the updates to rest of the descriptor are performed before
+	 * transferring ownership.
+	 */
+	wmb();
+
+	status |= BD_ENET_TX_READY | BD_ENET_TX_TC;
+	bdp->cbd_sc = cpu_to_fec16(status);
+
+	bdp = fec_enet_get_nextdesc(bdp, &txq->bd);
+
+	/* Make sure the update to bdp and tx_xdpf are performed before
+	 * txq->bd.cur.
+	 */
+	wmb();
+	txq->bd.cur = bdp;
+
+	/* Trigger transmission start */
+	writel(0, txq->bd.reg_desc_active);
+
 	return 0;
 }
 
-static bool fec_enet_copybreak(struct net_device *ndev, struct sk_buff **skb,
-			       struct bufdesc *bdp, u32 length, bool swap)
+static int fec_enet_xdp_tx_xmit(struct fec_enet_private *fep, int cpu,
+				struct xdp_buff *xdp)
 {
-	struct  fec_enet_private *fep = netdev_priv(ndev);
-	struct sk_buff *new_skb;
-
-	if (length > fep->rx_copybreak)
-		return false;
-
-	new_skb = netdev_alloc_skb(ndev, length);
-	if (!new_skb)
-		return false;
-
-	dma_sync_single_for_cpu(&fep->pdev->dev,
-				fec32_to_cpu(bdp->cbd_bufaddr),
-				FEC_ENET_RX_FRSIZE - fep->rx_align,
-				DMA_FROM_DEVICE);
-	if (!swap)
-		memcpy(new_skb->data, (*skb)->data, length);
-	else
-		swap_buffer2(new_skb->data, (*skb)->data, length);
-	*skb = new_skb;
+	struct xdp_frame *xdpf = xdp_convert_buff_to_frame(xdp);
+	struct fec_enet_priv_tx_q *txq;
+	struct netdev_queue *nq;
+	int queue, ret;
+
+	if (unlikely(!xdpf))
+		return -EFAULT;
+
+	queue = fec_enet_xdp_get_tx_queue(fep, cpu);
+	txq = fep->tx_queue[queue];
+	nq = netdev_get_tx_queue(fep->netdev, queue);
+
+	/* The Tx ring is shared with the stack */
+	__netif_tx_lock(nq, cpu);
+	txq_trans_update(nq);
+	ret = fec_enet_txq_xmit_frame(fep, txq, xdpf, false);
+	__netif_tx_unlock(nq);
+
+	return ret;
+}
+
+static u32
+fec_enet_run_xdp(struct fec_enet_private *fep, struct bpf_prog *prog,
+		 struct xdp_buff *xdp, struct fec_enet_priv_rx_q *rxq, int cpu)
+{
+	unsigned int sync, len = xdp->data_end - xdp->data;
+	struct page *page;
+	u32 act;
+
+	act = bpf_prog_run_xdp(prog, xdp);
+
+	/* Due xdp_adjust_tail: DMA sync for_device cover max len CPU touch */
+	sync = xdp->data_end - xdp->data_hard_start - FEC_ENET_XDP_HEADROOM;
+	sync = max(sync, len);
+
+	switch (act) {
+	case XDP_PASS:
+		return FEC_ENET_XDP_PASS;
+	case XDP_TX:
+		if (!fec_enet_xdp_tx_xmit(fep, cpu, xdp))
+			return FEC_ENET_XDP_TX;
+		trace_xdp_exception(fep->netdev, prog, act);
+		break;
+	case XDP_REDIRECT:
+		if (!xdp_do_redirect(fep->netdev, xdp, prog))
+			return FEC_ENET_XDP_REDIR;
+		trace_xdp_exception(fep->netdev, prog, act);
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		fallthrough;
+	case XDP_ABORTED:
+		trace_xdp_exception(fep->netdev, prog, act);
+		fallthrough;
+	case XDP_DROP:
+		break;
+	}
+
+	page = virt_to_head_page(xdp->data);
+	page_pool_put_page(rxq->page_pool, page, sync, true);
 
-	return true;
+	return FEC_ENET_XDP_CONSUMED;
 }
 
 /* During a receive, the bd_rx.cur points to the current incoming buffer.
@@ -1505,7 +1743,6 @@ fec_enet_rx_queue(struct net_device *ndev, int budget, u16 queue_id)
 	struct fec_enet_priv_rx_q *rxq;
 	struct bufdesc *bdp;
 	unsigned short status;
-	struct  sk_buff *skb_new = NULL;
 	struct  sk_buff *skb;
 	ushort	pkt_len;
 	__u8 *data;
@@ -1514,13 +1751,33 @@ fec_enet_rx_queue(struct net_device *ndev, int budget, u16 queue_id)
 	bool	vlan_packet_rcvd = false;
 	u16	vlan_tag;
 	int	index = 0;
-	bool	is_copybreak;
 	bool	need_swap = fep->quirks & FEC_QUIRK_SWAP_FRAME;
+	struct bpf_prog *xdp_prog;
+	struct xdp_buff xdp;
+	struct page *page, *new_page;
+	enum dma_data_direction dma_dir;
+	unsigned int data_shift = 0;
+	unsigned int len, sync_len;
+	u32 xdp_result, xdp_res = 0;
+	int cpu = smp_processor_id();
 
 #ifdef CONFIG_M532x
 	flush_cache_all();
 #endif
 	rxq = fep->rx_queue[queue_id];
+	dma_dir = page_pool_get_dma_dir(rxq->page_pool);
+
+#if !defined(CONFIG_M5272)
+	/* The frame is shifted by the two bytes which align the IP header */
+	if (fep->quirks & FEC_QUIRK_HAS_RACC)
+		data_shift = 2;
+#endif
+
+	xdp.rxq = &rxq->xdp_rxq;
+	xdp.frame_sz = PAGE_SIZE;
+
+	rcu_read_lock();
+	xdp_prog = READ_ONCE(fep->xdp_prog);
 
 	/* First, grab all of the stats for the incoming packet.
 	 * These get messed up if we get called due to a busy condition.
@@ -1567,37 +1824,79 @@ fec_enet_rx_queue(struct net_device *ndev, int budget, u16 queue_id)
 		ndev->stats.rx_bytes += pkt_len;
 
 		index = fec_enet_get_bd_index(bdp, &rxq->bd);
-		skb = rxq->rx_skbuff[index];
+		page = rxq->rx_page[index];
+		new_page = NULL;
+
+		dma_sync_single_for_cpu(&fep->pdev->dev,
+					fec32_to_cpu(bdp->cbd_bufaddr),
+					pkt_len, dma_dir);
+		prefetch(page_address(page) + FEC_ENET_XDP_HEADROOM);
+
+		if (need_swap)
+			swap_buffer(page_address(page) + FEC_ENET_XDP_HEADROOM,
+				    pkt_len);
 
 		/* The packet length includes FCS, but we don't want to
 		 * include that when passing upstream as it messes up
 		 * bridging applications.
 		 */
-		is_copybreak = fec_enet_copybreak(ndev, &skb, bdp, pkt_len - 4,
-						  need_swap);
-		if (!is_copybreak) {
-			skb_new = netdev_alloc_skb(ndev, FEC_ENET_RX_FRSIZE);
-			if (unlikely(!skb_new)) {
+		xdp.data_hard_start = page_address(page);
+		xdp.data = xdp.data_hard_start + FEC_ENET_XDP_HEADROOM +
+			   data_shift;
+		xdp_set_data_meta_invalid(&xdp);
+		xdp.data_end = xdp.data + pkt_len - 4 - data_shift;
+		sync_len = pkt_len;
+
+		/* Get the page's replacement before it can leave the ring */
+		if (xdp_prog || xdp.data_end - xdp.data > fep->rx_copybreak) {
+			new_page = fec_enet_rx_alloc_page(fep, rxq);
+			if (unlikely(!new_page)) {
 				ndev->stats.rx_dropped++;
-				goto rx_processing_done;
+				goto rx_recycle;
 			}
-			dma_unmap_single(&fep->pdev->dev,
-					 fec32_to_cpu(bdp->cbd_bufaddr),
-					 FEC_ENET_RX_FRSIZE - fep->rx_align,
-					 DMA_FROM_DEVICE);
 		}
 
-		prefetch(skb->data - NET_IP_ALIGN);
-		skb_put(skb, pkt_len - 4);
-		data = skb->data;
+		if (xdp_prog) {
+			xdp_result = fec_enet_run_xdp(fep, xdp_prog, &xdp, rxq,
+						      cpu);
+			if (xdp_result != FEC_ENET_XDP_PASS) {
+				xdp_res |= xdp_result;
+				fec_enet_update_cbd(rxq, bdp, index, new_page);
+				goto rx_processing_done;
+			}
 
-		if (!is_copybreak && need_swap)
-			swap_buffer(data, pkt_len);
+			/* The program may have moved the tail */
+			sync_len = max_t(unsigned int, sync_len,
+					 xdp.data_end - xdp.data_hard_start -
+					 FEC_ENET_XDP_HEADROOM);
+		}
 
-#if !defined(CONFIG_M5272)
-		if (fep->quirks & FEC_QUIRK_HAS_RACC)
-			data = skb_pull_inline(skb, 2);
-#endif
+		len = xdp.data_end - xdp.data;
+		if (len <= fep->rx_copybreak) {
+			/* Copy small frames, their page stays in the ring */
+			skb = napi_alloc_skb(&fep->napi, len);
+			if (unlikely(!skb)) {
+				ndev->stats.rx_dropped++;
+				goto rx_drop;
+			}
+			skb_put_data(skb, xdp.data, len);
+			if (new_page)
+				page_pool_recycle_direct(rxq->page_pool,
+							 new_page);
+			fec_enet_rx_sync_for_device(fep, rxq, page, sync_len);
+		} else {
+			skb = build_skb(xdp.data_hard_start, PAGE_SIZE);
+			if (unlikely(!skb)) {
+				ndev->stats.rx_dropped++;
+				goto rx_drop;
+			}
+			fec_enet_rx_hold_page(rxq, page);
+			skb_reserve(skb, xdp.data - xdp.data_hard_start);
+			skb_put(skb, len);
+			fec_enet_update_cbd(rxq, bdp, index, new_page);
+		}
+
+		data = skb->data;
 
 		/* Extract the enhanced buffer descriptor */
 		ebdp = NULL;
@@ -1645,16 +1944,13 @@ fec_enet_rx_queue(struct net_device *ndev, int budget, u16 queue_id)
 
 		skb_record_rx_queue(skb, queue_id);
 		napi_gro_receive(&fep->napi, skb);
+		goto rx_processing_done;
 
-		if (is_copybreak) {
-			dma_sync_single_for_device(&fep->pdev->dev,
-						   fec32_to_cpu(bdp->cbd_bufaddr),
-						   FEC_ENET_RX_FRSIZE - fep->rx_align,
-						   DMA_FROM_DEVICE);
-		} else {
-			rxq->rx_skbuff[index] = skb_new;
-			fec_enet_new_rxbdp(ndev, bdp, skb_new);
-		}
+rx_drop:
+		if (new_page)
+			page_pool_recycle_direct(rxq->page_pool, new_page);
+rx_recycle:
+		fec_enet_rx_sync_for_device(fep, rxq, page, sync_len);
 
 rx_processing_done:
 		/* Clear the status flags for this buffer */
@@ -1686,6 +1982,11 @@ rx_processing_done:
 		writel(0, rxq->bd.reg_desc_active);
 	}
 	rxq->bd.cur = bdp;
+
+	if (xdp_res & FEC_ENET_XDP_REDIR)
+		xdp_do_flush();
+	rcu_read_unlock();
+
 	return pkt_received;
 }
 
@@ -2978,33 +3279,37 @@ static int fec_enet_ioctl(struct net_device *ndev, struct ifreq *rq, int cmd)
 	return phy_mii_ioctl(phydev, rq, cmd);
 }
 
+static void fec_enet_free_rxq_pages(struct fec_enet_priv_rx_q *rxq)
+{
+	unsigned int i;
+
+	if (!rxq->page_pool)
+		return;
+
+	fec_enet_rx_reuse_drain(rxq);
+
+	for (i = 0; i < rxq->bd.ring_size; i++) {
+		if (rxq->rx_page[i])
+			page_pool_put_full_page(rxq->page_pool,
+						rxq->rx_page[i], false);
+		rxq->rx_page[i] = NULL;
+	}
+
+	if (xdp_rxq_info_is_reg(&rxq->xdp_rxq))
+		xdp_rxq_info_unreg(&rxq->xdp_rxq);
+	page_pool_destroy(rxq->page_pool);
+	rxq->page_pool = NULL;
+}
+
 static void fec_enet_free_buffers(struct net_device *ndev)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	unsigned int i;
 	struct sk_buff *skb;
-	struct bufdesc	*bdp;
 	struct fec_enet_priv_tx_q *txq;
-	struct fec_enet_priv_rx_q *rxq;
 	unsigned int q;
 
-	for (q = 0; q < fep->num_rx_queues; q++) {
-		rxq = fep->rx_queue[q];
-		bdp = rxq->bd.base;
-		for (i = 0; i < rxq->bd.ring_size; i++) {
-			skb = rxq->rx_skbuff[i];
-			rxq->rx_skbuff[i] = NULL;
-			if (skb) {
-				dma_unmap_single(&fep->pdev->dev,
-						 fec32_to_cpu(bdp->cbd_bufaddr),
-						 FEC_ENET_RX_FRSIZE - fep->rx_align,
-						 DMA_FROM_DEVICE);
-				dev_kfree_skb(skb);
-			}
-			bdp = fec_enet_get_nextdesc(bdp, &rxq->bd);
-		}
-	}
-
+	/* Frames sent back with XDP_TX still hold pages of the Rx pools */
 	for (q = 0; q < fep->num_tx_queues; q++) {
 		txq = fep->tx_queue[q];
 		for (i = 0; i < txq->bd.ring_size; i++) {
@@ -3013,8 +3318,15 @@ static void fec_enet_free_buffers(struct net_device *ndev)
 			skb = txq->tx_skbuff[i];
 			txq->tx_skbuff[i] = NULL;
 			dev_kfree_skb(skb);
+			if (txq->tx_xdpf[i]) {
+				xdp_return_frame(txq->tx_xdpf[i]);
+				txq->tx_xdpf[i] = NULL;
+			}
 		}
 	}
+
+	for (q = 0; q < fep->num_rx_queues; q++)
+		fec_enet_free_rxq_pages(fep->rx_queue[q]);
 }
 
 static void fec_enet_free_queue(struct net_device *ndev)
@@ -3088,28 +3400,82 @@ alloc_failed:
 	return ret;
 }
 
+/* XDP_TX sends frames straight from the Rx pages */
+static enum dma_data_direction fec_enet_rx_dma_dir(struct bpf_prog *prog)
+{
+	return prog ? DMA_BIDIRECTIONAL : DMA_FROM_DEVICE;
+}
+
+static int
+fec_enet_create_page_pool(struct fec_enet_private *fep,
+			  struct fec_enet_priv_rx_q *rxq, int size,
+			  enum dma_data_direction dma_dir)
+{
+	struct page_pool_params pp_params = {
+		.order = 0,
+		.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV,
+		.pool_size = size,
+		.nid = dev_to_node(&fep->pdev->dev),
+		.dev = &fep->pdev->dev,
+		.dma_dir = dma_dir,
+		.offset = FEC_ENET_XDP_HEADROOM,
+		.max_len = FEC_ENET_RX_FRSIZE,
+	};
+	int err;
+
+	rxq->page_pool = page_pool_create(&pp_params);
+	if (IS_ERR(rxq->page_pool)) {
+		err = PTR_ERR(rxq->page_pool);
+		rxq->page_pool = NULL;
+		return err;
+	}
+
+	err = xdp_rxq_info_reg(&rxq->xdp_rxq, fep->netdev, rxq->bd.qid);
+	if (err < 0)
+		goto err_free_pp;
+
+	err = xdp_rxq_info_reg_mem_model(&rxq->xdp_rxq, MEM_TYPE_PAGE_POOL,
+					 rxq->page_pool);
+	if (err)
+		goto err_unregister_rxq;
+
+	return 0;
+
+err_unregister_rxq:
+	xdp_rxq_info_unreg(&rxq->xdp_rxq);
+err_free_pp:
+	page_pool_destroy(rxq->page_pool);
+	rxq->page_pool = NULL;
+	return err;
+}
+
 static int
 fec_enet_alloc_rxq_buffers(struct net_device *ndev, unsigned int queue)
 {
 	struct fec_enet_private *fep = netdev_priv(ndev);
 	unsigned int i;
-	struct sk_buff *skb;
+	struct page *page;
 	struct bufdesc	*bdp;
 	struct fec_enet_priv_rx_q *rxq;
+	int err;
 
 	rxq = fep->rx_queue[queue];
 	bdp = rxq->bd.base;
-	for (i = 0; i < rxq->bd.ring_size; i++) {
-		skb = netdev_alloc_skb(ndev, FEC_ENET_RX_FRSIZE);
-		if (!skb)
-			goto err_alloc;
 
-		if (fec_enet_new_rxbdp(ndev, bdp, skb)) {
-			dev_kfree_skb(skb);
+	err = fec_enet_create_page_pool(fep, rxq, rxq->bd.ring_size,
+					fec_enet_rx_dma_dir(fep->xdp_prog));
+	if (err < 0) {
+		netdev_err(ndev, "%s failed queue %d (%d)\n", __func__, queue,
+			   err);
+		return err;
+	}
+
+	for (i = 0; i < rxq->bd.ring_size; i++) {
+		page = page_pool_dev_alloc_pages(rxq->page_pool);
+		if (!page)
 			goto err_alloc;
-		}
 
-		rxq->rx_skbuff[i] = skb;
+		fec_enet_update_cbd(rxq, bdp, i, page);
 		bdp->cbd_sc = cpu_to_fec16(BD_ENET_RX_EMPTY);
 
 		if (fep->bufdesc_ex) {
@@ -3472,6 +3838,147 @@ u16 fec_enet_select_queue(struct net_device *ndev, struct sk_buff *skb,
 	return  fec_enet_vlan_pri_to_queue[vlan_tag >> 13];
 }
 
+/* Install a program on a running interface, with Rx page pools mapped for
+ * it. The new pools are filled before anything is stopped, so that a
+ * failure leaves the interface as it was. The swap itself only restarts
+ * the MAC, the PHY and the link stay up.
+ */
+static int fec_enet_xdp_swap_pools(struct net_device *ndev,
+				   struct bpf_prog *prog)
+{
+	struct fec_enet_private *fep = netdev_priv(ndev);
+	struct fec_enet_priv_rx_q *rxq, *pools;
+	struct bpf_prog *old_prog;
+	struct bufdesc *bdp;
+	unsigned int q, i;
+	int err = 0;
+
+	pools = kcalloc(fep->num_rx_queues, sizeof(*pools), GFP_KERNEL);
+	if (!pools)
+		return -ENOMEM;
+
+	for (q = 0; q < fep->num_rx_queues; q++) {
+		pools[q].bd = fep->rx_queue[q]->bd;
+
+		err = fec_enet_create_page_pool(fep, &pools[q],
+						pools[q].bd.ring_size,
+						fec_enet_rx_dma_dir(prog));
+		if (err)
+			goto out_free;
+
+		for (i = 0; i < pools[q].bd.ring_size; i++) {
+			pools[q].rx_page[i] =
+				page_pool_dev_alloc_pages(pools[q].page_pool);
+			if (!pools[q].rx_page[i]) {
+				err = -ENOMEM;
+				goto out_free;
+			}
+		}
+	}
+
+	napi_disable(&fep->napi);
+	netif_tx_lock_bh(ndev);
+	fec_stop(ndev);
+
+	/* From here on pools[] holds what the rings used so far */
+	for (q = 0; q < fep->num_rx_queues; q++) {
+		rxq = fep->rx_queue[q];
+		fec_enet_rx_reuse_drain(rxq);
+
+		swap(rxq->page_pool, pools[q].page_pool);
+		swap(rxq->xdp_rxq, pools[q].xdp_rxq);
+
+		bdp = rxq->bd.base;
+		for (i = 0; i < rxq->bd.ring_size; i++) {
+			swap(rxq->rx_page[i], pools[q].rx_page[i]);
+			fec_enet_update_cbd(rxq, bdp, i, rxq->rx_page[i]);
+			bdp = fec_enet_get_nextdesc(bdp, &rxq->bd);
+		}
+	}
+
+	old_prog = xchg(&fep->xdp_prog, prog);
+
+	/* Also gives XDP_TX frames still on the Tx rings back to them */
+	fec_restart(ndev);
+	netif_tx_wake_all_queues(ndev);
+	netif_tx_unlock_bh(ndev);
+	napi_enable(&fep->napi);
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+out_free:
+	for (q = 0; q < fep->num_rx_queues; q++)
+		fec_enet_free_rxq_pages(&pools[q]);
+	kfree(pools);
+	return err;
+}
+
+static int fec_enet_bpf(struct net_device *dev, struct netdev_bpf *bpf)
+{
+	struct fec_enet_private *fep = netdev_priv(dev);
+	bool is_run = netif_running(dev);
+	struct bpf_prog *old_prog;
+
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		/* The frames would have to be swapped before the program */
+		if (fep->quirks & FEC_QUIRK_SWAP_FRAME) {
+			NL_SET_ERR_MSG_MOD(bpf->extack,
+					   "XDP is not supported on this controller");
+			return -EOPNOTSUPP;
+		}
+
+		/* The page pools are mapped for the Tx direction as well while
+		 * a program is attached, recreate them.
+		 */
+		if (is_run && !fep->xdp_prog != !bpf->prog)
+			return fec_enet_xdp_swap_pools(dev, bpf->prog);
+
+		old_prog = xchg(&fep->xdp_prog, bpf->prog);
+		if (old_prog)
+			bpf_prog_put(old_prog);
+
+		return 0;
+
+	default:
+		return -EINVAL;
+	}
+}
+
+static int
+fec_enet_xdp_xmit(struct net_device *dev, int num_frames,
+		  struct xdp_frame **frames, u32 flags)
+{
+	struct fec_enet_private *fep = netdev_priv(dev);
+	struct fec_enet_priv_tx_q *txq;
+	int cpu = smp_processor_id();
+	struct netdev_queue *nq;
+	int i, queue, drops = 0;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!netif_running(dev)))
+		return -ENETDOWN;
+
+	queue = fec_enet_xdp_get_tx_queue(fep, cpu);
+	txq = fep->tx_queue[queue];
+	nq = netdev_get_tx_queue(dev, queue);
+
+	__netif_tx_lock(nq, cpu);
+	txq_trans_update(nq);
+	for (i = 0; i < num_frames; i++) {
+		if (fec_enet_txq_xmit_frame(fep, txq, frames[i], true)) {
+			xdp_return_frame_rx_napi(frames[i]);
+			drops++;
+		}
+	}
+	__netif_tx_unlock(nq);
+
+	return num_frames - drops;
+}
+
 static const struct net_device_ops fec_netdev_ops = {
 	.ndo_open		= fec_enet_open,
 	.ndo_stop		= fec_enet_close,
@@ -3486,6 +3993,8 @@ static const struct net_device_ops fec_netdev_ops = {
 	.ndo_poll_controller	= fec_poll_controller,
 #endif
 	.ndo_set_features	= fec_set_features,
+	.ndo_bpf		= fec_enet_bpf,
+	.ndo_xdp_xmit		= fec_enet_xdp_xmit,
 };
 
 static const unsigned short offset_des_active_rxq[] = {
@@ -22,6 +22,8 @@
 #include <linux/net_tstamp.h>
 #include <linux/reset.h>
 #include <net/page_pool.h>
+#include <net/xdp.h>
+#include <uapi/linux/bpf.h>
 
 struct stmmac_resources {
 	void __iomem *addr;
@@ -31,12 +33,20 @@ struct stmmac_resources {
 	int irq;
 };
 
+enum stmmac_txbuf_type {
+	STMMAC_TXBUF_T_SKB,
+	STMMAC_TXBUF_T_XDP_TX,
+	STMMAC_TXBUF_T_XDP_NDO,
+	STMMAC_TXBUF_T_XSK_TX,
+};
+
 struct stmmac_tx_info {
 	dma_addr_t buf;
 	bool map_as_page;
 	unsigned len;
 	bool last_segment;
 	bool is_jumbo;
+	enum stmmac_txbuf_type buf_type;
 };
 
 #define STMMAC_TBS_AVAIL	BIT(0)
@@ -54,6 +64,9 @@ struct stmmac_tx_queue {
 	struct dma_desc *dma_tx;
 	struct sk_buff **tx_skbuff;
 	struct stmmac_tx_info *tx_skbuff_dma;
+	struct xdp_frame **xdpf;
+	struct xsk_buff_pool *xsk_pool;
+	u32 xsk_frames_done;
 	unsigned int cur_tx;
 	unsigned int dirty_tx;
 	dma_addr_t dma_tx_phy;
@@ -66,6 +79,8 @@ struct stmmac_rx_buffer {
 	struct page *sec_page;
 	dma_addr_t addr;
 	dma_addr_t sec_addr;
+	unsigned int page_offset;
+	struct xdp_buff *xdp;
 };
 
 struct stmmac_rx_queue {
@@ -73,6 +88,8 @@ struct stmmac_rx_queue {
 	u32 queue_index;
 	struct page_pool *page_pool;
 	struct stmmac_rx_buffer *buf_pool;
+	struct xsk_buff_pool *xsk_pool;
+	u32 buf_alloc_num;
 	struct stmmac_priv *priv_data;
 	struct dma_extended_desc *dma_erx;
 	struct dma_desc *dma_rx ____cacheline_aligned_in_smp;
@@ -87,6 +104,7 @@ struct stmmac_rx_queue {
 		unsigned int len;
 		unsigned int error;
 	} state;
+	struct xdp_rxq_info xdp_rxq;
 };
 
 struct stmmac_channel {
@@ -155,6 +173,7 @@ struct stmmac_priv {
 	bool tx_path_in_lpi_mode;
 	bool tso;
 	int sph;
+	bool sph_cap;
 	u32 sarc_type;
 
 	unsigned int dma_buf_sz;
@@ -246,6 +265,10 @@ struct stmmac_priv {
 
 	/* Receive Side Scaling */
 	struct stmmac_rss rss;
+
+	/* XDP BPF Program */
+	unsigned long af_xdp_zc_qps[BITS_TO_LONGS(MTL_MAX_TX_QUEUES)];
+	struct bpf_prog *xdp_prog;
 };
 
 enum stmmac_state {
@@ -272,6 +295,9 @@ void stmmac_disable_eee_mode(struct stmmac_priv *priv);
 bool stmmac_eee_init(struct stmmac_priv *priv);
 int stmmac_reinit_queues(struct net_device *dev, u32 rx_cnt, u32 tx_cnt);
 int stmmac_reinit_ringparam(struct net_device *dev, u32 rx_size, u32 tx_size);
+void stmmac_xdp_release(struct net_device *dev);
+int stmmac_xdp_open(struct net_device *dev);
+int stmmac_xsk_wakeup(struct net_device *dev, u32 queue, u32 flags);
 
 #if IS_ENABLED(CONFIG_STMMAC_SELFTESTS)
 void stmmac_selftest_run(struct net_device *dev,
@@ -297,4 +323,17 @@ static inline int stmmac_selftest_get_count(struct stmmac_priv *priv)
 
 int stmmac_bus_clks_enable(struct stmmac_priv *priv, bool enabled);
 
+static inline bool stmmac_xdp_is_enabled(struct stmmac_priv *priv)
+{
+	return !!priv->xdp_prog;
+}
+
+static inline unsigned int stmmac_rx_offset(struct stmmac_priv *priv)
+{
+	if (stmmac_xdp_is_enabled(priv))
+		return XDP_PACKET_HEADROOM;
+
+	return 0;
+}
+
 #endif /* __STMMAC_H__ */
@@ -37,9 +37,12 @@
 #include <linux/net_tstamp.h>
 #include <linux/phylink.h>
 #include <linux/udp.h>
+#include <linux/bpf_trace.h>
 #include <net/pkt_cls.h>
+#include <net/xdp_sock_drv.h>
 #include "stmmac_ptp.h"
 #include "stmmac.h"
+#include "stmmac_xdp.h"
 #include <linux/reset.h>
 #include <linux/of_mdio.h>
 #include "dwmac1000.h"
@@ -86,6 +89,16 @@ MODULE_PARM_DESC(buf_sz, "DMA buffer size");
 
 #define	STMMAC_RX_COPYBREAK	256
 
+#define STMMAC_RX_FILL_BATCH	16
+
+#define STMMAC_XDP_PASS		0
+#define STMMAC_XDP_CONSUMED	BIT(0)
+#define STMMAC_XDP_TX		BIT(1)
+#define STMMAC_XDP_REDIRECT	BIT(2)
+
+#define STMMAC_TX_XSK_AVAIL		16
+#define STMMAC_XSK_TX_BUDGET_MAX	256
+
 static const u32 default_msg_level = (NETIF_MSG_DRV | NETIF_MSG_PROBE |
 				      NETIF_MSG_LINK | NETIF_MSG_IFUP |
 				      NETIF_MSG_IFDOWN | NETIF_MSG_TIMER);
@@ -1227,7 +1240,12 @@ static void stmmac_clear_rx_descriptors(struct stmmac_priv *priv, u32 queue)
 
 	/* Clear the RX descriptors */
 	for (i = 0; i < priv->dma_rx_size; i++)
-		if (priv->extend_desc)
+		if (rx_q->xsk_pool && !rx_q->buf_pool[i].xdp)
+			/* No XSK buffer yet, keep it away from the DMA */
+			stmmac_clear_desc(priv, priv->extend_desc ?
+					  &rx_q->dma_erx[i].basic :
+					  &rx_q->dma_rx[i]);
+		else if (priv->extend_desc)
 			stmmac_init_rx_desc(priv, &rx_q->dma_erx[i].basic,
 					priv->use_riwt, priv->mode,
 					(i == priv->dma_rx_size - 1),
@@ -1320,7 +1338,8 @@ static int stmmac_init_rx_buffers(struct stmmac_priv *priv, struct dma_desc *p,
 		stmmac_set_desc_sec_addr(priv, p, buf->sec_addr, false);
 	}
 
-	buf->addr = page_pool_get_dma_addr(buf->page);
+	buf->page_offset = stmmac_rx_offset(priv);
+	buf->addr = page_pool_get_dma_addr(buf->page) + buf->page_offset;
 	stmmac_set_desc_addr(priv, p, buf->addr);
 	if (priv->dma_buf_sz == BUF_SIZE_16KiB)
 		stmmac_init_desc3(priv, p);
@@ -1346,6 +1365,10 @@ static void stmmac_free_rx_buffer(struct stmmac_priv *priv, u32 queue, int i)
 	if (buf->sec_page)
 		page_pool_put_full_page(rx_q->page_pool, buf->sec_page, false);
 	buf->sec_page = NULL;
+
+	if (buf->xdp)
+		xsk_buff_free(buf->xdp);
+	buf->xdp = NULL;
 }
 
 /**
@@ -1358,7 +1381,9 @@ static void stmmac_free_tx_buffer(struct stmmac_priv *priv, u32 queue, int i)
 {
 	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
 
-	if (tx_q->tx_skbuff_dma[i].buf) {
+	/* XDP_TX frames live in RX page pool pages mapped by the pool */
+	if (tx_q->tx_skbuff_dma[i].buf &&
+	    tx_q->tx_skbuff_dma[i].buf_type != STMMAC_TXBUF_T_XDP_TX) {
 		if (tx_q->tx_skbuff_dma[i].map_as_page)
 			dma_unmap_page(priv->device,
 				       tx_q->tx_skbuff_dma[i].buf,
@@ -1371,12 +1396,85 @@ static void stmmac_free_tx_buffer(struct stmmac_priv *priv, u32 queue, int i)
 					 DMA_TO_DEVICE);
 	}
 
+	if (tx_q->xdpf[i]) {
+		xdp_return_frame(tx_q->xdpf[i]);
+		tx_q->xdpf[i] = NULL;
+	}
+
+	if (tx_q->tx_skbuff_dma[i].buf_type == STMMAC_TXBUF_T_XSK_TX)
+		tx_q->xsk_frames_done++;
+
 	if (tx_q->tx_skbuff[i]) {
 		dev_kfree_skb_any(tx_q->tx_skbuff[i]);
 		tx_q->tx_skbuff[i] = NULL;
-		tx_q->tx_skbuff_dma[i].buf = 0;
-		tx_q->tx_skbuff_dma[i].map_as_page = false;
 	}
+
+	tx_q->tx_skbuff_dma[i].buf = 0;
+	tx_q->tx_skbuff_dma[i].map_as_page = false;
+	tx_q->tx_skbuff_dma[i].buf_type = STMMAC_TXBUF_T_SKB;
+}
+
+/**
+ * stmmac_get_xsk_pool - get the AF_XDP zero-copy pool of a queue
+ * @priv: driver private structure
+ * @queue: queue index
+ * Description: a queue only runs in zero-copy mode when an XDP program is
+ * attached and a pool has been bound to it.
+ */
+static struct xsk_buff_pool *stmmac_get_xsk_pool(struct stmmac_priv *priv,
+						 u32 queue)
+{
+	if (!stmmac_xdp_is_enabled(priv) ||
+	    !test_bit(queue, priv->af_xdp_zc_qps))
+		return NULL;
+
+	return xsk_get_pool_from_qid(priv->dev, queue);
+}
+
+/**
+ * stmmac_alloc_rx_buffers_zc - fill a zero-copy RX ring
+ * @priv: driver private structure
+ * @queue: RX queue index
+ * Description: takes as many buffers as the XSK fill ring has to offer, up
+ * to the ring size. The fill ring is usually still empty at this point, as
+ * sockets get bound before userspace fills it. Descriptors left without a
+ * buffer stay owned by the CPU and userspace is asked to kick the refill.
+ */
+static void stmmac_alloc_rx_buffers_zc(struct stmmac_priv *priv, u32 queue)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+	int i;
+
+	rx_q->buf_alloc_num = 0;
+
+	for (i = 0; i < priv->dma_rx_size; i++) {
+		struct stmmac_rx_buffer *buf = &rx_q->buf_pool[i];
+		struct dma_desc *p;
+
+		if (priv->extend_desc)
+			p = &((rx_q->dma_erx + i)->basic);
+		else
+			p = rx_q->dma_rx + i;
+
+		buf->xdp = NULL;
+		if (rx_q->buf_alloc_num == i)
+			buf->xdp = xsk_buff_alloc(rx_q->xsk_pool);
+
+		/* stmmac_clear_rx_descriptors() keeps the others CPU owned */
+		if (!buf->xdp)
+			continue;
+
+		stmmac_set_desc_addr(priv, p, xsk_buff_xdp_get_dma(buf->xdp));
+		stmmac_set_desc_sec_addr(priv, p, 0, false);
+		rx_q->buf_alloc_num++;
+	}
+
+	/* Descriptors left without a buffer are the first ones to refill */
+	rx_q->dirty_rx = rx_q->buf_alloc_num & (priv->dma_rx_size - 1);
+
+	if (rx_q->buf_alloc_num < priv->dma_rx_size &&
+	    xsk_uses_need_wakeup(rx_q->xsk_pool))
+		xsk_set_rx_need_wakeup(rx_q->xsk_pool);
 }
 
 /**
@@ -1397,6 +1495,11 @@ static int stmmac_reinit_rx_buffers(struct stmmac_priv *priv)
 		for (i = 0; i < priv->dma_rx_size; i++) {
 			struct stmmac_rx_buffer *buf = &rx_q->buf_pool[i];
 
+			if (buf->xdp) {
+				xsk_buff_free(buf->xdp);
+				buf->xdp = NULL;
+			}
+
 			if (buf->page) {
 				page_pool_recycle_direct(rx_q->page_pool, buf->page);
 				buf->page = NULL;
@@ -1412,6 +1515,11 @@ static int stmmac_reinit_rx_buffers(struct stmmac_priv *priv)
 	for (queue = 0; queue < rx_count; queue++) {
 		struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
 
+		if (rx_q->xsk_pool) {
+			stmmac_alloc_rx_buffers_zc(priv, queue);
+			continue;
+		}
+
 		for (i = 0; i < priv->dma_rx_size; i++) {
 			struct stmmac_rx_buffer *buf = &rx_q->buf_pool[i];
 			struct dma_desc *p;
@@ -1426,7 +1534,9 @@ static int stmmac_reinit_rx_buffers(struct stmmac_priv *priv)
 				if (!buf->page)
 					goto err_reinit_rx_buffers;
 
-				buf->addr = page_pool_get_dma_addr(buf->page);
+				buf->page_offset = stmmac_rx_offset(priv);
+				buf->addr = page_pool_get_dma_addr(buf->page) +
+					    buf->page_offset;
 			}
 
 			if (priv->sph && !buf->sec_page) {
@@ -1490,22 +1600,43 @@ static int init_dma_rx_desc_rings(struct net_device *dev, gfp_t flags)
 
 		stmmac_clear_rx_descriptors(priv, queue);
 
-		for (i = 0; i < priv->dma_rx_size; i++) {
-			struct dma_desc *p;
-
-			if (priv->extend_desc)
-				p = &((rx_q->dma_erx + i)->basic);
-			else
-				p = rx_q->dma_rx + i;
-
-			ret = stmmac_init_rx_buffers(priv, p, i, flags,
-						     queue);
-			if (ret)
-				goto err_init_rx_buffers;
+		rx_q->xsk_pool = stmmac_get_xsk_pool(priv, queue);
+		if (rx_q->xsk_pool) {
+			WARN_ON(xdp_rxq_info_reg_mem_model(&rx_q->xdp_rxq,
+							   MEM_TYPE_XSK_BUFF_POOL,
+							   NULL));
+			netdev_info(priv->dev,
+				    "Register MEM_TYPE_XSK_BUFF_POOL RxQ-%d\n",
+				    rx_q->queue_index);
+			xsk_pool_set_rxq_info(rx_q->xsk_pool, &rx_q->xdp_rxq);
+		} else {
+			WARN_ON(xdp_rxq_info_reg_mem_model(&rx_q->xdp_rxq,
+							   MEM_TYPE_PAGE_POOL,
+							   rx_q->page_pool));
 		}
 
 		rx_q->cur_rx = 0;
-		rx_q->dirty_rx = (unsigned int)(i - priv->dma_rx_size);
+
+		if (rx_q->xsk_pool) {
+			stmmac_alloc_rx_buffers_zc(priv, queue);
+		} else {
+			for (i = 0; i < priv->dma_rx_size; i++) {
+				struct dma_desc *p;
+
+				if (priv->extend_desc)
+					p = &((rx_q->dma_erx + i)->basic);
+				else
+					p = rx_q->dma_rx + i;
+
+				ret = stmmac_init_rx_buffers(priv, p, i, flags,
+							     queue);
+				if (ret)
+					goto err_init_rx_buffers;
+			}
+
+			rx_q->buf_alloc_num = priv->dma_rx_size;
+			rx_q->dirty_rx = (unsigned int)(i - priv->dma_rx_size);
+		}
 
 		/* Setup the chained descriptor addresses */
 		if (priv->mode == STMMAC_CHAIN_MODE) {
@@ -1585,9 +1716,13 @@ static int init_dma_tx_desc_rings(struct net_device *dev)
 			tx_q->tx_skbuff_dma[i].map_as_page = false;
 			tx_q->tx_skbuff_dma[i].len = 0;
 			tx_q->tx_skbuff_dma[i].last_segment = false;
+			tx_q->tx_skbuff_dma[i].buf_type = STMMAC_TXBUF_T_SKB;
 			tx_q->tx_skbuff[i] = NULL;
+			tx_q->xdpf[i] = NULL;
 		}
 
+		tx_q->xsk_pool = stmmac_get_xsk_pool(priv, queue);
+		tx_q->xsk_frames_done = 0;
 		tx_q->dirty_tx = 0;
 		tx_q->cur_tx = 0;
 		tx_q->mss = 0;
@@ -1645,10 +1780,18 @@ static void dma_free_rx_skbufs(struct stmmac_priv *priv, u32 queue)
  */
 static void dma_free_tx_skbufs(struct stmmac_priv *priv, u32 queue)
 {
+	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
 	int i;
 
+	tx_q->xsk_frames_done = 0;
+
 	for (i = 0; i < priv->dma_tx_size; i++)
 		stmmac_free_tx_buffer(priv, queue, i);
+
+	if (tx_q->xsk_pool && tx_q->xsk_frames_done) {
+		xsk_tx_completed(tx_q->xsk_pool, tx_q->xsk_frames_done);
+		tx_q->xsk_frames_done = 0;
+	}
 }
 
 /**
@@ -1678,21 +1821,32 @@ static void free_dma_rx_desc_resources(struct stmmac_priv *priv)
 		struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
 
 		/* Release the DMA RX socket buffers */
-		dma_free_rx_skbufs(priv, queue);
+		if (rx_q->buf_pool)
+			dma_free_rx_skbufs(priv, queue);
 
 		/* Free DMA regions of consistent memory previously allocated */
-		if (!priv->extend_desc)
+		if (!priv->extend_desc && rx_q->dma_rx)
 			dma_free_coherent(priv->device, priv->dma_rx_size *
 					  sizeof(struct dma_desc),
 					  rx_q->dma_rx, rx_q->dma_rx_phy);
-		else
+		else if (priv->extend_desc && rx_q->dma_erx)
 			dma_free_coherent(priv->device, priv->dma_rx_size *
 					  sizeof(struct dma_extended_desc),
 					  rx_q->dma_erx, rx_q->dma_rx_phy);
 
+		if (xdp_rxq_info_is_reg(&rx_q->xdp_rxq))
+			xdp_rxq_info_unreg(&rx_q->xdp_rxq);
+
 		kfree(rx_q->buf_pool);
 		if (rx_q->page_pool)
 			page_pool_destroy(rx_q->page_pool);
+
+		/* The rings may be freed again on a later error or close */
+		rx_q->dma_rx = NULL;
+		rx_q->dma_erx = NULL;
+		rx_q->buf_pool = NULL;
+		rx_q->page_pool = NULL;
+		rx_q->xsk_pool = NULL;
 	}
 }
 
@@ -1712,7 +1866,8 @@ static void free_dma_tx_desc_resources(struct stmmac_priv *priv)
 		void *addr;
 
 		/* Release the DMA TX socket buffers */
-		dma_free_tx_skbufs(priv, queue);
+		if (tx_q->tx_skbuff_dma && tx_q->tx_skbuff && tx_q->xdpf)
+			dma_free_tx_skbufs(priv, queue);
 
 		if (priv->extend_desc) {
 			size = sizeof(struct dma_extended_desc);
@@ -1727,10 +1882,22 @@ static void free_dma_tx_desc_resources(struct stmmac_priv *priv)
 
 		size *= priv->dma_tx_size;
 
-		dma_free_coherent(priv->device, size, addr, tx_q->dma_tx_phy);
+		if (addr)
+			dma_free_coherent(priv->device, size, addr,
+					  tx_q->dma_tx_phy);
 
 		kfree(tx_q->tx_skbuff_dma);
 		kfree(tx_q->tx_skbuff);
+		kfree(tx_q->xdpf);
+
+		/* The rings may be freed again on a later error or close */
+		tx_q->dma_etx = NULL;
+		tx_q->dma_entx = NULL;
+		tx_q->dma_tx = NULL;
+		tx_q->tx_skbuff_dma = NULL;
+		tx_q->tx_skbuff = NULL;
+		tx_q->xdpf = NULL;
+		tx_q->xsk_pool = NULL;
 	}
 }
 
@@ -1751,19 +1918,26 @@ static int alloc_dma_rx_desc_resources(struct stmmac_priv *priv)
 	/* RX queues buffers and DMA */
 	for (queue = 0; queue < rx_count; queue++) {
 		struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+		bool xdp_prog = stmmac_xdp_is_enabled(priv);
 		struct page_pool_params pp_params = { 0 };
 		unsigned int num_pages;
 
 		rx_q->queue_index = queue;
 		rx_q->priv_data = priv;
 
-		pp_params.flags = PP_FLAG_DMA_MAP;
+		/* The pool syncs recycled pages back to the device, XDP_TX
+		 * sends frames straight from these pages.
+		 */
+		pp_params.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
 		pp_params.pool_size = priv->dma_rx_size;
-		num_pages = DIV_ROUND_UP(priv->dma_buf_sz, PAGE_SIZE);
+		num_pages = DIV_ROUND_UP(priv->dma_buf_sz + stmmac_rx_offset(priv),
+					 PAGE_SIZE);
 		pp_params.order = ilog2(num_pages);
 		pp_params.nid = dev_to_node(priv->device);
 		pp_params.dev = priv->device;
-		pp_params.dma_dir = DMA_FROM_DEVICE;
+		pp_params.dma_dir = xdp_prog ? DMA_BIDIRECTIONAL : DMA_FROM_DEVICE;
+		pp_params.offset = stmmac_rx_offset(priv);
+		pp_params.max_len = priv->dma_buf_sz;
 
 		rx_q->page_pool = page_pool_create(&pp_params);
 		if (IS_ERR(rx_q->page_pool)) {
@@ -1796,6 +1970,13 @@ static int alloc_dma_rx_desc_resources(struct stmmac_priv *priv)
 			if (!rx_q->dma_rx)
 				goto err_dma;
 		}
+
+		if (xdp_rxq_info_reg(&rx_q->xdp_rxq, priv->dev,
+				     rx_q->queue_index)) {
+			netdev_err(priv->dev, "Failed to register xdp rxq info\n");
+			ret = -EINVAL;
+			goto err_dma;
+		}
 	}
 
 	return 0;
@@ -1841,6 +2022,12 @@ static int alloc_dma_tx_desc_resources(struct stmmac_priv *priv)
 		if (!tx_q->tx_skbuff)
 			goto err_dma;
 
+		tx_q->xdpf = kcalloc(priv->dma_tx_size,
+				     sizeof(struct xdp_frame *),
+				     GFP_KERNEL);
+		if (!tx_q->xdpf)
+			goto err_dma;
+
 		if (priv->extend_desc)
 			size = sizeof(struct dma_extended_desc);
 		else if (tx_q->tbs & STMMAC_TBS_AVAIL)
@@ -2011,6 +2198,17 @@ static void stmmac_stop_all_dma(struct stmmac_priv *priv)
 		stmmac_stop_tx_dma(priv, chan);
 }
 
+static u32 stmmac_rx_buf_size(struct stmmac_priv *priv, u32 queue)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+
+	/* Zero-copy queues receive into the frames of the XSK pool */
+	if (rx_q->xsk_pool)
+		return xsk_pool_get_rx_frame_size(rx_q->xsk_pool);
+
+	return priv->dma_buf_sz;
+}
+
 /**
  *  stmmac_dma_operation_mode - HW DMA operation mode
  *  @priv: driver private structure
@@ -2062,8 +2260,8 @@ static void stmmac_dma_operation_mode(struct stmmac_priv *priv)
 
 		stmmac_dma_rx_mode(priv, priv->ioaddr, rxmode, chan,
 				rxfifosz, qmode);
-		stmmac_set_dma_bfsize(priv, priv->ioaddr, priv->dma_buf_sz,
-				chan);
+		stmmac_set_dma_bfsize(priv, priv->ioaddr,
+				      stmmac_rx_buf_size(priv, chan), chan);
 	}
 
 	for (chan = 0; chan < tx_channels_count; chan++) {
@@ -2074,6 +2272,125 @@ static void stmmac_dma_operation_mode(struct stmmac_priv *priv)
 	}
 }
 
+static void stmmac_flush_tx_descriptors(struct stmmac_priv *priv, int queue)
+{
+	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
+	int desc_size;
+
+	/* The own bit must be the latest setting done when prepare the
+	 * descriptor and then barrier is needed to make sure that
+	 * all is coherent before granting the DMA engine.
+	 */
+	wmb();
+
+	stmmac_enable_dma_transmission(priv, priv->ioaddr);
+
+	if (likely(priv->extend_desc))
+		desc_size = sizeof(struct dma_extended_desc);
+	else if (tx_q->tbs & STMMAC_TBS_AVAIL)
+		desc_size = sizeof(struct dma_edesc);
+	else
+		desc_size = sizeof(struct dma_desc);
+
+	tx_q->tx_tail_addr = tx_q->dma_tx_phy + (tx_q->cur_tx * desc_size);
+	stmmac_set_tx_tail_ptr(priv, priv->ioaddr, tx_q->tx_tail_addr, queue);
+}
+
+/**
+ * stmmac_xdp_xmit_zc - send the frames queued on an AF_XDP socket
+ * @priv: driver private structure
+ * @queue: TX queue index
+ * @budget: maximum number of frames to send
+ * Description: the XSK frames share the TX ring with the stack, called with
+ * the TX queue lock held. Returns true when the socket has nothing left to
+ * send, false when the ring ran out of room first.
+ */
+static bool stmmac_xdp_xmit_zc(struct stmmac_priv *priv, u32 queue, u32 budget)
+{
+	struct netdev_queue *nq = netdev_get_tx_queue(priv->dev, queue);
+	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
+	struct xsk_buff_pool *pool = tx_q->xsk_pool;
+	unsigned int entry = tx_q->cur_tx;
+	struct dma_desc *tx_desc = NULL;
+	struct xdp_desc xdp_desc;
+	bool work_done = true;
+
+	/* Avoids TX time-out as we are sharing with slow path */
+	txq_trans_update(nq);
+
+	budget = min(budget, stmmac_tx_avail(priv, queue));
+
+	for (; budget > 0; budget--) {
+		dma_addr_t dma_addr;
+		bool set_ic;
+
+		/* Leave room for the stack, it is sharing the ring with us */
+		if (unlikely(stmmac_tx_avail(priv, queue) < STMMAC_TX_XSK_AVAIL)) {
+			work_done = false;
+			break;
+		}
+
+		if (!netif_carrier_ok(priv->dev))
+			break;
+
+		if (!xsk_tx_peek_desc(pool, &xdp_desc))
+			break;
+
+		if (likely(priv->extend_desc))
+			tx_desc = (struct dma_desc *)(tx_q->dma_etx + entry);
+		else if (tx_q->tbs & STMMAC_TBS_AVAIL)
+			tx_desc = &tx_q->dma_entx[entry].basic;
+		else
+			tx_desc = tx_q->dma_tx + entry;
+
+		dma_addr = xsk_buff_raw_get_dma(pool, xdp_desc.addr);
+		xsk_buff_raw_dma_sync_for_device(pool, dma_addr, xdp_desc.len);
+
+		/* The frame goes back to the pool through xsk_tx_completed(),
+		 * there is nothing to unmap nor to free.
+		 */
+		tx_q->tx_skbuff_dma[entry].buf_type = STMMAC_TXBUF_T_XSK_TX;
+		tx_q->tx_skbuff_dma[entry].buf = 0;
+		tx_q->tx_skbuff_dma[entry].map_as_page = false;
+		tx_q->tx_skbuff_dma[entry].len = xdp_desc.len;
+		tx_q->tx_skbuff_dma[entry].last_segment = true;
+		tx_q->tx_skbuff_dma[entry].is_jumbo = false;
+		tx_q->xdpf[entry] = NULL;
+
+		stmmac_set_desc_addr(priv, tx_desc, dma_addr);
+
+		tx_q->tx_count_frames++;
+
+		if (!priv->tx_coal_frames)
+			set_ic = false;
+		else if (tx_q->tx_count_frames % priv->tx_coal_frames == 0)
+			set_ic = true;
+		else
+			set_ic = false;
+
+		if (set_ic) {
+			tx_q->tx_count_frames = 0;
+			stmmac_set_tx_ic(priv, tx_desc);
+			priv->xstats.tx_set_ic_bit++;
+		}
+
+		stmmac_prepare_tx_desc(priv, tx_desc, 1, xdp_desc.len, true,
+				       priv->mode, true, true, xdp_desc.len);
+
+		priv->dev->stats.tx_bytes += xdp_desc.len;
+
+		tx_q->cur_tx = STMMAC_GET_ENTRY(tx_q->cur_tx, priv->dma_tx_size);
+		entry = tx_q->cur_tx;
+	}
+
+	if (tx_desc) {
+		stmmac_flush_tx_descriptors(priv, queue);
+		xsk_tx_release(pool);
+	}
+
+	return budget > 0 && work_done;
+}
+
 /**
  * stmmac_tx_clean - to manage the transmission completion
  * @priv: driver private structure
@@ -2086,6 +2403,7 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
 	unsigned int bytes_compl = 0, pkts_compl = 0;
 	unsigned int entry, count = 0;
+	unsigned int xsk_frames = 0;
 
 	__netif_tx_lock_bh(netdev_get_tx_queue(priv->dev, queue));
 
@@ -2093,6 +2411,7 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 
 	entry = tx_q->dirty_tx;
 	while ((entry != tx_q->cur_tx) && (count < budget)) {
+		struct xdp_frame *xdpf = tx_q->xdpf[entry];
 		struct sk_buff *skb = tx_q->tx_skbuff[entry];
 		struct dma_desc *p;
 		int status;
@@ -2129,7 +2448,8 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 			stmmac_get_tx_hwtstamp(priv, p, skb);
 		}
 
-		if (likely(tx_q->tx_skbuff_dma[entry].buf)) {
+		if (likely(tx_q->tx_skbuff_dma[entry].buf &&
+			   tx_q->tx_skbuff_dma[entry].buf_type != STMMAC_TXBUF_T_XDP_TX)) {
 			if (tx_q->tx_skbuff_dma[entry].map_as_page)
 				dma_unmap_page(priv->device,
 					       tx_q->tx_skbuff_dma[entry].buf,
@@ -2150,6 +2470,14 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 		tx_q->tx_skbuff_dma[entry].last_segment = false;
 		tx_q->tx_skbuff_dma[entry].is_jumbo = false;
 
+		if (xdpf) {
+			xdp_return_frame(xdpf);
+			tx_q->xdpf[entry] = NULL;
+		}
+
+		if (tx_q->tx_skbuff_dma[entry].buf_type == STMMAC_TXBUF_T_XSK_TX)
+			xsk_frames++;
+
 		if (likely(skb != NULL)) {
 			pkts_compl++;
 			bytes_compl += skb->len;
@@ -2157,6 +2485,8 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 			tx_q->tx_skbuff[entry] = NULL;
 		}
 
+		tx_q->tx_skbuff_dma[entry].buf_type = STMMAC_TXBUF_T_SKB;
+
 		stmmac_release_tx_desc(priv, p, priv->mode);
 
 		entry = STMMAC_GET_ENTRY(entry, priv->dma_tx_size);
@@ -2166,6 +2496,18 @@ static int stmmac_tx_clean(struct stmmac_priv *priv, int budget, u32 queue)
 	netdev_tx_completed_queue(netdev_get_tx_queue(priv->dev, queue),
 				  pkts_compl, bytes_compl);
 
+	if (tx_q->xsk_pool) {
+		if (xsk_frames)
+			xsk_tx_completed(tx_q->xsk_pool, xsk_frames);
+
+		if (xsk_uses_need_wakeup(tx_q->xsk_pool))
+			xsk_set_tx_need_wakeup(tx_q->xsk_pool);
+
+		/* Frames still queued on the socket keep the NAPI polling */
+		if (!stmmac_xdp_xmit_zc(priv, queue, STMMAC_XSK_TX_BUDGET_MAX))
+			count = budget;
+	}
+
 	if (unlikely(netif_tx_queue_stopped(netdev_get_tx_queue(priv->dev,
 								queue))) &&
 	    stmmac_tx_avail(priv, queue) > STMMAC_TX_THRESH(priv)) {
@@ -2391,14 +2733,11 @@ static void stmmac_check_ether_addr(struct stmmac_priv *priv)
 }
 
 /**
- * stmmac_init_dma_engine - DMA init.
+ * stmmac_init_dma_chans - DMA channels init.
  * @priv: driver private structure
- * Description:
- * It inits the DMA invoking the specific MAC/GMAC callback.
- * Some DMA parameters can be passed from the platform;
- * in case of these are not passed a default is kept for the MAC or GMAC.
+ * Description: points the RX/TX DMA channels at their descriptor rings.
  */
-static int stmmac_init_dma_engine(struct stmmac_priv *priv)
+static void stmmac_init_dma_chans(struct stmmac_priv *priv)
 {
 	u32 rx_channels_count = priv->plat->rx_queues_to_use;
 	u32 tx_channels_count = priv->plat->tx_queues_to_use;
@@ -2406,28 +2745,6 @@ static int stmmac_init_dma_engine(struct stmmac_priv *priv)
 	struct stmmac_rx_queue *rx_q;
 	struct stmmac_tx_queue *tx_q;
 	u32 chan = 0;
-	int atds = 0;
-	int ret = 0;
-
-	if (!priv->plat->dma_cfg || !priv->plat->dma_cfg->pbl) {
-		dev_err(priv->device, "Invalid DMA configuration\n");
-		return -EINVAL;
-	}
-
-	if (priv->extend_desc && (priv->mode == STMMAC_RING_MODE))
-		atds = 1;
-
-	ret = stmmac_reset(priv, priv->ioaddr);
-	if (ret) {
-		dev_err(priv->device, "Failed to reset the dma\n");
-		return ret;
-	}
-
-	/* DMA Configuration */
-	stmmac_dma_init(priv, priv->ioaddr, priv->plat->dma_cfg, atds);
-
-	if (priv->plat->axi)
-		stmmac_axi(priv, priv->ioaddr, priv->plat->axi);
 
 	/* DMA CSR Channel configuration */
 	for (chan = 0; chan < dma_csr_ch; chan++)
@@ -2441,7 +2758,7 @@ static int stmmac_init_dma_engine(struct stmmac_priv *priv)
 				    rx_q->dma_rx_phy, chan);
 
 		rx_q->rx_tail_addr = rx_q->dma_rx_phy +
-				     (priv->dma_rx_size *
+				     (rx_q->buf_alloc_num *
 				      sizeof(struct dma_desc));
 		stmmac_set_rx_tail_ptr(priv, priv->ioaddr,
 				       rx_q->rx_tail_addr, chan);
@@ -2458,6 +2775,42 @@ static int stmmac_init_dma_engine(struct stmmac_priv *priv)
 		stmmac_set_tx_tail_ptr(priv, priv->ioaddr,
 				       tx_q->tx_tail_addr, chan);
 	}
+}
+
+/**
+ * stmmac_init_dma_engine - DMA init.
+ * @priv: driver private structure
+ * Description:
+ * It inits the DMA invoking the specific MAC/GMAC callback.
+ * Some DMA parameters can be passed from the platform;
+ * in case of these are not passed a default is kept for the MAC or GMAC.
+ */
+static int stmmac_init_dma_engine(struct stmmac_priv *priv)
+{
+	int atds = 0;
+	int ret = 0;
+
+	if (!priv->plat->dma_cfg || !priv->plat->dma_cfg->pbl) {
+		dev_err(priv->device, "Invalid DMA configuration\n");
+		return -EINVAL;
+	}
+
+	if (priv->extend_desc && (priv->mode == STMMAC_RING_MODE))
+		atds = 1;
+
+	ret = stmmac_reset(priv, priv->ioaddr);
+	if (ret) {
+		dev_err(priv->device, "Failed to reset the dma\n");
+		return ret;
+	}
+
+	/* DMA Configuration */
+	stmmac_dma_init(priv, priv->ioaddr, priv->plat->dma_cfg, atds);
+
+	if (priv->plat->axi)
+		stmmac_axi(priv, priv->ioaddr, priv->plat->axi);
+
+	stmmac_init_dma_chans(priv);
 
 	return ret;
 }
@@ -3709,11 +4062,9 @@ static void stmmac_rx_vlan(struct net_device *dev, struct sk_buff *skb)
 static inline void stmmac_rx_refill(struct stmmac_priv *priv, u32 queue)
 {
 	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
-	int len, dirty = stmmac_rx_dirty(priv, queue);
+	int dirty = stmmac_rx_dirty(priv, queue);
 	unsigned int entry = rx_q->dirty_rx;
 
-	len = DIV_ROUND_UP(priv->dma_buf_sz, PAGE_SIZE) * PAGE_SIZE;
-
 	while (dirty-- > 0) {
 		struct stmmac_rx_buffer *buf = &rx_q->buf_pool[entry];
 		struct dma_desc *p;
@@ -3736,18 +4087,11 @@ static inline void stmmac_rx_refill(struct stmmac_priv *priv, u32 queue)
 				break;
 
 			buf->sec_addr = page_pool_get_dma_addr(buf->sec_page);
-
-			dma_sync_single_for_device(priv->device, buf->sec_addr,
-						   len, DMA_FROM_DEVICE);
 		}
 
-		buf->addr = page_pool_get_dma_addr(buf->page);
-
-		/* Sync whole allocation to device. This will invalidate old
-		 * data.
-		 */
-		dma_sync_single_for_device(priv->device, buf->addr, len,
-					   DMA_FROM_DEVICE);
+		/* The page pool already synced the buffer for the device */
+		buf->page_offset = stmmac_rx_offset(priv);
+		buf->addr = page_pool_get_dma_addr(buf->page) + buf->page_offset;
 
 		stmmac_set_desc_addr(priv, p, buf->addr);
 		if (priv->sph)
@@ -3826,41 +4170,236 @@ static unsigned int stmmac_rx_buf2_len(struct stmmac_priv *priv,
 	return plen - len;
 }
 
-/**
- * stmmac_rx - manage the receive process
- * @priv: driver private structure
- * @limit: napi bugget
- * @queue: RX queue index.
- * Description :  this the function called by the napi poll method.
- * It gets all the frames inside the ring.
- */
-static int stmmac_rx(struct stmmac_priv *priv, int limit, u32 queue)
+static int stmmac_xdp_xmit_xdpf(struct stmmac_priv *priv, int queue,
+				struct xdp_frame *xdpf, bool dma_map)
 {
-	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
-	struct stmmac_channel *ch = &priv->channel[queue];
-	unsigned int count = 0, error = 0, len = 0;
-	int status = 0, coe = priv->hw->rx_csum;
-	unsigned int next_entry = rx_q->cur_rx;
-	unsigned int desc_size;
-	struct sk_buff *skb = NULL;
+	struct stmmac_tx_queue *tx_q = &priv->tx_queue[queue];
+	unsigned int entry = tx_q->cur_tx;
+	struct dma_desc *tx_desc;
+	dma_addr_t dma_addr;
+	bool set_ic;
 
-	if (netif_msg_rx_status(priv)) {
-		void *rx_head;
+	if (stmmac_tx_avail(priv, queue) < STMMAC_TX_THRESH(priv))
+		return STMMAC_XDP_CONSUMED;
 
-		netdev_dbg(priv->dev, "%s: descriptor ring:\n", __func__);
-		if (priv->extend_desc) {
-			rx_head = (void *)rx_q->dma_erx;
-			desc_size = sizeof(struct dma_extended_desc);
-		} else {
-			rx_head = (void *)rx_q->dma_rx;
-			desc_size = sizeof(struct dma_desc);
-		}
+	if (likely(priv->extend_desc))
+		tx_desc = (struct dma_desc *)(tx_q->dma_etx + entry);
+	else if (tx_q->tbs & STMMAC_TBS_AVAIL)
+		tx_desc = &tx_q->dma_entx[entry].basic;
+	else
+		tx_desc = tx_q->dma_tx + entry;
 
-		stmmac_display_ring(priv, rx_head, priv->dma_rx_size, true,
-				    rx_q->dma_rx_phy, desc_size);
+	if (dma_map) {
+		dma_addr = dma_map_single(priv->device, xdpf->data,
+					  xdpf->len, DMA_TO_DEVICE);
+		if (dma_mapping_error(priv->device, dma_addr))
+			return STMMAC_XDP_CONSUMED;
+
+		tx_q->tx_skbuff_dma[entry].buf_type = STMMAC_TXBUF_T_XDP_NDO;
+	} else {
+		struct page *page = virt_to_page(xdpf->data);
+
+		/* XDP_TX sends the frame from the RX page pool page */
+		dma_addr = page_pool_get_dma_addr(page) +
+			   (xdpf->data - page_address(page));
+		dma_sync_single_for_device(priv->device, dma_addr,
+					   xdpf->len, DMA_BIDIRECTIONAL);
+
+		tx_q->tx_skbuff_dma[entry].buf_type = STMMAC_TXBUF_T_XDP_TX;
 	}
-	while (count < limit) {
-		unsigned int buf1_len = 0, buf2_len = 0;
+
+	tx_q->tx_skbuff_dma[entry].buf = dma_addr;
+	tx_q->tx_skbuff_dma[entry].map_as_page = false;
+	tx_q->tx_skbuff_dma[entry].len = xdpf->len;
+	tx_q->tx_skbuff_dma[entry].last_segment = true;
+	tx_q->tx_skbuff_dma[entry].is_jumbo = false;
+
+	tx_q->xdpf[entry] = xdpf;
+
+	stmmac_set_desc_addr(priv, tx_desc, dma_addr);
+
+	tx_q->tx_count_frames++;
+
+	if (!priv->tx_coal_frames)
+		set_ic = false;
+	else if (tx_q->tx_count_frames % priv->tx_coal_frames == 0)
+		set_ic = true;
+	else
+		set_ic = false;
+
+	if (set_ic) {
+		tx_q->tx_count_frames = 0;
+		stmmac_set_tx_ic(priv, tx_desc);
+		priv->xstats.tx_set_ic_bit++;
+	}
+
+	stmmac_prepare_tx_desc(priv, tx_desc, 1, xdpf->len, true, priv->mode,
+			       true, true, xdpf->len);
+
+	priv->dev->stats.tx_bytes += xdpf->len;
+
+	tx_q->cur_tx = STMMAC_GET_ENTRY(entry, priv->dma_tx_size);
+
+	return STMMAC_XDP_TX;
+}
+
+static int stmmac_xdp_get_tx_queue(struct stmmac_priv *priv, int cpu)
+{
+	int index = cpu;
+
+	if (unlikely(index < 0))
+		index = 0;
+
+	while (index >= priv->plat->tx_queues_to_use)
+		index -= priv->plat->tx_queues_to_use;
+
+	return index;
+}
+
+static int stmmac_xdp_xmit_back(struct stmmac_priv *priv,
+				struct xdp_buff *xdp)
+{
+	bool zc = xdp->rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL;
+	int cpu = smp_processor_id();
+	struct netdev_queue *nq;
+	struct xdp_frame *xdpf;
+	int queue;
+	int res;
+
+	queue = stmmac_xdp_get_tx_queue(priv, cpu);
+	nq = netdev_get_tx_queue(priv->dev, queue);
+
+	__netif_tx_lock(nq, cpu);
+	/* Avoids TX time-out as we are sharing with slow path */
+	txq_trans_update(nq);
+
+	/* Check for room before converting, the conversion copies XSK
+	 * buffers and gives them back to their pool right away.
+	 */
+	if (stmmac_tx_avail(priv, queue) < STMMAC_TX_THRESH(priv)) {
+		res = STMMAC_XDP_CONSUMED;
+		goto unlock;
+	}
+
+	xdpf = xdp_convert_buff_to_frame(xdp);
+	if (unlikely(!xdpf)) {
+		res = STMMAC_XDP_CONSUMED;
+		goto unlock;
+	}
+
+	/* The copy of an XSK buffer is a plain page which needs mapping */
+	res = stmmac_xdp_xmit_xdpf(priv, queue, xdpf, zc);
+	if (res == STMMAC_XDP_TX) {
+		stmmac_flush_tx_descriptors(priv, queue);
+	} else if (zc) {
+		/* Only the copy is left, the RX buffer is gone either way */
+		xdp_return_frame(xdpf);
+		priv->dev->stats.tx_dropped++;
+		res = STMMAC_XDP_TX;
+	}
+
+unlock:
+	__netif_tx_unlock(nq);
+
+	return res;
+}
+
+static int __stmmac_xdp_run_prog(struct stmmac_priv *priv,
+				 struct bpf_prog *prog,
+				 struct xdp_buff *xdp)
+{
+	u32 act;
+	int res;
+
+	act = bpf_prog_run_xdp(prog, xdp);
+	switch (act) {
+	case XDP_PASS:
+		res = STMMAC_XDP_PASS;
+		break;
+	case XDP_TX:
+		res = stmmac_xdp_xmit_back(priv, xdp);
+		break;
+	case XDP_REDIRECT:
+		if (xdp_do_redirect(priv->dev, xdp, prog) < 0)
+			res = STMMAC_XDP_CONSUMED;
+		else
+			res = STMMAC_XDP_REDIRECT;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		fallthrough;
+	case XDP_ABORTED:
+		trace_xdp_exception(priv->dev, prog, act);
+		fallthrough;
+	case XDP_DROP:
+		res = STMMAC_XDP_CONSUMED;
+		break;
+	}
+
+	return res;
+}
+
+static void stmmac_finalize_xdp_rx(struct stmmac_priv *priv,
+				   int xdp_status)
+{
+	int cpu = smp_processor_id();
+	int queue;
+
+	queue = stmmac_xdp_get_tx_queue(priv, cpu);
+
+	if (xdp_status & STMMAC_XDP_TX)
+		stmmac_tx_timer_arm(priv, queue);
+
+	if (xdp_status & STMMAC_XDP_REDIRECT)
+		xdp_do_flush();
+}
+
+/**
+ * stmmac_rx - manage the receive process
+ * @priv: driver private structure
+ * @limit: napi bugget
+ * @queue: RX queue index.
+ * Description :  this the function called by the napi poll method.
+ * It gets all the frames inside the ring.
+ */
+static int stmmac_rx(struct stmmac_priv *priv, int limit, u32 queue)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+	struct stmmac_channel *ch = &priv->channel[queue];
+	unsigned int count = 0, error = 0, len = 0;
+	int status = 0, coe = priv->hw->rx_csum;
+	unsigned int next_entry = rx_q->cur_rx;
+	enum dma_data_direction dma_dir;
+	unsigned int desc_size;
+	struct sk_buff *skb = NULL;
+	struct bpf_prog *prog;
+	struct xdp_buff xdp;
+	int xdp_status = 0;
+	int buf_sz;
+
+	dma_dir = page_pool_get_dma_dir(rx_q->page_pool);
+	buf_sz = DIV_ROUND_UP(priv->dma_buf_sz + stmmac_rx_offset(priv),
+			      PAGE_SIZE) * PAGE_SIZE;
+	prog = READ_ONCE(priv->xdp_prog);
+	xdp.rxq = &rx_q->xdp_rxq;
+
+	if (netif_msg_rx_status(priv)) {
+		void *rx_head;
+
+		netdev_dbg(priv->dev, "%s: descriptor ring:\n", __func__);
+		if (priv->extend_desc) {
+			rx_head = (void *)rx_q->dma_erx;
+			desc_size = sizeof(struct dma_extended_desc);
+		} else {
+			rx_head = (void *)rx_q->dma_rx;
+			desc_size = sizeof(struct dma_desc);
+		}
+
+		stmmac_display_ring(priv, rx_head, priv->dma_rx_size, true,
+				    rx_q->dma_rx_phy, desc_size);
+	}
+	while (count < limit) {
+		unsigned int buf1_len = 0, buf2_len = 0;
 		enum pkt_hash_types hash_type;
 		struct stmmac_rx_buffer *buf;
 		struct dma_desc *np, *p;
@@ -3959,7 +4498,65 @@ read_again:
 			len -= ETH_FCS_LEN;
 		}
 
+		if (!skb && prog && unlikely(status & rx_not_ls)) {
+			/* The program only gets to see whole frames, which
+			 * fit in one buffer at the MTUs allowed with XDP.
+			 */
+			page_pool_recycle_direct(rx_q->page_pool, buf->page);
+			buf->page = NULL;
+			priv->dev->stats.rx_dropped++;
+			error = 1;
+			goto read_again;
+		}
+
 		if (!skb) {
+			unsigned int pre_len, sync_len = 0;
+			int res = STMMAC_XDP_PASS;
+
+			dma_sync_single_for_cpu(priv->device, buf->addr,
+						buf1_len, dma_dir);
+
+			xdp.data = page_address(buf->page) + buf->page_offset;
+			xdp.data_end = xdp.data + buf1_len;
+			xdp.data_hard_start = page_address(buf->page);
+			xdp_set_data_meta_invalid(&xdp);
+			xdp.frame_sz = buf_sz;
+
+			if (prog) {
+				pre_len = xdp.data_end - xdp.data_hard_start -
+					  buf->page_offset;
+				res = __stmmac_xdp_run_prog(priv, prog, &xdp);
+				/* The program may have moved the tail, sync
+				 * back to the device whatever it touched.
+				 */
+				sync_len = xdp.data_end - xdp.data_hard_start -
+					   buf->page_offset;
+				sync_len = max(sync_len, pre_len);
+			}
+
+			if (res != STMMAC_XDP_PASS) {
+				if (res == STMMAC_XDP_CONSUMED) {
+					page_pool_put_page(rx_q->page_pool,
+							   virt_to_head_page(xdp.data),
+							   sync_len, true);
+					priv->dev->stats.rx_dropped++;
+				} else {
+					/* The page went to the TX ring or
+					 * to the redirect target.
+					 */
+					xdp_status |= res;
+					priv->dev->stats.rx_packets++;
+					priv->dev->stats.rx_bytes += len;
+				}
+
+				buf->page = NULL;
+				count++;
+				continue;
+			}
+
+			/* The program may have moved the start of the frame */
+			buf1_len = xdp.data_end - xdp.data;
+
 			skb = napi_alloc_skb(&ch->rx_napi, buf1_len);
 			if (!skb) {
 				priv->dev->stats.rx_dropped++;
@@ -3967,10 +4564,7 @@ read_again:
 				goto drain_data;
 			}
 
-			dma_sync_single_for_cpu(priv->device, buf->addr,
-						buf1_len, DMA_FROM_DEVICE);
-			skb_copy_to_linear_data(skb, page_address(buf->page),
-						buf1_len);
+			skb_copy_to_linear_data(skb, xdp.data, buf1_len);
 			skb_put(skb, buf1_len);
 
 			/* Data payload copied into SKB, page ready for recycle */
@@ -3978,9 +4572,9 @@ read_again:
 			buf->page = NULL;
 		} else if (buf1_len) {
 			dma_sync_single_for_cpu(priv->device, buf->addr,
-						buf1_len, DMA_FROM_DEVICE);
+						buf1_len, dma_dir);
 			skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags,
-					buf->page, 0, buf1_len,
+					buf->page, buf->page_offset, buf1_len,
 					priv->dma_buf_sz);
 
 			/* Data payload appended into SKB */
@@ -3990,7 +4584,7 @@ read_again:
 
 		if (buf2_len) {
 			dma_sync_single_for_cpu(priv->device, buf->sec_addr,
-						buf2_len, DMA_FROM_DEVICE);
+						buf2_len, dma_dir);
 			skb_add_rx_frag(skb, skb_shinfo(skb)->nr_frags,
 					buf->sec_page, 0, buf2_len,
 					priv->dma_buf_sz);
@@ -4036,6 +4630,8 @@ drain_data:
 		rx_q->state.len = len;
 	}
 
+	stmmac_finalize_xdp_rx(priv, xdp_status);
+
 	stmmac_rx_refill(priv, queue);
 
 	priv->xstats.rx_pkt_n += count;
@@ -4043,6 +4639,325 @@ drain_data:
 	return count;
 }
 
+static void stmmac_dispatch_skb_zc(struct stmmac_priv *priv, u32 queue,
+				   struct dma_desc *p, struct dma_desc *np,
+				   struct xdp_buff *xdp)
+{
+	struct stmmac_channel *ch = &priv->channel[queue];
+	unsigned int len = xdp->data_end - xdp->data;
+	enum pkt_hash_types hash_type;
+	int coe = priv->hw->rx_csum;
+	struct sk_buff *skb;
+	u32 hash;
+
+	/* The XSK buffer goes back to the pool, the stack gets a copy */
+	skb = napi_alloc_skb(&ch->rx_napi, len);
+	if (unlikely(!skb)) {
+		priv->dev->stats.rx_dropped++;
+		return;
+	}
+
+	skb_put_data(skb, xdp->data, len);
+
+	stmmac_get_rx_hwtstamp(priv, p, np, skb);
+	stmmac_rx_vlan(priv->dev, skb);
+	skb->protocol = eth_type_trans(skb, priv->dev);
+
+	if (unlikely(!coe))
+		skb_checksum_none_assert(skb);
+	else
+		skb->ip_summed = CHECKSUM_UNNECESSARY;
+
+	if (!stmmac_get_rx_hash(priv, p, &hash, &hash_type))
+		skb_set_hash(skb, hash, hash_type);
+
+	skb_record_rx_queue(skb, queue);
+	napi_gro_receive(&ch->rx_napi, skb);
+
+	priv->dev->stats.rx_packets++;
+	priv->dev->stats.rx_bytes += len;
+}
+
+/**
+ * stmmac_rx_dirty_zc - number of zero-copy RX descriptors without a buffer
+ * @priv: driver private structure
+ * @queue: RX queue index
+ * Description: consumed descriptors always give their XSK buffer away, so
+ * dirty_rx == cur_rx means either a full ring or, when the fill ring ran
+ * dry, an empty one. The buffer at dirty_rx tells them apart.
+ */
+static u32 stmmac_rx_dirty_zc(struct stmmac_priv *priv, u32 queue)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+
+	if (rx_q->dirty_rx == rx_q->cur_rx &&
+	    !rx_q->buf_pool[rx_q->dirty_rx].xdp)
+		return priv->dma_rx_size;
+
+	return stmmac_rx_dirty(priv, queue);
+}
+
+static bool stmmac_rx_refill_zc(struct stmmac_priv *priv, u32 queue, u32 budget)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+	unsigned int entry = rx_q->dirty_rx;
+	struct dma_desc *rx_desc = NULL;
+	bool ret = true;
+
+	budget = min(budget, stmmac_rx_dirty_zc(priv, queue));
+
+	while (budget-- > 0) {
+		struct stmmac_rx_buffer *buf = &rx_q->buf_pool[entry];
+		dma_addr_t dma_addr;
+		bool use_rx_wd;
+
+		if (!buf->xdp) {
+			buf->xdp = xsk_buff_alloc(rx_q->xsk_pool);
+			if (!buf->xdp) {
+				ret = false;
+				break;
+			}
+		}
+
+		if (priv->extend_desc)
+			rx_desc = (struct dma_desc *)(rx_q->dma_erx + entry);
+		else
+			rx_desc = rx_q->dma_rx + entry;
+
+		dma_addr = xsk_buff_xdp_get_dma(buf->xdp);
+		stmmac_set_desc_addr(priv, rx_desc, dma_addr);
+		stmmac_set_desc_sec_addr(priv, rx_desc, 0, false);
+		stmmac_refill_desc3(priv, rx_q, rx_desc);
+
+		rx_q->rx_count_frames++;
+		rx_q->rx_count_frames += priv->rx_coal_frames;
+		if (rx_q->rx_count_frames > priv->rx_coal_frames)
+			rx_q->rx_count_frames = 0;
+
+		use_rx_wd = !priv->rx_coal_frames;
+		use_rx_wd |= rx_q->rx_count_frames > 0;
+		if (!priv->use_riwt)
+			use_rx_wd = false;
+
+		dma_wmb();
+		stmmac_set_rx_owner(priv, rx_desc, use_rx_wd);
+
+		entry = STMMAC_GET_ENTRY(entry, priv->dma_rx_size);
+	}
+
+	if (rx_desc) {
+		rx_q->dirty_rx = entry;
+		rx_q->rx_tail_addr = rx_q->dma_rx_phy +
+				     (rx_q->dirty_rx * sizeof(struct dma_desc));
+		stmmac_set_rx_tail_ptr(priv, priv->ioaddr, rx_q->rx_tail_addr, queue);
+	}
+
+	return ret;
+}
+
+/**
+ * stmmac_rx_zc - manage the zero-copy receive process
+ * @priv: driver private structure
+ * @limit: napi bugget
+ * @queue: RX queue index.
+ * Description: the frames land straight in the buffers of the AF_XDP
+ * socket, every frame goes through the XDP program which normally
+ * redirects it to the socket.
+ */
+static int stmmac_rx_zc(struct stmmac_priv *priv, int limit, u32 queue)
+{
+	struct stmmac_rx_queue *rx_q = &priv->rx_queue[queue];
+	unsigned int count = 0, error = 0, len = 0;
+	int dirty = stmmac_rx_dirty_zc(priv, queue);
+	unsigned int next_entry = rx_q->cur_rx;
+	unsigned int desc_size;
+	struct bpf_prog *prog;
+	bool failure = false;
+	int xdp_status = 0;
+	int status = 0;
+
+	if (netif_msg_rx_status(priv)) {
+		void *rx_head;
+
+		netdev_dbg(priv->dev, "%s: descriptor ring:\n", __func__);
+		if (priv->extend_desc) {
+			rx_head = (void *)rx_q->dma_erx;
+			desc_size = sizeof(struct dma_extended_desc);
+		} else {
+			rx_head = (void *)rx_q->dma_rx;
+			desc_size = sizeof(struct dma_desc);
+		}
+
+		stmmac_display_ring(priv, rx_head, priv->dma_rx_size, true,
+				    rx_q->dma_rx_phy, desc_size);
+	}
+
+	prog = READ_ONCE(priv->xdp_prog);
+
+	while (count < limit) {
+		struct stmmac_rx_buffer *buf;
+		unsigned int buf1_len = 0;
+		struct dma_desc *np, *p;
+		int entry;
+		int res;
+
+		if (!count && rx_q->state_saved) {
+			error = rx_q->state.error;
+			len = rx_q->state.len;
+		} else {
+			rx_q->state_saved = false;
+			error = 0;
+			len = 0;
+		}
+
+		if (count >= limit)
+			break;
+
+read_again:
+		buf1_len = 0;
+		entry = next_entry;
+		buf = &rx_q->buf_pool[entry];
+
+		if (dirty >= STMMAC_RX_FILL_BATCH) {
+			failure = failure ||
+				  !stmmac_rx_refill_zc(priv, queue, dirty);
+			dirty = 0;
+		}
+
+		if (priv->extend_desc)
+			p = (struct dma_desc *)(rx_q->dma_erx + entry);
+		else
+			p = rx_q->dma_rx + entry;
+
+		/* read the status of the incoming frame */
+		status = stmmac_rx_status(priv, &priv->dev->stats,
+					  &priv->xstats, p);
+		/* check if managed by the DMA otherwise go ahead */
+		if (unlikely(status & dma_own))
+			break;
+
+		/* A descriptor the refill could not serve yet */
+		if (unlikely(!buf->xdp))
+			break;
+
+		rx_q->cur_rx = STMMAC_GET_ENTRY(rx_q->cur_rx,
+						priv->dma_rx_size);
+		next_entry = rx_q->cur_rx;
+
+		if (priv->extend_desc)
+			np = (struct dma_desc *)(rx_q->dma_erx + next_entry);
+		else
+			np = rx_q->dma_rx + next_entry;
+
+		prefetch(np);
+
+		if (priv->extend_desc)
+			stmmac_rx_extended_status(priv, &priv->dev->stats,
+					&priv->xstats, rx_q->dma_erx + entry);
+		if (unlikely(status == discard_frame)) {
+			error = 1;
+			if (!priv->hwts_rx_en)
+				priv->dev->stats.rx_errors++;
+		}
+
+		/* The XSK pool expects one frame per buffer, frames spanning
+		 * several buffers are dropped.
+		 */
+		if (unlikely(!error && (status & rx_not_ls))) {
+			priv->dev->stats.rx_dropped++;
+			error = 1;
+		}
+
+		if (unlikely(error)) {
+			/* Consumed descriptors never keep their buffer, see
+			 * stmmac_rx_dirty_zc().
+			 */
+			xsk_buff_free(buf->xdp);
+			buf->xdp = NULL;
+			dirty++;
+
+			if (status & rx_not_ls)
+				goto read_again;
+
+			count++;
+			continue;
+		}
+
+		/* Buffer is good. Go on. */
+		buf1_len = stmmac_rx_buf1_len(priv, p, status, len);
+		len += buf1_len;
+
+		/* ACS is set; GMAC core strips PAD/FCS for IEEE 802.3
+		 * Type frames (LLC/LLC-SNAP)
+		 *
+		 * llc_snap is never checked in GMAC >= 4, so this ACS
+		 * feature is always disabled and packets need to be
+		 * stripped manually.
+		 */
+		if (likely(priv->synopsys_id >= DWMAC_CORE_4_00) ||
+		    unlikely(status != llc_snap)) {
+			buf1_len -= ETH_FCS_LEN;
+			len -= ETH_FCS_LEN;
+		}
+
+		/* RX buffer is good and fits into an XSK pool buffer */
+		buf->xdp->data_end = buf->xdp->data + buf1_len;
+		xsk_buff_dma_sync_for_cpu(buf->xdp, rx_q->xsk_pool);
+
+		res = __stmmac_xdp_run_prog(priv, prog, buf->xdp);
+		switch (res) {
+		case STMMAC_XDP_PASS:
+			stmmac_dispatch_skb_zc(priv, queue, p, np, buf->xdp);
+			xsk_buff_free(buf->xdp);
+			break;
+		case STMMAC_XDP_CONSUMED:
+			xsk_buff_free(buf->xdp);
+			priv->dev->stats.rx_dropped++;
+			break;
+		case STMMAC_XDP_TX:
+		case STMMAC_XDP_REDIRECT:
+			xdp_status |= res;
+			priv->dev->stats.rx_packets++;
+			priv->dev->stats.rx_bytes += len;
+			break;
+		}
+
+		buf->xdp = NULL;
+		dirty++;
+		count++;
+	}
+
+	if (status & rx_not_ls) {
+		rx_q->state_saved = true;
+		rx_q->state.error = error;
+		rx_q->state.len = len;
+	}
+
+	stmmac_finalize_xdp_rx(priv, xdp_status);
+
+	/* Post what is left */
+	dirty = stmmac_rx_dirty_zc(priv, queue);
+	if (dirty)
+		failure = !stmmac_rx_refill_zc(priv, queue, dirty) || failure;
+
+	priv->xstats.rx_pkt_n += count;
+
+	/* Any descriptor still without a buffer needs userspace to fill
+	 * the fill ring and kick us again.
+	 */
+	if (xsk_uses_need_wakeup(rx_q->xsk_pool)) {
+		if (failure || stmmac_rx_dirty_zc(priv, queue) > 0)
+			xsk_set_rx_need_wakeup(rx_q->xsk_pool);
+		else
+			xsk_clear_rx_need_wakeup(rx_q->xsk_pool);
+
+		return (int)count;
+	}
+
+	/* Keep polling while the fill ring is short of buffers */
+	return failure ? limit : (int)count;
+}
+
 static int stmmac_napi_poll_rx(struct napi_struct *napi, int budget)
 {
 	struct stmmac_channel *ch =
@@ -4053,7 +4968,10 @@ static int stmmac_napi_poll_rx(struct napi_struct *napi, int budget)
 
 	priv->xstats.napi_poll++;
 
-	work_done = stmmac_rx(priv, budget, chan);
+	if (priv->rx_queue[chan].xsk_pool)
+		work_done = stmmac_rx_zc(priv, budget, chan);
+	else
+		work_done = stmmac_rx(priv, budget, chan);
 	if (work_done < budget && napi_complete_done(napi, work_done)) {
 		unsigned long flags;
 
@@ -4148,6 +5066,11 @@ static int stmmac_change_mtu(struct net_device *dev, int new_mtu)
 		return -EBUSY;
 	}
 
+	if (stmmac_xdp_is_enabled(priv) && new_mtu > ETH_DATA_LEN) {
+		netdev_dbg(priv->dev, "Jumbo frames not supported for XDP\n");
+		return -EINVAL;
+	}
+
 	new_mtu = STMMAC_ALIGN(new_mtu);
 
 	/* If condition true, FIFO is too small or MTU too large */
@@ -4789,6 +5712,225 @@ static int stmmac_vlan_rx_kill_vid(struct net_device *ndev, __be16 proto, u16 vi
 	return ret;
 }
 
+static int stmmac_bpf(struct net_device *dev, struct netdev_bpf *bpf)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+
+	switch (bpf->command) {
+	case XDP_SETUP_PROG:
+		return stmmac_xdp_set_prog(priv, bpf->prog, bpf->extack);
+	case XDP_SETUP_XSK_POOL:
+		return stmmac_xdp_setup_pool(priv, bpf->xsk.pool,
+					     bpf->xsk.queue_id);
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static int stmmac_xdp_xmit(struct net_device *dev, int num_frames,
+			   struct xdp_frame **frames, u32 flags)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+	int cpu = smp_processor_id();
+	struct netdev_queue *nq;
+	int i, drops = 0;
+	int queue;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev)))
+		return -ENETDOWN;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	queue = stmmac_xdp_get_tx_queue(priv, cpu);
+	nq = netdev_get_tx_queue(priv->dev, queue);
+
+	__netif_tx_lock(nq, cpu);
+
+	/* The rings may be going away for an XDP reconfiguration */
+	if (unlikely(netif_tx_queue_stopped(nq))) {
+		__netif_tx_unlock(nq);
+		return -ENETDOWN;
+	}
+
+	/* Avoids TX time-out as we are sharing with slow path */
+	txq_trans_update(nq);
+
+	for (i = 0; i < num_frames; i++) {
+		int res;
+
+		res = stmmac_xdp_xmit_xdpf(priv, queue, frames[i], true);
+		if (res == STMMAC_XDP_CONSUMED) {
+			xdp_return_frame_rx_napi(frames[i]);
+			priv->dev->stats.tx_dropped++;
+			drops++;
+		}
+	}
+
+	if (flags & XDP_XMIT_FLUSH) {
+		stmmac_flush_tx_descriptors(priv, queue);
+		stmmac_tx_timer_arm(priv, queue);
+	}
+
+	__netif_tx_unlock(nq);
+
+	return num_frames - drops;
+}
+
+static void stmmac_xsk_kick_napi(struct stmmac_priv *priv, u32 chan,
+				 bool rx)
+{
+	struct stmmac_channel *ch = &priv->channel[chan];
+	struct napi_struct *napi = rx ? &ch->rx_napi : &ch->tx_napi;
+
+	/* A running poll picks the new work up before completing */
+	if (napi_if_scheduled_mark_missed(napi))
+		return;
+
+	if (likely(napi_schedule_prep(napi))) {
+		unsigned long flags;
+
+		spin_lock_irqsave(&ch->lock, flags);
+		stmmac_disable_dma_irq(priv, priv->ioaddr, chan, rx, !rx);
+		spin_unlock_irqrestore(&ch->lock, flags);
+		__napi_schedule(napi);
+	}
+}
+
+int stmmac_xsk_wakeup(struct net_device *dev, u32 queue, u32 flags)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+
+	if (!netif_running(dev) || !netif_carrier_ok(dev))
+		return -ENETDOWN;
+
+	if (!stmmac_xdp_is_enabled(priv))
+		return -ENXIO;
+
+	if (queue >= priv->plat->rx_queues_to_use ||
+	    queue >= priv->plat->tx_queues_to_use)
+		return -EINVAL;
+
+	if (!priv->rx_queue[queue].xsk_pool &&
+	    !priv->tx_queue[queue].xsk_pool)
+		return -ENXIO;
+
+	if (flags & XDP_WAKEUP_RX)
+		stmmac_xsk_kick_napi(priv, queue, true);
+	if (flags & XDP_WAKEUP_TX)
+		stmmac_xsk_kick_napi(priv, queue, false);
+
+	return 0;
+}
+
+/**
+ * stmmac_xdp_release - stop the data path for an XDP reconfiguration
+ * @dev: net device structure
+ * Description: unlike stmmac_release(), the PHY, the IRQ lines and the
+ * MAC configuration are kept, only the DMA rings are released.
+ */
+void stmmac_xdp_release(struct net_device *dev)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+	u32 chan;
+
+	stmmac_disable_all_queues(priv);
+
+	/* Stopped TX queues keep ndo_xdp_xmit() away from the rings too,
+	 * nothing wakes them up once the NAPIs are disabled.
+	 */
+	netif_tx_disable(dev);
+
+	for (chan = 0; chan < priv->plat->tx_queues_to_use; chan++)
+		del_timer_sync(&priv->tx_queue[chan].txtimer);
+
+	/* Stop TX/RX DMA channels */
+	stmmac_stop_all_dma(priv);
+
+	/* Release and free the Rx/Tx resources */
+	free_dma_desc_resources(priv);
+
+	/* Disable the MAC Rx/Tx */
+	stmmac_mac_set(priv, priv->ioaddr, false);
+
+	/* set trans_start so we don't get spurious
+	 * watchdogs during reset
+	 */
+	netif_trans_update(dev);
+}
+
+/**
+ * stmmac_xdp_open - restart the data path after an XDP reconfiguration
+ * @dev: net device structure
+ * Description: sets the DMA rings up again for the current XDP program
+ * and zero-copy pools, counterpart of stmmac_xdp_release().
+ */
+int stmmac_xdp_open(struct net_device *dev)
+{
+	struct stmmac_priv *priv = netdev_priv(dev);
+	u32 rx_cnt = priv->plat->rx_queues_to_use;
+	u32 tx_cnt = priv->plat->tx_queues_to_use;
+	bool sph_en;
+	u32 chan;
+	int ret;
+
+	ret = alloc_dma_desc_resources(priv);
+	if (ret < 0) {
+		netdev_err(dev, "%s: DMA descriptors allocation failed\n",
+			   __func__);
+		goto dma_desc_error;
+	}
+
+	ret = init_dma_desc_rings(dev, GFP_KERNEL);
+	if (ret < 0) {
+		netdev_err(dev, "%s: DMA descriptors initialization failed\n",
+			   __func__);
+		goto init_error;
+	}
+
+	stmmac_init_dma_chans(priv);
+
+	/* Adjust Split header */
+	sph_en = (priv->hw->rx_csum > 0) && priv->sph;
+
+	for (chan = 0; chan < rx_cnt; chan++) {
+		stmmac_set_dma_bfsize(priv, priv->ioaddr,
+				      stmmac_rx_buf_size(priv, chan), chan);
+		stmmac_enable_sph(priv, priv->ioaddr, sph_en, chan);
+	}
+
+	/* Enable the MAC Rx/Tx */
+	stmmac_mac_set(priv, priv->ioaddr, true);
+
+	/* Start Rx & Tx DMA Channels */
+	stmmac_start_all_dma(priv);
+
+	stmmac_enable_all_queues(priv);
+	netif_tx_start_all_queues(dev);
+
+	return 0;
+
+init_error:
+	free_dma_desc_resources(priv);
+dma_desc_error:
+	/* The interface stays up without rings: the DMA is stopped and its
+	 * interrupts masked, the TX queues stay stopped, and the NAPIs are
+	 * enabled again so that stmmac_release() finds them as it expects.
+	 */
+	for (chan = 0; chan < max(rx_cnt, tx_cnt); chan++) {
+		struct stmmac_channel *ch = &priv->channel[chan];
+		unsigned long flags;
+
+		spin_lock_irqsave(&ch->lock, flags);
+		stmmac_disable_dma_irq(priv, priv->ioaddr, chan,
+				       chan < rx_cnt, chan < tx_cnt);
+		spin_unlock_irqrestore(&ch->lock, flags);
+	}
+
+	stmmac_enable_all_queues(priv);
+	return ret;
+}
+
 static const struct net_device_ops stmmac_netdev_ops = {
 	.ndo_open = stmmac_open,
 	.ndo_start_xmit = stmmac_xmit,
@@ -4807,6 +5949,9 @@ static const struct net_device_ops stmmac_netdev_ops = {
 	.ndo_set_mac_address = stmmac_set_mac_address,
 	.ndo_vlan_rx_add_vid = stmmac_vlan_rx_add_vid,
 	.ndo_vlan_rx_kill_vid = stmmac_vlan_rx_kill_vid,
+	.ndo_bpf = stmmac_bpf,
+	.ndo_xdp_xmit = stmmac_xdp_xmit,
+	.ndo_xsk_wakeup = stmmac_xsk_wakeup,
 };
 
 static void stmmac_reset_subtask(struct stmmac_priv *priv)
@@ -5124,7 +6269,8 @@ int stmmac_dvr_probe(struct device *device,
 
 	if (priv->dma_cap.sphen) {
 		ndev->hw_features |= NETIF_F_GRO;
-		priv->sph = true;
+		priv->sph_cap = true;
+		priv->sph = priv->sph_cap;
 		dev_info(priv->device, "SPH feature enabled\n");
 	}
 
@@ -10,6 +10,7 @@
 #include <linux/completion.h>
 #include <linux/crc32.h>
 #include <linux/ethtool.h>
+#include <linux/filter.h>
 #include <linux/ip.h>
 #include <linux/phy.h>
 #include <linux/udp.h>
@@ -17,8 +18,10 @@
 #include <net/pkt_sched.h>
 #include <net/tcp.h>
 #include <net/udp.h>
+#include <net/xdp.h>
 #include <net/tc_act/tc_gact.h>
 #include "stmmac.h"
+#include "stmmac_xdp.h"
 
 struct stmmachdr {
 	__be32 version;
@@ -1812,6 +1815,177 @@ fail_disable:
 	return ret;
 }
 
+static struct bpf_prog *stmmac_test_xdp_prog(u32 act)
+{
+	struct bpf_insn insns[] = {
+		BPF_MOV64_IMM(BPF_REG_0, act),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_prog *prog;
+	int err;
+
+	prog = bpf_prog_alloc(bpf_prog_size(ARRAY_SIZE(insns)), 0);
+	if (!prog)
+		return ERR_PTR(-ENOMEM);
+
+	memcpy(prog->insnsi, insns, sizeof(insns));
+	prog->len = ARRAY_SIZE(insns);
+	prog->type = BPF_PROG_TYPE_XDP;
+
+	prog = bpf_prog_select_runtime(prog, &err);
+	if (err) {
+		bpf_prog_free(prog);
+		return ERR_PTR(err);
+	}
+
+	/* This is the reference handed over to the driver */
+	bpf_prog_inc(prog);
+	return prog;
+}
+
+static int __stmmac_test_xdp(struct stmmac_priv *priv, u32 act)
+{
+	unsigned long dropped = priv->dev->stats.rx_dropped;
+	struct stmmac_packet_attrs attr = { };
+	struct bpf_prog *prog;
+	int ret;
+
+	if (!IS_ENABLED(CONFIG_BPF_SYSCALL))
+		return -EOPNOTSUPP;
+	if (stmmac_xdp_is_enabled(priv) || priv->dev->mtu > ETH_DATA_LEN)
+		return -EOPNOTSUPP;
+
+	prog = stmmac_test_xdp_prog(act);
+	if (IS_ERR(prog))
+		return PTR_ERR(prog);
+
+	ret = stmmac_xdp_set_prog(priv, prog, NULL);
+	if (ret) {
+		bpf_prog_put(prog);
+		return ret;
+	}
+
+	attr.dst = priv->dev->dev_addr;
+	ret = __stmmac_test_loopback(priv, &attr);
+
+	stmmac_xdp_set_prog(priv, NULL, NULL);
+
+	if (act != XDP_DROP)
+		return ret;
+
+	/* The packet must not reach the stack, but the driver shall see it */
+	if (ret != -ETIMEDOUT)
+		return ret ? ret : -EINVAL;
+	if (priv->dev->stats.rx_dropped <= dropped)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int stmmac_test_xdp_drop(struct stmmac_priv *priv)
+{
+	return __stmmac_test_xdp(priv, XDP_DROP);
+}
+
+static int stmmac_test_xdp_pass(struct stmmac_priv *priv)
+{
+	return __stmmac_test_xdp(priv, XDP_PASS);
+}
+
+static int stmmac_test_xdp_xmit(struct stmmac_priv *priv)
+{
+	struct stmmac_packet_attrs attr = { };
+	struct stmmac_test_priv *tpriv;
+	struct xdp_rxq_info rxq = { };
+	struct xdp_frame *xdpf;
+	struct sk_buff *skb;
+	struct xdp_buff xdp;
+	struct page *page;
+	int ret, sent;
+
+	if (priv->dev->mtu > ETH_DATA_LEN)
+		return -EOPNOTSUPP;
+
+	tpriv = kzalloc(sizeof(*tpriv), GFP_KERNEL);
+	if (!tpriv)
+		return -ENOMEM;
+
+	tpriv->ok = false;
+	init_completion(&tpriv->comp);
+
+	tpriv->pt.type = htons(ETH_P_IP);
+	tpriv->pt.func = stmmac_test_loopback_validate;
+	tpriv->pt.dev = priv->dev;
+	tpriv->pt.af_packet_priv = tpriv;
+	tpriv->packet = &attr;
+
+	attr.dst = priv->dev->dev_addr;
+
+	skb = stmmac_test_get_udp_skb(priv, &attr);
+	if (!skb) {
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	/* There is no checksum offload on this path */
+	ret = skb_checksum_help(skb);
+	if (ret || skb->len > PAGE_SIZE - XDP_PACKET_HEADROOM -
+	    SKB_DATA_ALIGN(sizeof(struct skb_shared_info))) {
+		kfree_skb(skb);
+		ret = ret ? ret : -EINVAL;
+		goto cleanup;
+	}
+
+	page = dev_alloc_page();
+	if (!page) {
+		kfree_skb(skb);
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	rxq.dev = priv->dev;
+	rxq.mem.type = MEM_TYPE_PAGE_ORDER0;
+
+	xdp.data_hard_start = page_address(page);
+	xdp.data = xdp.data_hard_start + XDP_PACKET_HEADROOM;
+	xdp.data_end = xdp.data + skb->len;
+	xdp.data_meta = xdp.data;
+	xdp.rxq = &rxq;
+	xdp.frame_sz = PAGE_SIZE;
+	skb_copy_bits(skb, 0, xdp.data, skb->len);
+	kfree_skb(skb);
+
+	xdpf = xdp_convert_buff_to_frame(&xdp);
+	if (!xdpf) {
+		put_page(page);
+		ret = -ENOMEM;
+		goto cleanup;
+	}
+
+	dev_add_pack(&tpriv->pt);
+
+	local_bh_disable();
+	sent = priv->dev->netdev_ops->ndo_xdp_xmit(priv->dev, 1, &xdpf,
+						   XDP_XMIT_FLUSH);
+	local_bh_enable();
+
+	if (sent < 0)
+		xdp_return_frame(xdpf);
+	if (sent != 1) {
+		ret = sent < 0 ? sent : -EIO;
+		goto remove_pack;
+	}
+
+	wait_for_completion_timeout(&tpriv->comp, STMMAC_LB_TIMEOUT);
+	ret = tpriv->ok ? 0 : -ETIMEDOUT;
+
+remove_pack:
+	dev_remove_pack(&tpriv->pt);
+cleanup:
+	kfree(tpriv);
+	return ret;
+}
+
 #define STMMAC_LOOPBACK_NONE	0
 #define STMMAC_LOOPBACK_MAC	1
 #define STMMAC_LOOPBACK_PHY	2
@@ -1949,6 +2123,18 @@ static const struct stmmac_test {
 		.name = "TBS (ETF Scheduler)        ",
 		.lb = STMMAC_LOOPBACK_PHY,
 		.fn = stmmac_test_tbs,
+	}, {
+		.name = "XDP Drop                   ",
+		.lb = STMMAC_LOOPBACK_PHY,
+		.fn = stmmac_test_xdp_drop,
+	}, {
+		.name = "XDP Pass                   ",
+		.lb = STMMAC_LOOPBACK_PHY,
+		.fn = stmmac_test_xdp_pass,
+	}, {
+		.name = "XDP Xmit                   ",
+		.lb = STMMAC_LOOPBACK_PHY,
+		.fn = stmmac_test_xdp_xmit,
 	},
 };
 
@@ -0,0 +1,168 @@
+// SPDX-License-Identifier: GPL-2.0
+/* XDP and AF_XDP zero-copy support for stmmac
+ *
+ * Attaching a program or a zero-copy pool changes the layout of the RX
+ * buffers, so the rings are released and set up again while the PHY,
+ * the IRQs and the MAC configuration stay untouched.
+ */
+
+#include <net/xdp_sock_drv.h>
+
+#include "stmmac.h"
+#include "stmmac_xdp.h"
+
+/* Set the rings up again for the configuration in place before a failed
+ * stmmac_xdp_open(), which left the interface running without rings.
+ */
+static void stmmac_xdp_reopen(struct stmmac_priv *priv)
+{
+	stmmac_xdp_release(priv->dev);
+	if (stmmac_xdp_open(priv->dev))
+		netdev_err(priv->dev, "Failed to restore the rings\n");
+}
+
+static int stmmac_xdp_enable_pool(struct stmmac_priv *priv,
+				  struct xsk_buff_pool *pool, u16 queue)
+{
+	bool need_update;
+	int err;
+
+	if (queue >= priv->plat->rx_queues_to_use ||
+	    queue >= priv->plat->tx_queues_to_use)
+		return -EINVAL;
+
+	/* Only the DMA tail pointer keeps the engine away from descriptors
+	 * the fill ring has no buffer for yet.
+	 */
+	if (!priv->plat->has_gmac4 && !priv->plat->has_xgmac)
+		return -EOPNOTSUPP;
+
+	err = xsk_pool_dma_map(pool, priv->device, STMMAC_RX_DMA_ATTR);
+	if (err) {
+		netdev_err(priv->dev, "Failed to map xsk pool\n");
+		return err;
+	}
+
+	need_update = netif_running(priv->dev) && stmmac_xdp_is_enabled(priv);
+
+	if (need_update)
+		stmmac_xdp_release(priv->dev);
+
+	set_bit(queue, priv->af_xdp_zc_qps);
+
+	if (need_update) {
+		err = stmmac_xdp_open(priv->dev);
+		if (err)
+			goto err_open;
+
+		/* Kick the RX side so the fill ring gets used right away, the
+		 * socket asks for it through need_wakeup otherwise.
+		 */
+		stmmac_xsk_wakeup(priv->dev, queue, XDP_WAKEUP_RX);
+	}
+
+	return 0;
+
+err_open:
+	clear_bit(queue, priv->af_xdp_zc_qps);
+	xsk_pool_dma_unmap(pool, STMMAC_RX_DMA_ATTR);
+
+	/* Try to get the queue back to the copy mode */
+	stmmac_xdp_reopen(priv);
+
+	return err;
+}
+
+static int stmmac_xdp_disable_pool(struct stmmac_priv *priv, u16 queue)
+{
+	struct xsk_buff_pool *pool;
+	bool need_update;
+	int err;
+
+	if (queue >= priv->plat->rx_queues_to_use ||
+	    queue >= priv->plat->tx_queues_to_use)
+		return -EINVAL;
+
+	pool = xsk_get_pool_from_qid(priv->dev, queue);
+	if (!pool)
+		return -EINVAL;
+
+	need_update = netif_running(priv->dev) && stmmac_xdp_is_enabled(priv);
+
+	if (need_update)
+		stmmac_xdp_release(priv->dev);
+
+	clear_bit(queue, priv->af_xdp_zc_qps);
+
+	if (need_update) {
+		err = stmmac_xdp_open(priv->dev);
+		if (err) {
+			/* The pool stays attached, keep it in use */
+			set_bit(queue, priv->af_xdp_zc_qps);
+			stmmac_xdp_reopen(priv);
+			return err;
+		}
+	}
+
+	xsk_pool_dma_unmap(pool, STMMAC_RX_DMA_ATTR);
+
+	return 0;
+}
+
+int stmmac_xdp_setup_pool(struct stmmac_priv *priv, struct xsk_buff_pool *pool,
+			  u16 queue)
+{
+	return pool ? stmmac_xdp_enable_pool(priv, pool, queue) :
+		      stmmac_xdp_disable_pool(priv, queue);
+}
+
+int stmmac_xdp_set_prog(struct stmmac_priv *priv, struct bpf_prog *prog,
+			struct netlink_ext_ack *extack)
+{
+	struct net_device *dev = priv->dev;
+	struct bpf_prog *old_prog;
+	bool need_update;
+	bool if_running;
+	int err;
+
+	if (prog && dev->mtu > ETH_DATA_LEN) {
+		/* For now, the driver doesn't support XDP functionality with
+		 * jumbo frames so we return error.
+		 */
+		NL_SET_ERR_MSG_MOD(extack, "Jumbo frames not supported");
+		return -EOPNOTSUPP;
+	}
+
+	if_running = netif_running(dev);
+	need_update = !!priv->xdp_prog != !!prog;
+
+	/* Going in or out of XDP changes the RX buffer headroom and DMA
+	 * direction, swapping one program for another does not.
+	 */
+	if (if_running && need_update)
+		stmmac_xdp_release(dev);
+
+	old_prog = xchg(&priv->xdp_prog, prog);
+
+	/* Disable RX SPH for XDP operation */
+	priv->sph = priv->sph_cap && !stmmac_xdp_is_enabled(priv);
+
+	if (if_running && need_update) {
+		err = stmmac_xdp_open(dev);
+		if (err) {
+			/* The caller puts @prog when we fail, so the old
+			 * program has to go back in along with its reference.
+			 */
+			xchg(&priv->xdp_prog, old_prog);
+			priv->sph = priv->sph_cap &&
+				    !stmmac_xdp_is_enabled(priv);
+			stmmac_xdp_reopen(priv);
+			return err;
+		}
+	}
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
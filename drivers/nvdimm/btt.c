@@ -12,6 +12,8 @@
 #include <linux/hdreg.h>
 #include <linux/genhd.h>
 #include <linux/sizes.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 #include <linux/ndctl.h>
 #include <linux/fs.h>
 #include <linux/nd.h>
@@ -727,17 +729,24 @@ static int btt_rtt_init(struct arena_info *arena)
 	return 0;
 }
 
+/*
+ * Map writers only need to be serialised against writers of the same
+ * premap, so use several locks per lane to keep unrelated writes running
+ * on different CPUs from colliding on a lock.
+ */
 static int btt_maplocks_init(struct arena_info *arena)
 {
-	u32 i;
+	u32 i, nr_locks;
 
-	arena->map_locks = kcalloc(arena->nfree, sizeof(struct aligned_lock),
+	nr_locks = roundup_pow_of_two(arena->nfree * BTT_MAP_LOCKS_PER_LANE);
+	arena->map_locks = kvcalloc(nr_locks, sizeof(struct aligned_lock),
 				GFP_KERNEL);
 	if (!arena->map_locks)
 		return -ENOMEM;
 
-	for (i = 0; i < arena->nfree; i++)
+	for (i = 0; i < nr_locks; i++)
 		spin_lock_init(&arena->map_locks[i].lock);
+	arena->map_locks_bits = ilog2(nr_locks);
 
 	return 0;
 }
@@ -806,7 +815,7 @@ static void free_arenas(struct btt *btt)
 	list_for_each_entry_safe(arena, next, &btt->arena_list, list) {
 		list_del(&arena->list);
 		kfree(arena->rtt);
-		kfree(arena->map_locks);
+		kvfree(arena->map_locks);
 		kfree(arena->freelist);
 		debugfs_remove_recursive(arena->debugfs_dir);
 		kfree(arena);
@@ -1085,12 +1094,19 @@ static int lba_to_arena(struct btt *btt, sector_t sector, __u32 *premap,
 
 /*
  * The following (lock_map, unlock_map) are mostly just to improve
- * readability, since they index into an array of locks
+ * readability, since they index into an array of locks.  The map cache
+ * line index is hashed so that strided writes spread over all the locks.
  */
+static u32 map_lock_idx(struct arena_info *arena, u32 premap)
+{
+	return hash_32(premap * MAP_ENT_SIZE / L1_CACHE_BYTES,
+			arena->map_locks_bits);
+}
+
 static void lock_map(struct arena_info *arena, u32 premap)
 		__acquires(&arena->map_locks[idx].lock)
 {
-	u32 idx = (premap * MAP_ENT_SIZE / L1_CACHE_BYTES) % arena->nfree;
+	u32 idx = map_lock_idx(arena, premap);
 
 	spin_lock(&arena->map_locks[idx].lock);
 }
@@ -1098,7 +1114,7 @@ static void lock_map(struct arena_info *arena, u32 premap)
 static void unlock_map(struct arena_info *arena, u32 premap)
 		__releases(&arena->map_locks[idx].lock)
 {
-	u32 idx = (premap * MAP_ENT_SIZE / L1_CACHE_BYTES) % arena->nfree;
+	u32 idx = map_lock_idx(arena, premap);
 
 	spin_unlock(&arena->map_locks[idx].lock);
 }
@@ -1351,8 +1367,12 @@ static int btt_write_pg(struct btt *btt, struct bio_integrity_payload *bip,
 
 		new_postmap = arena->freelist[lane].block;
 
-		/* Wait if the new block is being read from */
-		for (i = 0; i < arena->nfree; i++)
+		/*
+		 * Wait if the new block is being read from.  Lanes are
+		 * never above the CPU number, so the RTT slots past
+		 * nr_cpu_ids are never used.
+		 */
+		for (i = 0; i < min_t(u32, arena->nfree, nr_cpu_ids); i++)
 			while (arena->rtt[i] == (RTT_VALID | new_postmap))
 				cpu_relax();
 
@@ -27,6 +27,7 @@
 #define RTT_INVALID 0
 #define BTT_PG_SIZE 4096
 #define BTT_DEFAULT_NFREE ND_MAX_LANES
+#define BTT_MAP_LOCKS_PER_LANE 8
 #define LOG_SEQ_INIT 1
 
 #define IB_FLAG_ERROR 0x00000001
@@ -156,6 +157,7 @@ struct aligned_lock {
  * @freelist:		Pointer to in-memory list of free blocks
  * @rtt:		Pointer to in-memory "Read Tracking Table"
  * @map_locks:		Spinlocks protecting concurrent map writes
+ * @map_locks_bits:	log2 of the number of @map_locks
  * @nd_btt:		Pointer to parent nd_btt structure.
  * @list:		List head for list of arenas
  * @debugfs_dir:	Debugfs dentry
@@ -188,6 +190,7 @@ struct arena_info {
 	struct free_entry *freelist;
 	u32 *rtt;
 	struct aligned_lock *map_locks;
+	u32 map_locks_bits;
 	struct nd_btt *nd_btt;
 	struct list_head list;
 	struct dentry *debugfs_dir;
@@ -25,6 +25,7 @@
 #include <linux/nd.h>
 #include <linux/backing-dev.h>
 #include <linux/mm.h>
+#include <linux/async_tx.h>
 #include <asm/cacheflush.h>
 #include "pmem.h"
 #include "pfn.h"
@@ -189,6 +190,138 @@ static blk_status_t pmem_do_write(struct pmem_device *pmem,
 	return rc;
 }
 
+#ifdef CONFIG_BLK_DEV_PMEM_DMA
+static unsigned int dma_threshold;
+module_param(dma_threshold, uint, 0644);
+MODULE_PARM_DESC(dma_threshold,
+		"Offload writes of at least this many bytes to a DMA engine, 0 disables offload (default: 0)");
+
+struct pmem_dma_io {
+	struct pmem_device *pmem;
+	struct bio *bio;
+	unsigned long start;
+	bool do_acct;
+};
+
+static void pmem_dma_write_done(void *data)
+{
+	struct pmem_dma_io *io = data;
+	struct bio *bio = io->bio;
+	struct request_queue *q = bio->bi_disk->queue;
+	int ret = 0;
+
+	if (io->do_acct)
+		bio_end_io_acct(bio, io->start);
+	if (bio->bi_opf & REQ_FUA)
+		ret = nvdimm_flush(to_region(io->pmem), bio);
+	if (ret)
+		bio->bi_status = errno_to_blk_status(ret);
+	kfree(io);
+
+	bio_endio(bio);
+	blk_queue_exit(q);
+}
+
+static bool pmem_dma_eligible(struct pmem_device *pmem, struct bio *bio)
+{
+	unsigned int threshold = READ_ONCE(dma_threshold);
+
+	if (!threshold || bio->bi_iter.bi_size < threshold)
+		return false;
+	if (bio_op(bio) != REQ_OP_WRITE)
+		return false;
+	/* async_memcpy() needs struct pages for the media */
+	if (!(pmem->pfn_flags & PFN_MAP))
+		return false;
+	/*
+	 * Clearing poison and region specific flushes may sleep, leave
+	 * those writes to the CPU path rather than the DMA callback.
+	 */
+	if (is_bad_pmem(&pmem->bb, bio->bi_iter.bi_sector,
+				bio->bi_iter.bi_size))
+		return false;
+	if ((bio->bi_opf & REQ_FUA) && to_region(pmem)->flush)
+		return false;
+	return true;
+}
+
+/*
+ * Reads stay on the CPU: copy_mc_to_kernel() turns media errors into
+ * -EIO, while a DMA engine would not report them through async_tx.
+ */
+static bool pmem_dma_write(struct pmem_device *pmem, struct bio *bio)
+{
+	struct request_queue *q = bio->bi_disk->queue;
+	struct dma_async_tx_descriptor *tx = NULL;
+	struct async_submit_ctl submit;
+	struct pmem_dma_io *io;
+	struct bvec_iter iter;
+	struct bio_vec bvec;
+
+	if (!pmem_dma_eligible(pmem, bio))
+		return false;
+
+	init_async_submit(&submit, 0, NULL, NULL, NULL, NULL);
+	if (!async_tx_find_channel(&submit, DMA_MEMCPY, NULL, 0, NULL, 0,
+				bio->bi_iter.bi_size))
+		return false;
+
+	io = kmalloc(sizeof(*io), GFP_NOIO | __GFP_NOWARN);
+	if (!io)
+		return false;
+	io->pmem = pmem;
+	io->bio = bio;
+	io->do_acct = blk_queue_io_stat(q);
+	if (io->do_acct)
+		io->start = bio_start_io_acct(bio);
+	/* the bio completes after pmem_submit_bio() returns */
+	percpu_ref_get(&q->q_usage_counter);
+
+	bio_for_each_segment(bvec, bio, iter) {
+		phys_addr_t pmem_off = iter.bi_sector * 512 + pmem->data_offset;
+		unsigned int off, len;
+
+		flush_dcache_page(bvec.bv_page);
+		/*
+		 * The segment fits in its page, but a media offset that is
+		 * not page aligned puts it across two media pages, and
+		 * async_memcpy() maps one page at a time.
+		 */
+		for (off = 0; off < bvec.bv_len; off += len) {
+			phys_addr_t phys = pmem->phys_addr + pmem_off + off;
+
+			len = min_t(unsigned int, bvec.bv_len - off,
+					PAGE_SIZE - offset_in_page(phys));
+			init_async_submit(&submit, 0, tx, NULL, NULL, NULL);
+			tx = async_memcpy(pfn_to_page(PHYS_PFN(phys)),
+					bvec.bv_page, offset_in_page(phys),
+					bvec.bv_offset + off, len, &submit);
+			/*
+			 * No descriptor means async_memcpy() fell back to a
+			 * plain memcpy() through the cache, write that back
+			 * to media.
+			 */
+			if (!tx)
+				arch_wb_cache_pmem(pmem->virt_addr + pmem_off +
+						off, len);
+		}
+	}
+
+	/* complete the bio once the whole chain has been copied */
+	init_async_submit(&submit, ASYNC_TX_ACK, tx, pmem_dma_write_done, io,
+			NULL);
+	tx = async_trigger_callback(&submit);
+	async_tx_issue_pending(tx);
+
+	return true;
+}
+#else
+static bool pmem_dma_write(struct pmem_device *pmem, struct bio *bio)
+{
+	return false;
+}
+#endif
+
 static blk_qc_t pmem_submit_bio(struct bio *bio)
 {
 	int ret = 0;
@@ -203,6 +336,9 @@ static blk_qc_t pmem_submit_bio(struct bio *bio)
 	if (bio->bi_opf & REQ_PREFLUSH)
 		ret = nvdimm_flush(nd_region, bio);
 
+	if (!ret && pmem_dma_write(pmem, bio))
+		return BLK_QC_T_NONE;
+
 	do_acct = blk_queue_io_stat(bio->bi_disk->queue);
 	if (do_acct)
 		start = bio_start_io_acct(bio);
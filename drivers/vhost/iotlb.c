@@ -32,6 +32,7 @@ void vhost_iotlb_map_free(struct vhost_iotlb *iotlb,
 	list_del(&map->link);
 	kfree(map);
 	iotlb->nmaps--;
+	iotlb->gen++;
 }
 EXPORT_SYMBOL_GPL(vhost_iotlb_map_free);
 
@@ -73,6 +74,7 @@ int vhost_iotlb_add_range(struct vhost_iotlb *iotlb,
 	map->perm = perm;
 
 	iotlb->nmaps++;
+	iotlb->gen++;
 	vhost_iotlb_itree_insert(map, &iotlb->root);
 
 	INIT_LIST_HEAD(&map->link);
@@ -40,6 +40,11 @@ module_param(experimental_zcopytx, int, 0444);
 MODULE_PARM_DESC(experimental_zcopytx, "Enable Zero Copy TX;"
 		                       " 1 -Enable; 0 - Disable");
 
+static int tx_batch = 64;
+module_param(tx_batch, int, 0644);
+MODULE_PARM_DESC(tx_batch, "Max number of TX packets batched before updating"
+			   " the used ring (1-256)");
+
 /* Max number of bytes transferred before requeueing the job.
  * Using this limit prevents one virtqueue from starving others. */
 #define VHOST_NET_WEIGHT 0x80000
@@ -98,6 +103,8 @@ struct vhost_net_ubuf_ref {
 };
 
 #define VHOST_NET_BATCH 64
+/* Upper bound for the tx_batch module parameter */
+#define VHOST_NET_TX_BATCH_MAX 256
 struct vhost_net_buf {
 	void **queue;
 	int tail;
@@ -117,6 +124,9 @@ struct vhost_net_virtqueue {
 	int done_idx;
 	/* Number of XDP frames batched */
 	int batched_xdp;
+	/* Number of copied buffers batched by zerocopy TX, their heads
+	 * follow the UIO_MAXIOV zerocopy heads in vq->heads */
+	int batched_copied;
 	/* an array of userspace buffers info */
 	struct ubuf_info *ubuf_info;
 	/* Reference counting for outstanding ubufs.
@@ -456,6 +466,23 @@ static void vhost_net_signal_used(struct vhost_net_virtqueue *nvq)
 	nvq->done_idx = 0;
 }
 
+static void vhost_net_signal_copied(struct vhost_net_virtqueue *nvq)
+{
+	struct vhost_virtqueue *vq = &nvq->vq;
+
+	if (!nvq->batched_copied)
+		return;
+
+	vhost_add_used_and_signal_n(vq->dev, vq, vq->heads + UIO_MAXIOV,
+				    nvq->batched_copied);
+	nvq->batched_copied = 0;
+}
+
+static int vhost_net_tx_batch_size(void)
+{
+	return clamp(READ_ONCE(tx_batch), 1, VHOST_NET_TX_BATCH_MAX);
+}
+
 static void vhost_tx_batch(struct vhost_net *net,
 			   struct vhost_net_virtqueue *nvq,
 			   struct socket *sock,
@@ -533,7 +560,8 @@ static void vhost_net_busy_poll(struct vhost_net *net,
 	endtime = busy_clock() + busyloop_timeout;
 
 	while (vhost_can_busy_poll(endtime)) {
-		if (vhost_has_work(&net->dev)) {
+		/* Other work queued on the worker we are running on? */
+		if (vhost_vq_has_work(poll_rx ? rvq : tvq)) {
 			*busyloop_intr = true;
 			break;
 		}
@@ -773,12 +801,13 @@ static void handle_tx_copy(struct vhost_net *net, struct socket *sock)
 	size_t len, total_len = 0;
 	int err;
 	int sent_pkts = 0;
+	int batch = vhost_net_tx_batch_size();
 	bool sock_can_batch = (sock->sk->sk_sndbuf == INT_MAX);
 
 	do {
 		bool busyloop_intr = false;
 
-		if (nvq->done_idx == VHOST_NET_BATCH)
+		if (nvq->done_idx >= batch)
 			vhost_tx_batch(net, nvq, sock, &msg);
 
 		head = get_tx_bufs(net, nvq, &msg, &out, &in, &len,
@@ -866,12 +895,18 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 	struct ubuf_info *ubuf;
 	bool zcopy_used;
 	int sent_pkts = 0;
+	int batch = vhost_net_tx_batch_size();
 
 	do {
 		bool busyloop_intr;
 
-		/* Release DMAs done buffers first */
-		vhost_zerocopy_signal_used(net, vq);
+		/* Release DMAs done buffers once per batch, or right away if
+		 * they are what keeps us from using zerocopy.
+		 */
+		if (!(sent_pkts % batch) || vhost_exceeds_maxpend(net))
+			vhost_zerocopy_signal_used(net, vq);
+		if (nvq->batched_copied >= batch)
+			vhost_net_signal_copied(nvq);
 
 		busyloop_intr = false;
 		head = get_tx_bufs(net, nvq, &msg, &out, &in, &len,
@@ -938,12 +973,17 @@ static void handle_tx_zerocopy(struct vhost_net *net, struct socket *sock)
 		if (err != len)
 			pr_debug("Truncated TX packet: "
 				 " len %d != %zd\n", err, len);
-		if (!zcopy_used)
-			vhost_add_used_and_signal(&net->dev, vq, head, 0);
-		else
-			vhost_zerocopy_signal_used(net, vq);
+		if (!zcopy_used) {
+			vq->heads[UIO_MAXIOV + nvq->batched_copied].id =
+				cpu_to_vhost32(vq, head);
+			vq->heads[UIO_MAXIOV + nvq->batched_copied].len = 0;
+			++nvq->batched_copied;
+		}
 		vhost_net_tx_packet(net);
 	} while (likely(!vhost_exceeds_weight(vq, ++sent_pkts, total_len)));
+
+	vhost_zerocopy_signal_used(net, vq);
+	vhost_net_signal_copied(nvq);
 }
 
 /* Expects to be always run from workqueue - which acts as
@@ -1300,7 +1340,7 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 	}
 	n->vqs[VHOST_NET_VQ_RX].rxq.queue = queue;
 
-	xdp = kmalloc_array(VHOST_NET_BATCH, sizeof(*xdp), GFP_KERNEL);
+	xdp = kmalloc_array(VHOST_NET_TX_BATCH_MAX, sizeof(*xdp), GFP_KERNEL);
 	if (!xdp) {
 		kfree(vqs);
 		kvfree(n);
@@ -1320,18 +1360,21 @@ static int vhost_net_open(struct inode *inode, struct file *f)
 		n->vqs[i].upend_idx = 0;
 		n->vqs[i].done_idx = 0;
 		n->vqs[i].batched_xdp = 0;
+		n->vqs[i].batched_copied = 0;
 		n->vqs[i].vhost_hlen = 0;
 		n->vqs[i].sock_hlen = 0;
 		n->vqs[i].rx_ring = NULL;
 		vhost_net_buf_init(&n->vqs[i].rxq);
 	}
 	vhost_dev_init(dev, vqs, VHOST_NET_VQ_MAX,
-		       UIO_MAXIOV + VHOST_NET_BATCH,
+		       UIO_MAXIOV + VHOST_NET_TX_BATCH_MAX,
 		       VHOST_NET_PKT_WEIGHT, VHOST_NET_WEIGHT, true,
 		       NULL);
 
-	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev);
-	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_TX, handle_tx_net, EPOLLOUT, dev,
+			vqs[VHOST_NET_VQ_TX]);
+	vhost_poll_init(n->poll + VHOST_NET_VQ_RX, handle_rx_net, EPOLLIN, dev,
+			vqs[VHOST_NET_VQ_RX]);
 
 	f->private_data = n;
 	n->page_frag.page = NULL;
@@ -20,6 +20,9 @@
 #endif
 #include <uapi/linux/virtio_config.h>
 
+/* How many descriptors of a chain to read ahead with a single copy. */
+#define VRINGH_DESC_BATCH 8
+
 static __printf(1,2) __cold void vringh_bad(const char *fmt, ...)
 {
 	static DEFINE_RATELIMIT_STATE(vringh_rs,
@@ -35,8 +38,8 @@ static __printf(1,2) __cold void vringh_bad(const char *fmt, ...)
 }
 
 /* Returns vring->num if empty, -ve on error. */
-static inline int __vringh_get_head(const struct vringh *vrh,
-				    int (*getu16)(const struct vringh *vrh,
+static inline int __vringh_get_head(struct vringh *vrh,
+				    int (*getu16)(struct vringh *vrh,
 						  u16 *val, const __virtio16 *p),
 				    u16 *last_avail_idx)
 {
@@ -79,7 +82,7 @@ static inline int __vringh_get_head(const struct vringh *vrh,
 static inline ssize_t vringh_iov_xfer(struct vringh *vrh,
 				      struct vringh_kiov *iov,
 				      void *ptr, size_t len,
-				      int (*xfer)(const struct vringh *vrh,
+				      int (*xfer)(struct vringh *vrh,
 						  void *addr, void *ptr,
 						  size_t len))
 {
@@ -156,7 +159,7 @@ static inline bool no_range_check(struct vringh *vrh, u64 addr, size_t *len,
 }
 
 /* No reason for this code to be inline. */
-static int move_to_indirect(const struct vringh *vrh,
+static int move_to_indirect(struct vringh *vrh,
 			    int *up_next, u16 *i, void *addr,
 			    const struct vring_desc *desc,
 			    struct vring_desc **descs, int *desc_max)
@@ -214,7 +217,7 @@ static int resize_iovec(struct vringh_kiov *iov, gfp_t gfp)
 	return 0;
 }
 
-static u16 __cold return_from_indirect(const struct vringh *vrh, int *up_next,
+static u16 __cold return_from_indirect(struct vringh *vrh, int *up_next,
 				       struct vring_desc **descs, int *desc_max)
 {
 	u16 i = *up_next;
@@ -235,7 +238,7 @@ static int slow_copy(struct vringh *vrh, void *dst, const void *src,
 				      u64 addr,
 				      struct vringh_range *r),
 		     struct vringh_range *range,
-		     int (*copy)(const struct vringh *vrh,
+		     int (*copy)(struct vringh *vrh,
 				 void *dst, const void *src, size_t len))
 {
 	size_t part, len = sizeof(struct vring_desc);
@@ -261,6 +264,44 @@ static int slow_copy(struct vringh *vrh, void *dst, const void *src,
 	return 0;
 }
 
+/*
+ * Read descriptor i of descs. Chains are usually laid out consecutively,
+ * so read ahead up to VRINGH_DESC_BATCH descriptors with a single copy
+ * and serve the following descriptors of the chain from there.
+ */
+static inline int read_desc(struct vringh *vrh, struct vring_desc *desc,
+			    struct vring_desc *descs, int i, int desc_max,
+			    struct vring_desc *batch,
+			    struct vring_desc **batch_descs,
+			    int *batch_start, int *batch_num,
+			    int (*copy)(struct vringh *vrh,
+					void *dst, const void *src, size_t len))
+{
+	int num, err;
+
+	if (*batch_descs == descs &&
+	    i >= *batch_start && i < *batch_start + *batch_num) {
+		*desc = batch[i - *batch_start];
+		return 0;
+	}
+
+	num = min(desc_max - i, VRINGH_DESC_BATCH);
+	err = copy(vrh, batch, &descs[i], num * sizeof(*desc));
+	if (likely(!err)) {
+		*batch_descs = descs;
+		*batch_start = i;
+		*batch_num = num;
+		*desc = batch[0];
+		return 0;
+	}
+
+	*batch_num = 0;
+	if (num == 1)
+		return err;
+	/* Maybe only part of the table is accessible, don't read ahead. */
+	return copy(vrh, desc, &descs[i], sizeof(*desc));
+}
+
 static inline int
 __vringh_iov(struct vringh *vrh, u16 i,
 	     struct vringh_kiov *riov,
@@ -271,13 +312,17 @@ __vringh_iov(struct vringh *vrh, u16 i,
 					     struct vringh_range *)),
 	     bool (*getrange)(struct vringh *, u64, struct vringh_range *),
 	     gfp_t gfp,
-	     int (*copy)(const struct vringh *vrh,
+	     int (*copy)(struct vringh *vrh,
 			 void *dst, const void *src, size_t len))
 {
 	int err, count = 0, up_next, desc_max;
 	struct vring_desc desc, *descs;
 	struct vringh_range range = { -1ULL, 0 }, slowrange;
 	bool slow = false;
+	/* Descriptors read ahead from descs[batch_start]. */
+	struct vring_desc batch[VRINGH_DESC_BATCH];
+	struct vring_desc *batch_descs = NULL;
+	int batch_start = 0, batch_num = 0;
 
 	/* We start traversing vring's descriptor table. */
 	descs = vrh->vring.desc;
@@ -302,7 +347,9 @@ __vringh_iov(struct vringh *vrh, u16 i,
 			err = slow_copy(vrh, &desc, &descs[i], rcheck, getrange,
 					&slowrange, copy);
 		else
-			err = copy(vrh, &desc, &descs[i], sizeof(desc));
+			err = read_desc(vrh, &desc, descs, i, desc_max, batch,
+					&batch_descs, &batch_start, &batch_num,
+					copy);
 		if (unlikely(err))
 			goto fail;
 
@@ -413,9 +460,9 @@ fail:
 static inline int __vringh_complete(struct vringh *vrh,
 				    const struct vring_used_elem *used,
 				    unsigned int num_used,
-				    int (*putu16)(const struct vringh *vrh,
+				    int (*putu16)(struct vringh *vrh,
 						  __virtio16 *p, u16 val),
-				    int (*putused)(const struct vringh *vrh,
+				    int (*putused)(struct vringh *vrh,
 						   struct vring_used_elem *dst,
 						   const struct vring_used_elem
 						   *src, unsigned num))
@@ -461,7 +508,7 @@ static inline int __vringh_complete(struct vringh *vrh,
 
 
 static inline int __vringh_need_notify(struct vringh *vrh,
-				       int (*getu16)(const struct vringh *vrh,
+				       int (*getu16)(struct vringh *vrh,
 						     u16 *val,
 						     const __virtio16 *p))
 {
@@ -508,9 +555,9 @@ static inline int __vringh_need_notify(struct vringh *vrh,
 }
 
 static inline bool __vringh_notify_enable(struct vringh *vrh,
-					  int (*getu16)(const struct vringh *vrh,
+					  int (*getu16)(struct vringh *vrh,
 							u16 *val, const __virtio16 *p),
-					  int (*putu16)(const struct vringh *vrh,
+					  int (*putu16)(struct vringh *vrh,
 							__virtio16 *p, u16 val))
 {
 	u16 avail;
@@ -548,7 +595,7 @@ static inline bool __vringh_notify_enable(struct vringh *vrh,
 }
 
 static inline void __vringh_notify_disable(struct vringh *vrh,
-					   int (*putu16)(const struct vringh *vrh,
+					   int (*putu16)(struct vringh *vrh,
 							 __virtio16 *p, u16 val))
 {
 	if (!vrh->event_indices) {
@@ -562,7 +609,7 @@ static inline void __vringh_notify_disable(struct vringh *vrh,
 }
 
 /* Userspace access helpers: in this case, addresses are really userspace. */
-static inline int getu16_user(const struct vringh *vrh, u16 *val, const __virtio16 *p)
+static inline int getu16_user(struct vringh *vrh, u16 *val, const __virtio16 *p)
 {
 	__virtio16 v = 0;
 	int rc = get_user(v, (__force __virtio16 __user *)p);
@@ -570,20 +617,20 @@ static inline int getu16_user(const struct vringh *vrh, u16 *val, const __virtio
 	return rc;
 }
 
-static inline int putu16_user(const struct vringh *vrh, __virtio16 *p, u16 val)
+static inline int putu16_user(struct vringh *vrh, __virtio16 *p, u16 val)
 {
 	__virtio16 v = cpu_to_vringh16(vrh, val);
 	return put_user(v, (__force __virtio16 __user *)p);
 }
 
-static inline int copydesc_user(const struct vringh *vrh,
+static inline int copydesc_user(struct vringh *vrh,
 				void *dst, const void *src, size_t len)
 {
 	return copy_from_user(dst, (__force void __user *)src, len) ?
 		-EFAULT : 0;
 }
 
-static inline int putused_user(const struct vringh *vrh,
+static inline int putused_user(struct vringh *vrh,
 			       struct vring_used_elem *dst,
 			       const struct vring_used_elem *src,
 			       unsigned int num)
@@ -592,14 +639,14 @@ static inline int putused_user(const struct vringh *vrh,
 			    sizeof(*dst) * num) ? -EFAULT : 0;
 }
 
-static inline int xfer_from_user(const struct vringh *vrh, void *src,
+static inline int xfer_from_user(struct vringh *vrh, void *src,
 				 void *dst, size_t len)
 {
 	return copy_from_user(dst, (__force void __user *)src, len) ?
 		-EFAULT : 0;
 }
 
-static inline int xfer_to_user(const struct vringh *vrh,
+static inline int xfer_to_user(struct vringh *vrh,
 			       void *dst, void *src, size_t len)
 {
 	return copy_to_user((__force void __user *)dst, src, len) ?
@@ -835,27 +882,27 @@ int vringh_need_notify_user(struct vringh *vrh)
 EXPORT_SYMBOL(vringh_need_notify_user);
 
 /* Kernelspace access helpers. */
-static inline int getu16_kern(const struct vringh *vrh,
+static inline int getu16_kern(struct vringh *vrh,
 			      u16 *val, const __virtio16 *p)
 {
 	*val = vringh16_to_cpu(vrh, READ_ONCE(*p));
 	return 0;
 }
 
-static inline int putu16_kern(const struct vringh *vrh, __virtio16 *p, u16 val)
+static inline int putu16_kern(struct vringh *vrh, __virtio16 *p, u16 val)
 {
 	WRITE_ONCE(*p, cpu_to_vringh16(vrh, val));
 	return 0;
 }
 
-static inline int copydesc_kern(const struct vringh *vrh,
+static inline int copydesc_kern(struct vringh *vrh,
 				void *dst, const void *src, size_t len)
 {
 	memcpy(dst, src, len);
 	return 0;
 }
 
-static inline int putused_kern(const struct vringh *vrh,
+static inline int putused_kern(struct vringh *vrh,
 			       struct vring_used_elem *dst,
 			       const struct vring_used_elem *src,
 			       unsigned int num)
@@ -864,14 +911,14 @@ static inline int putused_kern(const struct vringh *vrh,
 	return 0;
 }
 
-static inline int xfer_kern(const struct vringh *vrh, void *src,
+static inline int xfer_kern(struct vringh *vrh, void *src,
 			    void *dst, size_t len)
 {
 	memcpy(dst, src, len);
 	return 0;
 }
 
-static inline int kern_xfer(const struct vringh *vrh, void *dst,
+static inline int kern_xfer(struct vringh *vrh, void *dst,
 			    void *src, size_t len)
 {
 	memcpy(dst, src, len);
@@ -1064,10 +1111,56 @@ EXPORT_SYMBOL(vringh_need_notify_kern);
 
 #if IS_REACHABLE(CONFIG_VHOST_IOTLB)
 
-static int iotlb_translate(const struct vringh *vrh,
+/*
+ * Look up addr in the translations we cached for this ring. The cache is
+ * dropped as soon as the IOTLB was modified.
+ */
+static const struct vringh_iotlb_cache *
+iotlb_cache_lookup(struct vringh *vrh, u64 addr)
+{
+	const struct vringh_iotlb_cache *entry;
+	unsigned int i;
+
+	if (unlikely(vrh->iotlb_cache_gen != vrh->iotlb->gen)) {
+		vrh->iotlb_cache_gen = vrh->iotlb->gen;
+		vrh->iotlb_cache_used = 0;
+		return NULL;
+	}
+
+	for (i = 0; i < vrh->iotlb_cache_used; i++) {
+		entry = &vrh->iotlb_cache[i];
+		if (addr >= entry->start && addr <= entry->last)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static const struct vringh_iotlb_cache *
+iotlb_cache_insert(struct vringh *vrh, const struct vhost_iotlb_map *map)
+{
+	struct vringh_iotlb_cache *entry;
+
+	if (vrh->iotlb_cache_used < VRINGH_IOTLB_CACHE_SIZE) {
+		entry = &vrh->iotlb_cache[vrh->iotlb_cache_used++];
+	} else {
+		entry = &vrh->iotlb_cache[vrh->iotlb_cache_next];
+		vrh->iotlb_cache_next = (vrh->iotlb_cache_next + 1) %
+					VRINGH_IOTLB_CACHE_SIZE;
+	}
+
+	entry->start = map->start;
+	entry->last = map->last;
+	entry->addr = map->addr;
+	entry->perm = map->perm;
+	return entry;
+}
+
+static int iotlb_translate(struct vringh *vrh,
 			   u64 addr, u64 len, struct bio_vec iov[],
 			   int iov_size, u32 perm)
 {
+	const struct vringh_iotlb_cache *entry;
 	struct vhost_iotlb_map *map;
 	struct vhost_iotlb *iotlb = vrh->iotlb;
 	int ret = 0;
@@ -1081,18 +1174,24 @@ static int iotlb_translate(const struct vringh *vrh,
 			break;
 		}
 
-		map = vhost_iotlb_itree_first(iotlb, addr,
-					      addr + len - 1);
-		if (!map || map->start > addr) {
-			ret = -EINVAL;
-			break;
-		} else if (!(map->perm & perm)) {
+		entry = iotlb_cache_lookup(vrh, addr);
+		if (!entry) {
+			map = vhost_iotlb_itree_first(iotlb, addr,
+						      addr + len - 1);
+			if (!map || map->start > addr) {
+				ret = -EINVAL;
+				break;
+			}
+			entry = iotlb_cache_insert(vrh, map);
+		}
+
+		if (!(entry->perm & perm)) {
 			ret = -EPERM;
 			break;
 		}
 
-		size = map->size - addr + map->start;
-		pa = map->addr + addr - map->start;
+		size = entry->last - addr + 1;
+		pa = entry->addr + addr - entry->start;
 		pfn = pa >> PAGE_SHIFT;
 		iov[ret].bv_page = pfn_to_page(pfn);
 		iov[ret].bv_len = min(len - s, size);
@@ -1105,7 +1204,7 @@ static int iotlb_translate(const struct vringh *vrh,
 	return ret;
 }
 
-static inline int copy_from_iotlb(const struct vringh *vrh, void *dst,
+static inline int copy_from_iotlb(struct vringh *vrh, void *dst,
 				  void *src, size_t len)
 {
 	struct iov_iter iter;
@@ -1124,7 +1223,7 @@ static inline int copy_from_iotlb(const struct vringh *vrh, void *dst,
 	return ret;
 }
 
-static inline int copy_to_iotlb(const struct vringh *vrh, void *dst,
+static inline int copy_to_iotlb(struct vringh *vrh, void *dst,
 				void *src, size_t len)
 {
 	struct iov_iter iter;
@@ -1141,7 +1240,7 @@ static inline int copy_to_iotlb(const struct vringh *vrh, void *dst,
 	return copy_to_iter(src, len, &iter);
 }
 
-static inline int getu16_iotlb(const struct vringh *vrh,
+static inline int getu16_iotlb(struct vringh *vrh,
 			       u16 *val, const __virtio16 *p)
 {
 	struct bio_vec iov;
@@ -1162,7 +1261,7 @@ static inline int getu16_iotlb(const struct vringh *vrh,
 	return 0;
 }
 
-static inline int putu16_iotlb(const struct vringh *vrh,
+static inline int putu16_iotlb(struct vringh *vrh,
 			       __virtio16 *p, u16 val)
 {
 	struct bio_vec iov;
@@ -1183,7 +1282,7 @@ static inline int putu16_iotlb(const struct vringh *vrh,
 	return 0;
 }
 
-static inline int copydesc_iotlb(const struct vringh *vrh,
+static inline int copydesc_iotlb(struct vringh *vrh,
 				 void *dst, const void *src, size_t len)
 {
 	int ret;
@@ -1195,7 +1294,7 @@ static inline int copydesc_iotlb(const struct vringh *vrh,
 	return 0;
 }
 
-static inline int xfer_from_iotlb(const struct vringh *vrh, void *src,
+static inline int xfer_from_iotlb(struct vringh *vrh, void *src,
 				  void *dst, size_t len)
 {
 	int ret;
@@ -1207,7 +1306,7 @@ static inline int xfer_from_iotlb(const struct vringh *vrh, void *src,
 	return 0;
 }
 
-static inline int xfer_to_iotlb(const struct vringh *vrh,
+static inline int xfer_to_iotlb(struct vringh *vrh,
 			       void *dst, void *src, size_t len)
 {
 	int ret;
@@ -1219,7 +1318,7 @@ static inline int xfer_to_iotlb(const struct vringh *vrh,
 	return 0;
 }
 
-static inline int putused_iotlb(const struct vringh *vrh,
+static inline int putused_iotlb(struct vringh *vrh,
 				struct vring_used_elem *dst,
 				const struct vring_used_elem *src,
 				unsigned int num)
@@ -1252,6 +1351,8 @@ int vringh_init_iotlb(struct vringh *vrh, u64 features,
 		      struct vring_avail *avail,
 		      struct vring_used *used)
 {
+	vrh->iotlb_cache_used = 0;
+	vrh->iotlb_cache_next = 0;
 	return vringh_init_kern(vrh, features, num, weak_barriers,
 				desc, avail, used);
 }
@@ -1265,6 +1366,8 @@ EXPORT_SYMBOL(vringh_init_iotlb);
 void vringh_set_iotlb(struct vringh *vrh, struct vhost_iotlb *iotlb)
 {
 	vrh->iotlb = iotlb;
+	vrh->iotlb_cache_used = 0;
+	vrh->iotlb_cache_next = 0;
 }
 EXPORT_SYMBOL(vringh_set_iotlb);
 
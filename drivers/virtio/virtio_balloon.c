@@ -21,6 +21,7 @@
 #include <linux/magic.h>
 #include <linux/pseudo_fs.h>
 #include <linux/page_reporting.h>
+#include <linux/sort.h>
 
 /*
  * Balloon device works in 4K page units.  So each page is pointed to by
@@ -42,6 +43,12 @@
 	(1 << (VIRTIO_BALLOON_HINT_BLOCK_ORDER + PAGE_SHIFT))
 #define VIRTIO_BALLOON_HINT_BLOCK_PAGES (1 << VIRTIO_BALLOON_HINT_BLOCK_ORDER)
 
+/* A free page report block, see virtballoon_coalesce_report() */
+struct virtio_balloon_report_range {
+	unsigned long pfn;
+	unsigned int len;
+};
+
 #ifdef CONFIG_BALLOON_COMPACTION
 static struct vfsmount *balloon_mnt;
 #endif
@@ -126,6 +133,9 @@ struct virtio_balloon {
 	/* Free page reporting device */
 	struct virtqueue *reporting_vq;
 	struct page_reporting_dev_info pr_dev_info;
+	/* A report with contiguous blocks merged */
+	struct virtio_balloon_report_range report_ranges[PAGE_REPORTING_CAPACITY];
+	struct scatterlist report_sg[PAGE_REPORTING_CAPACITY];
 };
 
 static const struct virtio_device_id id_table[] = {
@@ -165,6 +175,51 @@ static void tell_host(struct virtio_balloon *vb, struct virtqueue *vq)
 
 }
 
+static int report_range_cmp(const void *a, const void *b)
+{
+	const struct virtio_balloon_report_range *ra = a, *rb = b;
+
+	if (ra->pfn < rb->pfn)
+		return -1;
+	return ra->pfn > rb->pfn;
+}
+
+/*
+ * The reporting core hands us blocks in free list order and walks its
+ * scatterlist again once we are done, so sort and merge physically
+ * contiguous blocks into our own list: fewer, larger ranges for the host
+ * to discard.
+ */
+static unsigned int virtballoon_coalesce_report(struct virtio_balloon *vb,
+						struct scatterlist *sgl,
+						unsigned int nents)
+{
+	struct virtio_balloon_report_range *r = vb->report_ranges;
+	struct scatterlist *sg;
+	unsigned int i, n = 0;
+
+	for_each_sg(sgl, sg, nents, i) {
+		r[i].pfn = page_to_pfn(sg_page(sg));
+		r[i].len = sg->length;
+	}
+	sort(r, nents, sizeof(*r), report_range_cmp, NULL);
+
+	for (i = 1; i < nents; i++) {
+		if (r[n].pfn + (r[n].len >> PAGE_SHIFT) == r[i].pfn &&
+		    (u64)r[n].len + r[i].len <= UINT_MAX)
+			r[n].len += r[i].len;
+		else
+			r[++n] = r[i];
+	}
+	n++;
+
+	sg_init_table(vb->report_sg, n);
+	for (i = 0; i < n; i++)
+		sg_set_page(&vb->report_sg[i], pfn_to_page(r[i].pfn),
+			    r[i].len, 0);
+	return n;
+}
+
 static int virtballoon_free_page_report(struct page_reporting_dev_info *pr_dev_info,
 				   struct scatterlist *sg, unsigned int nents)
 {
@@ -173,8 +228,11 @@ static int virtballoon_free_page_report(struct page_reporting_dev_info *pr_dev_i
 	struct virtqueue *vq = vb->reporting_vq;
 	unsigned int unused, err;
 
+	nents = virtballoon_coalesce_report(vb, sg, nents);
+
 	/* We should always be able to add these buffers to an empty queue. */
-	err = virtqueue_add_inbuf(vq, sg, nents, vb, GFP_NOWAIT | __GFP_NOWARN);
+	err = virtqueue_add_inbuf(vq, vb->report_sg, nents, vb,
+				  GFP_NOWAIT | __GFP_NOWARN);
 
 	/*
 	 * In the extremely unlikely case that something has occurred and we
@@ -53,6 +53,14 @@ struct virtio_mem {
 	struct work_struct wq;
 	atomic_t config_changed;
 
+	/*
+	 * Ordered workqueue that adds (and, with auto-onlining, onlines)
+	 * fully plugged memory blocks, while the next range is plugged.
+	 */
+	struct workqueue_struct *add_wq;
+	/* Last error when adding memory blocks via the add_wq. */
+	atomic_t add_rc;
+
 	/* Virtqueue for guest->host requests. */
 	struct virtqueue *vq;
 
@@ -102,6 +110,8 @@ struct virtio_mem {
 	/* Summary of all memory block states. */
 	unsigned long nb_mb_state[VIRTIO_MEM_MB_STATE_COUNT];
 #define VIRTIO_MEM_NB_OFFLINE_THRESHOLD		10
+	/* Maximum number of memory blocks to plug with a single request. */
+#define VIRTIO_MEM_PLUG_BATCH_MB		4
 
 	/*
 	 * One byte state per memory block.
@@ -152,6 +162,14 @@ struct virtio_mem {
 	struct list_head next;
 };
 
+/* A range of plugged memory blocks to be added by the add_wq. */
+struct virtio_mem_add_work {
+	struct work_struct work;
+	struct virtio_mem *vm;
+	unsigned long first_mb_id;
+	unsigned long nb_mb;
+};
+
 /*
  * We have to share a single online_page callback among all virtio-mem
  * devices. We use RCU to iterate the list in the callback.
@@ -395,22 +413,11 @@ static int virtio_mem_sb_bitmap_prepare_next_mb(struct virtio_mem *vm)
 }
 
 /*
- * Try to add a memory block to Linux. This will usually only fail
- * if out of memory.
- *
- * Must not be called with the vm->hotplug_mutex held (possible deadlock with
- * onlining code).
- *
- * Will not modify the state of the memory block.
+ * Allocate the resource name used for add_memory_driver_managed(). Only
+ * called from the workqueue, before any memory block is added.
  */
-static int virtio_mem_mb_add(struct virtio_mem *vm, unsigned long mb_id)
+static int virtio_mem_prepare_resource_name(struct virtio_mem *vm)
 {
-	const uint64_t addr = virtio_mem_mb_id_to_phys(mb_id);
-	int nid = vm->nid;
-
-	if (nid == NUMA_NO_NODE)
-		nid = memory_add_physaddr_to_nid(addr);
-
 	/*
 	 * When force-unloading the driver and we still have memory added to
 	 * Linux, the resource name has to stay.
@@ -421,13 +428,54 @@ static int virtio_mem_mb_add(struct virtio_mem *vm, unsigned long mb_id)
 		if (!vm->resource_name)
 			return -ENOMEM;
 	}
+	return 0;
+}
 
-	dev_dbg(&vm->vdev->dev, "adding memory block: %lu\n", mb_id);
-	return add_memory_driver_managed(nid, addr, memory_block_size_bytes(),
+/*
+ * Try to add a range of consecutive memory blocks to Linux. This will
+ * usually only fail if out of memory.
+ *
+ * Must not be called with the vm->hotplug_mutex held (possible deadlock with
+ * onlining code).
+ *
+ * Will not modify the state of the memory blocks.
+ */
+static int virtio_mem_mb_add_range(struct virtio_mem *vm, unsigned long mb_id,
+				   unsigned long nb_mb)
+{
+	const uint64_t addr = virtio_mem_mb_id_to_phys(mb_id);
+	int nid = vm->nid;
+	int rc;
+
+	if (nid == NUMA_NO_NODE)
+		nid = memory_add_physaddr_to_nid(addr);
+
+	rc = virtio_mem_prepare_resource_name(vm);
+	if (rc)
+		return rc;
+
+	dev_dbg(&vm->vdev->dev, "adding memory blocks: %lu - %lu\n", mb_id,
+		mb_id + nb_mb - 1);
+	return add_memory_driver_managed(nid, addr,
+					 nb_mb * memory_block_size_bytes(),
 					 vm->resource_name,
 					 MEMHP_MERGE_RESOURCE);
 }
 
+/*
+ * Try to add a memory block to Linux. This will usually only fail
+ * if out of memory.
+ *
+ * Must not be called with the vm->hotplug_mutex held (possible deadlock with
+ * onlining code).
+ *
+ * Will not modify the state of the memory block.
+ */
+static int virtio_mem_mb_add(struct virtio_mem *vm, unsigned long mb_id)
+{
+	return virtio_mem_mb_add_range(vm, mb_id, 1);
+}
+
 /*
  * Try to remove a memory block from Linux. Will only fail if the memory block
  * is not offline.
@@ -1128,6 +1176,128 @@ static int virtio_mem_mb_plug_and_add(struct virtio_mem *vm,
 	return 0;
 }
 
+/*
+ * Add a range of fully plugged memory blocks to Linux. If that fails, the
+ * memory blocks are marked plugged-but-not-added, to be unplugged by the
+ * workqueue.
+ */
+static void virtio_mem_mb_add_range_or_fail(struct virtio_mem *vm,
+					    unsigned long first_mb_id,
+					    unsigned long nb_mb)
+{
+	unsigned long mb_id;
+	int rc;
+
+	rc = virtio_mem_mb_add_range(vm, first_mb_id, nb_mb);
+	if (!rc)
+		return;
+
+	dev_err(&vm->vdev->dev,
+		"adding memory blocks %lu - %lu failed with %d\n", first_mb_id,
+		first_mb_id + nb_mb - 1, rc);
+
+	mutex_lock(&vm->hotplug_mutex);
+	for (mb_id = first_mb_id; mb_id < first_mb_id + nb_mb; mb_id++)
+		virtio_mem_mb_set_state(vm, mb_id, VIRTIO_MEM_MB_STATE_PLUGGED);
+	mutex_unlock(&vm->hotplug_mutex);
+
+	atomic_set(&vm->add_rc, rc);
+	virtio_mem_retry(vm);
+}
+
+static void virtio_mem_add_work_fn(struct work_struct *work)
+{
+	struct virtio_mem_add_work *add_work;
+
+	add_work = container_of(work, struct virtio_mem_add_work, work);
+	virtio_mem_mb_add_range_or_fail(add_work->vm, add_work->first_mb_id,
+					add_work->nb_mb);
+	kfree(add_work);
+}
+
+/*
+ * Calculate how many fully plugged memory blocks we can plug with a
+ * single request, starting with the given number of consecutive candidate
+ * memory blocks.
+ */
+static unsigned long virtio_mem_plug_batch_size(struct virtio_mem *vm,
+						unsigned long nb_mb,
+						uint64_t nb_sb)
+{
+	const uint64_t max_size = (uint64_t)U16_MAX * vm->device_block_size;
+	unsigned long nb_offline;
+
+	nb_offline = vm->nb_mb_state[VIRTIO_MEM_MB_STATE_OFFLINE] +
+		     vm->nb_mb_state[VIRTIO_MEM_MB_STATE_OFFLINE_PARTIAL];
+	if (nb_offline >= VIRTIO_MEM_NB_OFFLINE_THRESHOLD)
+		return 0;
+
+	nb_mb = min_t(uint64_t, nb_mb, nb_sb / vm->nb_sb_per_mb);
+	nb_mb = min_t(unsigned long, nb_mb, VIRTIO_MEM_PLUG_BATCH_MB);
+	nb_mb = min(nb_mb, VIRTIO_MEM_NB_OFFLINE_THRESHOLD - nb_offline);
+	/* the device takes the number of device blocks as 16 bit value */
+	return min_t(uint64_t, nb_mb, div64_u64(max_size,
+						memory_block_size_bytes()));
+}
+
+/*
+ * Plug a range of consecutive unused memory blocks completely, using a
+ * single request, and add them to Linux asynchronously, so we can already
+ * plug the next range while the memmap of this range gets initialized and
+ * the memory blocks get onlined.
+ *
+ * Will modify the state of the memory blocks.
+ */
+static int virtio_mem_mb_plug_and_add_batch(struct virtio_mem *vm,
+					    unsigned long first_mb_id,
+					    unsigned long nb_mb,
+					    uint64_t *nb_sb)
+{
+	const uint64_t addr = virtio_mem_mb_id_to_phys(first_mb_id);
+	const uint64_t size = nb_mb * memory_block_size_bytes();
+	struct virtio_mem_add_work *add_work;
+	unsigned long mb_id;
+	int rc;
+
+	/* the add_wq must never have to allocate the name */
+	rc = virtio_mem_prepare_resource_name(vm);
+	if (rc)
+		return rc;
+
+	dev_dbg(&vm->vdev->dev, "plugging memory blocks: %lu - %lu\n",
+		first_mb_id, first_mb_id + nb_mb - 1);
+
+	rc = virtio_mem_send_plug_request(vm, addr, size);
+	if (rc)
+		return rc;
+
+	/*
+	 * Mark the blocks properly offline before adding them to Linux,
+	 * so the memory notifiers will find the blocks in the right state.
+	 */
+	mutex_lock(&vm->hotplug_mutex);
+	for (mb_id = first_mb_id; mb_id < first_mb_id + nb_mb; mb_id++) {
+		virtio_mem_mb_set_sb_plugged(vm, mb_id, 0, vm->nb_sb_per_mb);
+		virtio_mem_mb_set_state(vm, mb_id, VIRTIO_MEM_MB_STATE_OFFLINE);
+	}
+	mutex_unlock(&vm->hotplug_mutex);
+	*nb_sb -= nb_mb * vm->nb_sb_per_mb;
+
+	add_work = kmalloc(sizeof(*add_work), GFP_KERNEL);
+	if (!add_work) {
+		/* add synchronously, errors are reported via add_rc */
+		virtio_mem_mb_add_range_or_fail(vm, first_mb_id, nb_mb);
+		return 0;
+	}
+
+	INIT_WORK(&add_work->work, virtio_mem_add_work_fn);
+	add_work->vm = vm;
+	add_work->first_mb_id = first_mb_id;
+	add_work->nb_mb = nb_mb;
+	queue_work(vm->add_wq, &add_work->work);
+	return 0;
+}
+
 /*
  * Try to plug the desired number of subblocks of a memory block that
  * is already added to Linux.
@@ -1189,7 +1359,7 @@ static int virtio_mem_mb_plug_any_sb(struct virtio_mem *vm, unsigned long mb_id,
 static int virtio_mem_plug_request(struct virtio_mem *vm, uint64_t diff)
 {
 	uint64_t nb_sb = diff / vm->subblock_size;
-	unsigned long mb_id;
+	unsigned long mb_id, last_mb_id, nb_mb, i;
 	int rc;
 
 	if (!nb_sb)
@@ -1222,26 +1392,50 @@ static int virtio_mem_plug_request(struct virtio_mem *vm, uint64_t diff)
 	 */
 	mutex_unlock(&vm->hotplug_mutex);
 
-	/* Try to plug and add unused blocks */
+	/* Try to plug and add unused blocks, consecutive ones in one go */
 	virtio_mem_for_each_mb_state(vm, mb_id, VIRTIO_MEM_MB_STATE_UNUSED) {
 		if (virtio_mem_too_many_mb_offline(vm))
 			return -ENOSPC;
 
-		rc = virtio_mem_mb_plug_and_add(vm, mb_id, &nb_sb);
+		nb_mb = 1;
+		while (mb_id + nb_mb < vm->next_mb_id &&
+		       nb_mb < VIRTIO_MEM_PLUG_BATCH_MB &&
+		       virtio_mem_mb_get_state(vm, mb_id + nb_mb) ==
+		       VIRTIO_MEM_MB_STATE_UNUSED)
+			nb_mb++;
+		nb_mb = virtio_mem_plug_batch_size(vm, nb_mb, nb_sb);
+
+		if (nb_mb)
+			rc = virtio_mem_mb_plug_and_add_batch(vm, mb_id, nb_mb,
+							      &nb_sb);
+		else
+			rc = virtio_mem_mb_plug_and_add(vm, mb_id, &nb_sb);
 		if (rc || !nb_sb)
 			return rc;
 		cond_resched();
 	}
 
-	/* Try to prepare, plug and add new blocks */
+	/* Try to prepare, plug and add new blocks, in batches */
 	while (nb_sb) {
 		if (virtio_mem_too_many_mb_offline(vm))
 			return -ENOSPC;
 
+		nb_mb = 0;
+		if (vm->next_mb_id <= vm->last_usable_mb_id)
+			nb_mb = vm->last_usable_mb_id - vm->next_mb_id + 1;
+		nb_mb = virtio_mem_plug_batch_size(vm, nb_mb, nb_sb);
+
 		rc = virtio_mem_prepare_next_mb(vm, &mb_id);
+		for (i = 1; !rc && i < nb_mb; i++)
+			rc = virtio_mem_prepare_next_mb(vm, &last_mb_id);
 		if (rc)
 			return rc;
-		rc = virtio_mem_mb_plug_and_add(vm, mb_id, &nb_sb);
+
+		if (nb_mb)
+			rc = virtio_mem_mb_plug_and_add_batch(vm, mb_id, nb_mb,
+							      &nb_sb);
+		else
+			rc = virtio_mem_mb_plug_and_add(vm, mb_id, &nb_sb);
 		if (rc)
 			return rc;
 		cond_resched();
@@ -1547,10 +1741,20 @@ retry:
 		virtio_mem_refresh_config(vm);
 	}
 
+	/*
+	 * Wait until all memory blocks we plugged previously were added, so
+	 * we don't race with the add_wq on their state.
+	 */
+	flush_workqueue(vm->add_wq);
+
 	/* Unplug any leftovers from previous runs */
 	if (!rc)
 		rc = virtio_mem_unplug_pending_mb(vm);
 
+	/* Adding memory blocks failed, handle it like a failed plug request */
+	if (!rc)
+		rc = atomic_xchg(&vm->add_rc, 0);
+
 	if (!rc && vm->requested_size != vm->plugged_size) {
 		if (vm->requested_size > vm->plugged_size) {
 			diff = vm->requested_size - vm->plugged_size;
@@ -1768,6 +1972,7 @@ static int virtio_mem_probe(struct virtio_device *vdev)
 	init_waitqueue_head(&vm->host_resp);
 	vm->vdev = vdev;
 	INIT_WORK(&vm->wq, virtio_mem_run_wq);
+	atomic_set(&vm->add_rc, 0);
 	mutex_init(&vm->hotplug_mutex);
 	INIT_LIST_HEAD(&vm->next);
 	spin_lock_init(&vm->removal_lock);
@@ -1775,10 +1980,17 @@ static int virtio_mem_probe(struct virtio_device *vdev)
 	vm->retry_timer.function = virtio_mem_timer_expired;
 	vm->retry_timer_ms = VIRTIO_MEM_RETRY_TIMER_MIN_MS;
 
+	vm->add_wq = alloc_ordered_workqueue("%s_add", WQ_FREEZABLE,
+					     dev_name(&vdev->dev));
+	if (!vm->add_wq) {
+		rc = -ENOMEM;
+		goto out_free_vm;
+	}
+
 	/* register the virtqueue */
 	rc = virtio_mem_init_vq(vm);
 	if (rc)
-		goto out_free_vm;
+		goto out_destroy_wq;
 
 	/* initialize the device by querying the config */
 	rc = virtio_mem_init(vm);
@@ -1822,6 +2034,8 @@ out_del_resource:
 	virtio_mem_delete_resource(vm);
 out_del_vq:
 	vdev->config->del_vqs(vdev);
+out_destroy_wq:
+	destroy_workqueue(vm->add_wq);
 out_free_vm:
 	kfree(vm);
 	vdev->priv = NULL;
@@ -1845,9 +2059,10 @@ static void virtio_mem_remove(struct virtio_device *vdev)
 	spin_unlock_irq(&vm->removal_lock);
 	mutex_unlock(&vm->hotplug_mutex);
 
-	/* wait until the workqueue stopped */
+	/* wait until the workqueues stopped */
 	cancel_work_sync(&vm->wq);
 	hrtimer_cancel(&vm->retry_timer);
+	destroy_workqueue(vm->add_wq);
 
 	/*
 	 * After we unregistered our callbacks, user space can online partially
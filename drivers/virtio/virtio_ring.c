@@ -13,6 +13,12 @@
 #include <linux/dma-mapping.h>
 #include <xen/xen.h>
 
+#ifndef VIRTIO_F_IN_ORDER
+/* Device uses buffers in the same order in which they have been made
+ * available (virtio 1.1, 6.). */
+#define VIRTIO_F_IN_ORDER		35
+#endif
+
 #ifdef DEBUG
 /* For development, we want to crash whenever the ring is screwed. */
 #define BAD_RING(_vq, fmt, args...)				\
@@ -68,6 +74,8 @@
 struct vring_desc_state_split {
 	void *data;			/* Data for callback. */
 	struct vring_desc *indir_desc;	/* Indirect descriptor, if any. */
+	u32 total_len;			/* Writable length, for in-order batches. */
+	u16 num;			/* Descriptor list length. */
 };
 
 struct vring_desc_state_packed {
@@ -105,6 +113,9 @@ struct vring_virtqueue {
 	/* Host publishes avail event idx */
 	bool event;
 
+	/* Host uses buffers in the order they were made available */
+	bool in_order;
+
 	/* Head of free buffer list. */
 	unsigned int free_head;
 	/* Number we've added since last sync. */
@@ -412,6 +423,15 @@ static struct vring_desc *alloc_indirect_split(struct virtqueue *_vq,
 	return desc;
 }
 
+static inline void virtqueue_publish_avail_split(struct vring_virtqueue *vq)
+{
+	/* Descriptors and available array need to be set before we expose the
+	 * new available array entries. */
+	virtio_wmb(vq->weak_barriers);
+	vq->split.vring.avail->idx = cpu_to_virtio16(vq->vq.vdev,
+						vq->split.avail_idx_shadow);
+}
+
 static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      struct scatterlist *sgs[],
 				      unsigned int total_sg,
@@ -419,12 +439,14 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 				      unsigned int in_sgs,
 				      void *data,
 				      void *ctx,
+				      bool publish,
 				      gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	struct scatterlist *sg;
 	struct vring_desc *desc;
 	unsigned int i, n, avail, descs_used, prev, err_idx;
+	u32 total_len = 0;
 	int head;
 	bool indirect;
 
@@ -500,6 +522,7 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 			desc[i].flags = cpu_to_virtio16(_vq->vdev, VRING_DESC_F_NEXT | VRING_DESC_F_WRITE);
 			desc[i].addr = cpu_to_virtio64(_vq->vdev, addr);
 			desc[i].len = cpu_to_virtio32(_vq->vdev, sg->length);
+			total_len += sg->length;
 			prev = i;
 			i = virtio16_to_cpu(_vq->vdev, desc[i].next);
 		}
@@ -540,27 +563,31 @@ static inline int virtqueue_add_split(struct virtqueue *_vq,
 		vq->split.desc_state[head].indir_desc = desc;
 	else
 		vq->split.desc_state[head].indir_desc = ctx;
+	vq->split.desc_state[head].num = descs_used;
+	vq->split.desc_state[head].total_len = total_len;
 
 	/* Put entry in available array (but don't update avail->idx until they
 	 * do sync). */
 	avail = vq->split.avail_idx_shadow & (vq->split.vring.num - 1);
 	vq->split.vring.avail->ring[avail] = cpu_to_virtio16(_vq->vdev, head);
 
-	/* Descriptors and available array need to be set before we expose the
-	 * new available array entries. */
-	virtio_wmb(vq->weak_barriers);
 	vq->split.avail_idx_shadow++;
-	vq->split.vring.avail->idx = cpu_to_virtio16(_vq->vdev,
-						vq->split.avail_idx_shadow);
 	vq->num_added++;
 
+	/* A batched add exposes avail->idx once, after the last buffer. */
+	if (publish)
+		virtqueue_publish_avail_split(vq);
+
 	pr_debug("Added buffer head %i to %p\n", head, vq);
 	END_USE(vq);
 
 	/* This is very unlikely, but theoretically possible.  Kick
 	 * just in case. */
-	if (unlikely(vq->num_added == (1 << 16) - 1))
+	if (unlikely(vq->num_added == (1 << 16) - 1)) {
+		if (!publish)
+			virtqueue_publish_avail_split(vq);
 		virtqueue_kick(_vq);
+	}
 
 	return 0;
 
@@ -626,23 +653,39 @@ static void detach_buf_split(struct vring_virtqueue *vq, unsigned int head,
 	/* Clear data ptr. */
 	vq->split.desc_state[head].data = NULL;
 
-	/* Put back on free list: unmap first-level descriptors and find end */
-	i = head;
+	if (vq->in_order) {
+		/*
+		 * The chain is head, head + 1, ... and sits right behind the
+		 * free region, so there is no list to fix up and, without
+		 * the DMA API, nothing to walk.
+		 */
+		j = vq->split.desc_state[head].num;
+		vq->vq.num_free += j;
+		for (i = head; vq->use_dma_api && j; j--) {
+			vring_unmap_one_split(vq, &vq->split.vring.desc[i]);
+			i = (i + 1) & (vq->split.vring.num - 1);
+		}
+	} else {
+		/* Put back on free list: unmap first-level descriptors and
+		 * find end */
+		i = head;
+
+		while (vq->split.vring.desc[i].flags & nextflag) {
+			vring_unmap_one_split(vq, &vq->split.vring.desc[i]);
+			i = virtio16_to_cpu(vq->vq.vdev,
+					    vq->split.vring.desc[i].next);
+			vq->vq.num_free++;
+		}
 
-	while (vq->split.vring.desc[i].flags & nextflag) {
 		vring_unmap_one_split(vq, &vq->split.vring.desc[i]);
-		i = virtio16_to_cpu(vq->vq.vdev, vq->split.vring.desc[i].next);
+		vq->split.vring.desc[i].next = cpu_to_virtio16(vq->vq.vdev,
+							vq->free_head);
+		vq->free_head = head;
+
+		/* Plus final descriptor */
 		vq->vq.num_free++;
 	}
 
-	vring_unmap_one_split(vq, &vq->split.vring.desc[i]);
-	vq->split.vring.desc[i].next = cpu_to_virtio16(vq->vq.vdev,
-						vq->free_head);
-	vq->free_head = head;
-
-	/* Plus final descriptor */
-	vq->vq.num_free++;
-
 	if (vq->indirect) {
 		struct vring_desc *indir_desc =
 				vq->split.desc_state[head].indir_desc;
@@ -675,14 +718,62 @@ static inline bool more_used_split(const struct vring_virtqueue *vq)
 			vq->split.vring.used->idx);
 }
 
+/*
+ * Detach the buffer described by the used entry at last_used_idx.  The
+ * caller has checked that the entry exists and issued the read barrier.
+ */
+static void *detach_used_split(struct vring_virtqueue *vq, unsigned int *len,
+			       void **ctx)
+{
+	void *ret;
+	unsigned int i, head;
+	u16 last_used;
+
+	last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
+	i = virtio32_to_cpu(vq->vq.vdev,
+			vq->split.vring.used->ring[last_used].id);
+	*len = virtio32_to_cpu(vq->vq.vdev,
+			vq->split.vring.used->ring[last_used].len);
+
+	if (unlikely(i >= vq->split.vring.num)) {
+		BAD_RING(vq, "id %u out of range\n", i);
+		return NULL;
+	}
+
+	head = i;
+	if (vq->in_order) {
+		/*
+		 * The oldest outstanding buffer starts right after the free
+		 * region.  An in-order device may write a single used entry
+		 * for a whole batch; buffers before that entry's id were
+		 * used in full.
+		 */
+		head = (vq->free_head + vq->vq.num_free) &
+		       (vq->split.vring.num - 1);
+		if (head != i)
+			*len = vq->split.desc_state[head].total_len;
+	}
+
+	if (unlikely(!vq->split.desc_state[head].data)) {
+		BAD_RING(vq, "id %u is not a head!\n", head);
+		return NULL;
+	}
+
+	/* detach_buf_split clears data, so grab it now. */
+	ret = vq->split.desc_state[head].data;
+	detach_buf_split(vq, head, ctx);
+	if (head == i)
+		vq->last_used_idx++;
+
+	return ret;
+}
+
 static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 					 unsigned int *len,
 					 void **ctx)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
 	void *ret;
-	unsigned int i;
-	u16 last_used;
 
 	START_USE(vq);
 
@@ -700,25 +791,10 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	/* Only get used array entries after they have been exposed by host. */
 	virtio_rmb(vq->weak_barriers);
 
-	last_used = (vq->last_used_idx & (vq->split.vring.num - 1));
-	i = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].id);
-	*len = virtio32_to_cpu(_vq->vdev,
-			vq->split.vring.used->ring[last_used].len);
-
-	if (unlikely(i >= vq->split.vring.num)) {
-		BAD_RING(vq, "id %u out of range\n", i);
-		return NULL;
-	}
-	if (unlikely(!vq->split.desc_state[i].data)) {
-		BAD_RING(vq, "id %u is not a head!\n", i);
+	ret = detach_used_split(vq, len, ctx);
+	if (unlikely(!ret))
 		return NULL;
-	}
 
-	/* detach_buf_split clears data, so grab it now. */
-	ret = vq->split.desc_state[i].data;
-	detach_buf_split(vq, i, ctx);
-	vq->last_used_idx++;
 	/* If we expect an interrupt for the next entry, tell host
 	 * by writing event index and flush out the write before
 	 * the read in the next get_buf call. */
@@ -733,6 +809,50 @@ static void *virtqueue_get_buf_ctx_split(struct virtqueue *_vq,
 	return ret;
 }
 
+static unsigned int virtqueue_get_bufs_split(struct virtqueue *_vq,
+					     void **data,
+					     unsigned int *len,
+					     void **ctx,
+					     unsigned int max)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n = 0;
+	u16 used_idx;
+
+	START_USE(vq);
+
+	if (unlikely(vq->broken)) {
+		END_USE(vq);
+		return 0;
+	}
+
+	used_idx = virtio16_to_cpu(_vq->vdev, vq->split.vring.used->idx);
+	if (vq->last_used_idx == used_idx) {
+		END_USE(vq);
+		return 0;
+	}
+
+	/* One barrier covers every entry up to the used->idx we just read. */
+	virtio_rmb(vq->weak_barriers);
+
+	while (n < max && vq->last_used_idx != used_idx) {
+		data[n] = detach_used_split(vq, &len[n], ctx ? &ctx[n] : NULL);
+		if (unlikely(!data[n]))
+			break;
+		n++;
+	}
+
+	if (n && !(vq->split.avail_flags_shadow & VRING_AVAIL_F_NO_INTERRUPT))
+		virtio_store_mb(vq->weak_barriers,
+				&vring_used_event(&vq->split.vring),
+				cpu_to_virtio16(_vq->vdev, vq->last_used_idx));
+
+	LAST_ADD_TIME_INVALID(vq);
+
+	END_USE(vq);
+	return n;
+}
+
 static void virtqueue_disable_cb_split(struct virtqueue *_vq)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -1697,6 +1817,7 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 				unsigned int in_sgs,
 				void *data,
 				void *ctx,
+				bool publish,
 				gfp_t gfp)
 {
 	struct vring_virtqueue *vq = to_vvq(_vq);
@@ -1704,7 +1825,8 @@ static inline int virtqueue_add(struct virtqueue *_vq,
 	return vq->packed_ring ? virtqueue_add_packed(_vq, sgs, total_sg,
 					out_sgs, in_sgs, data, ctx, gfp) :
 				 virtqueue_add_split(_vq, sgs, total_sg,
-					out_sgs, in_sgs, data, ctx, gfp);
+					out_sgs, in_sgs, data, ctx, publish,
+					gfp);
 }
 
 /**
@@ -1738,7 +1860,7 @@ int virtqueue_add_sgs(struct virtqueue *_vq,
 			total_sg++;
 	}
 	return virtqueue_add(_vq, sgs, total_sg, out_sgs, in_sgs,
-			     data, NULL, gfp);
+			     data, NULL, true, gfp);
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_sgs);
 
@@ -1760,7 +1882,7 @@ int virtqueue_add_outbuf(struct virtqueue *vq,
 			 void *data,
 			 gfp_t gfp)
 {
-	return virtqueue_add(vq, &sg, num, 1, 0, data, NULL, gfp);
+	return virtqueue_add(vq, &sg, num, 1, 0, data, NULL, true, gfp);
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_outbuf);
 
@@ -1782,7 +1904,7 @@ int virtqueue_add_inbuf(struct virtqueue *vq,
 			void *data,
 			gfp_t gfp)
 {
-	return virtqueue_add(vq, &sg, num, 0, 1, data, NULL, gfp);
+	return virtqueue_add(vq, &sg, num, 0, 1, data, NULL, true, gfp);
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf);
 
@@ -1806,10 +1928,89 @@ int virtqueue_add_inbuf_ctx(struct virtqueue *vq,
 			void *ctx,
 			gfp_t gfp)
 {
-	return virtqueue_add(vq, &sg, num, 0, 1, data, ctx, gfp);
+	return virtqueue_add(vq, &sg, num, 0, 1, data, ctx, true, gfp);
 }
 EXPORT_SYMBOL_GPL(virtqueue_add_inbuf_ctx);
 
+static int virtqueue_add_batch(struct virtqueue *_vq,
+			       struct scatterlist *sgs[],
+			       unsigned int nums[],
+			       void *data[],
+			       void *ctx[],
+			       unsigned int count,
+			       bool out,
+			       gfp_t gfp)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n;
+	int err = 0;
+
+	for (n = 0; n < count; n++) {
+		err = virtqueue_add(_vq, &sgs[n], nums[n], out, !out, data[n],
+				    ctx ? ctx[n] : NULL, false, gfp);
+		if (err)
+			break;
+	}
+
+	/* Packed rings make each buffer available through its own flags. */
+	if (n && !vq->packed_ring)
+		virtqueue_publish_avail_split(vq);
+
+	return n ? n : err;
+}
+
+/**
+ * virtqueue_add_outbuf_batch - expose several output buffers to other end
+ * @vq: the struct virtqueue we're talking about.
+ * @sgs: array of @count scatterlists (each well-formed and terminated!)
+ * @nums: the number of entries in each of @sgs readable by other side
+ * @data: array of @count tokens identifying the buffers.
+ * @count: the number of buffers.
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * Like @count calls to virtqueue_add_outbuf(), except that a split ring
+ * publishes its available index (and the barrier before it) once for
+ * the whole batch.  Stops at the first buffer that cannot be added.
+ *
+ * Caller must ensure we don't call this with other virtqueue operations
+ * at the same time (except where noted).
+ *
+ * Returns the number of buffers added, or a negative error (ie. ENOSPC,
+ * ENOMEM, EIO) if not even the first one was.
+ */
+int virtqueue_add_outbuf_batch(struct virtqueue *vq,
+			       struct scatterlist *sgs[], unsigned int nums[],
+			       void *data[], unsigned int count,
+			       gfp_t gfp)
+{
+	return virtqueue_add_batch(vq, sgs, nums, data, NULL, count, true, gfp);
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_outbuf_batch);
+
+/**
+ * virtqueue_add_inbuf_batch - expose several input buffers to other end
+ * @vq: the struct virtqueue we're talking about.
+ * @sgs: array of @count scatterlists (each well-formed and terminated!)
+ * @nums: the number of entries in each of @sgs writable by other side
+ * @data: array of @count tokens identifying the buffers.
+ * @ctx: array of @count extra contexts for the tokens, or NULL
+ * @count: the number of buffers.
+ * @gfp: how to do memory allocations (if necessary).
+ *
+ * Batched virtqueue_add_inbuf_ctx(); see virtqueue_add_outbuf_batch().
+ *
+ * Returns the number of buffers added, or a negative error (ie. ENOSPC,
+ * ENOMEM, EIO) if not even the first one was.
+ */
+int virtqueue_add_inbuf_batch(struct virtqueue *vq,
+			      struct scatterlist *sgs[], unsigned int nums[],
+			      void *data[], void *ctx[], unsigned int count,
+			      gfp_t gfp)
+{
+	return virtqueue_add_batch(vq, sgs, nums, data, ctx, count, false, gfp);
+}
+EXPORT_SYMBOL_GPL(virtqueue_add_inbuf_batch);
+
 /**
  * virtqueue_kick_prepare - first half of split virtqueue_kick call.
  * @_vq: the struct virtqueue
@@ -1906,6 +2107,43 @@ void *virtqueue_get_buf(struct virtqueue *_vq, unsigned int *len)
 	return virtqueue_get_buf_ctx(_vq, len, NULL);
 }
 EXPORT_SYMBOL_GPL(virtqueue_get_buf);
+
+/**
+ * virtqueue_get_bufs - get up to @max used buffers
+ * @_vq: the struct virtqueue we're talking about.
+ * @data: array of at least @max entries for the "data" tokens
+ * @len: array of at least @max entries for the lengths written
+ * @ctx: array of at least @max entries for the extra contexts, or NULL
+ * @max: the maximum number of buffers to return.
+ *
+ * Like repeated virtqueue_get_buf_ctx() calls, but a split ring reads
+ * the used index, issues the read barrier and updates the used event
+ * once for the whole batch.
+ *
+ * Caller must ensure we don't call this with other virtqueue
+ * operations at the same time (except where noted).
+ *
+ * Returns the number of buffers returned in @data.
+ */
+unsigned int virtqueue_get_bufs(struct virtqueue *_vq, void **data,
+				unsigned int *len, void **ctx, unsigned int max)
+{
+	struct vring_virtqueue *vq = to_vvq(_vq);
+	unsigned int n = 0;
+
+	if (!vq->packed_ring)
+		return virtqueue_get_bufs_split(_vq, data, len, ctx, max);
+
+	while (n < max) {
+		data[n] = virtqueue_get_buf_ctx_packed(_vq, &len[n],
+						       ctx ? &ctx[n] : NULL);
+		if (!data[n])
+			break;
+		n++;
+	}
+	return n;
+}
+EXPORT_SYMBOL_GPL(virtqueue_get_bufs);
 /**
  * virtqueue_disable_cb - disable callbacks
  * @_vq: the struct virtqueue we're talking about.
@@ -2093,6 +2331,7 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC) &&
 		!context;
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->in_order = virtio_has_feature(vdev, VIRTIO_F_IN_ORDER);
 
 	if (virtio_has_feature(vdev, VIRTIO_F_ORDER_PLATFORM))
 		vq->weak_barriers = false;
@@ -2123,6 +2362,8 @@ struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	vq->free_head = 0;
 	for (i = 0; i < vring.num-1; i++)
 		vq->split.vring.desc[i].next = cpu_to_virtio16(vdev, i + 1);
+	/* In-order allocation treats the descriptor table as a ring. */
+	vq->split.vring.desc[i].next = cpu_to_virtio16(vdev, 0);
 	memset(vq->split.desc_state, 0, vring.num *
 			sizeof(struct vring_desc_state_split));
 
@@ -2234,11 +2475,17 @@ void vring_transport_features(struct virtio_device *vdev)
 			break;
 		case VIRTIO_F_ORDER_PLATFORM:
 			break;
+		case VIRTIO_F_IN_ORDER:
+			break;
 		default:
 			/* We don't understand this bit. */
 			__virtio_clear_bit(vdev, i);
 		}
 	}
+
+	/* The in-order fast path is only implemented for the split ring. */
+	if (__virtio_test_bit(vdev, VIRTIO_F_RING_PACKED))
+		__virtio_clear_bit(vdev, VIRTIO_F_IN_ORDER);
 }
 EXPORT_SYMBOL_GPL(vring_transport_features);
 
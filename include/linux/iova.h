@@ -20,12 +20,14 @@ struct iova {
 	struct rb_node	node;
 	unsigned long	pfn_hi; /* Highest allocated pfn */
 	unsigned long	pfn_lo; /* Lowest allocated pfn */
+	unsigned long	gap;	/* Free pfns right below pfn_lo */
+	unsigned long	__subtree_max_gap; /* Largest gap in this subtree */
 };
 
 struct iova_magazine;
 struct iova_cpu_rcache;
 
-#define IOVA_RANGE_CACHE_MAX_SIZE 6	/* log of max cached IOVA range size (in pages) */
+#define IOVA_RANGE_CACHE_MAX_SIZE 9	/* log of max cached IOVA range size (in pages) */
 #define MAX_GLOBAL_MAGS 32	/* magazines per bin */
 
 struct iova_rcache {
@@ -40,6 +42,10 @@ struct iova_domain;
 /* Call-Back from IOVA code into IOMMU drivers */
 typedef void (* iova_flush_cb)(struct iova_domain *domain);
 
+/* Call-Back to flush the IOMMU TLBs for a range of pfns only */
+typedef void (* iova_flush_range_cb)(struct iova_domain *domain,
+				     unsigned long pfn, unsigned long pages);
+
 /* Destructor for per-entry data */
 typedef void (* iova_entry_dtor)(unsigned long data);
 
@@ -49,6 +55,12 @@ typedef void (* iova_entry_dtor)(unsigned long data);
 /* Timeout (in ms) after which entries are flushed from the Flush-Queue */
 #define IOVA_FQ_TIMEOUT	10
 
+/*
+ * Maximum number of ranges the entries of a Flush-Queue may coalesce into
+ * to be flushed with range invalidations instead of a full flush
+ */
+#define IOVA_FQ_MAX_RANGES	16
+
 /* Flush Queue entry for defered flushing */
 struct iova_fq_entry {
 	unsigned long iova_pfn;
@@ -67,9 +79,8 @@ struct iova_fq {
 /* holds all the iova translations for a domain */
 struct iova_domain {
 	spinlock_t	iova_rbtree_lock; /* Lock to protect update of rbtree */
-	struct rb_root	rbroot;		/* iova domain rbtree root */
-	struct rb_node	*cached_node;	/* Save last alloced node */
-	struct rb_node	*cached32_node; /* Save last 32-bit alloced node */
+	struct rb_root	rbroot;		/* iova domain rbtree root, augmented
+					   with the largest gap per subtree */
 	unsigned long	granule;	/* pfn granularity for this domain */
 	unsigned long	start_pfn;	/* Lower limit for this domain */
 	unsigned long	dma_32bit_pfn;
@@ -88,6 +99,9 @@ struct iova_domain {
 	iova_flush_cb	flush_cb;	/* Call-Back function to flush IOMMU
 					   TLBs */
 
+	iova_flush_range_cb flush_range_cb; /* Optional Call-Back function to
+					       flush a range of IOMMU TLBs */
+
 	iova_entry_dtor entry_dtor;	/* IOMMU driver specific destructor for
 					   iova entry */
 
@@ -157,7 +171,9 @@ void init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn);
 bool has_iova_flush_queue(struct iova_domain *iovad);
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor);
+			  iova_flush_cb flush_cb,
+			  iova_flush_range_cb flush_range_cb,
+			  iova_entry_dtor entry_dtor);
 struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn);
 void put_iova_domain(struct iova_domain *iovad);
 struct iova *split_and_remove_iova(struct iova_domain *iovad,
@@ -243,6 +259,7 @@ static inline bool has_iova_flush_queue(struct iova_domain *iovad)
 
 static inline int init_iova_flush_queue(struct iova_domain *iovad,
 					iova_flush_cb flush_cb,
+					iova_flush_range_cb flush_range_cb,
 					iova_entry_dtor entry_dtor)
 {
 	return -ENODEV;
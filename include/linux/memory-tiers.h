@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_MEMORY_TIERS_H
+#define _LINUX_MEMORY_TIERS_H
+
+#include <linux/types.h>
+
+#ifdef CONFIG_DEV_DAX_KMEM_TIERING
+void node_set_lower_tier(int nid);
+void node_clear_lower_tier(int nid);
+unsigned long node_tier_promotions(int nid);
+unsigned long node_tier_demotions(int nid);
+#else
+static inline void node_set_lower_tier(int nid)
+{
+}
+
+static inline void node_clear_lower_tier(int nid)
+{
+}
+
+static inline unsigned long node_tier_promotions(int nid)
+{
+	return 0;
+}
+
+static inline unsigned long node_tier_demotions(int nid)
+{
+	return 0;
+}
+#endif /* CONFIG_DEV_DAX_KMEM_TIERING */
+
+#endif /* _LINUX_MEMORY_TIERS_H */
@@ -27,6 +27,8 @@ struct vhost_iotlb {
 	unsigned int limit;
 	unsigned int nmaps;
 	unsigned int flags;
+	/* Bumped whenever a mapping is added or removed. */
+	u64 gen;
 };
 
 int vhost_iotlb_add_range(struct vhost_iotlb *iotlb, u64 start, u64 last,
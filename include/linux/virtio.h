@@ -57,6 +57,16 @@ int virtqueue_add_sgs(struct virtqueue *vq,
 		      void *data,
 		      gfp_t gfp);
 
+int virtqueue_add_outbuf_batch(struct virtqueue *vq,
+			       struct scatterlist *sgs[], unsigned int nums[],
+			       void *data[], unsigned int count,
+			       gfp_t gfp);
+
+int virtqueue_add_inbuf_batch(struct virtqueue *vq,
+			      struct scatterlist *sgs[], unsigned int nums[],
+			      void *data[], void *ctx[], unsigned int count,
+			      gfp_t gfp);
+
 bool virtqueue_kick(struct virtqueue *vq);
 
 bool virtqueue_kick_prepare(struct virtqueue *vq);
@@ -68,6 +78,9 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len);
 void *virtqueue_get_buf_ctx(struct virtqueue *vq, unsigned int *len,
 			    void **ctx);
 
+unsigned int virtqueue_get_bufs(struct virtqueue *vq, void **data,
+				unsigned int *len, void **ctx, unsigned int max);
+
 void virtqueue_disable_cb(struct virtqueue *vq);
 
 bool virtqueue_enable_cb(struct virtqueue *vq);
@@ -20,6 +20,15 @@
 #endif
 #include <asm/barrier.h>
 
+/* A translation cached from the IOTLB, see struct vringh. */
+struct vringh_iotlb_cache {
+	u64 start, last;
+	u64 addr;
+	u32 perm;
+};
+
+#define VRINGH_IOTLB_CACHE_SIZE 4
+
 /* virtio_ring with information needed for host access. */
 struct vringh {
 	/* Everything is little endian */
@@ -46,6 +55,11 @@ struct vringh {
 	/* IOTLB for this vring */
 	struct vhost_iotlb *iotlb;
 
+	/* Recently used IOTLB translations, valid while iotlb->gen matches. */
+	struct vringh_iotlb_cache iotlb_cache[VRINGH_IOTLB_CACHE_SIZE];
+	unsigned int iotlb_cache_used, iotlb_cache_next;
+	u64 iotlb_cache_gen;
+
 	/* The function to call to notify the guest about added buffers */
 	void (*notify)(struct vringh *);
 };
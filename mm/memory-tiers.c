@@ -0,0 +1,281 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Page placement between DRAM and slower memory nodes
+ *
+ * Nodes made of slower memory, such as persistent memory onlined by the
+ * dax/kmem driver, are registered as a lower tier.  While at least one such
+ * node exists, ktierd samples the pages of every node once per interval:
+ *
+ *  - a page of a lower tier node that was referenced since the previous
+ *    pass and already sits on the active LRU is hot, and is migrated to
+ *    the closest upper tier node as long as that node has free memory
+ *    above its high watermarks;
+ *
+ *  - once an upper tier node drops below its high watermarks, its inactive
+ *    pages that were not referenced since the previous pass are cold, and
+ *    are migrated to the closest lower tier node with free memory.
+ *
+ * Only a window of each node is looked at per pass, so hot pages are found
+ * over several intervals rather than with one walk of the whole node.
+ */
+
+#include <linux/freezer.h>
+#include <linux/kthread.h>
+#include <linux/memory-tiers.h>
+#include <linux/memory_hotplug.h>
+#include <linux/migrate.h>
+#include <linux/mm.h>
+#include <linux/mm_inline.h>
+#include <linux/mmzone.h>
+#include <linux/nodemask.h>
+#include <linux/rmap.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+
+#include "internal.h"
+
+#define TIER_SCAN_INTERVAL_MS	1000
+/* Number of pfns of a node looked at per pass */
+#define TIER_SCAN_PFNS		(16UL << (20 - PAGE_SHIFT)) /* 16MB */
+
+struct tier_node {
+	atomic_long_t promoted;		/* pages moved out of this node */
+	atomic_long_t demoted;		/* pages moved into this node */
+	unsigned long scan_pfn;		/* ktierd only */
+	int users;			/* protected by tier_lock */
+};
+
+static DEFINE_MUTEX(tier_lock);
+static nodemask_t lower_tier_nodes = NODE_MASK_NONE;
+static struct tier_node tier_nodes[MAX_NUMNODES];
+static struct task_struct *tier_thread;
+
+/* Free pages of @nid above the high watermarks of its zones */
+static long tier_node_headroom(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	long headroom = 0;
+	int i;
+
+	for (i = 0; i < MAX_NR_ZONES; i++) {
+		struct zone *zone = pgdat->node_zones + i;
+
+		if (!managed_zone(zone))
+			continue;
+		headroom += zone_page_state(zone, NR_FREE_PAGES) -
+			    high_wmark_pages(zone);
+	}
+
+	return headroom;
+}
+
+/* Closest node of the other tier than @nid with some free memory to spare */
+static int tier_target_node(int nid, bool promote)
+{
+	int n, dist, best = NUMA_NO_NODE, best_dist = INT_MAX;
+
+	for_each_node_state(n, N_MEMORY) {
+		if (node_isset(n, lower_tier_nodes) == promote)
+			continue;
+		dist = node_distance(nid, n);
+		if (dist < best_dist && tier_node_headroom(n) > 0) {
+			best = n;
+			best_dist = dist;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * page_referenced() also clears the accessed bits, so for a mapped page it
+ * reports accesses since the previous pass.  Unmapped page cache only has
+ * PG_referenced, which the LRU aging clears.
+ */
+static bool tier_page_wanted(struct page *page, bool promote)
+{
+	unsigned long vm_flags = 0;
+	bool referenced;
+
+	referenced = page_referenced(page, 0, NULL, &vm_flags) ||
+		     PageReferenced(page);
+	if (vm_flags & VM_LOCKED)
+		return false;
+
+	if (promote)
+		return referenced && PageActive(page);
+	return !referenced && !PageActive(page);
+}
+
+/* Isolate up to @nr_max pages of @nid to migrate, returns the number taken */
+static long tier_isolate_pages(int nid, bool promote, long nr_max,
+			       struct list_head *pages)
+{
+	struct tier_node *tn = &tier_nodes[nid];
+	unsigned long start = node_start_pfn(nid);
+	unsigned long end = node_end_pfn(nid);
+	unsigned long pfn, i;
+	long nr = 0;
+
+	if (start >= end)
+		return 0;
+
+	pfn = tn->scan_pfn;
+	if (pfn < start || pfn >= end)
+		pfn = start;
+
+	for (i = 0; i < TIER_SCAN_PFNS && nr < nr_max; i++, pfn++) {
+		struct page *page;
+
+		if (pfn >= end)
+			pfn = start;
+		if (!(i % SWAP_CLUSTER_MAX))
+			cond_resched();
+
+		page = pfn_to_online_page(pfn);
+		if (!page || PageTail(page) || !PageLRU(page))
+			continue;
+		if (!get_page_unless_zero(page))
+			continue;
+
+		if (PageLRU(page) && !PageUnevictable(page) &&
+		    page_to_nid(page) == nid &&
+		    tier_page_wanted(page, promote) &&
+		    !isolate_lru_page(page)) {
+			mod_node_page_state(page_pgdat(page),
+					    NR_ISOLATED_ANON + page_is_file_lru(page),
+					    thp_nr_pages(page));
+			list_add_tail(&page->lru, pages);
+			nr += thp_nr_pages(page);
+		}
+
+		put_page(page);
+	}
+	tn->scan_pfn = pfn;
+
+	return nr;
+}
+
+/* Migrate @pages to @target, returns the number of pages moved */
+static long tier_migrate_pages(struct list_head *pages, long nr, int target)
+{
+	struct migration_target_control mtc = {
+		.nid = target,
+		.gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+			    __GFP_THISNODE | __GFP_NOWARN | __GFP_NOMEMALLOC,
+	};
+	struct page *page;
+
+	/* There is no migrate reason for tiering, NUMA placement is closest */
+	if (migrate_pages(pages, alloc_migration_target, NULL,
+			  (unsigned long)&mtc, MIGRATE_ASYNC,
+			  MR_NUMA_MISPLACED)) {
+		list_for_each_entry(page, pages, lru)
+			nr -= thp_nr_pages(page);
+		putback_movable_pages(pages);
+	}
+
+	return nr;
+}
+
+static void tier_scan_node(int nid)
+{
+	bool promote = node_isset(nid, lower_tier_nodes);
+	LIST_HEAD(pages);
+	long room, nr;
+	int target;
+
+	/* Demote only from upper tier nodes under memory pressure */
+	if (!promote && tier_node_headroom(nid) > 0)
+		return;
+
+	target = tier_target_node(nid, promote);
+	if (target == NUMA_NO_NODE)
+		return;
+
+	room = tier_node_headroom(target);
+	if (!promote)
+		room = min(room, -tier_node_headroom(nid));
+
+	nr = tier_isolate_pages(nid, promote, room, &pages);
+	if (!nr)
+		return;
+
+	nr = tier_migrate_pages(&pages, nr, target);
+	if (promote)
+		atomic_long_add(nr, &tier_nodes[nid].promoted);
+	else
+		atomic_long_add(nr, &tier_nodes[target].demoted);
+}
+
+static int ktierd(void *unused)
+{
+	int nid;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		for_each_node_state(nid, N_MEMORY)
+			tier_scan_node(nid);
+
+		try_to_freeze();
+		schedule_timeout_interruptible(
+				msecs_to_jiffies(TIER_SCAN_INTERVAL_MS));
+	}
+
+	return 0;
+}
+
+/**
+ * node_set_lower_tier - mark a node as made of slower memory
+ * @nid: node the memory was added to
+ *
+ * Calls nest, the node stays in the lower tier until node_clear_lower_tier()
+ * was called as many times.
+ */
+void node_set_lower_tier(int nid)
+{
+	struct task_struct *thread;
+
+	mutex_lock(&tier_lock);
+	if (!tier_nodes[nid].users++)
+		node_set(nid, lower_tier_nodes);
+
+	if (!tier_thread) {
+		thread = kthread_run(ktierd, NULL, "ktierd");
+		if (IS_ERR(thread))
+			pr_warn("Failed to start ktierd: %ld\n", PTR_ERR(thread));
+		else
+			tier_thread = thread;
+	}
+	mutex_unlock(&tier_lock);
+}
+EXPORT_SYMBOL_GPL(node_set_lower_tier);
+
+void node_clear_lower_tier(int nid)
+{
+	mutex_lock(&tier_lock);
+	if (!WARN_ON(!tier_nodes[nid].users) && !--tier_nodes[nid].users)
+		node_clear(nid, lower_tier_nodes);
+
+	if (nodes_empty(lower_tier_nodes) && tier_thread) {
+		kthread_stop(tier_thread);
+		tier_thread = NULL;
+	}
+	mutex_unlock(&tier_lock);
+}
+EXPORT_SYMBOL_GPL(node_clear_lower_tier);
+
+/* Pages promoted out of lower tier node @nid */
+unsigned long node_tier_promotions(int nid)
+{
+	return atomic_long_read(&tier_nodes[nid].promoted);
+}
+EXPORT_SYMBOL_GPL(node_tier_promotions);
+
+/* Pages demoted into lower tier node @nid */
+unsigned long node_tier_demotions(int nid)
+{
+	return atomic_long_read(&tier_nodes[nid].demoted);
+}
+EXPORT_SYMBOL_GPL(node_tier_demotions);
@@ -25,6 +25,9 @@ static struct workqueue_struct *virtio_vsock_workqueue;
 static struct virtio_vsock __rcu *the_virtio_vsock;
 static DEFINE_MUTEX(the_virtio_vsock_mutex); /* protects the_virtio_vsock */
 
+/* Buffers added to or reclaimed from a virtqueue in one go */
+#define VIRTIO_VSOCK_BATCH 8
+
 struct virtio_vsock {
 	struct virtio_device *vdev;
 	struct virtqueue *vqs[VSOCK_VQ_MAX];
@@ -99,56 +102,75 @@ virtio_transport_send_pkt_work(struct work_struct *work)
 	vq = vsock->vqs[VSOCK_VQ_TX];
 
 	for (;;) {
+		struct scatterlist sg[VIRTIO_VSOCK_BATCH][2];
+		struct scatterlist *sgs[VIRTIO_VSOCK_BATCH];
+		unsigned int nums[VIRTIO_VSOCK_BATCH];
+		void *pkts[VIRTIO_VSOCK_BATCH];
 		struct virtio_vsock_pkt *pkt;
-		struct scatterlist hdr, buf, *sgs[2];
-		int ret, in_sg = 0, out_sg = 0;
-		bool reply;
+		int i, n = 0, ret;
 
 		spin_lock_bh(&vsock->send_pkt_list_lock);
-		if (list_empty(&vsock->send_pkt_list)) {
-			spin_unlock_bh(&vsock->send_pkt_list_lock);
+		while (n < VIRTIO_VSOCK_BATCH &&
+		       !list_empty(&vsock->send_pkt_list)) {
+			pkt = list_first_entry(&vsock->send_pkt_list,
+					       struct virtio_vsock_pkt, list);
+			list_del_init(&pkt->list);
+			pkts[n++] = pkt;
+		}
+		spin_unlock_bh(&vsock->send_pkt_list_lock);
+
+		if (!n)
 			break;
+
+		for (i = 0; i < n; i++) {
+			pkt = pkts[i];
+
+			virtio_transport_deliver_tap_pkt(pkt);
+
+			nums[i] = pkt->buf ? 2 : 1;
+			sg_init_table(sg[i], nums[i]);
+			sg_set_buf(&sg[i][0], &pkt->hdr, sizeof(pkt->hdr));
+			if (pkt->buf)
+				sg_set_buf(&sg[i][1], pkt->buf, pkt->len);
+			sgs[i] = sg[i];
 		}
 
-		pkt = list_first_entry(&vsock->send_pkt_list,
-				       struct virtio_vsock_pkt, list);
-		list_del_init(&pkt->list);
-		spin_unlock_bh(&vsock->send_pkt_list_lock);
+		ret = virtqueue_add_outbuf_batch(vq, sgs, nums, pkts, n,
+						 GFP_KERNEL);
+		if (ret < 0)
+			ret = 0;
 
-		virtio_transport_deliver_tap_pkt(pkt);
+		/* Completions are reaped under tx_lock, so the packets added
+		 * are still ours to look at.
+		 */
+		for (i = 0; i < ret; i++) {
+			pkt = pkts[i];
+			if (pkt->reply) {
+				struct virtqueue *rx_vq = vsock->vqs[VSOCK_VQ_RX];
+				int val;
 
-		reply = pkt->reply;
+				val = atomic_dec_return(&vsock->queued_replies);
 
-		sg_init_one(&hdr, &pkt->hdr, sizeof(pkt->hdr));
-		sgs[out_sg++] = &hdr;
-		if (pkt->buf) {
-			sg_init_one(&buf, pkt->buf, pkt->len);
-			sgs[out_sg++] = &buf;
+				/* Do we now have resources to resume rx processing? */
+				if (val + 1 == virtqueue_get_vring_size(rx_vq))
+					restart_rx = true;
+			}
+
+			added = true;
 		}
 
-		ret = virtqueue_add_sgs(vq, sgs, out_sg, in_sg, pkt, GFP_KERNEL);
 		/* Usually this means that there is no more space available in
 		 * the vq
 		 */
-		if (ret < 0) {
+		if (ret < n) {
 			spin_lock_bh(&vsock->send_pkt_list_lock);
-			list_add(&pkt->list, &vsock->send_pkt_list);
+			for (i = n - 1; i >= ret; i--) {
+				pkt = pkts[i];
+				list_add(&pkt->list, &vsock->send_pkt_list);
+			}
 			spin_unlock_bh(&vsock->send_pkt_list_lock);
 			break;
 		}
-
-		if (reply) {
-			struct virtqueue *rx_vq = vsock->vqs[VSOCK_VQ_RX];
-			int val;
-
-			val = atomic_dec_return(&vsock->queued_replies);
-
-			/* Do we now have resources to resume rx processing? */
-			if (val + 1 == virtqueue_get_vring_size(rx_vq))
-				restart_rx = true;
-		}
-
-		added = true;
 	}
 
 	if (added)
@@ -245,39 +267,49 @@ out_rcu:
 static void virtio_vsock_rx_fill(struct virtio_vsock *vsock)
 {
 	int buf_len = VIRTIO_VSOCK_DEFAULT_RX_BUF_SIZE;
+	struct scatterlist sg[VIRTIO_VSOCK_BATCH][2];
+	struct scatterlist *sgs[VIRTIO_VSOCK_BATCH];
+	unsigned int nums[VIRTIO_VSOCK_BATCH];
+	void *pkts[VIRTIO_VSOCK_BATCH];
 	struct virtio_vsock_pkt *pkt;
-	struct scatterlist hdr, buf, *sgs[2];
 	struct virtqueue *vq;
-	int ret;
+	int i, n, ret;
 
 	vq = vsock->vqs[VSOCK_VQ_RX];
 
 	do {
-		pkt = kzalloc(sizeof(*pkt), GFP_KERNEL);
-		if (!pkt)
-			break;
-
-		pkt->buf = kmalloc(buf_len, GFP_KERNEL);
-		if (!pkt->buf) {
-			virtio_transport_free_pkt(pkt);
-			break;
-		}
+		for (n = 0; n < VIRTIO_VSOCK_BATCH && n < vq->num_free; n++) {
+			pkt = kzalloc(sizeof(*pkt), GFP_KERNEL);
+			if (!pkt)
+				break;
 
-		pkt->buf_len = buf_len;
-		pkt->len = buf_len;
+			pkt->buf = kmalloc(buf_len, GFP_KERNEL);
+			if (!pkt->buf) {
+				virtio_transport_free_pkt(pkt);
+				break;
+			}
 
-		sg_init_one(&hdr, &pkt->hdr, sizeof(pkt->hdr));
-		sgs[0] = &hdr;
+			pkt->buf_len = buf_len;
+			pkt->len = buf_len;
 
-		sg_init_one(&buf, pkt->buf, buf_len);
-		sgs[1] = &buf;
-		ret = virtqueue_add_sgs(vq, sgs, 0, 2, pkt, GFP_KERNEL);
-		if (ret) {
-			virtio_transport_free_pkt(pkt);
-			break;
+			sg_init_table(sg[n], 2);
+			sg_set_buf(&sg[n][0], &pkt->hdr, sizeof(pkt->hdr));
+			sg_set_buf(&sg[n][1], pkt->buf, buf_len);
+			sgs[n] = sg[n];
+			nums[n] = 2;
+			pkts[n] = pkt;
 		}
-		vsock->rx_buf_nr++;
-	} while (vq->num_free);
+		if (!n)
+			break;
+
+		/* Publishes the whole batch with a single avail index update */
+		ret = virtqueue_add_inbuf_batch(vq, sgs, nums, pkts, NULL, n,
+						GFP_KERNEL);
+		for (i = max(ret, 0); i < n; i++)
+			virtio_transport_free_pkt(pkts[i]);
+		if (ret > 0)
+			vsock->rx_buf_nr += ret;
+	} while (ret == VIRTIO_VSOCK_BATCH && vq->num_free);
 	if (vsock->rx_buf_nr > vsock->rx_buf_max_nr)
 		vsock->rx_buf_max_nr = vsock->rx_buf_nr;
 	virtqueue_kick(vq);
@@ -297,12 +329,15 @@ static void virtio_transport_tx_work(struct work_struct *work)
 		goto out;
 
 	do {
-		struct virtio_vsock_pkt *pkt;
-		unsigned int len;
+		void *pkts[VIRTIO_VSOCK_BATCH];
+		unsigned int lens[VIRTIO_VSOCK_BATCH];
+		unsigned int i, n;
 
 		virtqueue_disable_cb(vq);
-		while ((pkt = virtqueue_get_buf(vq, &len)) != NULL) {
-			virtio_transport_free_pkt(pkt);
+		while ((n = virtqueue_get_bufs(vq, pkts, lens, NULL,
+					       VIRTIO_VSOCK_BATCH))) {
+			for (i = 0; i < n; i++)
+				virtio_transport_free_pkt(pkts[i]);
 			added = true;
 		}
 	} while (!virtqueue_enable_cb(vq));